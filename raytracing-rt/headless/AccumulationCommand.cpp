@@ -0,0 +1,143 @@
+#include "Commands.h"
+
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <execution>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+	struct Options
+	{
+		uint32_t Width = 3840;
+		uint32_t Height = 2160;
+		int Frames = 1024;
+		// pixels whose exact sum is tracked for the error
+		uint32_t ErrorStride = 97;
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless accumulation [options]\n"
+			"  time and check every accumulation format on made up radiance\n"
+			"  --width <n>    (3840)\n"
+			"  --height <n>   (2160)\n"
+			"  --frames <n>   accumulated frames, the error is reported at the end (1024)\n";
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i + 1 < argc; i += 2) {
+			const char* arg = argv[i];
+			const char* value = argv[i + 1];
+			if (strcmp(arg, "--width") == 0) options.Width = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--height") == 0) options.Height = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--frames") == 0) options.Frames = atoi(value);
+			else return false;
+		}
+		return argc % 2 == 1 && options.Width > 0 && options.Height > 0 && options.Frames > 0;
+	}
+
+	// noisy radiance around a per pixel mean, with the occasional firefly, cheap enough
+	// for the memory traffic to dominate
+	glm::vec3 Sample(uint32_t pixel, int frame)
+	{
+		uint32_t hash = (pixel * 0x9e3779b1u) ^ ((uint32_t)frame * 0x85ebca6bu);
+		hash ^= hash >> 15;
+		hash *= 0x2c1b3c6du;
+		hash ^= hash >> 12;
+		float noise = (float)(hash & 0xffffu) / 65535.0f;
+		float mean = 0.05f + (float)(pixel % 251) / 251.0f;
+		float firefly = (hash >> 28) == 0 ? 8.0f : 1.0f;
+		return glm::vec3(mean * noise * firefly, 0.5f * mean * noise, 0.25f + 0.5f * noise);
+	}
+
+}
+
+int RunAccumulation(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	const uint32_t pixelCount = options.Width * options.Height;
+	std::vector<uint32_t> rows(options.Height);
+	std::iota(rows.begin(), rows.end(), 0);
+
+	// exact sums of a subset of the pixels
+	std::vector<uint32_t> tracked;
+	for (uint32_t pixel = 0; pixel < pixelCount; pixel += options.ErrorStride)
+		tracked.push_back(pixel);
+	std::vector<glm::dvec3> exact(tracked.size(), glm::dvec3(0.0));
+	for (size_t i = 0; i < tracked.size(); ++i)
+		for (int frame = 0; frame < options.Frames; ++frame)
+			exact[i] += glm::dvec3(Sample(tracked[i], frame));
+
+	printf("%ux%u, %d frames\n", options.Width, options.Height, options.Frames);
+	printf("%-8s %8s %12s %10s %12s %14s %14s\n", "format", "bytes/px", "add ms", "GB/s", "resolve ms", "rms rel error", "max rel error");
+
+	for (int f = 0; f < (int)AccumulationFormat::Count; ++f) {
+		AccumulationFormat format = (AccumulationFormat)f;
+		AccumulationBuffer buffer;
+		buffer.Resize(pixelCount, format);
+		buffer.Clear();
+
+		double addMs = 0.0;
+		for (int frame = 0; frame < options.Frames; ++frame) {
+			buffer.BeginFrame(frame + 1);
+			auto start = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, rows.begin(), rows.end(), [&](uint32_t y) {
+				for (uint32_t x = 0; x < options.Width; ++x) {
+					uint32_t pixel = y * options.Width + x;
+					buffer.Add(pixel, Sample(pixel, frame));
+				}
+			});
+			addMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		addMs /= options.Frames;
+
+		// decode every row as the renderer's resolve does
+		auto start = std::chrono::steady_clock::now();
+		std::vector<float> checksums(options.Height);
+		std::for_each(std::execution::par, rows.begin(), rows.end(), [&](uint32_t y) {
+			std::vector<float> scratch(options.Width * AccumulationBuffer::ChannelCount);
+			const float* channels[AccumulationBuffer::ChannelCount];
+			buffer.GetRow((size_t)y * options.Width, options.Width, scratch.data(), channels);
+			float sum = 0.0f;
+			for (uint32_t x = 0; x < options.Width; ++x)
+				sum += channels[0][x] + channels[1][x] + channels[2][x];
+			checksums[y] = sum;
+		});
+		double resolveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		double squaredError = 0.0, maxError = 0.0;
+		for (size_t i = 0; i < tracked.size(); ++i) {
+			glm::vec3 value = buffer.Get(tracked[i]);
+			for (int channel = 0; channel < 3; ++channel) {
+				double error = std::abs(value[channel] - exact[i][channel]) / std::max(exact[i][channel], 1e-9);
+				squaredError += error * error;
+				maxError = std::max(maxError, error);
+			}
+		}
+		double rmsError = std::sqrt(squaredError / (tracked.size() * 3));
+
+		// every add reads and writes the pixel
+		size_t bytesPerPixel = GetAccumulationBytesPerPixel(format);
+		double gigabytesPerSecond = 2.0 * bytesPerPixel * pixelCount / (addMs * 1e6);
+
+		printf("%-8s %8zu %12.2f %10.2f %12.2f %14.2e %14.2e\n", GetAccumulationFormatName(format), bytesPerPixel,
+			addMs, gigabytesPerSecond, resolveMs, rmsError, maxError);
+	}
+	return 0;
+}
@@ -0,0 +1,333 @@
+#include "Commands.h"
+
+#include "Camera.h"
+#include "ImageIO.h"
+#include "Renderer.h"
+#include "Scene.hpp"
+#include "SceneGenerator.h"
+#include "Stats.h"
+#include "include/json.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+	const char* s_ShippedScenes[] = {
+		"scene.json", "second_scene.json", "third_scene.json", "fourth_scene.json", "square_scene.json"
+	};
+
+	struct Options
+	{
+		uint32_t Width = 256;
+		uint32_t Height = 144;
+		int Frames = 4;
+		int Samples = 4;
+		uint32_t Seed = 1;
+		std::vector<int> SyntheticSizes = { 64, 512 };
+		std::string Output = "bench.json";
+		std::string References = "bench/references";
+		bool UpdateReferences = false;
+		std::string Compare;
+		// relative slowdown reported as a regression
+		float Threshold = 0.05f;
+		// the one scene a child process measures, empty in the parent
+		std::string Only;
+	};
+
+	struct Result
+	{
+		std::string Name;
+		size_t Spheres = 0;
+		// median over the frames
+		double FrameTimeMs = 0.0;
+		double MraysPerSecond = 0.0;
+		// of the child process that measured the scene alone
+		size_t PeakRss = 0;
+		double Rmse = 0.0;
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless bench [options]\n"
+			"  --width <n>             image width (256)\n"
+			"  --height <n>            image height (144)\n"
+			"  --frames <n>            accumulated frames (4)\n"
+			"  --samples <n>           samples per pixel and frame (4)\n"
+			"  --seed <n>              random seed (1)\n"
+			"  --synthetic <n,n,...>   sphere counts of the generated uniform scenes (64,512)\n"
+			"  --output <file>         results as JSON (bench.json)\n"
+			"  --references <folder>   reference images for the RMSE (bench/references)\n"
+			"  --update-references     write the references from this run\n"
+			"  --compare <file>        previous results, slowdowns above the threshold fail the run\n"
+			"  --threshold <x>         relative slowdown counted as a regression (0.05)\n"
+			"  --only <name>           measure only this scene, in this process\n";
+	}
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		for (const char* c = text; *c;) {
+			char* end;
+			long value = strtol(c, &end, 10);
+			if (end == c)
+				return {};
+			values.push_back((int)value);
+			c = *end == ',' ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i) {
+			const char* arg = argv[i];
+			if (strcmp(arg, "--update-references") == 0) {
+				options.UpdateReferences = true;
+				continue;
+			}
+
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!value)
+				return false;
+			++i;
+
+			if (strcmp(arg, "--width") == 0) options.Width = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--height") == 0) options.Height = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--frames") == 0) options.Frames = atoi(value);
+			else if (strcmp(arg, "--samples") == 0) options.Samples = atoi(value);
+			else if (strcmp(arg, "--seed") == 0) options.Seed = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--synthetic") == 0) options.SyntheticSizes = ParseList(value);
+			else if (strcmp(arg, "--output") == 0) options.Output = value;
+			else if (strcmp(arg, "--references") == 0) options.References = value;
+			else if (strcmp(arg, "--compare") == 0) options.Compare = value;
+			else if (strcmp(arg, "--threshold") == 0) options.Threshold = (float)atof(value);
+			else if (strcmp(arg, "--only") == 0) options.Only = value;
+			else return false;
+		}
+		return options.Width > 0 && options.Height > 0 && options.Frames > 0 && options.Samples > 0;
+	}
+
+	double Rmse(const std::vector<float>& image, const std::vector<float>& reference)
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < image.size(); ++i) {
+			double difference = (double)image[i] - reference[i];
+			sum += difference * difference;
+		}
+		return image.empty() ? 0.0 : std::sqrt(sum / image.size());
+	}
+
+	Result Run(const std::string& name, Scene& scene, const Options& options)
+	{
+		scene.Prepare();
+
+		Camera camera(45.0f, 0.1f, 100.0f);
+		camera.OnResize(options.Width, options.Height);
+
+		Renderer renderer;
+		renderer.OnResize(options.Width, options.Height);
+		renderer.GetSettings().MonteCarloNbSample = options.Samples;
+		renderer.GetSettings().Seed = options.Seed;
+
+		// warm up the thread pool and the caches, the reset makes the timed frames draw the same samples
+		renderer.Render(scene, camera);
+		renderer.ResetFrameIndex();
+
+		std::vector<double> frameTimes;
+		Stats::Totals before = Stats::Collect();
+		for (int frame = 0; frame < options.Frames; ++frame) {
+			auto start = std::chrono::steady_clock::now();
+			renderer.Render(scene, camera);
+			frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		Stats::Totals totals = Stats::Collect() - before;
+
+		double totalMs = 0.0;
+		for (double time : frameTimes)
+			totalMs += time;
+		std::sort(frameTimes.begin(), frameTimes.end());
+
+		Result result;
+		result.Name = name;
+		result.Spheres = scene.Spheres.size();
+		result.FrameTimeMs = frameTimes[frameTimes.size() / 2];
+		result.MraysPerSecond = totals.Counters[Stats::RaysTraced] / (totalMs * 1e3);
+		result.PeakRss = GetPeakRss();
+
+		fs::path reference = fs::path(options.References) / (name + ".pfm");
+		std::vector<float> radiance = renderer.GetRadiance();
+		if (options.UpdateReferences) {
+			fs::create_directories(options.References);
+			ImageIO::WritePFM(reference.string(), options.Width, options.Height, 3, radiance.data());
+		}
+		else {
+			// without its reference a scene could change its image unnoticed
+			if (!fs::exists(reference))
+				throw std::runtime_error("No reference image " + reference.string() + ", record them with --update-references");
+			uint32_t width, height;
+			int channels;
+			std::vector<float> expected = ImageIO::ReadPFM(reference.string(), width, height, channels);
+			if (width != options.Width || height != options.Height || channels != 3)
+				throw std::runtime_error("Reference image " + reference.string() + " does not match the bench resolution");
+			result.Rmse = Rmse(radiance, expected);
+		}
+		return result;
+	}
+
+	nlohmann::json ToJson(const Options& options, const std::vector<Result>& results)
+	{
+		nlohmann::json j;
+		j["Settings"] = {
+			{ "Width", options.Width }, { "Height", options.Height }, { "Frames", options.Frames },
+			{ "Samples", options.Samples }, { "Seed", options.Seed }
+		};
+		for (const Result& result : results) {
+			nlohmann::json entry = {
+				{ "Name", result.Name },
+				{ "Spheres", result.Spheres },
+				{ "FrameTimeMs", result.FrameTimeMs },
+				{ "MraysPerSecond", result.MraysPerSecond },
+				{ "PeakRssBytes", result.PeakRss },
+				{ "Rmse", result.Rmse },
+			};
+			j["Scenes"].push_back(entry);
+		}
+		return j;
+	}
+
+	Result FromJson(const nlohmann::json& entry)
+	{
+		Result result;
+		result.Name = entry.at("Name").get<std::string>();
+		result.Spheres = entry.at("Spheres").get<size_t>();
+		result.FrameTimeMs = entry.at("FrameTimeMs").get<double>();
+		result.MraysPerSecond = entry.at("MraysPerSecond").get<double>();
+		result.PeakRss = entry.at("PeakRssBytes").get<size_t>();
+		result.Rmse = entry.at("Rmse").get<double>();
+		return result;
+	}
+
+	// loads or generates the scene of a result name, the stem of a shipped scene or synthetic_<count>
+	Scene LoadBenchScene(const std::string& name)
+	{
+		const std::string synthetic = "synthetic_";
+		if (name.compare(0, synthetic.size(), synthetic) == 0) {
+			SceneGeneratorSettings settings;
+			settings.SphereCount = (uint32_t)atoi(name.c_str() + synthetic.size());
+			return GenerateScene(settings);
+		}
+		Scene scene;
+		scene.Cubemap.exist = false;
+		scene.pass = false;
+		scene.loadScene(name + ".json");
+		return scene;
+	}
+
+	// the peak memory of a process covers its whole life, so every scene is measured by a
+	// process of its own started with --only
+	Result RunChild(const std::string& name, const Options& options)
+	{
+		const fs::path output = fs::temp_directory_path() / ("raytracing-rt-bench-" + name + ".json");
+		std::string command = "\"" + std::string(GetProgramPath()) + "\" bench --only " + name
+			+ " --width " + std::to_string(options.Width) + " --height " + std::to_string(options.Height)
+			+ " --frames " + std::to_string(options.Frames) + " --samples " + std::to_string(options.Samples)
+			+ " --seed " + std::to_string(options.Seed) + " --references \"" + options.References + "\""
+			+ " --output \"" + output.string() + "\"";
+		if (options.UpdateReferences)
+			command += " --update-references";
+		if (std::system(command.c_str()) != 0)
+			throw std::runtime_error("Benchmark of " + name + " failed");
+
+		std::ifstream file(output);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file for reading: " + output.string());
+		Result result = FromJson(nlohmann::json::parse(file).at("Scenes").at(0));
+		file.close();
+		fs::remove(output);
+		return result;
+	}
+
+	void WriteResults(const Options& options, const std::vector<Result>& results)
+	{
+		std::ofstream file(options.Output);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file for writing: " + options.Output);
+		file << ToJson(options, results).dump(4);
+	}
+
+	// prints the speed of every scene against the previous run, false on a regression
+	bool Compare(const std::string& filename, const std::vector<Result>& results, float threshold)
+	{
+		std::ifstream file(filename);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file for reading: " + filename);
+		nlohmann::json previous = nlohmann::json::parse(file);
+
+		bool passed = true;
+		for (const Result& result : results) {
+			for (const nlohmann::json& entry : previous.at("Scenes")) {
+				if (entry.at("Name").get<std::string>() != result.Name)
+					continue;
+
+				double before = entry.at("FrameTimeMs").get<double>();
+				double change = before > 0.0 ? result.FrameTimeMs / before - 1.0 : 0.0;
+				bool regressed = change > threshold;
+				passed &= !regressed;
+				printf("  %-28s %+6.1f%% frame time%s\n", result.Name.c_str(), change * 100.0, regressed ? "  REGRESSION" : "");
+			}
+		}
+		return passed;
+	}
+
+}
+
+int RunBench(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	if (!options.Only.empty()) {
+		Scene scene = LoadBenchScene(options.Only);
+		WriteResults(options, { Run(options.Only, scene, options) });
+		return 0;
+	}
+
+	std::vector<std::string> names;
+	for (const char* filename : s_ShippedScenes)
+		names.push_back(fs::path(filename).stem().string());
+	for (int sphereCount : options.SyntheticSizes)
+		names.push_back("synthetic_" + std::to_string(sphereCount));
+
+	std::vector<Result> results;
+	printf("%-30s %8s %12s %10s %10s %10s\n", "scene", "spheres", "ms/frame", "Mrays/s", "peak MB", "rmse");
+
+	for (const std::string& name : names) {
+		Result result = RunChild(name, options);
+		printf("%-30s %8zu %12.2f %10.3f %10.1f %10.6f\n", result.Name.c_str(), result.Spheres, result.FrameTimeMs,
+			result.MraysPerSecond, result.PeakRss / (1024.0 * 1024.0), result.Rmse);
+		fflush(stdout);
+		results.push_back(std::move(result));
+	}
+
+	WriteResults(options, results);
+	std::cout << "results written to " << options.Output << "\n";
+
+	if (!options.Compare.empty() && !Compare(options.Compare, results, options.Threshold))
+		return 2;
+	return 0;
+}
@@ -0,0 +1,205 @@
+#include "Commands.h"
+
+#include "BVH.h"
+#include "Ray.h"
+#include "SceneGenerator.h"
+#include "SphereBVH.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace {
+
+	struct Options
+	{
+		std::vector<int> Sizes = { 10000, 100000, 1000000 };
+		SphereDistribution Distribution = SphereDistribution::Uniform;
+		int Rays = 1000000;
+		uint32_t Seed = 1;
+	};
+
+	struct Config
+	{
+		const char* Name;
+		BVHBuildOptions Options;
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless bvh [options]\n"
+			"  build time, cost, memory and trace speed of every BVH builder and node width on generated scenes\n"
+			"  --sizes <n,n,...>           sphere counts (10000,100000,1000000)\n"
+			"  --distribution <name>       uniform, clustered, nested or mixed-scale (uniform)\n"
+			"  --rays <n>                  rays traced per tree (1000000)\n"
+			"  --seed <n>                  scene and ray seed (1)\n";
+	}
+
+	std::vector<int> ParseList(const char* text)
+	{
+		std::vector<int> values;
+		for (const char* c = text; *c;) {
+			char* end;
+			long value = strtol(c, &end, 10);
+			if (end == c)
+				return {};
+			values.push_back((int)value);
+			c = *end == ',' ? end + 1 : end;
+		}
+		return values;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i + 1 < argc; i += 2) {
+			const char* arg = argv[i];
+			const char* value = argv[i + 1];
+			if (strcmp(arg, "--sizes") == 0) options.Sizes = ParseList(value);
+			else if (strcmp(arg, "--distribution") == 0) {
+				if (!ParseDistribution(value, options.Distribution))
+					return false;
+			}
+			else if (strcmp(arg, "--rays") == 0) options.Rays = atoi(value);
+			else if (strcmp(arg, "--seed") == 0) options.Seed = (uint32_t)strtoul(value, nullptr, 10);
+			else return false;
+		}
+		return argc % 2 == 1 && !options.Sizes.empty() && options.Rays > 0;
+	}
+
+	// rays leaving the surface of random spheres in random directions, like the bounces of a path
+	std::vector<Ray> MakeRays(const std::vector<Sphere>& spheres, int count, uint32_t seed)
+	{
+		std::mt19937 generator(seed);
+		std::uniform_int_distribution<size_t> pickSphere(0, spheres.size() - 1);
+		std::normal_distribution<float> gaussian;
+		std::vector<Ray> rays(count);
+		for (Ray& ray : rays) {
+			const Sphere& sphere = spheres[pickSphere(generator)];
+			glm::vec3 normal, direction;
+			do normal = glm::vec3(gaussian(generator), gaussian(generator), gaussian(generator));
+			while (glm::dot(normal, normal) < 1e-6f);
+			do direction = glm::vec3(gaussian(generator), gaussian(generator), gaussian(generator));
+			while (glm::dot(direction, direction) < 1e-6f);
+			normal = glm::normalize(normal);
+			direction = glm::normalize(direction);
+			if (glm::dot(direction, normal) < 0.0f)
+				direction = -direction;
+			ray.Origin = sphere.Position + normal * sphere.Radius * 1.0001f;
+			ray.Direction = direction;
+		}
+		return rays;
+	}
+
+	struct TraceResult
+	{
+		double Milliseconds = 0.0;
+		double Steps = 0.0; // per ray
+		double Tests = 0.0;
+		// distance to the closest hit of each ray, the sphere can differ on ties
+		std::vector<float> Hits;
+	};
+
+	TraceResult Trace(const SphereBVH& tree, const std::vector<Sphere>& spheres, const std::vector<Ray>& rays)
+	{
+		const size_t ChunkSize = 4096;
+		std::vector<size_t> chunks((rays.size() + ChunkSize - 1) / ChunkSize);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::vector<uint64_t> steps(chunks.size()), tests(chunks.size());
+
+		TraceResult result;
+		result.Hits.resize(rays.size());
+		auto start = std::chrono::steady_clock::now();
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+			size_t end = std::min(rays.size(), (chunk + 1) * ChunkSize);
+			uint32_t chunkSteps = 0, chunkTests = 0;
+			for (size_t i = chunk * ChunkSize; i < end; ++i) {
+				float tMax = std::numeric_limits<float>::max();
+				int sphereIndex = -1;
+				tree.Intersect(spheres, rays[i], 0.0f, tMax, sphereIndex, chunkSteps, chunkTests);
+				result.Hits[i] = tMax;
+			}
+			steps[chunk] = chunkSteps;
+			tests[chunk] = chunkTests;
+		});
+		result.Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		result.Steps = (double)std::accumulate(steps.begin(), steps.end(), uint64_t(0)) / rays.size();
+		result.Tests = (double)std::accumulate(tests.begin(), tests.end(), uint64_t(0)) / rays.size();
+		return result;
+	}
+
+}
+
+int RunBvh(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	BVHBuildOptions sah, sahTreelets, morton, mortonTreelets, sahWide4, sahWide8;
+	sahTreelets.Treelets = true;
+	morton.Builder = mortonTreelets.Builder = BVHBuilder::Morton;
+	mortonTreelets.Treelets = true;
+	sahWide4.Width = 4;
+	sahWide8.Width = 8;
+	const Config configs[] = {
+		{ "sah", sah },
+		{ "sah+treelets", sahTreelets },
+		{ "morton", morton },
+		{ "morton+treelets", mortonTreelets },
+		{ "sah wide4", sahWide4 },
+		{ "sah wide8", sahWide8 },
+	};
+
+	printf("%s spheres, %d rays per tree\n", GetDistributionName(options.Distribution), options.Rays);
+	printf("%-10s %-16s %10s %8s %8s %10s %8s %8s %12s\n", "spheres", "builder", "build ms", "cost", "B/sphere", "Mrays/s", "steps", "tests", "build=rays");
+
+	int mismatchCount = 0;
+	for (int size : options.Sizes) {
+		SceneGeneratorSettings settings;
+		settings.SphereCount = (uint32_t)size;
+		settings.Distribution = options.Distribution;
+		settings.Seed = options.Seed;
+		Scene scene = GenerateScene(settings);
+		std::vector<Ray> rays = MakeRays(scene.Spheres, options.Rays, options.Seed);
+
+		std::vector<float> referenceHits;
+		for (const Config& config : configs) {
+			auto start = std::chrono::steady_clock::now();
+			SphereBVH tree(scene.Spheres, config.Options);
+			double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			TraceResult trace = Trace(tree, scene.Spheres, rays);
+			// how many rays the build time would have traced, where the cheaper builds stop paying off
+			double buildRays = buildMs / trace.Milliseconds * rays.size();
+			printf("%-10zu %-16s %10.2f %8.2f %8.1f %10.2f %8.1f %8.1f %12.0f\n", scene.Spheres.size(), config.Name, buildMs, tree.GetCost(),
+				(double)tree.GetMemoryUsage() / scene.Spheres.size(), rays.size() / (trace.Milliseconds * 1e3), trace.Steps, trace.Tests, buildRays);
+
+			// every tree has to find the same hits as the first one
+			if (referenceHits.empty()) {
+				referenceHits = std::move(trace.Hits);
+				continue;
+			}
+			for (size_t i = 0; i < rays.size(); ++i)
+				if (trace.Hits[i] != referenceHits[i])
+					++mismatchCount;
+		}
+	}
+
+	if (mismatchCount > 0) {
+		std::cerr << mismatchCount << " rays found another closest hit than with the SAH tree\n";
+		return 1;
+	}
+	return 0;
+}
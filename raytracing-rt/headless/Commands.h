@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Commands of the headless front end, each parses its own arguments (argv[0] is the
+// command name) and returns the process exit code.
+int RunRender(int argc, char** argv);
+int RunBench(int argc, char** argv);
+int RunGenerate(int argc, char** argv);
+int RunAccumulation(int argc, char** argv);
+int RunCoordinate(int argc, char** argv);
+int RunWorker(int argc, char** argv);
+int RunMerge(int argc, char** argv);
+int RunBvh(int argc, char** argv);
+int RunSequence(int argc, char** argv);
+
+// helpers shared by the commands
+// the executable as it was started, to start more of it
+const char* GetProgramPath();
+bool EndsWith(const std::string& text, const char* suffix);
+// peak resident memory of the process in bytes, 0 when unknown
+size_t GetPeakRss();
@@ -0,0 +1,429 @@
+#include "Commands.h"
+
+#include "Camera.h"
+#include "ImageIO.h"
+#include "Protocol.h"
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+	struct Options
+	{
+		std::string Scene;
+		std::string Cubemap;
+		uint32_t Width = 640;
+		uint32_t Height = 360;
+		int Frames = 16;
+		int Samples = 8;
+		uint32_t Seed = 0;
+		float ApertureRadius = 0.0f;
+		float FocusDistance = 5.0f;
+		uint16_t Port = 5555;
+		int LocalWorkers = 0;
+		uint32_t RowsPerUnit = 16;
+		// 0 keeps every frame of a row band in one unit, the merged image is then the one a
+		// single process renders, bit for bit
+		uint32_t FramesPerUnit = 0;
+		std::string Output = "render.ppm";
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless coordinate <scene.json> [options]\n"
+			"  --cubemap <name>        cubemap from the cubemaps folder, the workers need it too\n"
+			"  --width <n>             image width (640)\n"
+			"  --height <n>            image height (360)\n"
+			"  --frames <n>            accumulated frames (16)\n"
+			"  --samples <n>           samples per pixel and frame (8)\n"
+			"  --seed <n>              random seed (0)\n"
+			"  --aperture <r>          lens radius for depth of field, 0 for a pinhole (0)\n"
+			"  --focus <d>             distance in focus in front of the camera (5)\n"
+			"  --port <n>              where the workers connect, 0 for any free port (5555)\n"
+			"  --local-workers <n>     start n workers on this machine (0)\n"
+			"  --rows-per-unit <n>     rows of a work unit (16)\n"
+			"  --frames-per-unit <n>   frames of a work unit, 0 for all of them (0)\n"
+			"  --output <file>         .ppm or .pfm (render.ppm)\n";
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i) {
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+			if (arg[0] != '-') {
+				if (!options.Scene.empty())
+					return false;
+				options.Scene = arg;
+				continue;
+			}
+			if (!value)
+				return false;
+			++i;
+
+			if (strcmp(arg, "--cubemap") == 0) options.Cubemap = value;
+			else if (strcmp(arg, "--width") == 0) options.Width = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--height") == 0) options.Height = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--frames") == 0) options.Frames = atoi(value);
+			else if (strcmp(arg, "--samples") == 0) options.Samples = atoi(value);
+			else if (strcmp(arg, "--seed") == 0) options.Seed = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--aperture") == 0) options.ApertureRadius = (float)atof(value);
+			else if (strcmp(arg, "--focus") == 0) options.FocusDistance = (float)atof(value);
+			else if (strcmp(arg, "--port") == 0) options.Port = (uint16_t)atoi(value);
+			else if (strcmp(arg, "--local-workers") == 0) options.LocalWorkers = atoi(value);
+			else if (strcmp(arg, "--rows-per-unit") == 0) options.RowsPerUnit = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--frames-per-unit") == 0) options.FramesPerUnit = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--output") == 0) options.Output = value;
+			else return false;
+		}
+		return !options.Scene.empty() && options.Width > 0 && options.Height > 0 && options.Frames > 0
+			&& options.Samples > 0 && options.RowsPerUnit > 0 && options.Cubemap.size() < sizeof(Protocol::JobHeader::Cubemap);
+	}
+
+	struct Connection
+	{
+		int Id = 0;
+		// to the worker
+		Socket Link;
+		std::thread Thread;
+		// unit being rendered, -1 when none, guarded by the Coordinator lock
+		int Unit = -1;
+		int UnitsDone = 0;
+		int UnitsWasted = 0;
+	};
+
+	// Hands the units out to the connection threads and merges what comes back
+	class Coordinator
+	{
+	public:
+		Coordinator(uint32_t width, uint32_t height, const std::vector<Protocol::UnitHeader>& units)
+			: m_Width(width), m_Height(height), m_Sums((size_t)width * height * 3, 0.0), m_RowFrames(height, 0)
+		{
+			for (const Protocol::UnitHeader& header : units) {
+				Unit& unit = m_Units.emplace_back();
+				unit.Header = header;
+			}
+		}
+
+		// a unit nobody renders yet, else a second copy of the one running for the longest so a
+		// slow or stuck worker does not hold the image back. Waits while every unit left has
+		// its two copies running, false once the image is complete
+		bool Acquire(Connection& connection)
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			for (;;) {
+				if (m_DoneCount == m_Units.size())
+					return false;
+
+				int oldest = -1;
+				for (int i = 0; i < (int)m_Units.size(); ++i) {
+					const Unit& unit = m_Units[i];
+					if (unit.Done || unit.Running >= 2)
+						continue;
+					if (unit.Running == 0) {
+						oldest = i;
+						break;
+					}
+					if (oldest < 0 || unit.Started < m_Units[oldest].Started)
+						oldest = i;
+				}
+
+				if (oldest >= 0) {
+					Unit& unit = m_Units[oldest];
+					if (unit.Running++ == 0)
+						unit.Started = std::chrono::steady_clock::now();
+					connection.Unit = oldest;
+					return true;
+				}
+				m_Changed.wait(lock);
+			}
+		}
+
+		const Protocol::UnitHeader& GetHeader(int unit) const { return m_Units[unit].Header; }
+
+		// adds the sums of the connection's unit to the image, unless its other copy came first
+		void Complete(Connection& connection, const float* sums)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			Unit& unit = m_Units[connection.Unit];
+			--unit.Running;
+			connection.Unit = -1;
+			if (unit.Done) {
+				++connection.UnitsWasted;
+				return;
+			}
+
+			const Protocol::UnitHeader& header = unit.Header;
+			double* out = m_Sums.data() + (size_t)header.FirstRow * m_Width * 3;
+			const size_t count = (size_t)header.RowCount * m_Width * 3;
+			for (size_t i = 0; i < count; ++i)
+				out[i] += sums[i];
+			for (uint32_t row = 0; row < header.RowCount; ++row)
+				m_RowFrames[header.FirstRow + row] += header.FrameCount;
+
+			unit.Done = true;
+			++m_DoneCount;
+			++connection.UnitsDone;
+			m_Changed.notify_all();
+		}
+
+		// the connection ended, its unit goes back to the others. Return false if it was only
+		// cut off from a copy that was not needed anymore
+		bool Release(Connection& connection)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			bool lost = true;
+			if (connection.Unit >= 0) {
+				Unit& unit = m_Units[connection.Unit];
+				--unit.Running;
+				lost = !unit.Done;
+				connection.Unit = -1;
+			}
+			--m_ActiveCount;
+			m_Changed.notify_all();
+			return lost;
+		}
+
+		void Add(Connection& connection)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Connections.push_back(&connection);
+			++m_ActiveCount;
+		}
+
+		void Leave()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			--m_ActiveCount;
+		}
+
+		int GetActiveCount() const
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_ActiveCount;
+		}
+
+		bool IsDone() const
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_DoneCount == m_Units.size();
+		}
+
+		size_t GetDoneCount() const
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			return m_DoneCount;
+		}
+
+		// connections still waiting for a copy whose twin already landed, cut them off
+		void InterruptStragglers()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (Connection* connection : m_Connections)
+				if (connection->Unit >= 0)
+					connection->Link.Shutdown();
+		}
+
+		// every row divided by the frames it got
+		std::vector<float> GetRadiance() const
+		{
+			std::vector<float> radiance(m_Sums.size());
+			for (uint32_t y = 0; y < m_Height; ++y) {
+				const double frames = (double)std::max<uint32_t>(m_RowFrames[y], 1);
+				const size_t start = (size_t)y * m_Width * 3;
+				for (size_t i = start; i < start + (size_t)m_Width * 3; ++i)
+					radiance[i] = (float)(m_Sums[i] / frames);
+			}
+			return radiance;
+		}
+
+	private:
+		struct Unit
+		{
+			Protocol::UnitHeader Header{};
+			bool Done = false;
+			int Running = 0; // copies being rendered
+			std::chrono::steady_clock::time_point Started{};
+		};
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Changed;
+		std::vector<Unit> m_Units;
+		size_t m_DoneCount = 0;
+		int m_ActiveCount = 0;
+		std::vector<Connection*> m_Connections;
+
+		uint32_t m_Width, m_Height;
+		std::vector<double> m_Sums;
+		std::vector<uint32_t> m_RowFrames;
+	};
+
+	std::vector<Protocol::UnitHeader> SplitImage(const Options& options)
+	{
+		const uint32_t framesPerUnit = options.FramesPerUnit > 0 ? options.FramesPerUnit : (uint32_t)options.Frames;
+
+		std::vector<Protocol::UnitHeader> units;
+		for (uint32_t firstFrame = 1; firstFrame <= (uint32_t)options.Frames; firstFrame += framesPerUnit) {
+			for (uint32_t firstRow = 0; firstRow < options.Height; firstRow += options.RowsPerUnit) {
+				Protocol::UnitHeader unit;
+				unit.Id = (uint32_t)units.size();
+				unit.FirstRow = firstRow;
+				unit.RowCount = std::min(options.RowsPerUnit, options.Height - firstRow);
+				unit.FirstFrame = firstFrame;
+				unit.FrameCount = std::min(framesPerUnit, (uint32_t)options.Frames + 1 - firstFrame);
+				units.push_back(unit);
+			}
+		}
+		return units;
+	}
+
+	void Serve(Coordinator& coordinator, Connection& connection, const Protocol::JobHeader& job, const std::string& sceneData, uint32_t width)
+	{
+		try {
+			Protocol::Send(connection.Link, Protocol::MessageType::Job, &job, sizeof(job));
+			Protocol::Message reply = Protocol::Receive(connection.Link);
+			if (reply.Type == Protocol::MessageType::NeedScene) {
+				Protocol::Send(connection.Link, Protocol::MessageType::SceneData, sceneData.data(), sceneData.size());
+				reply = Protocol::Receive(connection.Link);
+			}
+			if (reply.Type != Protocol::MessageType::Ready)
+				throw std::runtime_error("The worker did not get ready");
+
+			while (coordinator.Acquire(connection)) {
+				const Protocol::UnitHeader& unit = coordinator.GetHeader(connection.Unit);
+				Protocol::Send(connection.Link, Protocol::MessageType::Unit, &unit, sizeof(unit));
+
+				Protocol::Message result = Protocol::Receive(connection.Link, Protocol::MessageType::Result);
+				const size_t expected = sizeof(unit) + (size_t)unit.RowCount * width * 3 * sizeof(float);
+				if (result.Payload.size() != expected || result.Get<Protocol::UnitHeader>().Id != unit.Id)
+					throw std::runtime_error("The worker sent back an other unit");
+				coordinator.Complete(connection, reinterpret_cast<const float*>(result.Payload.data() + sizeof(unit)));
+			}
+			Protocol::Send(connection.Link, Protocol::MessageType::Done);
+			coordinator.Leave();
+		}
+		catch (const std::exception& e) {
+			if (coordinator.Release(connection))
+				std::cerr << "worker " << connection.Id << " lost: " << e.what() << "\n";
+		}
+	}
+
+}
+
+int RunCoordinate(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	Scene scene;
+	scene.Cubemap.exist = false;
+	scene.pass = false;
+	scene.loadScene(options.Scene);
+	if (!options.Cubemap.empty())
+		scene.loadCubemap(options.Cubemap.c_str());
+	scene.Prepare();
+
+	std::ostringstream sceneStream;
+	scene.Serialize(sceneStream);
+	const std::string sceneData = sceneStream.str();
+
+	// the default view of the app and of the render command
+	Camera camera(45.0f, 0.1f, 100.0f);
+	camera.SetLens(options.ApertureRadius, options.FocusDistance);
+
+	Protocol::JobHeader job;
+	job.Width = options.Width;
+	job.Height = options.Height;
+	job.Samples = options.Samples;
+	job.Seed = options.Seed;
+	for (int i = 0; i < 3; ++i) {
+		job.CameraPosition[i] = camera.GetPosition()[i];
+		job.CameraDirection[i] = camera.GetDirection()[i];
+	}
+	job.ApertureRadius = camera.GetApertureRadius();
+	job.FocusDistance = camera.GetFocusDistance();
+	job.SceneHash = scene.Hash;
+	strncpy(job.Cubemap, options.Cubemap.c_str(), sizeof(job.Cubemap) - 1);
+
+	const std::vector<Protocol::UnitHeader> units = SplitImage(options);
+	Coordinator coordinator(options.Width, options.Height, units);
+
+	Socket listener = Socket::Listen(options.Port);
+	const uint16_t port = listener.GetLocalPort();
+	std::cout << units.size() << " units, waiting for workers on port " << port << "\n";
+
+	// each local worker is a process of its own, as a remote one would be
+	std::atomic<int> localWorkersRunning{ options.LocalWorkers };
+	std::vector<std::thread> localWorkers;
+	const std::string workerCommand = "\"" + std::string(GetProgramPath()) + "\" worker --connect 127.0.0.1:" + std::to_string(port);
+	for (int i = 0; i < options.LocalWorkers; ++i)
+		localWorkers.emplace_back([&workerCommand, &localWorkersRunning]() {
+			std::system(workerCommand.c_str());
+			--localWorkersRunning;
+		});
+
+	auto start = std::chrono::steady_clock::now();
+	std::list<Connection> connections;
+	size_t reported = 0;
+	while (!coordinator.IsDone()) {
+		if (listener.WaitReadable(100)) {
+			Connection& connection = connections.emplace_back();
+			connection.Id = (int)connections.size();
+			connection.Link = listener.Accept();
+			coordinator.Add(connection);
+			connection.Thread = std::thread(Serve, std::ref(coordinator), std::ref(connection), std::cref(job), std::cref(sceneData), options.Width);
+		}
+
+		// every tenth of the image
+		size_t done = coordinator.GetDoneCount();
+		if (done * 10 / units.size() != reported * 10 / units.size()) {
+			std::cout << done << "/" << units.size() << " units\n";
+			reported = done;
+		}
+
+		// nobody else is expected to show up
+		if (options.LocalWorkers > 0 && localWorkersRunning == 0 && coordinator.GetActiveCount() == 0 && !coordinator.IsDone()) {
+			listener.Close();
+			for (Connection& connection : connections)
+				connection.Thread.join();
+			for (std::thread& worker : localWorkers)
+				worker.join();
+			throw std::runtime_error("Every local worker left before the image was complete");
+		}
+	}
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+	listener.Close();
+	coordinator.InterruptStragglers();
+	for (Connection& connection : connections)
+		connection.Thread.join();
+	for (std::thread& worker : localWorkers)
+		worker.join();
+
+	std::cout << units.size() << " units in " << seconds << "s\n";
+	for (const Connection& connection : connections)
+		std::cout << "  worker " << connection.Id << ": " << connection.UnitsDone << " units, " << connection.UnitsWasted << " beaten by a copy\n";
+
+	std::vector<float> radiance = coordinator.GetRadiance();
+	if (EndsWith(options.Output, ".pfm"))
+		ImageIO::WritePFM(options.Output, options.Width, options.Height, 3, radiance.data());
+	else
+		ImageIO::WritePPM(options.Output, options.Width, options.Height, radiance.data());
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include "Commands.h"
+
+#include "SceneGenerator.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless generate <output> [options]\n"
+			"  output is written to the scenes folder, as JSON or binary when it ends with .rtscene\n"
+			"  --count <n>             spheres (1000)\n"
+			"  --distribution <name>   uniform, clustered, nested or mixed-scale (uniform)\n"
+			"  --seed <n>              (1)\n"
+			"  --extent <x>            half size of the filled cube (10)\n"
+			"  --min-radius <x>        (0.05)\n"
+			"  --max-radius <x>        (0.3)\n"
+			"  --clusters <n>          cluster count of the clustered distribution (16)\n"
+			"  --diffuse <w>           weight of the diffuse materials (0.6)\n"
+			"  --metallic <w>          weight of the metallic materials (0.25)\n"
+			"  --dielectric <w>        weight of the dielectric materials (0.15)\n"
+			"  --emissive <fraction>   fraction of lights (0.02)\n"
+			"  --no-ground             no ground plane\n"
+			"  --instances <n>         place the spheres as one cluster, n times on a grid (0)\n"
+			"  --moving <fraction>     fraction of the spheres moving while the shutter is open (0)\n"
+			"  --motion <length>       distance a moving sphere travels (0.5)\n";
+	}
+
+	bool ParseOptions(int argc, char** argv, std::string& output, SceneGeneratorSettings& settings)
+	{
+		for (int i = 1; i < argc; ++i) {
+			const char* arg = argv[i];
+			if (arg[0] != '-') {
+				if (!output.empty())
+					return false;
+				output = arg;
+				continue;
+			}
+			if (strcmp(arg, "--no-ground") == 0) {
+				settings.Ground = false;
+				continue;
+			}
+
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!value)
+				return false;
+			++i;
+
+			if (strcmp(arg, "--count") == 0) settings.SphereCount = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--distribution") == 0) {
+				if (!ParseDistribution(value, settings.Distribution))
+					return false;
+			}
+			else if (strcmp(arg, "--seed") == 0) settings.Seed = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--extent") == 0) settings.Extent = (float)atof(value);
+			else if (strcmp(arg, "--min-radius") == 0) settings.MinRadius = (float)atof(value);
+			else if (strcmp(arg, "--max-radius") == 0) settings.MaxRadius = (float)atof(value);
+			else if (strcmp(arg, "--clusters") == 0) settings.ClusterCount = atoi(value);
+			else if (strcmp(arg, "--diffuse") == 0) settings.DiffuseWeight = (float)atof(value);
+			else if (strcmp(arg, "--metallic") == 0) settings.MetallicWeight = (float)atof(value);
+			else if (strcmp(arg, "--dielectric") == 0) settings.DielectricWeight = (float)atof(value);
+			else if (strcmp(arg, "--emissive") == 0) settings.EmissiveFraction = (float)atof(value);
+			else if (strcmp(arg, "--instances") == 0) settings.InstanceCount = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--moving") == 0) settings.MovingFraction = (float)atof(value);
+			else if (strcmp(arg, "--motion") == 0) settings.MotionLength = (float)atof(value);
+			else return false;
+		}
+		return !output.empty() && settings.MinRadius > 0.0f && settings.MaxRadius >= settings.MinRadius;
+	}
+
+}
+
+int RunGenerate(int argc, char** argv)
+{
+	std::string output;
+	SceneGeneratorSettings settings;
+	if (!ParseOptions(argc, argv, output, settings)) {
+		PrintUsage();
+		return 1;
+	}
+
+	Scene scene = GenerateScene(settings);
+	scene.saveScene(output);
+	std::cout << scene.Spheres.size() << " spheres (" << GetDistributionName(settings.Distribution) << ")";
+	if (!scene.MovingSpheres.empty())
+		std::cout << ", " << scene.MovingSpheres.size() << " moving";
+	if (!scene.Instances.empty())
+		std::cout << " and " << scene.Instances.size() << " instances of a " << settings.SphereCount << " spheres cluster";
+	std::cout << " written to scenes/" << output << "\n";
+	return 0;
+}
@@ -0,0 +1,72 @@
+// Headless front end of the renderer : same scenes, cubemaps and renderer as the app,
+// without a window. Run it from the raytracing-rt folder so scenes/ and cubemaps/ are found.
+//
+//   raytracing-rt-headless <command> [options]
+
+#include "Commands.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+	struct Command
+	{
+		const char* Name;
+		int (*Run)(int argc, char** argv);
+		const char* Description;
+	};
+
+	const Command s_Commands[] = {
+		{ "render", RunRender, "render a scene to an image" },
+		{ "bench", RunBench, "time the shipped and synthetic scenes, compare against a previous run" },
+		{ "generate", RunGenerate, "write a procedural scene of many spheres" },
+		{ "accumulation", RunAccumulation, "bandwidth and accuracy of the accumulation formats" },
+		{ "coordinate", RunCoordinate, "split a render into units for worker processes and merge their results" },
+		{ "worker", RunWorker, "render units for a coordinator" },
+		{ "merge", RunMerge, "add sample buffers of disjoint sample ranges into one image" },
+		{ "bvh", RunBvh, "build and trace times of the BVH builders across scene sizes" },
+		{ "sequence", RunSequence, "render the numbered images of a keyframed sequence" },
+	};
+
+	const char* s_ProgramPath = "";
+
+	void PrintUsage()
+	{
+		std::cout << "usage: raytracing-rt-headless <command> [options]\n";
+		for (const Command& command : s_Commands)
+			std::cout << "  " << command.Name << "\t" << command.Description << "\n";
+		std::cout << "run a command with --help for its options\n";
+	}
+
+}
+
+const char* GetProgramPath()
+{
+	return s_ProgramPath;
+}
+
+int main(int argc, char** argv)
+{
+	s_ProgramPath = argv[0];
+	if (argc < 2) {
+		PrintUsage();
+		return 1;
+	}
+
+	for (const Command& command : s_Commands) {
+		if (strcmp(argv[1], command.Name) != 0)
+			continue;
+
+		try {
+			return command.Run(argc - 1, argv + 1);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	PrintUsage();
+	return 1;
+}
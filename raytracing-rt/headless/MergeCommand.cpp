@@ -0,0 +1,76 @@
+#include "Commands.h"
+
+#include "ImageIO.h"
+#include "SampleBuffer.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless merge <a.rtsamples> <b.rtsamples> ... [options]\n"
+			"  --output <file>  .ppm, .pfm or .rtsamples to merge further (merged.pfm)\n";
+	}
+
+}
+
+int RunMerge(int argc, char** argv)
+{
+	std::vector<std::string> inputs;
+	std::string output = "merged.pfm";
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (argv[i][0] == '-') {
+			PrintUsage();
+			return 1;
+		}
+		else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (inputs.empty()) {
+		PrintUsage();
+		return 1;
+	}
+
+	// one buffer in memory besides the result, whatever the number of inputs
+	SampleBuffer merged;
+	SampleBuffer next;
+	double mergeSeconds = 0.0;
+	size_t mergedBytes = 0;
+	for (const std::string& input : inputs) {
+		next.Read(input);
+
+		auto start = std::chrono::steady_clock::now();
+		merged.Merge(next);
+		mergeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		// both sides are read, the result is written
+		mergedBytes += 3 * next.GetByteSize();
+	}
+
+	std::cout << inputs.size() << " buffers, " << merged.GetSampleCount() << " samples per pixel in "
+		<< merged.GetRanges().size() << " range" << (merged.GetRanges().size() > 1 ? "s" : "")
+		<< ", merged at " << mergedBytes / (mergeSeconds * 1e9) << " GB/s\n";
+	for (const SampleBuffer::Range& range : merged.GetRanges())
+		std::cout << "  samples " << range.First << " to " << range.First + range.Count - 1 << "\n";
+
+	const SampleBuffer::Origin& origin = merged.GetOrigin();
+	if (EndsWith(output, ".rtsamples")) {
+		merged.Write(output);
+	}
+	else {
+		std::vector<float> radiance = merged.Resolve();
+		if (EndsWith(output, ".pfm"))
+			ImageIO::WritePFM(output, origin.Width, origin.Height, 3, radiance.data());
+		else
+			ImageIO::WritePPM(output, origin.Width, origin.Height, radiance.data());
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include "Protocol.h"
+
+#include <string>
+
+namespace Protocol {
+
+	namespace {
+
+		struct MessageHeader
+		{
+			uint32_t Type;
+			uint32_t Reserved;
+			uint64_t Size;
+		};
+
+		// a scene of a few hundred million spheres, anything above is a stream out of sync
+		const uint64_t MaxPayload = 1ULL << 34;
+
+	}
+
+	void Send(Socket& socket, MessageType type, const void* header, size_t headerSize, const void* data, size_t dataSize)
+	{
+		MessageHeader message{ (uint32_t)type, 0, (uint64_t)(headerSize + dataSize) };
+		socket.Send(&message, sizeof(message));
+		if (headerSize > 0)
+			socket.Send(header, headerSize);
+		if (dataSize > 0)
+			socket.Send(data, dataSize);
+	}
+
+	Message Receive(Socket& socket)
+	{
+		MessageHeader header;
+		socket.Receive(&header, sizeof(header));
+		if (header.Type > (uint32_t)MessageType::Done || header.Size > MaxPayload)
+			throw std::runtime_error("Unexpected data on the connection");
+
+		Message message;
+		message.Type = (MessageType)header.Type;
+		message.Payload.resize((size_t)header.Size);
+		if (!message.Payload.empty())
+			socket.Receive(message.Payload.data(), message.Payload.size());
+		return message;
+	}
+
+	Message Receive(Socket& socket, MessageType expected)
+	{
+		Message message = Receive(socket);
+		if (message.Type != expected)
+			throw std::runtime_error("Unexpected message " + std::to_string((uint32_t)message.Type) + ", expected " + std::to_string((uint32_t)expected));
+		return message;
+	}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Socket.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// Messages between the coordinate command and its workers : a type and a payload size,
+// then the payload. Both ends run the same build, the structures below go over the wire
+// as they are (little endian).
+namespace Protocol {
+
+	// 2 added the lens of the camera
+	const uint32_t Version = 2;
+
+	enum class MessageType : uint32_t
+	{
+		Job,       // coordinator : JobHeader, what the image is made of
+		NeedScene, // worker : no scene of that hash in its cache
+		SceneData, // coordinator : the scene in the binary scene format
+		Ready,     // worker : scene loaded, waiting for units
+		Unit,      // coordinator : UnitHeader
+		Result,    // worker : UnitHeader then the rgb sums of the unit rows, interleaved
+		Done       // coordinator : no more work, the worker leaves
+	};
+
+	struct JobHeader
+	{
+		uint32_t Version = Protocol::Version;
+		uint32_t Width = 0, Height = 0;
+		int32_t Samples = 0;
+		uint32_t Seed = 0;
+		uint8_t Antialiasing = 1;
+		uint8_t PrefilteredEnvironment = 0;
+		uint8_t Reserved[2] = {};
+		float CameraPosition[3] = {};
+		float CameraDirection[3] = {};
+		float ApertureRadius = 0.0f;
+		float FocusDistance = 0.0f;
+		// Scene::Hash, the worker looks the scene up by it before asking for it
+		uint64_t SceneHash = 0;
+		char Cubemap[256] = {}; // empty when the scene has none
+	};
+
+	// rows [FirstRow, FirstRow + RowCount) summed over the frames [FirstFrame, FirstFrame + FrameCount)
+	struct UnitHeader
+	{
+		uint32_t Id = 0;
+		uint32_t FirstRow = 0, RowCount = 0;
+		uint32_t FirstFrame = 1, FrameCount = 0;
+	};
+
+	struct Message
+	{
+		MessageType Type = MessageType::Done;
+		std::vector<uint8_t> Payload;
+
+		// the payload starts with a T, throws if it is too short
+		template<typename T>
+		T Get() const
+		{
+			if (Payload.size() < sizeof(T))
+				throw std::runtime_error("Message too short");
+			T value;
+			memcpy(&value, Payload.data(), sizeof(T));
+			return value;
+		}
+	};
+
+	// payload is header followed by data
+	void Send(Socket& socket, MessageType type, const void* header = nullptr, size_t headerSize = 0, const void* data = nullptr, size_t dataSize = 0);
+	Message Receive(Socket& socket);
+	// same, throws unless the message is of type expected
+	Message Receive(Socket& socket, MessageType expected);
+
+}
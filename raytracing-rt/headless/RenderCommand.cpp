@@ -0,0 +1,260 @@
+#include "Commands.h"
+
+#include "Camera.h"
+#include "ImageIO.h"
+#include "Renderer.h"
+#include "Scene.hpp"
+#include "Stats.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+	struct Options
+	{
+		std::string Scene;
+		std::string Cubemap;
+		uint32_t Width = 640;
+		uint32_t Height = 360;
+		int Frames = 16;
+		int Samples = 8;
+		uint32_t Seed = 0;
+		float ApertureRadius = 0.0f;
+		float FocusDistance = 5.0f;
+		std::string Output = "render.ppm";
+		std::string TraceFile;
+		Trace::Level TraceLevel = Trace::Tiles;
+		bool HugePages = false;
+		AccumulationFormat Accumulation = AccumulationFormat::Float;
+		std::string CheckpointFile;
+		uint32_t CheckpointInterval = 16;
+		std::string ResumeFile;
+		uint64_t FirstSample = 0;
+		BVHBuildOptions TreeOptions;
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless render <scene.json> [options]\n"
+			"  --cubemap <name>       cubemap from the cubemaps folder\n"
+			"  --width <n>            image width (640)\n"
+			"  --height <n>           image height (360)\n"
+			"  --frames <n>           accumulated frames, counting the resumed ones (16)\n"
+			"  --samples <n>          samples per pixel and frame (8)\n"
+			"  --seed <n>             random seed (0)\n"
+			"  --aperture <r>         lens radius for depth of field, 0 for a pinhole (0)\n"
+			"  --focus <d>            distance in focus in front of the camera (5)\n"
+			"  --output <file>        .ppm, .pfm or .rtsamples for the unnormalized sums (render.ppm)\n"
+			"  --first-sample <n>     with .rtsamples, first sample index of the range (0)\n"
+			"  --trace <file>         write a Chrome trace of the render\n"
+			"  --trace-level <level>  passes, tiles or stages (tiles)\n"
+			"  --huge-pages           back the frame buffers with huge pages when allowed\n"
+			"  --accumulation <name>  float, double, half or rgbe (float)\n"
+			"  --checkpoint <file>    save the accumulation to resume it later\n"
+			"  --checkpoint-every <n> frames between two checkpoints (16)\n"
+			"  --resume <file>        continue a checkpoint, its size, samples and seed win\n"
+			"  --bvh <builder>        sah or morton, for the sphere and instance trees (sah)\n"
+			"  --treelets             restructure the treelets of those trees after the build\n"
+			"  --bvh-width <n>        children per node of the sphere tree, 4 and 8 quantize the boxes (2)\n";
+	}
+
+	bool ParseTraceLevel(const char* name, Trace::Level& level)
+	{
+		if (strcmp(name, "passes") == 0) level = Trace::Passes;
+		else if (strcmp(name, "tiles") == 0) level = Trace::Tiles;
+		else if (strcmp(name, "stages") == 0) level = Trace::Stages;
+		else return false;
+		return true;
+	}
+
+	bool ParseAccumulation(const char* name, AccumulationFormat& format)
+	{
+		for (int i = 0; i < (int)AccumulationFormat::Count; ++i) {
+			std::string formatName = GetAccumulationFormatName((AccumulationFormat)i);
+			std::transform(formatName.begin(), formatName.end(), formatName.begin(), [](char c) { return (char)tolower(c); });
+			if (formatName == name) {
+				format = (AccumulationFormat)i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseBVHBuilder(const char* name, BVHBuilder& builder)
+	{
+		for (int i = 0; i < (int)BVHBuilder::Count; ++i) {
+			std::string builderName = GetBVHBuilderName((BVHBuilder)i);
+			std::transform(builderName.begin(), builderName.end(), builderName.begin(), [](char c) { return (char)tolower(c); });
+			if (builderName == name) {
+				builder = (BVHBuilder)i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i) {
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+			if (arg[0] != '-') {
+				if (!options.Scene.empty())
+					return false;
+				options.Scene = arg;
+				continue;
+			}
+			if (strcmp(arg, "--huge-pages") == 0) {
+				options.HugePages = true;
+				continue;
+			}
+			if (strcmp(arg, "--treelets") == 0) {
+				options.TreeOptions.Treelets = true;
+				continue;
+			}
+			if (!value)
+				return false;
+			++i;
+
+			if (strcmp(arg, "--cubemap") == 0) options.Cubemap = value;
+			else if (strcmp(arg, "--width") == 0) options.Width = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--height") == 0) options.Height = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--frames") == 0) options.Frames = atoi(value);
+			else if (strcmp(arg, "--samples") == 0) options.Samples = atoi(value);
+			else if (strcmp(arg, "--seed") == 0) options.Seed = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--aperture") == 0) options.ApertureRadius = (float)atof(value);
+			else if (strcmp(arg, "--focus") == 0) options.FocusDistance = (float)atof(value);
+			else if (strcmp(arg, "--output") == 0) options.Output = value;
+			else if (strcmp(arg, "--trace") == 0) options.TraceFile = value;
+			else if (strcmp(arg, "--checkpoint") == 0) options.CheckpointFile = value;
+			else if (strcmp(arg, "--checkpoint-every") == 0) options.CheckpointInterval = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--resume") == 0) options.ResumeFile = value;
+			else if (strcmp(arg, "--first-sample") == 0) options.FirstSample = strtoull(value, nullptr, 10);
+			else if (strcmp(arg, "--accumulation") == 0) {
+				if (!ParseAccumulation(value, options.Accumulation))
+					return false;
+			}
+			else if (strcmp(arg, "--bvh") == 0) {
+				if (!ParseBVHBuilder(value, options.TreeOptions.Builder))
+					return false;
+			}
+			else if (strcmp(arg, "--bvh-width") == 0) {
+				options.TreeOptions.Width = (uint32_t)atoi(value);
+				if (options.TreeOptions.Width != 2 && options.TreeOptions.Width != 4 && options.TreeOptions.Width != 8)
+					return false;
+			}
+			else if (strcmp(arg, "--trace-level") == 0) {
+				if (!ParseTraceLevel(value, options.TraceLevel))
+					return false;
+			}
+			else return false;
+		}
+		// a sample range has nothing to resume, merge the ranges instead
+		const bool sampleRange = EndsWith(options.Output, ".rtsamples");
+		if (sampleRange && (!options.CheckpointFile.empty() || !options.ResumeFile.empty()))
+			return false;
+		return !options.Scene.empty() && options.Width > 0 && options.Height > 0 && options.Frames > 0 && options.Samples > 0 && options.CheckpointInterval > 0;
+	}
+
+}
+
+int RunRender(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	Scene scene;
+	scene.Cubemap.exist = false;
+	scene.pass = false;
+	scene.loadScene(options.Scene);
+	if (!options.Cubemap.empty())
+		scene.loadCubemap(options.Cubemap.c_str());
+	scene.TreeOptions = options.TreeOptions;
+	scene.Prepare();
+
+	Camera camera(45.0f, 0.1f, 100.0f);
+	camera.OnResize(options.Width, options.Height);
+	camera.SetLens(options.ApertureRadius, options.FocusDistance);
+
+	Renderer renderer;
+	renderer.GetSettings().HugePages = options.HugePages;
+	renderer.GetSettings().Accumulation = options.Accumulation;
+	renderer.OnResize(options.Width, options.Height);
+	renderer.GetSettings().MonteCarloNbSample = options.Samples;
+	renderer.GetSettings().Seed = options.Seed;
+
+	if (!options.ResumeFile.empty()) {
+		try {
+			renderer.RestoreCheckpoint(CheckpointIO::Read(options.ResumeFile), scene, camera);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Could not resume: " << e.what() << "\n";
+			return 1;
+		}
+		std::cout << "resumed " << options.ResumeFile << " after " << renderer.GetAccumulatedFrameCount() << " frames\n";
+	}
+	if (!options.CheckpointFile.empty()) {
+		renderer.GetSettings().CheckpointFile = options.CheckpointFile;
+		renderer.GetSettings().CheckpointInterval = options.CheckpointInterval;
+	}
+
+	if (!options.TraceFile.empty()) {
+		Trace::Clear();
+		Trace::CurrentLevel = options.TraceLevel;
+	}
+
+	Stats::Totals before = Stats::Collect();
+	auto start = std::chrono::steady_clock::now();
+	// a sample range is taken as many passes of --samples, like the frames
+	const bool sampleRange = EndsWith(options.Output, ".rtsamples");
+	SampleBuffer samples;
+	const int resumedFrames = (int)renderer.GetAccumulatedFrameCount();
+	for (int frame = resumedFrames; frame < options.Frames; ++frame) {
+		if (sampleRange)
+			renderer.RenderSampleRange(scene, camera, options.FirstSample + (uint64_t)frame * options.Samples, options.Samples, samples);
+		else
+			renderer.Render(scene, camera);
+	}
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	const int frames = std::max(options.Frames - resumedFrames, 0);
+
+	// the last frame is always saved : the interval checkpoints are dropped while the previous
+	// one is still being written, so the file on disk may hold fewer frames or none at all
+	if (!options.CheckpointFile.empty()) {
+		renderer.WaitForCheckpoint();
+		const CheckpointWriter& writer = renderer.GetCheckpointWriter();
+		if (writer.GetWrittenCount() == 0 || writer.GetWrittenFrameCount() != renderer.GetAccumulatedFrameCount())
+			CheckpointIO::Write(options.CheckpointFile, renderer.CaptureCheckpoint(scene, camera));
+		std::cout << "checkpoint after " << renderer.GetAccumulatedFrameCount() << " frames written to " << options.CheckpointFile << "\n";
+	}
+
+	Trace::CurrentLevel = Trace::Off;
+
+	Stats::Totals totals = Stats::Collect() - before;
+	std::cout << frames << " frames in " << seconds << "s, "
+		<< totals.Counters[Stats::RaysTraced] / (seconds * 1e6f) << " Mrays/s\n";
+
+	if (sampleRange)
+		samples.Write(options.Output);
+	else if (EndsWith(options.Output, ".pfm"))
+		renderer.ExportRadiance(options.Output);
+	else
+		ImageIO::WritePPM(options.Output, renderer.GetWidth(), renderer.GetHeight(), renderer.GetImageData());
+
+	if (!options.TraceFile.empty()) {
+		Trace::Dump(options.TraceFile);
+		std::cout << Trace::GetEventCount() << " trace events written to " << options.TraceFile << "\n";
+	}
+	return 0;
+}
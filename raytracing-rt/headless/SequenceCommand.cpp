@@ -0,0 +1,157 @@
+#include "Commands.h"
+
+#include "Camera.h"
+#include "ImageIO.h"
+#include "Renderer.h"
+#include "Scene.hpp"
+#include "Sequence.h"
+#include "SphereTreeRebuilder.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+	struct Options
+	{
+		std::string Sequence;
+		std::string Cubemap;
+		uint32_t Width = 640;
+		uint32_t Height = 360;
+		int Frames = 16;
+		int Samples = 8;
+		uint32_t Seed = 0;
+		// range of the sequence to render, the last one included, all of it by default
+		uint32_t First = 0;
+		uint32_t Last = std::numeric_limits<uint32_t>::max();
+		std::string Output = "frame.ppm";
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless sequence <sequence.json> [options]\n"
+			"  sequence.json is read from the scenes folder, it names the scene it animates\n"
+			"  --cubemap <name>       cubemap from the cubemaps folder\n"
+			"  --width <n>            image width (640)\n"
+			"  --height <n>           image height (360)\n"
+			"  --frames <n>           accumulated frames per image (16)\n"
+			"  --samples <n>          samples per pixel and frame (8)\n"
+			"  --seed <n>             random seed, the image of frame f uses seed + f (0)\n"
+			"  --first <n>            first frame of the sequence to render (0)\n"
+			"  --last <n>             last frame to render (the last of the sequence)\n"
+			"  --output <file>        .ppm or .pfm, numbered before the extension (frame.ppm gives frame_0000.ppm ...)\n";
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; ++i) {
+			const char* arg = argv[i];
+			if (arg[0] != '-') {
+				if (!options.Sequence.empty())
+					return false;
+				options.Sequence = arg;
+				continue;
+			}
+
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!value)
+				return false;
+			++i;
+
+			if (strcmp(arg, "--cubemap") == 0) options.Cubemap = value;
+			else if (strcmp(arg, "--width") == 0) options.Width = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--height") == 0) options.Height = (uint32_t)atoi(value);
+			else if (strcmp(arg, "--frames") == 0) options.Frames = atoi(value);
+			else if (strcmp(arg, "--samples") == 0) options.Samples = atoi(value);
+			else if (strcmp(arg, "--seed") == 0) options.Seed = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--first") == 0) options.First = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--last") == 0) options.Last = (uint32_t)strtoul(value, nullptr, 10);
+			else if (strcmp(arg, "--output") == 0) options.Output = value;
+			else return false;
+		}
+		return !options.Sequence.empty() && options.Width > 0 && options.Height > 0 && options.Frames > 0 && options.Samples > 0;
+	}
+
+	// output with the frame number before its extension
+	std::string NumberedName(const std::string& output, uint32_t frame)
+	{
+		const size_t dot = output.find_last_of('.');
+		const size_t slash = output.find_last_of("/\\");
+		const bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+		char number[16];
+		snprintf(number, sizeof(number), "_%04u", frame);
+		return hasExtension ? output.substr(0, dot) + number + output.substr(dot) : output + number;
+	}
+
+}
+
+int RunSequence(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	const Sequence sequence = Sequence::Load(options.Sequence);
+	const uint32_t last = std::min(options.Last, sequence.GetFrameCount() - 1);
+
+	// loaded and built once, the frames only move what the keys move
+	Scene scene;
+	scene.Cubemap.exist = false;
+	scene.pass = false;
+	scene.loadScene(sequence.GetScene());
+	if (!options.Cubemap.empty())
+		scene.loadCubemap(options.Cubemap.c_str());
+	scene.Prepare();
+	SphereTreeRebuilder rebuilder;
+
+	Camera camera(45.0f, 0.1f, 100.0f);
+	camera.OnResize(options.Width, options.Height);
+
+	// the frame buffers stay allocated from one image to the next
+	Renderer renderer;
+	renderer.OnResize(options.Width, options.Height);
+	renderer.GetSettings().MonteCarloNbSample = options.Samples;
+
+	double setupSeconds = 0.0, renderSeconds = 0.0;
+	uint32_t images = 0;
+	Stats::Totals before = Stats::Collect();
+	for (uint32_t frame = options.First; frame <= last; ++frame) {
+		auto start = std::chrono::steady_clock::now();
+		sequence.Apply(frame, scene, rebuilder, camera);
+		// a tree rebuilt in the background since the previous frame finds the same hits
+		rebuilder.ApplyPending(scene);
+		renderer.GetSettings().Seed = options.Seed + frame;
+		renderer.ResetFrameIndex();
+		auto rendering = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < options.Frames; ++i)
+			renderer.Render(scene, camera);
+		auto done = std::chrono::steady_clock::now();
+		setupSeconds += std::chrono::duration<double>(rendering - start).count();
+		renderSeconds += std::chrono::duration<double>(done - rendering).count();
+
+		const std::string output = NumberedName(options.Output, frame);
+		if (EndsWith(output, ".pfm"))
+			renderer.ExportRadiance(output);
+		else
+			ImageIO::WritePPM(output, renderer.GetWidth(), renderer.GetHeight(), renderer.GetImageData());
+		++images;
+	}
+	Stats::Totals totals = Stats::Collect() - before;
+
+	std::cout << images << " images of " << options.Frames << " frames in " << renderSeconds << "s, "
+		<< totals.Counters[Stats::RaysTraced] / (renderSeconds * 1e6) << " Mrays/s, "
+		<< setupSeconds * 1e3 / std::max(images, 1u) << "ms of setup per image\n";
+	if (images > 0)
+		std::cout << "written to " << NumberedName(options.Output, options.First) << " ... " << NumberedName(options.Output, last) << "\n";
+	return 0;
+}
@@ -0,0 +1,217 @@
+#include "Socket.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(_WIN32)
+	using SocketLength = int;
+
+	void Startup()
+	{
+		static const bool started = []() {
+			WSADATA data;
+			if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+				throw std::runtime_error("Could not start Winsock");
+			return true;
+		}();
+		(void)started;
+	}
+
+	void CloseSocket(uintptr_t handle) { closesocket((SOCKET)handle); }
+	int Poll(pollfd* fds, int count, int timeoutMs) { return WSAPoll(fds, count, timeoutMs); }
+#else
+	using SocketLength = socklen_t;
+
+	void Startup() {}
+	void CloseSocket(int handle) { close(handle); }
+	int Poll(pollfd* fds, int count, int timeoutMs) { return poll(fds, count, timeoutMs); }
+#endif
+
+#if defined(MSG_NOSIGNAL)
+	// a worker that went away must not kill the coordinator with SIGPIPE
+	const int SendFlags = MSG_NOSIGNAL;
+#else
+	const int SendFlags = 0;
+#endif
+
+	// the messages are small and answered right away, do not hold them back
+	template<typename Handle>
+	void SetNoDelay(Handle handle)
+	{
+		int enable = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+	}
+
+}
+
+#if defined(_WIN32)
+const Socket::Handle Socket::InvalidHandle = (Socket::Handle)INVALID_SOCKET;
+#else
+const Socket::Handle Socket::InvalidHandle = -1;
+#endif
+
+Socket::~Socket()
+{
+	Close();
+}
+
+Socket::Socket(Socket&& other) noexcept
+	: m_Handle(std::exchange(other.m_Handle, InvalidHandle))
+{
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+	if (this != &other) {
+		Close();
+		m_Handle = std::exchange(other.m_Handle, InvalidHandle);
+	}
+	return *this;
+}
+
+Socket Socket::Listen(uint16_t port)
+{
+	Startup();
+
+	Socket socket(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (!socket.IsOpen())
+		throw std::runtime_error("Could not create a socket");
+
+	// a coordinator started again right away can take the same port
+	int reuse = 1;
+	setsockopt(socket.m_Handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(socket.m_Handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		throw std::runtime_error("Could not listen on port " + std::to_string(port));
+	if (listen(socket.m_Handle, SOMAXCONN) != 0)
+		throw std::runtime_error("Could not listen on port " + std::to_string(port));
+	return socket;
+}
+
+Socket Socket::Connect(const std::string& host, uint16_t port)
+{
+	Startup();
+
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0 || !addresses)
+		throw std::runtime_error("Could not resolve " + host);
+
+	Socket socket;
+	for (addrinfo* address = addresses; address; address = address->ai_next) {
+		Socket candidate(::socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+		if (candidate.IsOpen() && connect(candidate.m_Handle, address->ai_addr, (SocketLength)address->ai_addrlen) == 0) {
+			socket = std::move(candidate);
+			break;
+		}
+	}
+	freeaddrinfo(addresses);
+
+	if (!socket.IsOpen())
+		throw std::runtime_error("Could not connect to " + host + ":" + std::to_string(port));
+	SetNoDelay(socket.m_Handle);
+	return socket;
+}
+
+bool Socket::WaitReadable(int timeoutMs) const
+{
+	pollfd fd{};
+	fd.fd = m_Handle;
+	fd.events = POLLIN;
+	int result = Poll(&fd, 1, timeoutMs);
+	if (result < 0)
+		throw std::runtime_error("Could not wait on a socket");
+	return result > 0;
+}
+
+Socket Socket::Accept() const
+{
+	Socket socket(accept(m_Handle, nullptr, nullptr));
+	if (!socket.IsOpen())
+		throw std::runtime_error("Could not accept a connection");
+	SetNoDelay(socket.m_Handle);
+	return socket;
+}
+
+uint16_t Socket::GetLocalPort() const
+{
+	sockaddr_in address{};
+	SocketLength length = sizeof(address);
+	if (getsockname(m_Handle, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+		throw std::runtime_error("Could not read the socket address");
+	return ntohs(address.sin_port);
+}
+
+void Socket::Send(const void* data, size_t size)
+{
+	const char* bytes = static_cast<const char*>(data);
+	while (size > 0) {
+		// a few MB at a time, Winsock takes an int
+		int chunk = (int)std::min<size_t>(size, 1 << 22);
+		int sent = send(m_Handle, bytes, chunk, SendFlags);
+		if (sent <= 0)
+			throw std::runtime_error("Connection lost while sending");
+		bytes += sent;
+		size -= (size_t)sent;
+	}
+}
+
+void Socket::Receive(void* data, size_t size)
+{
+	char* bytes = static_cast<char*>(data);
+	while (size > 0) {
+		int chunk = (int)std::min<size_t>(size, 1 << 22);
+		int received = recv(m_Handle, bytes, chunk, 0);
+		if (received <= 0)
+			throw std::runtime_error("Connection lost while receiving");
+		bytes += received;
+		size -= (size_t)received;
+	}
+}
+
+void Socket::Shutdown()
+{
+	if (!IsOpen())
+		return;
+#if defined(_WIN32)
+	shutdown(m_Handle, SD_BOTH);
+#else
+	shutdown(m_Handle, SHUT_RDWR);
+#endif
+}
+
+void Socket::Close()
+{
+	if (!IsOpen())
+		return;
+	CloseSocket(m_Handle);
+	m_Handle = InvalidHandle;
+}
+
+bool Socket::IsOpen() const
+{
+	return m_Handle != InvalidHandle;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Blocking TCP connection, enough for a coordinator and its workers on a local network.
+// Every call throws std::runtime_error on failure, the peer closing the connection included.
+class Socket
+{
+public:
+	Socket() = default;
+	~Socket();
+
+	Socket(Socket&& other) noexcept;
+	Socket& operator=(Socket&& other) noexcept;
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	// on every interface, port 0 picks a free one
+	static Socket Listen(uint16_t port);
+	static Socket Connect(const std::string& host, uint16_t port);
+
+	// false if nothing came within timeoutMs, a listening socket is readable when a connection waits
+	bool WaitReadable(int timeoutMs) const;
+	Socket Accept() const;
+	uint16_t GetLocalPort() const;
+
+	void Send(const void* data, size_t size);
+	void Receive(void* data, size_t size);
+
+	// ends the connection both ways, a thread blocked in Receive on it returns with an error
+	void Shutdown();
+	void Close();
+	bool IsOpen() const;
+
+private:
+#if defined(_WIN32)
+	using Handle = uintptr_t;
+#else
+	using Handle = int;
+#endif
+	explicit Socket(Handle handle) : m_Handle(handle) {}
+
+	static const Handle InvalidHandle;
+	Handle m_Handle = InvalidHandle;
+};
@@ -0,0 +1,3 @@
+// the app gets the stb_image implementation from Walnut, the headless build does not link it
+#define STB_IMAGE_IMPLEMENTATION
+#include "../src/include/stb_image.h"
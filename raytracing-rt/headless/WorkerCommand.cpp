@@ -0,0 +1,217 @@
+#include "Commands.h"
+
+#include "Camera.h"
+#include "Protocol.h"
+#include "Renderer.h"
+#include "Scene.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+	struct Options
+	{
+		std::string Host;
+		uint16_t Port = 0;
+		// give up connecting after this long, the coordinator may still be starting
+		int ConnectTimeout = 10;
+		// drop the connection when the next unit comes, to try the reassignment
+		int MaxUnits = -1;
+	};
+
+	void PrintUsage()
+	{
+		std::cout <<
+			"usage: raytracing-rt-headless worker --connect <host:port> [options]\n"
+			"  --connect <host:port>  coordinator to take work from\n"
+			"  --timeout <s>          seconds to keep trying to connect (10)\n"
+			"  --max-units <n>        leave without a word after n units, to test the coordinator\n";
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i + 1 < argc; i += 2) {
+			const char* arg = argv[i];
+			const char* value = argv[i + 1];
+
+			if (strcmp(arg, "--connect") == 0) {
+				const char* colon = strrchr(value, ':');
+				if (!colon)
+					return false;
+				options.Host.assign(value, colon);
+				options.Port = (uint16_t)atoi(colon + 1);
+			}
+			else if (strcmp(arg, "--timeout") == 0) options.ConnectTimeout = atoi(value);
+			else if (strcmp(arg, "--max-units") == 0) options.MaxUnits = atoi(value);
+			else return false;
+		}
+		return argc % 2 == 1 && !options.Host.empty() && options.Port != 0;
+	}
+
+	Socket ConnectWithRetry(const Options& options)
+	{
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(options.ConnectTimeout);
+		for (;;) {
+			try {
+				return Socket::Connect(options.Host, options.Port);
+			}
+			catch (const std::exception&) {
+				if (std::chrono::steady_clock::now() >= deadline)
+					throw;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		}
+	}
+
+	// scenes received before are kept by hash, a coordinator restarted on the same scene
+	// does not send it again
+	std::string GetCachedSceneName(uint64_t hash)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "cache/%016llx.rtscene", (unsigned long long)hash);
+		return name;
+	}
+
+	void PrepareScene(Scene& scene, const Protocol::JobHeader& job)
+	{
+		if (job.Cubemap[0] != '\0')
+			scene.loadCubemap(job.Cubemap);
+		scene.Prepare();
+	}
+
+	bool LoadCachedScene(const Protocol::JobHeader& job, Scene& scene)
+	{
+		const std::string name = GetCachedSceneName(job.SceneHash);
+		if (!fs::exists(fs::path("scenes") / name))
+			return false;
+
+		try {
+			scene.loadScene(name);
+			PrepareScene(scene, job);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Ignoring the cached scene " << name << ": " << e.what() << "\n";
+			return false;
+		}
+		return scene.Hash == job.SceneHash;
+	}
+
+	void ReceiveScene(Socket& socket, const Protocol::JobHeader& job, Scene& scene)
+	{
+		Protocol::Send(socket, Protocol::MessageType::NeedScene);
+		Protocol::Message data = Protocol::Receive(socket, Protocol::MessageType::SceneData);
+
+		std::istringstream stream(std::string(data.Payload.begin(), data.Payload.end()));
+		scene.Deserialize(stream, "the coordinator's scene");
+		PrepareScene(scene, job);
+		if (scene.Hash != job.SceneHash)
+			throw std::runtime_error("The scene received does not match its hash, is the cubemap the same on both sides?");
+
+		// written aside and renamed, an other worker on this machine may be reading it
+		try {
+			fs::create_directories(fs::path("scenes") / "cache");
+			const std::string name = GetCachedSceneName(job.SceneHash);
+			const std::string partial = name + "." + std::to_string(std::random_device{}()) + ".rtscene";
+			scene.saveScene(partial);
+			fs::rename(fs::path("scenes") / partial, fs::path("scenes") / name);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Could not cache the scene: " << e.what() << "\n";
+		}
+	}
+
+	std::vector<float> RenderUnit(Renderer& renderer, const Scene& scene, const Camera& camera, const Protocol::UnitHeader& unit)
+	{
+		const uint32_t width = renderer.GetWidth();
+		renderer.SetRowRange(unit.FirstRow, unit.RowCount);
+		renderer.BeginFrameRange(unit.FirstFrame);
+		for (uint32_t frame = 0; frame < unit.FrameCount; ++frame)
+			renderer.Render(scene, camera);
+
+		std::vector<float> sums((size_t)unit.RowCount * width * 3);
+		std::vector<float> scratch((size_t)width * AccumulationBuffer::ChannelCount);
+		const float* channels[AccumulationBuffer::ChannelCount];
+		for (uint32_t row = 0; row < unit.RowCount; ++row) {
+			renderer.GetAccumulation().GetRow((size_t)(unit.FirstRow + row) * width, width, scratch.data(), channels);
+			float* out = sums.data() + (size_t)row * width * 3;
+			for (uint32_t x = 0; x < width; ++x)
+				for (int channel = 0; channel < 3; ++channel)
+					out[x * 3 + channel] = channels[channel][x];
+		}
+		return sums;
+	}
+
+}
+
+int RunWorker(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		PrintUsage();
+		return 1;
+	}
+
+	Socket socket = ConnectWithRetry(options);
+	Protocol::JobHeader job = Protocol::Receive(socket, Protocol::MessageType::Job).Get<Protocol::JobHeader>();
+	if (job.Version != Protocol::Version)
+		throw std::runtime_error("The coordinator speaks an other version of the protocol");
+	job.Cubemap[sizeof(job.Cubemap) - 1] = '\0';
+
+	Scene scene;
+	scene.Cubemap.exist = false;
+	scene.pass = false;
+	if (!LoadCachedScene(job, scene))
+		ReceiveScene(socket, job, scene);
+	Protocol::Send(socket, Protocol::MessageType::Ready);
+
+	Camera camera(45.0f, 0.1f, 100.0f);
+	camera.OnResize(job.Width, job.Height);
+	camera.SetView(glm::vec3(job.CameraPosition[0], job.CameraPosition[1], job.CameraPosition[2]),
+		glm::vec3(job.CameraDirection[0], job.CameraDirection[1], job.CameraDirection[2]));
+	camera.SetLens(job.ApertureRadius, job.FocusDistance);
+
+	// the sums go back as floats, keep them in floats from the start
+	Renderer renderer;
+	Renderer::Settings& settings = renderer.GetSettings();
+	settings.Accumulate = true;
+	settings.Accumulation = AccumulationFormat::Float;
+	settings.MonteCarloNbSample = job.Samples;
+	settings.Seed = job.Seed;
+	settings.Antialiasing = job.Antialiasing != 0;
+	settings.PrefilteredEnvironment = job.PrefilteredEnvironment != 0;
+	renderer.OnResize(job.Width, job.Height);
+
+	int unitCount = 0;
+	for (;;) {
+		Protocol::Message message = Protocol::Receive(socket);
+		if (message.Type == Protocol::MessageType::Done)
+			break;
+		if (message.Type != Protocol::MessageType::Unit)
+			throw std::runtime_error("Unexpected message from the coordinator");
+		if (unitCount == options.MaxUnits) {
+			std::cout << "leaving after " << unitCount << " units\n";
+			return 0;
+		}
+
+		const Protocol::UnitHeader unit = message.Get<Protocol::UnitHeader>();
+		if (unit.RowCount == 0 || unit.FirstRow + unit.RowCount > job.Height || unit.FirstFrame == 0)
+			throw std::runtime_error("Unit out of the image");
+
+		std::vector<float> sums = RenderUnit(renderer, scene, camera, unit);
+		Protocol::Send(socket, Protocol::MessageType::Result, &unit, sizeof(unit), sums.data(), sums.size() * sizeof(float));
+		++unitCount;
+	}
+
+	std::cout << unitCount << " units rendered\n";
+	return 0;
+}
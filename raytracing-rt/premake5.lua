@@ -46,4 +46,46 @@ project "raytracing-rt"
       defines { "WL_DIST" }
       runtime "Release"
       optimize "On"
-      symbols "Off"
\ No newline at end of file
+      symbols "Off"
+
+-- same renderer without a window, for batch renders and traces
+project "raytracing-rt-headless"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++17"
+   staticruntime "off"
+
+   files { "src/**.h", "src/**.cpp", "headless/**.cpp" }
+   removefiles { "src/WalnutApp.cpp" }
+
+   defines { "RT_HEADLESS" }
+
+   includedirs
+   {
+      "../Walnut/vendor/glm",
+      "src",
+   }
+
+   targetdir ("../bin/" .. outputdir .. "/%{prj.name}")
+   objdir ("../bin-int/" .. outputdir .. "/%{prj.name}")
+
+   filter "system:windows"
+      systemversion "latest"
+      links { "psapi", "ws2_32" }
+
+   filter "system:linux"
+      links { "tbb", "pthread" }
+
+   filter "configurations:Debug"
+      runtime "Debug"
+      symbols "On"
+
+   filter "configurations:Release"
+      runtime "Release"
+      optimize "On"
+      symbols "On"
+
+   filter "configurations:Dist"
+      runtime "Release"
+      optimize "On"
+      symbols "Off"
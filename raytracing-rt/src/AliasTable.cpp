@@ -0,0 +1,57 @@
+#include "AliasTable.h"
+
+#include <algorithm>
+
+AliasTable::AliasTable(const std::vector<float>& weights)
+{
+	const size_t n = weights.size();
+	if (n == 0)
+		return;
+
+	double sum = 0.0;
+	for (float w : weights)
+		sum += std::max(w, 0.0f);
+	if (sum <= 0.0)
+		return;
+
+	m_Bins.resize(n);
+	m_Pmf.resize(n);
+
+	// scaled probabilities, a bin is "small" when under the average 1
+	std::vector<double> scaled(n);
+	std::vector<uint32_t> small, large;
+	small.reserve(n);
+	large.reserve(n);
+	for (size_t i = 0; i < n; ++i) {
+		m_Pmf[i] = (float)(std::max(weights[i], 0.0f) / sum);
+		scaled[i] = std::max(weights[i], 0.0f) / sum * n;
+		(scaled[i] < 1.0 ? small : large).push_back((uint32_t)i);
+	}
+
+	// fill every small bin with the excess of a large one
+	while (!small.empty() && !large.empty()) {
+		uint32_t s = small.back(); small.pop_back();
+		uint32_t l = large.back(); large.pop_back();
+
+		m_Bins[s] = { (float)scaled[s], l };
+		scaled[l] -= 1.0 - scaled[s];
+		(scaled[l] < 1.0 ? small : large).push_back(l);
+	}
+
+	// leftovers are full up to rounding errors
+	for (uint32_t i : large)
+		m_Bins[i] = { 1.0f, i };
+	for (uint32_t i : small)
+		m_Bins[i] = { 1.0f, i };
+}
+
+uint32_t AliasTable::Sample(float u, float& pmf) const
+{
+	const float scaled = u * m_Bins.size();
+	const uint32_t bin = std::min((uint32_t)scaled, (uint32_t)m_Bins.size() - 1);
+	const float remapped = scaled - bin;
+
+	const uint32_t index = remapped < m_Bins[bin].Threshold ? bin : m_Bins[bin].Alias;
+	pmf = m_Pmf[index];
+	return index;
+}
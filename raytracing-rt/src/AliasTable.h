@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Discrete distribution sampled in O(1) with Vose's alias method.
+class AliasTable
+{
+public:
+	AliasTable() = default;
+	explicit AliasTable(const std::vector<float>& weights);
+
+	// u in [0, 1), return the picked index, its probability in pmf
+	uint32_t Sample(float u, float& pmf) const;
+
+	float Pmf(uint32_t index) const { return m_Pmf[index]; }
+	uint32_t Size() const { return (uint32_t)m_Bins.size(); }
+	bool Empty() const { return m_Bins.empty(); }
+
+private:
+	struct Bin
+	{
+		float Threshold; // probability to keep the bin index instead of taking the alias
+		uint32_t Alias;
+	};
+
+	std::vector<Bin> m_Bins;
+	std::vector<float> m_Pmf;
+};
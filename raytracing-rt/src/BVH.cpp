@@ -0,0 +1,665 @@
+#include "BVH.h"
+
+#include <execution>
+#include <numeric>
+
+namespace {
+
+	const int BinCount = 12;
+	// a leaf is never bigger, the heuristic picks smaller ones when they pay off
+	const uint32_t MaxLeafSize = 8;
+	// relative to one primitive test
+	const float TraversalCost = 1.0f;
+	// past this depth the splits halve the range so the tree stays within MaxDepth
+	const uint32_t HeuristicDepth = 32;
+	// ranges of more primitives are binned, partitioned and split on the thread pool
+	const uint32_t ParallelBuildSize = 16 * 1024;
+	const uint32_t ChunkSize = 4 * 1024;
+	// leaves of a treelet, 2^7 subsets to try the splits of
+	const int TreeletSize = 7;
+
+	struct BuildItem
+	{
+		BVH::Bounds Box;
+		glm::vec3 Centroid;
+	};
+
+	// accumulate(partial, first, last) over [begin, end) by chunks on the thread pool,
+	// merged in order. The merges used here are exact, the result does not depend on the chunks
+	template<typename Partial, typename Accumulate, typename Merge>
+	Partial ParallelReduce(uint32_t begin, uint32_t end, Accumulate&& accumulate, Merge&& merge)
+	{
+		Partial result;
+		if (end - begin < ParallelBuildSize) {
+			accumulate(result, begin, end);
+			return result;
+		}
+
+		std::vector<uint32_t> chunks((end - begin + ChunkSize - 1) / ChunkSize);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::vector<Partial> partials(chunks.size());
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](uint32_t chunk) {
+			uint32_t first = begin + chunk * ChunkSize;
+			accumulate(partials[chunk], first, std::min(first + ChunkSize, end));
+		});
+		for (const Partial& partial : partials)
+			merge(result, partial);
+		return result;
+	}
+
+	// function(i) for i in [0, count), by chunks on the thread pool when there are many
+	template<typename Function>
+	void ParallelFor(uint32_t count, Function&& function)
+	{
+		struct Nothing {};
+		ParallelReduce<Nothing>(0, count,
+			[&](Nothing&, uint32_t first, uint32_t last) {
+				for (uint32_t i = first; i < last; ++i)
+					function(i);
+			},
+			[](Nothing&, const Nothing&) {});
+	}
+
+	// the two subtrees of a node built on the thread pool, each into its own nodes
+	template<typename BuildSide>
+	void BuildSides(BuildSide&& buildSide)
+	{
+		const int sides[2] = { 0, 1 };
+		std::for_each(std::execution::par, sides, sides + 2, buildSide);
+	}
+
+	// appends the nodes of a subtree built on its own, moving the right child indices along
+	void AppendSubtree(std::vector<BVH::Node>& nodes, const std::vector<BVH::Node>& subtree)
+	{
+		const uint32_t base = (uint32_t)nodes.size();
+		for (BVH::Node node : subtree) {
+			if (node.Count == 0)
+				node.Offset += base;
+			nodes.push_back(node);
+		}
+	}
+
+	// Top down binned SAH over order[begin, end), appending the nodes to nodes. Inner
+	// nodes refer to their right child by its index in nodes. The result is the same
+	// whether the large ranges go to the thread pool or not
+	void BuildBinnedSAH(const std::vector<BuildItem>& items, std::vector<uint32_t>& order, std::vector<uint32_t>& scratch, std::vector<BVH::Node>& nodes, uint32_t begin, uint32_t end, uint32_t depth)
+	{
+		const uint32_t index = (uint32_t)nodes.size();
+		nodes.emplace_back();
+
+		struct Extent
+		{
+			BVH::Bounds Box, Centroids;
+		};
+		const Extent extent = ParallelReduce<Extent>(begin, end,
+			[&](Extent& e, uint32_t first, uint32_t last) {
+				for (uint32_t i = first; i < last; ++i) {
+					e.Box.Grow(items[order[i]].Box);
+					e.Centroids.Grow(items[order[i]].Centroid);
+				}
+			},
+			[](Extent& e, const Extent& other) {
+				e.Box.Grow(other.Box);
+				e.Centroids.Grow(other.Centroids);
+			});
+		const BVH::Bounds& box = extent.Box;
+		const BVH::Bounds& centroids = extent.Centroids;
+		nodes[index].BoundsMin = box.Min;
+		nodes[index].BoundsMax = box.Max;
+
+		const uint32_t count = end - begin;
+		const auto makeLeaf = [&]() {
+			nodes[index].Offset = begin;
+			nodes[index].Count = count;
+		};
+		if (count == 1)
+			return makeLeaf();
+
+		glm::vec3 size = centroids.Max - centroids.Min;
+		int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+		uint32_t mid = begin + count / 2;
+		if (size[axis] > 0.0f && depth < HeuristicDepth) {
+			struct Bin
+			{
+				BVH::Bounds Box;
+				uint32_t Count = 0;
+			};
+			struct BinSet
+			{
+				Bin Bins[BinCount];
+			};
+
+			const float scale = BinCount / size[axis];
+			const auto binOf = [&](uint32_t item) {
+				int b = (int)((items[item].Centroid[axis] - centroids.Min[axis]) * scale);
+				return std::min(b, BinCount - 1);
+			};
+			const BinSet binned = ParallelReduce<BinSet>(begin, end,
+				[&](BinSet& bins, uint32_t first, uint32_t last) {
+					for (uint32_t i = first; i < last; ++i) {
+						Bin& bin = bins.Bins[binOf(order[i])];
+						bin.Box.Grow(items[order[i]].Box);
+						++bin.Count;
+					}
+				},
+				[](BinSet& bins, const BinSet& other) {
+					for (int b = 0; b < BinCount; ++b) {
+						bins.Bins[b].Box.Grow(other.Bins[b].Box);
+						bins.Bins[b].Count += other.Bins[b].Count;
+					}
+				});
+			const Bin* bins = binned.Bins;
+
+			// areas of the bins left of each split, then sweep from the right
+			float leftArea[BinCount];
+			uint32_t leftCount[BinCount];
+			BVH::Bounds left;
+			uint32_t n = 0;
+			for (int b = 0; b < BinCount - 1; ++b) {
+				left.Grow(bins[b].Box);
+				n += bins[b].Count;
+				leftArea[b] = left.SurfaceArea();
+				leftCount[b] = n;
+			}
+
+			float bestCost = std::numeric_limits<float>::max();
+			int bestSplit = -1;
+			BVH::Bounds right;
+			n = 0;
+			for (int b = BinCount - 1; b > 0; --b) {
+				right.Grow(bins[b].Box);
+				n += bins[b].Count;
+				if (n == 0 || leftCount[b - 1] == 0)
+					continue;
+				float cost = leftArea[b - 1] * leftCount[b - 1] + right.SurfaceArea() * n;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestSplit = b;
+				}
+			}
+
+			// a leaf costs a test per primitive
+			float area = box.SurfaceArea();
+			if (area > 0.0f && count <= MaxLeafSize && TraversalCost + bestCost / area >= (float)count)
+				return makeLeaf();
+
+			// stable, so that building from the resulting order splits the same way
+			const auto goesLeft = [&](uint32_t item) { return binOf(item) < bestSplit; };
+			if (count >= ParallelBuildSize) {
+				mid = (uint32_t)(std::stable_partition(std::execution::par, order.begin() + begin, order.begin() + end, goesLeft) - order.begin());
+			}
+			else {
+				// the scratch slots of the range, the other ranges may be partitioned meanwhile
+				uint32_t leftEnd = begin, rightEnd = begin;
+				for (uint32_t i = begin; i < end; ++i) {
+					if (goesLeft(order[i]))
+						order[leftEnd++] = order[i];
+					else
+						scratch[rightEnd++] = order[i];
+				}
+				std::copy(scratch.begin() + begin, scratch.begin() + rightEnd, order.begin() + leftEnd);
+				mid = leftEnd;
+			}
+		}
+		else if (count <= MaxLeafSize) {
+			return makeLeaf();
+		}
+
+		if (count < ParallelBuildSize) {
+			BuildBinnedSAH(items, order, scratch, nodes, begin, mid, depth + 1);
+			uint32_t right = (uint32_t)nodes.size();
+			BuildBinnedSAH(items, order, scratch, nodes, mid, end, depth + 1);
+			nodes[index].Offset = right;
+			nodes[index].Count = 0;
+			return;
+		}
+
+		std::vector<BVH::Node> subtrees[2];
+		const uint32_t ranges[3] = { begin, mid, end };
+		BuildSides([&](int side) {
+			BuildBinnedSAH(items, order, scratch, subtrees[side], ranges[side], ranges[side + 1], depth + 1);
+		});
+		AppendSubtree(nodes, subtrees[0]);
+		nodes[index].Offset = (uint32_t)nodes.size();
+		nodes[index].Count = 0;
+		AppendSubtree(nodes, subtrees[1]);
+	}
+
+	// Binary tree with explicit children, for the Morton builder and the treelets, flattened
+	// once done. The root is node 0, so Left = 0 marks a leaf of the build, which covers
+	// slots [First, First + Count). A subtree Collapse turned into a leaf keeps its children
+	struct TreeNode
+	{
+		BVH::Bounds Box;
+		uint32_t Left = 0;
+		uint32_t Right = 0;
+		uint32_t First = 0;
+		uint32_t Count = 0; // primitives under the node
+		bool Leaf = false;
+		// surface area heuristic of the subtree, not divided by the root area
+		float Cost = 0.0f;
+	};
+
+	void SetInner(std::vector<TreeNode>& tree, uint32_t at, uint32_t left, uint32_t right)
+	{
+		TreeNode& node = tree[at];
+		node.Left = left;
+		node.Right = right;
+		node.Leaf = false;
+		node.Box = tree[left].Box;
+		node.Box.Grow(tree[right].Box);
+		node.Count = tree[left].Count + tree[right].Count;
+		node.Cost = TraversalCost * node.Box.SurfaceArea() + tree[left].Cost + tree[right].Cost;
+	}
+
+	void SetLeaf(std::vector<TreeNode>& tree, uint32_t at, const BVH::Bounds& box, uint32_t first, uint32_t count)
+	{
+		TreeNode& node = tree[at];
+		node.Box = box;
+		node.First = first;
+		node.Count = count;
+		node.Leaf = true;
+		node.Cost = box.SurfaceArea() * (float)count;
+	}
+
+	// 30 bit code, 10 bits per axis interleaved
+	uint32_t MortonCode(const glm::vec3& p)
+	{
+		const auto spread = [](uint32_t v) {
+			v = (v | (v << 16)) & 0x030000ffu;
+			v = (v | (v << 8)) & 0x0300f00fu;
+			v = (v | (v << 4)) & 0x030c30c3u;
+			v = (v | (v << 2)) & 0x09249249u;
+			return v;
+		};
+		const auto quantize = [](float x) { return (uint32_t)std::min(std::max(x * 1024.0f, 0.0f), 1023.0f); };
+		return (spread(quantize(p.x)) << 2) | (spread(quantize(p.y)) << 1) | spread(quantize(p.z));
+	}
+
+	// one primitive per leaf over keys[begin, end), sorted by code then index. The subtree of
+	// a range of n primitives takes 2n - 1 nodes from at, depth first, so both sides can be
+	// written at once
+	void EmitMorton(const std::vector<BuildItem>& items, const std::vector<uint64_t>& keys, std::vector<TreeNode>& tree, uint32_t begin, uint32_t end, uint32_t at)
+	{
+		if (end - begin == 1) {
+			SetLeaf(tree, at, items[(uint32_t)keys[begin]].Box, begin, 1);
+			return;
+		}
+
+		// split where the highest bit that differs in the range flips, halve runs of equal codes
+		const uint32_t firstCode = (uint32_t)(keys[begin] >> 32), lastCode = (uint32_t)(keys[end - 1] >> 32);
+		uint32_t mid = begin + (end - begin) / 2;
+		if (firstCode != lastCode) {
+			int bit = 31;
+			while ((((firstCode ^ lastCode) >> bit) & 1) == 0)
+				--bit;
+			mid = (uint32_t)(std::partition_point(keys.begin() + begin, keys.begin() + end,
+				[bit](uint64_t key) { return ((key >> (32 + bit)) & 1) == 0; }) - keys.begin());
+		}
+
+		const uint32_t left = at + 1, right = at + 2 * (mid - begin);
+		if (end - begin < ParallelBuildSize) {
+			EmitMorton(items, keys, tree, begin, mid, left);
+			EmitMorton(items, keys, tree, mid, end, right);
+		}
+		else {
+			const uint32_t ranges[3] = { begin, mid, end };
+			const uint32_t roots[2] = { left, right };
+			BuildSides([&](int side) { EmitMorton(items, keys, tree, ranges[side], ranges[side + 1], roots[side]); });
+		}
+		SetInner(tree, at, left, right);
+	}
+
+	// the build tree of a flat one, its leaves keep their slots
+	uint32_t ToTree(const std::vector<BVH::Node>& nodes, uint32_t index, std::vector<TreeNode>& tree)
+	{
+		const uint32_t at = (uint32_t)tree.size();
+		tree.emplace_back();
+
+		const BVH::Node& node = nodes[index];
+		if (node.Count > 0) {
+			BVH::Bounds box;
+			box.Min = node.BoundsMin;
+			box.Max = node.BoundsMax;
+			SetLeaf(tree, at, box, node.Offset, node.Count);
+			return at;
+		}
+		uint32_t left = ToTree(nodes, index + 1, tree);
+		uint32_t right = ToTree(nodes, node.Offset, tree);
+		SetInner(tree, at, left, right);
+		return at;
+	}
+
+	// Finds the best binary tree over up to TreeletSize subtrees below root, grown from its
+	// children by opening the largest inner one, and rebuilds it with the same inner nodes
+	// when it is cheaper (Karras and Aila, "Fast parallel construction of high-quality BVHs")
+	class Treelet
+	{
+	public:
+		Treelet(std::vector<TreeNode>& tree, uint32_t root)
+			: m_Tree(tree)
+		{
+			m_Inner[m_InnerCount++] = root;
+			m_Leaves[m_LeafCount++] = tree[root].Left;
+			m_Leaves[m_LeafCount++] = tree[root].Right;
+			while (m_LeafCount < TreeletSize) {
+				int largest = -1;
+				float largestArea = -1.0f;
+				for (int i = 0; i < m_LeafCount; ++i) {
+					const TreeNode& node = tree[m_Leaves[i]];
+					float area = node.Box.SurfaceArea();
+					if (!node.Leaf && area > largestArea) {
+						largest = i;
+						largestArea = area;
+					}
+				}
+				if (largest < 0)
+					break;
+
+				uint32_t opened = m_Leaves[largest];
+				m_Inner[m_InnerCount++] = opened;
+				m_Leaves[largest] = tree[opened].Left;
+				m_Leaves[m_LeafCount++] = tree[opened].Right;
+			}
+		}
+
+		void Optimize()
+		{
+			// two subtrees only go together one way
+			if (m_LeafCount < 3)
+				return;
+
+			// every subset, the split of a set only refers to smaller numbers
+			const uint32_t full = (1u << m_LeafCount) - 1;
+			for (uint32_t set = 1; set <= full; ++set) {
+				const uint32_t lowest = set & (0u - set);
+				if (set == lowest) {
+					const TreeNode& leaf = m_Tree[m_Leaves[LeafOf(set)]];
+					m_Boxes[set] = leaf.Box;
+					m_Costs[set] = leaf.Cost;
+					continue;
+				}
+
+				m_Boxes[set] = m_Boxes[set ^ lowest];
+				m_Boxes[set].Grow(m_Boxes[lowest]);
+				float best = std::numeric_limits<float>::max();
+				// the side holding the lowest subtree, each split is seen once
+				for (uint32_t part = (set - 1) & set; part != 0; part = (part - 1) & set) {
+					if ((part & lowest) == 0)
+						continue;
+					float cost = m_Costs[part] + m_Costs[set ^ part];
+					if (cost < best) {
+						best = cost;
+						m_Splits[set] = part;
+					}
+				}
+				m_Costs[set] = TraversalCost * m_Boxes[set].SurfaceArea() + best;
+			}
+
+			const uint32_t root = m_Inner[0];
+			if (!(m_Costs[full] < m_Tree[root].Cost * 0.9999f))
+				return;
+			m_NextInner = 1;
+			Rebuild(full, root);
+		}
+
+	private:
+		static int LeafOf(uint32_t single)
+		{
+			int i = 0;
+			while ((single >> i) != 1)
+				++i;
+			return i;
+		}
+
+		uint32_t NodeOf(uint32_t set)
+		{
+			if ((set & (set - 1)) == 0)
+				return m_Leaves[LeafOf(set)];
+			uint32_t node = m_Inner[m_NextInner++];
+			Rebuild(set, node);
+			return node;
+		}
+
+		void Rebuild(uint32_t set, uint32_t at)
+		{
+			uint32_t left = NodeOf(m_Splits[set]);
+			uint32_t right = NodeOf(set ^ m_Splits[set]);
+			SetInner(m_Tree, at, left, right);
+		}
+
+	private:
+		std::vector<TreeNode>& m_Tree;
+		uint32_t m_Leaves[TreeletSize];
+		uint32_t m_Inner[TreeletSize - 1];
+		int m_LeafCount = 0;
+		int m_InnerCount = 0;
+		int m_NextInner = 0;
+
+		BVH::Bounds m_Boxes[1 << TreeletSize];
+		float m_Costs[1 << TreeletSize];
+		uint32_t m_Splits[1 << TreeletSize];
+	};
+
+	// bottom up, the treelet of a node is optimized after the ones below it
+	void OptimizeTreelets(std::vector<TreeNode>& tree, uint32_t at)
+	{
+		if (tree[at].Leaf)
+			return;
+
+		const uint32_t children[2] = { tree[at].Left, tree[at].Right };
+		if (tree[at].Count < ParallelBuildSize) {
+			OptimizeTreelets(tree, children[0]);
+			OptimizeTreelets(tree, children[1]);
+		}
+		else {
+			BuildSides([&](int side) { OptimizeTreelets(tree, children[side]); });
+		}
+		SetInner(tree, at, children[0], children[1]);
+		Treelet(tree, at).Optimize();
+	}
+
+	// small subtrees become leaves when testing all their primitives is cheaper
+	void Collapse(std::vector<TreeNode>& tree, uint32_t at)
+	{
+		if (tree[at].Leaf)
+			return;
+
+		const uint32_t children[2] = { tree[at].Left, tree[at].Right };
+		if (tree[at].Count < ParallelBuildSize) {
+			Collapse(tree, children[0]);
+			Collapse(tree, children[1]);
+		}
+		else {
+			BuildSides([&](int side) { Collapse(tree, children[side]); });
+		}
+		SetInner(tree, at, children[0], children[1]);
+
+		TreeNode& node = tree[at];
+		float leafCost = node.Box.SurfaceArea() * (float)node.Count;
+		if (node.Count <= MaxLeafSize && leafCost <= node.Cost) {
+			node.Leaf = true;
+			node.Cost = leafCost;
+		}
+	}
+
+	void Gather(const std::vector<TreeNode>& tree, uint32_t at, const std::vector<uint32_t>& slots, std::vector<uint32_t>& order)
+	{
+		const TreeNode& node = tree[at];
+		if (node.Left == 0) {
+			order.insert(order.end(), slots.begin() + node.First, slots.begin() + node.First + node.Count);
+			return;
+		}
+		Gather(tree, node.Left, slots, order);
+		Gather(tree, node.Right, slots, order);
+	}
+
+	// depth first into nodes, the primitives of the leaves appended to order. Returns the depth
+	uint32_t Flatten(const std::vector<TreeNode>& tree, uint32_t at, const std::vector<uint32_t>& slots, std::vector<BVH::Node>& nodes, std::vector<uint32_t>& order)
+	{
+		const TreeNode& node = tree[at];
+		const uint32_t index = (uint32_t)nodes.size();
+		nodes.emplace_back();
+		nodes[index].BoundsMin = node.Box.Min;
+		nodes[index].BoundsMax = node.Box.Max;
+
+		if (node.Leaf) {
+			nodes[index].Offset = (uint32_t)order.size();
+			nodes[index].Count = node.Count;
+			Gather(tree, at, slots, order);
+			return 1;
+		}
+
+		uint32_t leftDepth = Flatten(tree, node.Left, slots, nodes, order);
+		nodes[index].Offset = (uint32_t)nodes.size();
+		nodes[index].Count = 0;
+		uint32_t rightDepth = Flatten(tree, node.Right, slots, nodes, order);
+		return 1 + std::max(leftDepth, rightDepth);
+	}
+
+}
+
+const char* GetBVHBuilderName(BVHBuilder builder)
+{
+	switch (builder) {
+	case BVHBuilder::BinnedSAH: return "SAH";
+	case BVHBuilder::Morton: return "Morton";
+	default: return "";
+	}
+}
+
+float BVH::Bounds::SurfaceArea() const
+{
+	glm::vec3 d = glm::max(Max - Min, glm::vec3(0.0f));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+BVH::Bounds BVH::GetBounds() const
+{
+	Bounds bounds;
+	if (!m_Nodes.empty()) {
+		bounds.Min = m_Nodes[0].BoundsMin;
+		bounds.Max = m_Nodes[0].BoundsMax;
+	}
+	return bounds;
+}
+
+size_t BVH::GetMemoryUsage() const
+{
+	return m_Nodes.capacity() * sizeof(Node) + (m_Parents.capacity() + m_LeafOfSlot.capacity()) * sizeof(uint32_t);
+}
+
+float BVH::GetCost() const
+{
+	float rootArea = GetBounds().SurfaceArea();
+	return rootArea > 0.0f ? (float)(m_CostSum / rootArea) : 0.0f;
+}
+
+double BVH::NodeCost(const Node& node)
+{
+	glm::vec3 d = glm::max(node.BoundsMax - node.BoundsMin, glm::vec3(0.0f));
+	double area = 2.0 * ((double)d.x * d.y + (double)d.y * d.z + (double)d.z * d.x);
+	return area * (node.Count > 0 ? (double)node.Count : (double)TraversalCost);
+}
+
+void BVH::PrepareRefit()
+{
+	uint32_t primitiveCount = 0;
+	for (const Node& node : m_Nodes)
+		if (node.Count > 0)
+			primitiveCount = std::max(primitiveCount, node.Offset + node.Count);
+
+	m_Parents.assign(m_Nodes.size(), 0);
+	m_LeafOfSlot.assign(primitiveCount, 0);
+	for (uint32_t i = 0; i < (uint32_t)m_Nodes.size(); ++i) {
+		const Node& node = m_Nodes[i];
+		if (node.Count > 0) {
+			for (uint32_t slot = node.Offset; slot < node.Offset + node.Count; ++slot)
+				m_LeafOfSlot[slot] = i;
+		}
+		else {
+			m_Parents[i + 1] = i;
+			m_Parents[node.Offset] = i;
+		}
+	}
+}
+
+void BVH::Build(const std::vector<Bounds>& bounds, std::vector<uint32_t>& order, const BVHBuildOptions& options)
+{
+	m_Nodes.clear();
+	m_Parents.clear();
+	m_LeafOfSlot.clear();
+	m_CostSum = 0.0;
+	m_BuildCost = 0.0f;
+	order.resize(bounds.size());
+	if (bounds.empty())
+		return;
+
+	std::vector<BuildItem> items(bounds.size());
+	std::iota(order.begin(), order.end(), 0);
+	ParallelFor((uint32_t)items.size(), [&](uint32_t i) {
+		items[i].Box = bounds[i];
+		items[i].Centroid = bounds[i].Center();
+	});
+
+	std::vector<Node> nodes;
+	std::vector<TreeNode> tree;
+	std::vector<uint32_t> slots;
+	if (options.Builder == BVHBuilder::Morton) {
+		const Bounds centroids = ParallelReduce<Bounds>(0, (uint32_t)items.size(),
+			[&](Bounds& b, uint32_t first, uint32_t last) {
+				for (uint32_t i = first; i < last; ++i)
+					b.Grow(items[i].Centroid);
+			},
+			[](Bounds& b, const Bounds& other) { b.Grow(other); });
+		const glm::vec3 extent = centroids.Max - centroids.Min;
+		const glm::vec3 scale(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f, extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+		// code above the index, equal codes keep the input order
+		std::vector<uint64_t> keys(items.size());
+		ParallelFor((uint32_t)keys.size(), [&](uint32_t i) {
+			keys[i] = ((uint64_t)MortonCode((items[i].Centroid - centroids.Min) * scale) << 32) | i;
+		});
+		std::sort(std::execution::par, keys.begin(), keys.end());
+
+		slots.resize(keys.size());
+		std::transform(keys.begin(), keys.end(), slots.begin(), [](uint64_t key) { return (uint32_t)key; });
+		tree.resize(2 * keys.size() - 1);
+		EmitMorton(items, keys, tree, 0, (uint32_t)keys.size(), 0);
+	}
+	else {
+		std::vector<uint32_t> scratch(bounds.size());
+		nodes.reserve(2 * bounds.size() - 1);
+		BuildBinnedSAH(items, order, scratch, nodes, 0, (uint32_t)bounds.size(), 1);
+		if (options.Treelets) {
+			tree.reserve(nodes.size());
+			ToTree(nodes, 0, tree);
+			slots = order;
+		}
+	}
+
+	if (!tree.empty()) {
+		if (options.Treelets)
+			OptimizeTreelets(tree, 0);
+		Collapse(tree, 0);
+
+		nodes.clear();
+		order.clear();
+		uint32_t depth = Flatten(tree, 0, slots, nodes, order);
+		// the traversal stack has a slot per level, the binned SAH keeps under it
+		if (depth > MaxDepth) {
+			nodes.clear();
+			std::iota(order.begin(), order.end(), 0);
+			std::vector<uint32_t> scratch(bounds.size());
+			BuildBinnedSAH(items, order, scratch, nodes, 0, (uint32_t)bounds.size(), 1);
+		}
+	}
+
+	m_Nodes = std::move(nodes);
+	m_Nodes.shrink_to_fit();
+
+	for (const Node& node : m_Nodes)
+		m_CostSum += NodeCost(node);
+	m_BuildCost = GetCost();
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Ray.h"
+
+// How a BVH is built, from the best trees to the fastest builds
+enum class BVHBuilder
+{
+	BinnedSAH, // top down, splits chosen by the surface area heuristic
+	Morton,    // primitives sorted along a Morton curve, split where the codes differ, several times faster
+	Count
+};
+
+const char* GetBVHBuilderName(BVHBuilder builder);
+
+struct BVHBuildOptions
+{
+	BVHBuilder Builder = BVHBuilder::BinnedSAH;
+	// reorganize small treelets of the built tree for a lower surface area heuristic cost,
+	// mostly for Morton trees. The order is no longer the same when building again
+	bool Treelets = false;
+	// children per node of the sphere tree : 2, or 4 and 8 for the quantized nodes of WideBVH.
+	// The other trees stay binary
+	uint32_t Width = 2;
+};
+
+// Bounding volume hierarchy over boxes, for the closest hit queries on geometry.
+// Both builders run on the thread pool for large ranges. The nodes are stored depth first :
+// the left child of an inner node comes right after it, only the right one needs an index.
+// A leaf holds a range of primitives, Build gives the order they have to be stored in so
+// every leaf range is contiguous. With the binned SAH builder and no treelets, building
+// again from that order gives the same tree.
+// Moved primitives can be refit : the tree keeps its shape and only the boxes above them
+// change, which is fast but lets the tree get slower than a new build would be.
+class BVH
+{
+public:
+	struct Bounds
+	{
+		glm::vec3 Min{ std::numeric_limits<float>::max() };
+		glm::vec3 Max{ -std::numeric_limits<float>::max() };
+
+		void Grow(const glm::vec3& p) { Min = glm::min(Min, p); Max = glm::max(Max, p); }
+		void Grow(const Bounds& b) { Min = glm::min(Min, b.Min); Max = glm::max(Max, b.Max); }
+		glm::vec3 Center() const { return 0.5f * (Min + Max); }
+		float SurfaceArea() const;
+	};
+
+	// 32 bytes, two to a cache line
+	struct Node
+	{
+		glm::vec3 BoundsMin;
+		uint32_t Offset; // first primitive of a leaf, right child of an inner node
+		glm::vec3 BoundsMax;
+		uint32_t Count; // primitives of a leaf, 0 for an inner node
+	};
+
+	static const uint32_t MaxDepth = 64;
+
+	BVH() = default;
+
+	// order receives the primitives in leaf order, order[i] being the index in bounds
+	// of the i-th primitive the leaves refer to
+	void Build(const std::vector<Bounds>& bounds, std::vector<uint32_t>& order, const BVHBuildOptions& options = BVHBuildOptions());
+
+	bool Empty() const { return m_Nodes.empty(); }
+	const std::vector<Node>& GetNodes() const { return m_Nodes; }
+	Bounds GetBounds() const;
+	// bytes of the nodes and of what the refits use
+	size_t GetMemoryUsage() const;
+
+	// surface area heuristic : the node visits and primitive tests a ray through the root
+	// box can expect. Refits make it grow away from its value right after the build
+	float GetCost() const;
+	float GetBuildCost() const { return m_BuildCost; }
+
+	// the primitive at slot of the order got new bounds, boundsOf(slot) gives the bounds of
+	// the primitive at a slot. Refits its leaf and the nodes above it, up to the first node
+	// that does not change
+	template<typename BoundsOf>
+	void Refit(uint32_t slot, BoundsOf&& boundsOf);
+	// parents of the nodes and leaves of the slots Refit needs, made by the first refit
+	// otherwise. Trees that will be refit can take this time at build
+	void PrepareRefit();
+
+	// visit the leaves the ray may hit before tMax, nearest child first.
+	// intersectLeaf(first, count) tests the primitives and lowers tMax on a hit.
+	// steps counts the nodes visited
+	template<typename IntersectLeaf>
+	void Traverse(const Ray& ray, float tMin, float& tMax, IntersectLeaf&& intersectLeaf, uint32_t& steps) const;
+
+private:
+	static float IntersectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin, const glm::vec3& invDirection, float tMin, float tMax);
+	// area of the node weighted by what a ray entering it costs
+	static double NodeCost(const Node& node);
+
+private:
+	std::vector<Node> m_Nodes;
+
+	// sum of the node costs, kept up to date by the refits
+	double m_CostSum = 0.0;
+	float m_BuildCost = 0.0f;
+	// parent of each node and leaf of each slot of the order
+	std::vector<uint32_t> m_Parents;
+	std::vector<uint32_t> m_LeafOfSlot;
+};
+
+// entry distance of the ray in the box, infinity when it misses it in [tMin, tMax]
+inline float BVH::IntersectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin, const glm::vec3& invDirection, float tMin, float tMax)
+{
+	float tx0 = (boundsMin.x - origin.x) * invDirection.x, tx1 = (boundsMax.x - origin.x) * invDirection.x;
+	float ty0 = (boundsMin.y - origin.y) * invDirection.y, ty1 = (boundsMax.y - origin.y) * invDirection.y;
+	float tz0 = (boundsMin.z - origin.z) * invDirection.z, tz1 = (boundsMax.z - origin.z) * invDirection.z;
+	float enter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), tMin));
+	float exit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+	return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+template<typename BoundsOf>
+void BVH::Refit(uint32_t slot, BoundsOf&& boundsOf)
+{
+	if (m_LeafOfSlot.empty())
+		PrepareRefit();
+
+	// every box is the exact union of its children, so one that stays the same ends the refit
+	uint32_t current = m_LeafOfSlot[slot];
+	for (;;) {
+		Node& node = m_Nodes[current];
+		Bounds box;
+		if (node.Count > 0) {
+			for (uint32_t i = node.Offset; i < node.Offset + node.Count; ++i)
+				box.Grow(boundsOf(i));
+		}
+		else {
+			box.Grow(Bounds{ m_Nodes[current + 1].BoundsMin, m_Nodes[current + 1].BoundsMax });
+			box.Grow(Bounds{ m_Nodes[node.Offset].BoundsMin, m_Nodes[node.Offset].BoundsMax });
+		}
+		if (box.Min == node.BoundsMin && box.Max == node.BoundsMax)
+			return;
+
+		m_CostSum -= NodeCost(node);
+		node.BoundsMin = box.Min;
+		node.BoundsMax = box.Max;
+		m_CostSum += NodeCost(node);
+		if (current == 0)
+			return;
+		current = m_Parents[current];
+	}
+}
+
+template<typename IntersectLeaf>
+void BVH::Traverse(const Ray& ray, float tMin, float& tMax, IntersectLeaf&& intersectLeaf, uint32_t& steps) const
+{
+	if (m_Nodes.empty())
+		return;
+
+	const glm::vec3 invDirection = 1.0f / ray.Direction;
+	++steps;
+	if (IntersectBox(m_Nodes[0].BoundsMin, m_Nodes[0].BoundsMax, ray.Origin, invDirection, tMin, tMax) == std::numeric_limits<float>::infinity())
+		return;
+
+	// at most one entry per level, the build keeps the depth under MaxDepth
+	struct Pending
+	{
+		uint32_t Node;
+		float Distance;
+	} stack[MaxDepth];
+	uint32_t stackSize = 0;
+	uint32_t current = 0;
+	for (;;) {
+		const Node& node = m_Nodes[current];
+		if (node.Count > 0) {
+			intersectLeaf(node.Offset, node.Count);
+		}
+		else {
+			uint32_t near = current + 1, far = node.Offset;
+			steps += 2;
+			float tNear = IntersectBox(m_Nodes[near].BoundsMin, m_Nodes[near].BoundsMax, ray.Origin, invDirection, tMin, tMax);
+			float tFar = IntersectBox(m_Nodes[far].BoundsMin, m_Nodes[far].BoundsMax, ray.Origin, invDirection, tMin, tMax);
+			if (tFar < tNear) {
+				std::swap(near, far);
+				std::swap(tNear, tFar);
+			}
+			if (tNear != std::numeric_limits<float>::infinity()) {
+				if (tFar != std::numeric_limits<float>::infinity())
+					stack[stackSize++] = { far, tFar };
+				current = near;
+				continue;
+			}
+		}
+
+		// skip the subtrees a closer hit made out of reach
+		for (;;) {
+			if (stackSize == 0)
+				return;
+			const Pending& pending = stack[--stackSize];
+			if (pending.Distance <= tMax) {
+				current = pending.Node;
+				break;
+			}
+		}
+	}
+}
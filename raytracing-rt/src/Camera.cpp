@@ -4,11 +4,17 @@
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#ifndef RT_HEADLESS
 #include "Walnut/Input/Input.h"
+#endif
 
 #include "MyRand.h"
 
+#include <algorithm>
+
+#ifndef RT_HEADLESS
 using namespace Walnut;
+#endif
 
 Camera::Camera(float verticalFOV, float nearClip, float farClip)
 	: m_VerticalFOV(verticalFOV), m_NearClip(nearClip), m_FarClip(farClip)
@@ -19,6 +25,10 @@ Camera::Camera(float verticalFOV, float nearClip, float farClip)
 
 bool Camera::OnUpdate(float ts)
 {
+#ifdef RT_HEADLESS
+	// no window to read the mouse and keyboard from
+	return false;
+#else
 	glm::vec2 mousePos = Input::GetMousePosition();
 	glm::vec2 delta = (mousePos - m_LastMousePosition) * 0.002f;
 	m_LastMousePosition = mousePos;
@@ -90,6 +100,7 @@ bool Camera::OnUpdate(float ts)
 	}
 
 	return moved;
+#endif
 }
 
 void Camera::OnResize(uint32_t width, uint32_t height)
@@ -104,6 +115,21 @@ void Camera::OnResize(uint32_t width, uint32_t height)
 	RecalculateRayDirections();
 }
 
+void Camera::SetView(const glm::vec3& position, const glm::vec3& direction)
+{
+	m_Position = position;
+	m_ForwardDirection = glm::normalize(direction);
+
+	RecalculateView();
+	RecalculateRayDirections();
+}
+
+void Camera::SetLens(float apertureRadius, float focusDistance)
+{
+	m_ApertureRadius = std::max(apertureRadius, 0.0f);
+	m_FocusDistance = std::max(focusDistance, m_NearClip);
+}
+
 float Camera::GetRotationSpeed()
 {
 	return 0.3f;
@@ -10,6 +10,12 @@ public:
 
 	bool OnUpdate(float ts);
 	void OnResize(uint32_t width, uint32_t height);
+	// place the camera without going through the input, direction does not need to be normalized
+	void SetView(const glm::vec3& position, const glm::vec3& direction);
+	// thin lens : rays leave a disk of apertureRadius around the position and meet again on the
+	// plane focusDistance ahead, in front of which and past which the scene blurs. A radius of 0
+	// is the pinhole, the ray directions are then used as they are
+	void SetLens(float apertureRadius, float focusDistance);
 
 	const glm::mat4& GetProjection() const { return m_Projection; }
 	const glm::mat4& GetInverseProjection() const { return m_InverseProjection; }
@@ -18,6 +24,11 @@ public:
 	
 	const glm::vec3& GetPosition() const { return m_Position; }
 	const glm::vec3& GetDirection() const { return m_ForwardDirection; }
+	// unit axes of the image plane in world space
+	glm::vec3 GetRightDirection() const { return glm::vec3(m_InverseView[0]); }
+	glm::vec3 GetUpDirection() const { return glm::vec3(m_InverseView[1]); }
+	float GetApertureRadius() const { return m_ApertureRadius; }
+	float GetFocusDistance() const { return m_FocusDistance; }
 	const uint32_t GetViewportWidth() const { return m_ViewportWidth; }
 	const uint32_t GetViewportHeight() const { return m_ViewportHeight; }
 	
@@ -46,6 +57,9 @@ private:
 	glm::vec3 m_Position{0.0f, 0.0f, 0.0f};
 	glm::vec3 m_ForwardDirection{0.0f, 0.0f, 0.0f};
 
+	float m_ApertureRadius = 0.0f;
+	float m_FocusDistance = 5.0f;
+
 	// Cached ray directions
 	std::vector<glm::vec3> m_RayDirections;
 
@@ -0,0 +1,272 @@
+#include "Checkpoint.h"
+
+#include "Hash.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+	const char Magic[4] = { 'R', 'T', 'C', 'K' };
+	// 2 added the first frame, version 1 files start at frame 1. 3 added the lens, older
+	// files are pinhole renders
+	const uint32_t Version = 3;
+
+	// runs shorter than this are cheaper as literals
+	const size_t MinRun = 3;
+	const size_t MaxRun = 0x7f + MinRun;
+	const size_t MaxLiteral = 0x80;
+
+	template<typename T>
+	void WriteValue(std::ofstream& file, const T& value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	T ReadValue(std::ifstream& file)
+	{
+		T value{};
+		file.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+
+	// bytes of one value, the unit the planes are shuffled by
+	size_t GetElementSize(AccumulationFormat format)
+	{
+		if (format == AccumulationFormat::RGBE)
+			return sizeof(uint32_t);
+		return GetAccumulationBytesPerPixel(format) / AccumulationBuffer::ChannelCount;
+	}
+
+	// byte i of every value goes to byte plane i, so the exponents end up next to each other
+	std::vector<uint8_t> Shuffle(const std::vector<uint8_t>& data, size_t elementSize)
+	{
+		const size_t count = data.size() / elementSize;
+		std::vector<uint8_t> shuffled(data.size());
+		for (size_t byte = 0; byte < elementSize; ++byte)
+			for (size_t i = 0; i < count; ++i)
+				shuffled[byte * count + i] = data[i * elementSize + byte];
+		return shuffled;
+	}
+
+	std::vector<uint8_t> Unshuffle(const std::vector<uint8_t>& shuffled, size_t elementSize)
+	{
+		const size_t count = shuffled.size() / elementSize;
+		std::vector<uint8_t> data(shuffled.size());
+		for (size_t byte = 0; byte < elementSize; ++byte)
+			for (size_t i = 0; i < count; ++i)
+				data[i * elementSize + byte] = shuffled[byte * count + i];
+		return data;
+	}
+
+	// control byte 0x80 | (n - MinRun) followed by the byte repeated n times,
+	// or n - 1 followed by n literal bytes
+	std::vector<uint8_t> Encode(const std::vector<uint8_t>& data)
+	{
+		std::vector<uint8_t> encoded;
+		encoded.reserve(data.size() / 2);
+
+		const size_t size = data.size();
+		size_t i = 0;
+		while (i < size) {
+			size_t run = 1;
+			while (i + run < size && run < MaxRun && data[i + run] == data[i])
+				++run;
+			if (run >= MinRun) {
+				encoded.push_back((uint8_t)(0x80 | (run - MinRun)));
+				encoded.push_back(data[i]);
+				i += run;
+				continue;
+			}
+
+			const size_t start = i;
+			while (i < size && i - start < MaxLiteral) {
+				if (i + 2 < size && data[i] == data[i + 1] && data[i] == data[i + 2])
+					break;
+				++i;
+			}
+			encoded.push_back((uint8_t)(i - start - 1));
+			encoded.insert(encoded.end(), data.begin() + start, data.begin() + i);
+		}
+		return encoded;
+	}
+
+	bool Decode(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& data)
+	{
+		size_t out = 0;
+		size_t i = 0;
+		while (i < encoded.size()) {
+			const uint8_t control = encoded[i++];
+			if (control & 0x80) {
+				const size_t run = (control & 0x7f) + MinRun;
+				if (i >= encoded.size() || out + run > data.size())
+					return false;
+				memset(data.data() + out, encoded[i++], run);
+				out += run;
+			}
+			else {
+				const size_t literal = (size_t)control + 1;
+				if (i + literal > encoded.size() || out + literal > data.size())
+					return false;
+				memcpy(data.data() + out, encoded.data() + i, literal);
+				i += literal;
+				out += literal;
+			}
+		}
+		return out == data.size();
+	}
+
+}
+
+namespace CheckpointIO {
+
+	void Write(const std::string& filename, const Checkpoint& checkpoint)
+	{
+		const size_t elementSize = GetElementSize(checkpoint.Format);
+		const std::vector<uint8_t> encoded = Encode(Shuffle(checkpoint.Accumulation, elementSize));
+
+		std::ofstream file(filename, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("Could not open file for writing: " + filename);
+
+		file.write(Magic, sizeof(Magic));
+		WriteValue(file, Version);
+		WriteValue(file, checkpoint.Width);
+		WriteValue(file, checkpoint.Height);
+		WriteValue(file, checkpoint.FirstFrame);
+		WriteValue(file, checkpoint.FrameIndex);
+		WriteValue(file, checkpoint.FrameCount);
+		WriteValue(file, checkpoint.Seed);
+		WriteValue(file, (int32_t)checkpoint.MonteCarloNbSample);
+		WriteValue(file, (uint8_t)checkpoint.Antialiasing);
+		WriteValue(file, (uint8_t)checkpoint.PrefilteredEnvironment);
+		WriteValue(file, (uint8_t)checkpoint.Format);
+		WriteValue(file, (uint8_t)0);
+		WriteValue(file, checkpoint.CameraPosition);
+		WriteValue(file, checkpoint.CameraDirection);
+		WriteValue(file, checkpoint.ApertureRadius);
+		WriteValue(file, checkpoint.FocusDistance);
+		WriteValue(file, checkpoint.SceneHash);
+
+		WriteValue(file, (uint64_t)checkpoint.Accumulation.size());
+		WriteValue(file, HashBytes(checkpoint.Accumulation.data(), checkpoint.Accumulation.size()));
+		WriteValue(file, (uint64_t)encoded.size());
+		file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+		if (!file)
+			throw std::runtime_error("Could not write checkpoint: " + filename);
+	}
+
+	Checkpoint Read(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("Could not open file for reading: " + filename);
+
+		char magic[sizeof(Magic)] = {};
+		file.read(magic, sizeof(magic));
+		const uint32_t version = ReadValue<uint32_t>(file);
+		if (memcmp(magic, Magic, sizeof(Magic)) != 0 || version < 1 || version > Version)
+			throw std::runtime_error("Not a checkpoint of a supported version: " + filename);
+
+		Checkpoint checkpoint;
+		checkpoint.Width = ReadValue<uint32_t>(file);
+		checkpoint.Height = ReadValue<uint32_t>(file);
+		if (version >= 2)
+			checkpoint.FirstFrame = ReadValue<uint32_t>(file);
+		checkpoint.FrameIndex = ReadValue<uint32_t>(file);
+		checkpoint.FrameCount = ReadValue<uint32_t>(file);
+		checkpoint.Seed = ReadValue<uint32_t>(file);
+		checkpoint.MonteCarloNbSample = ReadValue<int32_t>(file);
+		checkpoint.Antialiasing = ReadValue<uint8_t>(file) != 0;
+		checkpoint.PrefilteredEnvironment = ReadValue<uint8_t>(file) != 0;
+		const uint8_t format = ReadValue<uint8_t>(file);
+		ReadValue<uint8_t>(file);
+		checkpoint.CameraPosition = ReadValue<glm::vec3>(file);
+		checkpoint.CameraDirection = ReadValue<glm::vec3>(file);
+		if (version >= 3) {
+			checkpoint.ApertureRadius = ReadValue<float>(file);
+			checkpoint.FocusDistance = ReadValue<float>(file);
+		}
+		checkpoint.SceneHash = ReadValue<uint64_t>(file);
+
+		const uint64_t rawSize = ReadValue<uint64_t>(file);
+		const uint64_t rawHash = ReadValue<uint64_t>(file);
+		const uint64_t encodedSize = ReadValue<uint64_t>(file);
+		if (!file || format >= (uint8_t)AccumulationFormat::Count)
+			throw std::runtime_error("Damaged checkpoint: " + filename);
+		checkpoint.Format = (AccumulationFormat)format;
+
+		// damaged sizes would ask for more memory than the image or the file holds
+		const uint64_t bytesPerPixel = GetAccumulationBytesPerPixel(checkpoint.Format);
+		const uint64_t pixelCount = (uint64_t)checkpoint.Width * checkpoint.Height;
+		const std::streamoff headerEnd = file.tellg();
+		file.seekg(0, std::ios::end);
+		const uint64_t remaining = (uint64_t)(file.tellg() - headerEnd);
+		file.seekg(headerEnd);
+		// each plane is padded to the buffer alignment at most
+		const uint64_t padding = (uint64_t)AlignedBuffer::Alignment * AccumulationBuffer::ChannelCount;
+		if (!file || pixelCount > ((uint64_t)1 << 40) / bytesPerPixel
+			|| rawSize < pixelCount * bytesPerPixel || rawSize > pixelCount * bytesPerPixel + padding)
+			throw std::runtime_error("Damaged checkpoint: " + filename);
+		if (encodedSize > remaining)
+			throw std::runtime_error("Truncated checkpoint: " + filename);
+
+		std::vector<uint8_t> encoded(encodedSize);
+		file.read(reinterpret_cast<char*>(encoded.data()), encoded.size());
+		if (!file)
+			throw std::runtime_error("Truncated checkpoint: " + filename);
+
+		std::vector<uint8_t> shuffled(rawSize);
+		if (!Decode(encoded, shuffled))
+			throw std::runtime_error("Damaged checkpoint: " + filename);
+		checkpoint.Accumulation = Unshuffle(shuffled, GetElementSize(checkpoint.Format));
+		if (HashBytes(checkpoint.Accumulation.data(), checkpoint.Accumulation.size()) != rawHash)
+			throw std::runtime_error("Damaged checkpoint: " + filename);
+
+		return checkpoint;
+	}
+
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	// the worker updates this object, let the last file land before tearing down
+	Wait();
+}
+
+bool CheckpointWriter::WriteAsync(Checkpoint checkpoint, const std::string& filename)
+{
+	if (IsBusy())
+		return false;
+
+	m_Pending = std::async(std::launch::async, [this, checkpoint = std::move(checkpoint), filename]()
+		{
+			const std::string partial = filename + ".tmp";
+			try {
+				CheckpointIO::Write(partial, checkpoint);
+				std::filesystem::rename(partial, filename);
+				m_WrittenFrameCount = checkpoint.FrameIndex - checkpoint.FirstFrame;
+				++m_WrittenCount;
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Error writing checkpoint " << filename << ": " << e.what() << std::endl;
+			}
+		});
+	return true;
+}
+
+bool CheckpointWriter::IsBusy() const
+{
+	return m_Pending.valid() && m_Pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+void CheckpointWriter::Wait()
+{
+	if (m_Pending.valid())
+		m_Pending.wait();
+}
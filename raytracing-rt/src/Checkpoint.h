@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Framebuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+// State of a progressive render between two frames, enough to carry on with the same
+// result as if it had never stopped. The random sequence needs no state of its own:
+// every pixel reseeds from the seed and the frame index.
+struct Checkpoint
+{
+	uint32_t Width = 0, Height = 0;
+	// the accumulation holds the frames from FirstFrame to the next one to render, FrameIndex excluded
+	uint32_t FirstFrame = 1;
+	uint32_t FrameIndex = 1;
+	uint32_t FrameCount = 0;
+	uint32_t Seed = 0;
+	int MonteCarloNbSample = 8;
+	bool Antialiasing = true;
+	bool PrefilteredEnvironment = false;
+
+	glm::vec3 CameraPosition{ 0.0f };
+	glm::vec3 CameraDirection{ 0.0f, 0.0f, -1.0f };
+	float ApertureRadius = 0.0f;
+	float FocusDistance = 5.0f;
+	// Scene::Hash of the scene rendered, a resume on an other scene is refused
+	uint64_t SceneHash = 0;
+
+	AccumulationFormat Format = AccumulationFormat::Float;
+	// the accumulation planes byte for byte, see AccumulationBuffer::GetBytes
+	std::vector<uint8_t> Accumulation;
+};
+
+// Checkpoint files (.rtcheckpoint), little endian. The accumulation is stored byte
+// plane by byte plane and run length encoded : the exponents of neighbouring pixels
+// repeat a lot, the low mantissa bits do not compress at all.
+// Throw std::runtime_error when the file can not be written, read or is damaged.
+namespace CheckpointIO {
+
+	void Write(const std::string& filename, const Checkpoint& checkpoint);
+	Checkpoint Read(const std::string& filename);
+
+}
+
+// Compresses and writes checkpoints on a background worker, one at a time. The file is
+// written next to the target and renamed over it once complete, so a crash during a
+// write leaves the previous checkpoint intact.
+class CheckpointWriter
+{
+public:
+	CheckpointWriter() = default;
+	~CheckpointWriter();
+
+	// return false, dropping the checkpoint, if the previous one is still being written
+	bool WriteAsync(Checkpoint checkpoint, const std::string& filename);
+	bool IsBusy() const;
+	void Wait();
+
+	// number of checkpoints written to disk
+	uint32_t GetWrittenCount() const { return m_WrittenCount; }
+	// accumulated frames of the last checkpoint written to disk, 0 before the first one
+	uint32_t GetWrittenFrameCount() const { return m_WrittenFrameCount; }
+
+private:
+	std::future<void> m_Pending;
+	std::atomic<uint32_t> m_WrittenCount{ 0 };
+	std::atomic<uint32_t> m_WrittenFrameCount{ 0 };
+};
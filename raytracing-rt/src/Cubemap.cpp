@@ -0,0 +1,494 @@
+#include "Cubemap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "include/stb_image.h"
+
+#define M_PI 3.14159265358979323846  /* pi */
+
+namespace {
+
+    // stbi callbacks reading from a FILE while reporting how much has been consumed
+    struct ProgressReader
+    {
+        FILE* file;
+        long size;
+        long consumed;
+        const LoadProgressCallback* onProgress;
+
+        void report()
+        {
+            if (*onProgress && size > 0)
+                (*onProgress)((float)consumed / (float)size);
+        }
+
+        static int read(void* user, char* data, int size)
+        {
+            ProgressReader* reader = (ProgressReader*)user;
+            int n = (int)fread(data, 1, size, reader->file);
+            reader->consumed += n;
+            reader->report();
+            return n;
+        }
+
+        static void skip(void* user, int n)
+        {
+            ProgressReader* reader = (ProgressReader*)user;
+            fseek(reader->file, n, SEEK_CUR);
+            reader->consumed += n;
+            reader->report();
+        }
+
+        static int eof(void* user)
+        {
+            ProgressReader* reader = (ProgressReader*)user;
+            return feof(reader->file);
+        }
+    };
+
+    // where each face sits in the cross image, in face size units
+    const int CrossOffset[Cubemap::FaceCount][2] = {
+        { 2, 1 }, // +X right
+        { 0, 1 }, // -X left
+        { 1, 0 }, // +Y top
+        { 1, 2 }, // -Y bottom
+        { 1, 1 }, // +Z front
+        { 3, 1 }, // -Z back
+    };
+
+    // texel = direction[axis] / major * scale + (faceSize - 1) / 2
+    // scale is +-faceSize / 2, the sign orients the face as in the cross image
+    struct FaceMapping
+    {
+        int uAxis, vAxis;
+        float uSign, vSign;
+    };
+
+    const FaceMapping FaceMappings[Cubemap::FaceCount] = {
+        { 2, 1, -1.0f, -1.0f }, // +X
+        { 2, 1,  1.0f, -1.0f }, // -X
+        { 0, 2,  1.0f,  1.0f }, // +Y
+        { 0, 2,  1.0f, -1.0f }, // -Y
+        { 0, 1,  1.0f, -1.0f }, // +Z
+        { 0, 1, -1.0f, -1.0f }, // -Z
+    };
+
+    // face of direction, and the coordinates in [-1, 1] on that face plane
+    int Project(const glm::vec3& direction, float& a, float& b)
+    {
+        const glm::vec3 magnitude = glm::abs(direction);
+        const int axis = magnitude.x >= magnitude.y ? (magnitude.x >= magnitude.z ? 0 : 2) : (magnitude.y >= magnitude.z ? 1 : 2);
+        const int face = axis * 2 + (direction[axis] < 0.0f);
+        const FaceMapping& mapping = FaceMappings[face];
+
+        const float invMajor = 1.0f / magnitude[axis];
+        a = direction[mapping.uAxis] * invMajor * mapping.uSign;
+        b = direction[mapping.vAxis] * invMajor * mapping.vSign;
+        return face;
+    }
+
+    // solid angle to face plane area ratio at (a, b)
+    float Jacobian(float a, float b)
+    {
+        float d2 = 1.0f + a * a + b * b;
+        return d2 * sqrtf(d2);
+    }
+
+    float Luminance(const glm::vec3& color)
+    {
+        return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+
+    // identifies the source image a cache file was made from
+    struct CacheStamp
+    {
+        uint64_t size;
+        int64_t time;
+    };
+
+    const uint32_t CacheMagic = 0x564E4552; // "RENV"
+    const uint32_t CacheVersion = 1;
+
+    CacheStamp MakeStamp(const std::filesystem::path& path)
+    {
+        CacheStamp stamp;
+        stamp.size = std::filesystem::file_size(path);
+        stamp.time = (int64_t)std::filesystem::last_write_time(path).time_since_epoch().count();
+        return stamp;
+    }
+
+    // face size of a cubemap made from a width x height image : 2:1 images are
+    // equirectangular, anything else is read as a cross
+    int FaceSizeOf(int width, int height)
+    {
+        return width == 2 * height ? width / 4 : std::min(width / 4, height / 3);
+    }
+
+    // sets the levels of faceSize and returns the texels of all of them
+    size_t LayoutLevels(Cubemap& cubemap)
+    {
+        cubemap.levelCount = 1;
+        while ((cubemap.faceSize >> cubemap.levelCount) > 0)
+            cubemap.levelCount++;
+
+        size_t total = 0;
+        cubemap.levelOffsets.resize(cubemap.levelCount);
+        for (int level = 0; level < cubemap.levelCount; ++level) {
+            const size_t size = cubemap.GetLevelSize(level);
+            cubemap.levelOffsets[level] = total;
+            total += Cubemap::FaceCount * size * size;
+        }
+        return total;
+    }
+
+    void AllocateLevels(Cubemap& cubemap)
+    {
+        cubemap.data = std::shared_ptr<glm::vec3[]>(new glm::vec3[LayoutLevels(cubemap)]);
+    }
+
+    size_t TexelCount(const Cubemap& cubemap)
+    {
+        const size_t size = cubemap.GetLevelSize(cubemap.levelCount - 1);
+        return cubemap.levelOffsets.back() + Cubemap::FaceCount * size * size;
+    }
+
+    // false when there is no cache or it does not hold the sourceFaceSize cubemap, which is then
+    // decoded again
+    bool ReadCache(const std::filesystem::path& path, const CacheStamp& stamp, int sourceFaceSize, Cubemap& cubemap)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+
+        uint32_t magic, version;
+        CacheStamp cached;
+        int32_t faceSize;
+        file.read((char*)&magic, sizeof(magic));
+        file.read((char*)&version, sizeof(version));
+        file.read((char*)&cached, sizeof(cached));
+        file.read((char*)&faceSize, sizeof(faceSize));
+        if (!file || magic != CacheMagic || version != CacheVersion || cached.size != stamp.size || cached.time != stamp.time
+            || faceSize <= 0 || faceSize != sourceFaceSize)
+            return false;
+
+        // the texels have to fill the rest of the file exactly before anything is allocated for them
+        const std::streamoff headerEnd = file.tellg();
+        file.seekg(0, std::ios::end);
+        const uint64_t remaining = (uint64_t)(file.tellg() - headerEnd);
+        file.seekg(headerEnd);
+        Cubemap layout;
+        layout.faceSize = faceSize;
+        if (!file || remaining != LayoutLevels(layout) * sizeof(glm::vec3))
+            return false;
+
+        cubemap.faceSize = faceSize;
+        AllocateLevels(cubemap);
+        file.read((char*)cubemap.data.get(), TexelCount(cubemap) * sizeof(glm::vec3));
+        if (!file) {
+            cubemap = Cubemap();
+            return false;
+        }
+        return true;
+    }
+
+    // best effort, a failure only means the next load decodes the image again
+    void WriteCache(const std::filesystem::path& path, const CacheStamp& stamp, const Cubemap& cubemap)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(path.parent_path(), error);
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return;
+
+        const int32_t faceSize = cubemap.faceSize;
+        file.write((const char*)&CacheMagic, sizeof(CacheMagic));
+        file.write((const char*)&CacheVersion, sizeof(CacheVersion));
+        file.write((const char*)&stamp, sizeof(stamp));
+        file.write((const char*)&faceSize, sizeof(faceSize));
+        file.write((const char*)cubemap.data.get(), TexelCount(cubemap) * sizeof(glm::vec3));
+    }
+
+    // rgb float pixels, HDR images keep their range, LDR ones are mapped to [0, 1]
+    bool Decode(const std::filesystem::path& path, int& width, int& height, std::vector<float>& pixels, const LoadProgressCallback& onProgress)
+    {
+        std::string pathStr = path.string();
+        FILE* file = fopen(pathStr.c_str(), "rb");
+        if (!file)
+            return false;
+
+        ProgressReader reader{ file, (long)std::filesystem::file_size(path), 0, &onProgress };
+        stbi_io_callbacks callbacks{ ProgressReader::read, ProgressReader::skip, ProgressReader::eof };
+
+        int nchannel;
+        const bool hdr = stbi_is_hdr_from_file(file);
+        if (hdr) {
+            float* data = stbi_loadf_from_callbacks(&callbacks, &reader, &width, &height, &nchannel, 3);
+            if (data) {
+                pixels.assign(data, data + (size_t)width * height * 3);
+                stbi_image_free(data);
+            }
+        }
+        else {
+            unsigned char* data = stbi_load_from_callbacks(&callbacks, &reader, &width, &height, &nchannel, 3);
+            if (data) {
+                pixels.resize((size_t)width * height * 3);
+                for (size_t i = 0; i < pixels.size(); ++i)
+                    pixels[i] = data[i] / 255.0f;
+                stbi_image_free(data);
+            }
+        }
+        fclose(file);
+
+        return !pixels.empty();
+    }
+
+    void FromCross(const std::vector<float>& pixels, int width, Cubemap& cubemap)
+    {
+        const int size = cubemap.faceSize;
+        for (int face = 0; face < Cubemap::FaceCount; ++face) {
+            glm::vec3* texels = cubemap.data.get() + (size_t)face * size * size;
+            const int offsetX = CrossOffset[face][0] * size;
+            const int offsetY = CrossOffset[face][1] * size;
+
+            for (int y = 0; y < size; ++y) {
+                const float* row = pixels.data() + ((size_t)(offsetY + y) * width + offsetX) * 3;
+                for (int x = 0; x < size; ++x)
+                    texels[y * size + x] = glm::vec3(row[x * 3], row[x * 3 + 1], row[x * 3 + 2]);
+            }
+        }
+    }
+
+    // resample the latitude / longitude image, -Z is at its center, +Y at its top
+    void FromEquirectangular(const std::vector<float>& pixels, int width, int height, Cubemap& cubemap)
+    {
+        const auto texel = [&](int x, int y) {
+            x = (x % width + width) % width;
+            y = glm::clamp(y, 0, height - 1);
+            const float* p = pixels.data() + ((size_t)y * width + x) * 3;
+            return glm::vec3(p[0], p[1], p[2]);
+        };
+
+        const int size = cubemap.faceSize;
+        for (int face = 0; face < Cubemap::FaceCount; ++face) {
+            glm::vec3* texels = cubemap.data.get() + (size_t)face * size * size;
+            const FaceMapping& mapping = FaceMappings[face];
+            const int axis = face / 2;
+
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    glm::vec3 direction;
+                    direction[axis] = (face & 1) ? -1.0f : 1.0f;
+                    direction[mapping.uAxis] = (2.0f * (x + 0.5f) / size - 1.0f) * mapping.uSign;
+                    direction[mapping.vAxis] = (2.0f * (y + 0.5f) / size - 1.0f) * mapping.vSign;
+                    direction = glm::normalize(direction);
+
+                    const float u = (0.5f + atan2f(direction.x, -direction.z) / (2.0f * (float)M_PI)) * width - 0.5f;
+                    const float v = acosf(glm::clamp(direction.y, -1.0f, 1.0f)) / (float)M_PI * height - 0.5f;
+                    const int x0 = (int)floorf(u);
+                    const int y0 = (int)floorf(v);
+                    const float fx = u - x0;
+                    const float fy = v - y0;
+
+                    const glm::vec3 top = glm::mix(texel(x0, y0), texel(x0 + 1, y0), fx);
+                    const glm::vec3 bottom = glm::mix(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fx);
+                    texels[y * size + x] = glm::mix(top, bottom, fy);
+                }
+            }
+        }
+    }
+
+    // box filter each level into the next one
+    void BuildMips(Cubemap& cubemap)
+    {
+        for (int level = 1; level < cubemap.levelCount; ++level) {
+            const int srcSize = cubemap.GetLevelSize(level - 1);
+            const int size = cubemap.GetLevelSize(level);
+
+            for (int face = 0; face < Cubemap::FaceCount; ++face) {
+                const glm::vec3* src = cubemap.GetFace(face, level - 1);
+                glm::vec3* dst = cubemap.data.get() + cubemap.levelOffsets[level] + (size_t)face * size * size;
+
+                for (int y = 0; y < size; ++y) {
+                    const int y0 = std::min(2 * y, srcSize - 1);
+                    const int y1 = std::min(2 * y + 1, srcSize - 1);
+                    for (int x = 0; x < size; ++x) {
+                        const int x0 = std::min(2 * x, srcSize - 1);
+                        const int x1 = std::min(2 * x + 1, srcSize - 1);
+                        dst[y * size + x] = 0.25f * (src[y0 * srcSize + x0] + src[y0 * srcSize + x1] + src[y1 * srcSize + x0] + src[y1 * srcSize + x1]);
+                    }
+                }
+            }
+        }
+    }
+
+}
+
+Cubemap Cubemap::Load(const std::string& filename, const LoadProgressCallback& onProgress)
+{
+    Cubemap cubemap;
+
+    std::filesystem::path cubemapsFolder = std::filesystem::current_path() / "cubemaps";
+    std::filesystem::path fullPath = cubemapsFolder / filename;
+
+    // Ensure the scenes directory exists
+    if (!std::filesystem::exists(cubemapsFolder)) {
+        std::filesystem::create_directories(cubemapsFolder);
+        return cubemap;
+    }
+
+    if (!std::filesystem::is_regular_file(fullPath))
+        return cubemap;
+
+    const CacheStamp stamp = MakeStamp(fullPath);
+    const std::filesystem::path cachePath = cubemapsFolder / ".cache" / (filename + ".envcache");
+
+    // the header of the image is enough to know the face size the cache must have
+    int sourceWidth, sourceHeight, sourceChannels;
+    const int sourceFaceSize = stbi_info(fullPath.string().c_str(), &sourceWidth, &sourceHeight, &sourceChannels) ? FaceSizeOf(sourceWidth, sourceHeight) : 0;
+
+    if (!ReadCache(cachePath, stamp, sourceFaceSize, cubemap)) {
+        // decoding is the bulk of the work, the conversion reports the last 20%
+        const LoadProgressCallback decodeProgress = [&onProgress](float progress) {
+            if (onProgress)
+                onProgress(0.8f * progress);
+        };
+
+        int width, height;
+        std::vector<float> pixels;
+        if (!Decode(fullPath, width, height, pixels, decodeProgress))
+            return cubemap;
+
+        const bool equirectangular = width == 2 * height;
+        cubemap.faceSize = FaceSizeOf(width, height);
+        if (cubemap.faceSize <= 0)
+            return cubemap;
+
+        AllocateLevels(cubemap);
+        if (equirectangular)
+            FromEquirectangular(pixels, width, height, cubemap);
+        else
+            FromCross(pixels, width, cubemap);
+        BuildMips(cubemap);
+
+        WriteCache(cachePath, stamp, cubemap);
+    }
+
+    // the sky as a light : each texel weighted by the power it sends toward the scene
+    const int size = cubemap.faceSize;
+    std::vector<float> weights((size_t)FaceCount * size * size);
+    const float texelArea = 4.0f / ((float)size * size);
+    for (int face = 0; face < FaceCount; ++face) {
+        const glm::vec3* texels = cubemap.GetFace(face);
+        for (int y = 0; y < size; ++y) {
+            const float b = 2.0f * (y + 0.5f) / size - 1.0f;
+            for (int x = 0; x < size; ++x) {
+                const float a = 2.0f * (x + 0.5f) / size - 1.0f;
+                const size_t index = ((size_t)face * size + y) * size + x;
+                weights[index] = Luminance(texels[y * size + x]) * texelArea / Jacobian(a, b);
+            }
+        }
+    }
+    cubemap.distribution = std::make_shared<AliasTable>(weights);
+    cubemap.exist = true;
+
+    if (onProgress)
+        onProgress(1.0f);
+
+    return cubemap;
+}
+
+glm::vec3 Cubemap::Sample(const glm::vec3& direction, float lod) const
+{
+    // major axis gives the face
+    float a, b;
+    const int face = Project(direction, a, b);
+
+    if (lod <= 0.0f)
+        return SampleLevel(face, a, b, 0);
+
+    lod = std::min(lod, (float)(levelCount - 1));
+    const int level = (int)lod;
+    const float t = lod - level;
+    const glm::vec3 fine = SampleLevel(face, a, b, level);
+    if (t == 0.0f)
+        return fine;
+    return glm::mix(fine, SampleLevel(face, a, b, std::min(level + 1, levelCount - 1)), t);
+}
+
+glm::vec3 Cubemap::SampleLevel(int face, float a, float b, int level) const
+{
+    const int size = GetLevelSize(level);
+
+    // texel space coordinates, texel centers are at integer positions
+    const float halfSize = 0.5f * size;
+    float u = a * halfSize + halfSize - 0.5f;
+    float v = b * halfSize + halfSize - 0.5f;
+
+    const float maxCoord = (float)(size - 1);
+    u = glm::clamp(u, 0.0f, maxCoord);
+    v = glm::clamp(v, 0.0f, maxCoord);
+
+    const int x0 = (int)u;
+    const int y0 = (int)v;
+    const int x1 = std::min(x0 + 1, size - 1);
+    const int y1 = std::min(y0 + 1, size - 1);
+    const float fx = u - x0;
+    const float fy = v - y0;
+
+    const glm::vec3* texels = GetFace(face, level);
+    const glm::vec3 top = glm::mix(texels[y0 * size + x0], texels[y0 * size + x1], fx);
+    const glm::vec3 bottom = glm::mix(texels[y1 * size + x0], texels[y1 * size + x1], fx);
+    return glm::mix(top, bottom, fy);
+}
+
+float Cubemap::LodForSolidAngle(float solidAngle) const
+{
+    // average solid angle of a full resolution texel, each level quadruples it
+    const float texelSolidAngle = 4.0f * (float)M_PI / (FaceCount * (float)faceSize * faceSize);
+    return std::max(0.5f * std::log2(solidAngle / texelSolidAngle), 0.0f);
+}
+
+glm::vec3 Cubemap::SampleDirection(float u1, float u2, float u3, float& pdf) const
+{
+    float pmf;
+    const uint32_t index = distribution->Sample(u1, pmf);
+    const int texelsPerFace = faceSize * faceSize;
+    const int face = index / texelsPerFace;
+    const int y = (index % texelsPerFace) / faceSize;
+    const int x = index % faceSize;
+
+    // uniform point in the texel, back to a direction
+    const float a = 2.0f * (x + u2) / faceSize - 1.0f;
+    const float b = 2.0f * (y + u3) / faceSize - 1.0f;
+    const FaceMapping& mapping = FaceMappings[face];
+    const int axis = face / 2;
+
+    glm::vec3 direction;
+    direction[axis] = (face & 1) ? -1.0f : 1.0f;
+    direction[mapping.uAxis] = a * mapping.uSign;
+    direction[mapping.vAxis] = b * mapping.vSign;
+
+    const float halfSize = 0.5f * faceSize;
+    pdf = pmf * halfSize * halfSize * Jacobian(a, b);
+    return glm::normalize(direction);
+}
+
+float Cubemap::Pdf(const glm::vec3& direction) const
+{
+    float a, b;
+    const int face = Project(direction, a, b);
+
+    const float halfSize = 0.5f * faceSize;
+    const int x = glm::clamp((int)((a + 1.0f) * halfSize), 0, faceSize - 1);
+    const int y = glm::clamp((int)((b + 1.0f) * halfSize), 0, faceSize - 1);
+    const uint32_t index = ((uint32_t)face * faceSize + y) * faceSize + x;
+
+    return distribution->Pmf(index) * halfSize * halfSize * Jacobian(a, b);
+}
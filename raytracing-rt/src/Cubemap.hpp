@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "AliasTable.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// called with the loading progress in [0, 1]
+using LoadProgressCallback = std::function<void(float)>;
+
+// Sky box loaded from a cross layout image :
+//        +Y
+//    -X  +Z  +X  -Z
+//        -Y
+// or from an equirectangular (2:1) image, both LDR (png, jpg...) or HDR (Radiance .hdr).
+// The image is converted once at load time into six square float faces with their mip
+// pyramid, so a lookup only has to pick the face and filter, no decoding or bounds check
+// per ray. The converted faces are cached on disk next to the source image.
+struct Cubemap
+{
+    enum Face
+    {
+        PositiveX,
+        NegativeX,
+        PositiveY,
+        NegativeY,
+        PositiveZ,
+        NegativeZ,
+        FaceCount
+    };
+
+    bool exist = false;
+    int faceSize = 0;
+    int levelCount = 0;
+    // for each mip level, FaceCount faces of size * size rgb texels, face after face, row after row
+    std::shared_ptr<glm::vec3[]> data;
+    std::vector<size_t> levelOffsets;
+    // texels weighted by luminance times solid angle, used to sample the sky as a light
+    std::shared_ptr<const AliasTable> distribution;
+
+    static Cubemap Load(const std::string& filename, const LoadProgressCallback& onProgress = nullptr);
+
+    // filtered radiance seen in direction (does not need to be normalized)
+    // lod 0 is bilinear on the full resolution faces, above it is trilinear in the pyramid
+    glm::vec3 Sample(const glm::vec3& direction, float lod = 0.0f) const;
+    // lod at which a texel covers solidAngle steradians
+    float LodForSolidAngle(float solidAngle) const;
+
+    // importance sample a direction toward the sky, u in [0, 1)^3, pdf is per solid angle
+    glm::vec3 SampleDirection(float u1, float u2, float u3, float& pdf) const;
+    // solid angle density of SampleDirection for direction
+    float Pdf(const glm::vec3& direction) const;
+
+    int GetLevelSize(int level) const { return std::max(faceSize >> level, 1); }
+    const glm::vec3* GetFace(int face, int level = 0) const
+    {
+        const int size = GetLevelSize(level);
+        return data.get() + levelOffsets[level] + (size_t)face * size * size;
+    }
+
+private:
+    glm::vec3 SampleLevel(int face, float a, float b, int level) const;
+};
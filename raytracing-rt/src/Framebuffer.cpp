@@ -0,0 +1,352 @@
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+	const size_t PageSize = 4096;
+	const size_t HugePageSize = 2 * 1024 * 1024;
+
+	size_t RoundUp(size_t value, size_t multiple)
+	{
+		return (value + multiple - 1) / multiple * multiple;
+	}
+
+	// null when the system has no huge page for us
+	void* AllocateHugePages(size_t size)
+	{
+#if defined(_WIN32)
+		// needs the "Lock pages in memory" privilege, most accounts do not have it
+		size_t largePage = GetLargePageMinimum();
+		if (largePage == 0)
+			return nullptr;
+		return VirtualAlloc(nullptr, RoundUp(size, largePage), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#else
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED)
+			return nullptr;
+#if defined(MADV_HUGEPAGE)
+		// transparent huge pages, the kernel is free to ignore it
+		madvise(data, size, MADV_HUGEPAGE);
+#endif
+		return data;
+#endif
+	}
+
+	void FreeHugePages(void* data, size_t size)
+	{
+#if defined(_WIN32)
+		VirtualFree(data, 0, MEM_RELEASE);
+#else
+		munmap(data, size);
+#endif
+	}
+
+	void* AllocateAligned(size_t size)
+	{
+#if defined(_MSC_VER)
+		return _aligned_malloc(size, AlignedBuffer::Alignment);
+#else
+		return std::aligned_alloc(AlignedBuffer::Alignment, size);
+#endif
+	}
+
+	// IEEE half, round to nearest even, overflow goes to infinity
+	uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000u;
+		uint32_t magnitude = bits & 0x7fffffffu;
+
+		if (magnitude >= 0x7f800000u) // inf or nan
+			return (uint16_t)(sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+		if (magnitude >= 0x477ff000u) // rounds above the largest half
+			return (uint16_t)(sign | 0x7c00u);
+		if (magnitude < 0x38800000u) { // subnormal half or zero
+			if (magnitude < 0x33000000u)
+				return (uint16_t)sign;
+			uint32_t exponent = magnitude >> 23;
+			uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+			uint32_t shift = 126 - exponent;
+			uint32_t half = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t midpoint = 1u << (shift - 1);
+			if (rest > midpoint || (rest == midpoint && (half & 1u)))
+				++half;
+			return (uint16_t)(sign | half);
+		}
+
+		uint32_t half = (magnitude - 0x38000000u) >> 13;
+		uint32_t rest = magnitude & 0x1fffu;
+		if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+			++half;
+		return (uint16_t)(sign | half);
+	}
+
+	float HalfToFloat(uint16_t half)
+	{
+		uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+		uint32_t exponent = (half >> 10) & 0x1fu;
+		uint32_t mantissa = half & 0x3ffu;
+
+		uint32_t bits;
+		if (exponent == 0x1fu)
+			bits = sign | 0x7f800000u | (mantissa << 13);
+		else if (exponent != 0)
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		else if (mantissa == 0)
+			bits = sign;
+		else {
+			// subnormal, normalize it
+			exponent = 113;
+			while ((mantissa & 0x400u) == 0) {
+				mantissa <<= 1;
+				--exponent;
+			}
+			bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+		}
+
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// Ward's shared exponent : r, g, b mantissas in the low bytes, exponent in the high one
+	uint32_t EncodeRGBE(const glm::vec3& color)
+	{
+		float largest = std::max(color.r, std::max(color.g, color.b));
+		if (largest < 1e-32f)
+			return 0;
+
+		int exponent;
+		float scale = std::frexp(largest, &exponent) * 256.0f / largest;
+		uint32_t r = (uint32_t)std::max(color.r * scale, 0.0f);
+		uint32_t g = (uint32_t)std::max(color.g * scale, 0.0f);
+		uint32_t b = (uint32_t)std::max(color.b * scale, 0.0f);
+		return r | (g << 8) | (b << 16) | ((uint32_t)(exponent + 128) << 24);
+	}
+
+	glm::vec3 DecodeRGBE(uint32_t rgbe)
+	{
+		uint32_t exponent = rgbe >> 24;
+		if (exponent == 0)
+			return glm::vec3(0.0f);
+
+		// the middle of the quantization step, truncation would drift down at every add
+		float scale = std::ldexp(1.0f, (int)exponent - (128 + 8));
+		const auto channel = [scale](uint32_t mantissa) { return mantissa ? (mantissa + 0.5f) * scale : 0.0f; };
+		return glm::vec3(channel(rgbe & 0xffu), channel((rgbe >> 8) & 0xffu), channel((rgbe >> 16) & 0xffu));
+	}
+
+	void FreeAligned(void* data)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(data);
+#else
+		std::free(data);
+#endif
+	}
+
+}
+
+AlignedBuffer::~AlignedBuffer()
+{
+	Release();
+}
+
+void AlignedBuffer::Reserve(size_t size, bool hugePages)
+{
+	// huge pages only pay off above a couple of them
+	hugePages = hugePages && size >= 2 * HugePageSize;
+	if (size <= m_Capacity && hugePages == m_HugePagesRequested)
+		return;
+
+	size_t capacity = size <= m_Capacity ? m_Capacity : std::max(size, m_Capacity + m_Capacity / 2);
+	Release();
+
+	m_HugePagesRequested = hugePages;
+	if (hugePages) {
+		capacity = RoundUp(capacity, HugePageSize);
+		m_Data = AllocateHugePages(capacity);
+		m_HugePages = m_Data != nullptr;
+	}
+	if (!m_Data) {
+		capacity = RoundUp(capacity, PageSize);
+		m_Data = AllocateAligned(capacity);
+	}
+	if (!m_Data)
+		throw std::bad_alloc();
+
+	m_Capacity = capacity;
+}
+
+void AlignedBuffer::Release()
+{
+	if (m_Data) {
+		if (m_HugePages)
+			FreeHugePages(m_Data, m_Capacity);
+		else
+			FreeAligned(m_Data);
+	}
+	m_Data = nullptr;
+	m_Capacity = 0;
+	m_HugePages = false;
+}
+
+const char* GetAccumulationFormatName(AccumulationFormat format)
+{
+	switch (format) {
+	case AccumulationFormat::Float: return "Float";
+	case AccumulationFormat::Double: return "Double";
+	case AccumulationFormat::Half: return "Half";
+	case AccumulationFormat::RGBE: return "RGBE";
+	default: return "";
+	}
+}
+
+size_t GetAccumulationBytesPerPixel(AccumulationFormat format)
+{
+	switch (format) {
+	case AccumulationFormat::Float: return 3 * sizeof(float);
+	case AccumulationFormat::Double: return 3 * sizeof(double);
+	case AccumulationFormat::Half: return 3 * sizeof(uint16_t);
+	case AccumulationFormat::RGBE: return sizeof(uint32_t);
+	default: return 0;
+	}
+}
+
+void AccumulationBuffer::Resize(uint32_t pixelCount, AccumulationFormat format, bool hugePages)
+{
+	m_PixelCount = pixelCount;
+	m_Format = format;
+
+	if (format == AccumulationFormat::RGBE) {
+		m_PlaneStride = RoundUp(pixelCount, AlignedBuffer::Alignment / sizeof(uint32_t));
+		m_Buffer.Reserve(m_PlaneStride * sizeof(uint32_t), hugePages);
+		return;
+	}
+
+	size_t elementSize = GetAccumulationBytesPerPixel(format) / ChannelCount;
+	m_PlaneStride = RoundUp(pixelCount, AlignedBuffer::Alignment / elementSize);
+	m_Buffer.Reserve(m_PlaneStride * ChannelCount * elementSize, hugePages);
+}
+
+void AccumulationBuffer::Clear()
+{
+	// all zero bits is 0 in every format
+	memset(m_Buffer.As<char>(), 0, GetByteSize());
+}
+
+size_t AccumulationBuffer::GetByteSize() const
+{
+	size_t planeCount = m_Format == AccumulationFormat::RGBE ? 1 : ChannelCount;
+	size_t elementSize = m_Format == AccumulationFormat::RGBE ? sizeof(uint32_t) : GetAccumulationBytesPerPixel(m_Format) / ChannelCount;
+	return m_PlaneStride * planeCount * elementSize;
+}
+
+glm::vec3 AccumulationBuffer::Get(size_t index) const
+{
+	switch (m_Format) {
+	case AccumulationFormat::Float: {
+		const float* planes = m_Buffer.As<float>();
+		return glm::vec3(planes[index], planes[m_PlaneStride + index], planes[2 * m_PlaneStride + index]);
+	}
+	case AccumulationFormat::Double: {
+		const double* planes = m_Buffer.As<double>();
+		return glm::vec3((float)planes[index], (float)planes[m_PlaneStride + index], (float)planes[2 * m_PlaneStride + index]);
+	}
+	case AccumulationFormat::Half: {
+		const uint16_t* planes = m_Buffer.As<uint16_t>();
+		return glm::vec3(HalfToFloat(planes[index]), HalfToFloat(planes[m_PlaneStride + index]), HalfToFloat(planes[2 * m_PlaneStride + index])) * (float)m_FrameIndex;
+	}
+	case AccumulationFormat::RGBE:
+		return DecodeRGBE(m_Buffer.As<uint32_t>()[index]) * (float)m_FrameIndex;
+	default:
+		return glm::vec3(0.0f);
+	}
+}
+
+void AccumulationBuffer::AddPacked(size_t index, const glm::vec3& radiance)
+{
+	switch (m_Format) {
+	case AccumulationFormat::Double: {
+		double* planes = m_Buffer.As<double>();
+		planes[index] += radiance.r;
+		planes[m_PlaneStride + index] += radiance.g;
+		planes[2 * m_PlaneStride + index] += radiance.b;
+		break;
+	}
+	case AccumulationFormat::Half: {
+		uint16_t* planes = m_Buffer.As<uint16_t>();
+		const float weight = 1.0f / (float)m_FrameIndex;
+		for (int channel = 0; channel < ChannelCount; ++channel) {
+			uint16_t& value = planes[channel * m_PlaneStride + index];
+			float mean = HalfToFloat(value);
+			value = FloatToHalf(mean + (radiance[channel] - mean) * weight);
+		}
+		break;
+	}
+	case AccumulationFormat::RGBE: {
+		uint32_t& value = m_Buffer.As<uint32_t>()[index];
+		glm::vec3 mean = DecodeRGBE(value);
+		value = EncodeRGBE(mean + (radiance - mean) / (float)m_FrameIndex);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void AccumulationBuffer::GetRow(size_t start, uint32_t count, float* scratch, const float* channels[ChannelCount]) const
+{
+	if (m_Format == AccumulationFormat::Float) {
+		for (int channel = 0; channel < ChannelCount; ++channel)
+			channels[channel] = m_Buffer.As<float>() + channel * m_PlaneStride + start;
+		return;
+	}
+
+	for (int channel = 0; channel < ChannelCount; ++channel)
+		channels[channel] = scratch + channel * count;
+
+	switch (m_Format) {
+	case AccumulationFormat::Double:
+		for (int channel = 0; channel < ChannelCount; ++channel) {
+			const double* plane = m_Buffer.As<double>() + channel * m_PlaneStride + start;
+			for (uint32_t i = 0; i < count; ++i)
+				scratch[channel * count + i] = (float)plane[i];
+		}
+		break;
+	case AccumulationFormat::Half:
+		for (int channel = 0; channel < ChannelCount; ++channel) {
+			const uint16_t* plane = m_Buffer.As<uint16_t>() + channel * m_PlaneStride + start;
+			for (uint32_t i = 0; i < count; ++i)
+				scratch[channel * count + i] = HalfToFloat(plane[i]) * (float)m_FrameIndex;
+		}
+		break;
+	case AccumulationFormat::RGBE: {
+		const uint32_t* plane = m_Buffer.As<uint32_t>() + start;
+		for (uint32_t i = 0; i < count; ++i) {
+			glm::vec3 value = DecodeRGBE(plane[i]) * (float)m_FrameIndex;
+			scratch[i] = value.r;
+			scratch[count + i] = value.g;
+			scratch[2 * count + i] = value.b;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// Cache line aligned storage that keeps its memory across resizes : it only grows,
+// by at least half its capacity, so dragging the viewport edge does not reallocate
+// every frame. The content is not kept when it grows.
+class AlignedBuffer
+{
+public:
+	static const size_t Alignment = 64;
+
+	AlignedBuffer() = default;
+	~AlignedBuffer();
+
+	AlignedBuffer(const AlignedBuffer&) = delete;
+	AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+	// make room for size bytes, huge pages are asked for when the size is worth it,
+	// the request falls back to normal pages when the system refuses
+	void Reserve(size_t size, bool hugePages = false);
+	void Release();
+
+	template<typename T>
+	T* As() const { return reinterpret_cast<T*>(m_Data); }
+
+	size_t GetCapacity() const { return m_Capacity; }
+	bool UsesHugePages() const { return m_HugePages; }
+
+private:
+	void* m_Data = nullptr;
+	size_t m_Capacity = 0;
+	bool m_HugePages = false;
+	bool m_HugePagesRequested = false;
+};
+
+// How the accumulated sums are stored, from the most accurate to the most compact
+enum class AccumulationFormat
+{
+	Float,  // 12 bytes per pixel
+	Double, // 24 bytes, no visible precision loss over very long runs
+	Half,   // 6 bytes, about 3 significant digits, for previews
+	RGBE,   // 4 bytes, shared exponent with 8 bit mantissas, dim channels of a bright pixel get lost, for previews
+	Count
+};
+
+const char* GetAccumulationFormatName(AccumulationFormat format);
+size_t GetAccumulationBytesPerPixel(AccumulationFormat format);
+
+// Sum of the radiance of every accumulated frame. The compact formats keep the running
+// mean instead, a sum would outgrow their precision within a few hundred frames, and
+// scale it back on read. The alpha channel is not kept and each
+// channel has its own aligned plane, except RGBE that packs a pixel in one word, so the
+// resolve loops read contiguous memory.
+class AccumulationBuffer
+{
+public:
+	static const int ChannelCount = 3;
+
+	void Resize(uint32_t pixelCount, AccumulationFormat format = AccumulationFormat::Float, bool hugePages = false);
+	void Clear();
+	// number of the frame the next adds belong to, from 1
+	void BeginFrame(uint32_t frameIndex) { m_FrameIndex = frameIndex; }
+
+	AccumulationFormat GetFormat() const { return m_Format; }
+	uint32_t GetPixelCount() const { return m_PixelCount; }
+
+	void Add(size_t index, const glm::vec3& radiance)
+	{
+		if (m_Format != AccumulationFormat::Float) {
+			AddPacked(index, radiance);
+			return;
+		}
+		float* planes = m_Buffer.As<float>();
+		planes[index] += radiance.r;
+		planes[m_PlaneStride + index] += radiance.g;
+		planes[2 * m_PlaneStride + index] += radiance.b;
+	}
+
+	glm::vec3 Get(size_t index) const;
+
+	// sums of count pixels from start, one array per channel : the planes themselves for
+	// Float, decoded into scratch (3 * count floats) otherwise
+	void GetRow(size_t start, uint32_t count, float* scratch, const float* channels[ChannelCount]) const;
+
+	const AlignedBuffer& GetStorage() const { return m_Buffer; }
+	// the planes as they lie in memory, padding included, to save and restore them as is
+	size_t GetByteSize() const;
+	uint8_t* GetBytes() { return m_Buffer.As<uint8_t>(); }
+	const uint8_t* GetBytes() const { return m_Buffer.As<uint8_t>(); }
+
+private:
+	void AddPacked(size_t index, const glm::vec3& radiance);
+
+private:
+	AlignedBuffer m_Buffer;
+	AccumulationFormat m_Format = AccumulationFormat::Float;
+	uint32_t m_PixelCount = 0;
+	uint32_t m_FrameIndex = 1;
+	// elements between two planes, rounded up to keep every plane aligned
+	size_t m_PlaneStride = 0;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+#include "BVH.h"
+#include "Ray.h"
+
+// Bottom level of the scene : primitives under their own BVH, in their own object space.
+// Built once and never changed, so every instance placing it in a scene shares it.
+// Rays reach it through the inverse transform of an instance, their direction is not
+// normalized and the distances along them are those of the world ray.
+class Geometry
+{
+public:
+	struct Hit
+	{
+		uint32_t Primitive = 0;
+		// where on the primitive, the meaning is up to the geometry
+		float U = 0.0f, V = 0.0f;
+	};
+
+	virtual ~Geometry() = default;
+
+	// closest hit in [tMin, tMax], lowers tMax when one is found. steps counts the BVH
+	// nodes visited, tests the primitives tested
+	virtual bool Intersect(const Ray& ray, float tMin, float& tMax, Hit& hit, uint32_t& steps, uint32_t& tests) const = 0;
+	// unit normal at the hit, position in object space
+	virtual glm::vec3 GetNormal(const Hit& hit, const glm::vec3& position) const = 0;
+	// material of the primitive hit, -1 when it is the instance's
+	virtual int GetMaterialIndex(const Hit& /*hit*/) const { return -1; }
+
+	virtual size_t GetPrimitiveCount() const = 0;
+	virtual BVH::Bounds GetBounds() const = 0;
+	// of the primitives, computed once at construction
+	virtual uint64_t GetHash() const = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// 64 bit hash of a byte range, eight bytes per step. Only meant to tell contents apart
+// (scene identity, checkpoint integrity), not for hash tables and not cryptographic.
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 0x9e3779b97f4a7c15ULL)
+{
+	const auto mix = [](uint64_t hash, uint64_t word) {
+		hash ^= word * 0xff51afd7ed558ccdULL;
+		hash = (hash << 31) | (hash >> 33);
+		return hash * 0xc4ceb9fe1a85ec53ULL;
+	};
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+		hash = mix(hash, word);
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, bytes + i, size - i);
+	// the length keeps "ab" and "ab\0" apart
+	return mix(mix(hash, tail), size);
+}
@@ -0,0 +1,79 @@
+#include "ImageIO.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace ImageIO {
+
+	void WritePFM(const std::string& filename, uint32_t width, uint32_t height, int channels, const float* data)
+	{
+		if (channels != 1 && channels != 3)
+			throw std::runtime_error("PFM only holds 1 or 3 channels: " + filename);
+
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file for writing: " + filename);
+
+		// negative scale means little endian
+		file << (channels == 3 ? "PF" : "Pf") << "\n" << width << " " << height << "\n-1.0\n";
+
+		// PFM stores its scanlines bottom to top as well
+		file.write(reinterpret_cast<const char*>(data), (size_t)width * height * channels * sizeof(float));
+	}
+
+	std::vector<float> ReadPFM(const std::string& filename, uint32_t& width, uint32_t& height, int& channels)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file for reading: " + filename);
+
+		std::string magic;
+		float scale = 0.0f;
+		file >> magic >> width >> height >> scale;
+		if (!file || (magic != "PF" && magic != "Pf") || scale >= 0.0f)
+			throw std::runtime_error("Not a little endian PFM file: " + filename);
+		file.get(); // single whitespace before the data
+
+		channels = magic == "PF" ? 3 : 1;
+		std::vector<float> data((size_t)width * height * channels);
+		file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+		if (!file)
+			throw std::runtime_error("Truncated PFM file: " + filename);
+		return data;
+	}
+
+	void WritePPM(const std::string& filename, uint32_t width, uint32_t height, const uint32_t* rgba)
+	{
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file for writing: " + filename);
+
+		file << "P6\n" << width << " " << height << "\n255\n";
+
+		std::vector<uint8_t> row(width * 3);
+		for (uint32_t y = height; y-- > 0;) {
+			for (uint32_t x = 0; x < width; ++x) {
+				uint32_t pixel = rgba[x + y * width];
+				row[x * 3 + 0] = pixel & 0xff;
+				row[x * 3 + 1] = (pixel >> 8) & 0xff;
+				row[x * 3 + 2] = (pixel >> 16) & 0xff;
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+	}
+
+	void WritePPM(const std::string& filename, uint32_t width, uint32_t height, const float* rgb)
+	{
+		// same clamp and rounding as the renderer's resolve
+		std::vector<uint32_t> rgba((size_t)width * height);
+		for (size_t i = 0; i < rgba.size(); ++i) {
+			uint32_t r = (uint32_t)(std::min(std::max(rgb[i * 3 + 0], 0.0f), 1.0f) * 255.0f);
+			uint32_t g = (uint32_t)(std::min(std::max(rgb[i * 3 + 1], 0.0f), 1.0f) * 255.0f);
+			uint32_t b = (uint32_t)(std::min(std::max(rgb[i * 3 + 2], 0.0f), 1.0f) * 255.0f);
+			rgba[i] = 0xff000000u | (b << 16) | (g << 8) | r;
+		}
+		WritePPM(filename, width, height, rgba.data());
+	}
+}
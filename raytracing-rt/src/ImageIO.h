@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Plain image files, readable by most viewers without pulling a codec in.
+// Rows are given bottom to top like the renderer stores them, throw std::runtime_error when a file can not be read or written.
+namespace ImageIO {
+
+	// float image, 1 (grayscale) or 3 (rgb) channels interleaved
+	void WritePFM(const std::string& filename, uint32_t width, uint32_t height, int channels, const float* data);
+
+	// reads what WritePFM wrote (little endian only), channels is set to 1 or 3
+	std::vector<float> ReadPFM(const std::string& filename, uint32_t& width, uint32_t& height, int& channels);
+
+	// 8 bit rgb from the renderer's RGBA pixels, alpha is dropped
+	void WritePPM(const std::string& filename, uint32_t width, uint32_t height, const uint32_t* rgba);
+	// 8 bit rgb from linear rgb floats interleaved, clamped to [0, 1]
+	void WritePPM(const std::string& filename, uint32_t width, uint32_t height, const float* rgb);
+}
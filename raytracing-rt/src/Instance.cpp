@@ -0,0 +1,60 @@
+#include "Instance.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+void Instance::UpdateTransform()
+{
+	ObjectToWorld = glm::translate(glm::mat4(1.0f), Position);
+	ObjectToWorld = glm::rotate(ObjectToWorld, glm::radians(Rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+	ObjectToWorld = glm::rotate(ObjectToWorld, glm::radians(Rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+	ObjectToWorld = glm::rotate(ObjectToWorld, glm::radians(Rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+	ObjectToWorld = glm::scale(ObjectToWorld, glm::vec3(Scale));
+	WorldToObject = glm::inverse(ObjectToWorld);
+}
+
+Ray Instance::ToObject(const Ray& ray) const
+{
+	// distances along the ray stay the same, the direction is left unnormalized for that
+	Ray local;
+	local.Origin = glm::vec3(WorldToObject * glm::vec4(ray.Origin, 1.0f));
+	local.Direction = glm::vec3(WorldToObject * glm::vec4(ray.Direction, 0.0f));
+	local.Time = ray.Time;
+	return local;
+}
+
+BVH::Bounds Instance::GetWorldBounds() const
+{
+	BVH::Bounds world;
+	if (!Shape)
+		return world;
+
+	const BVH::Bounds local = Shape->GetBounds();
+	for (int corner = 0; corner < 8; ++corner) {
+		glm::vec3 p((corner & 1) ? local.Max.x : local.Min.x, (corner & 2) ? local.Max.y : local.Min.y, (corner & 4) ? local.Max.z : local.Min.z);
+		world.Grow(glm::vec3(ObjectToWorld * glm::vec4(p, 1.0f)));
+	}
+	return world;
+}
+
+InstanceBVH::InstanceBVH(const std::vector<Instance>& instances, const BVHBuildOptions& options)
+{
+	std::vector<BVH::Bounds> bounds(instances.size());
+	for (size_t i = 0; i < instances.size(); ++i)
+		bounds[i] = instances[i].GetWorldBounds();
+	m_BVH.Build(bounds, m_Order, options);
+}
+
+bool InstanceBVH::Intersect(const std::vector<Instance>& instances, const Ray& ray, float tMin, float& tMax, Hit& hit, uint32_t& steps, uint32_t& tests) const
+{
+	bool found = false;
+	m_BVH.Traverse(ray, tMin, tMax, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			const Instance& instance = instances[m_Order[i]];
+			if (instance.Shape && instance.Shape->Intersect(instance.ToObject(ray), tMin, tMax, hit.Primitive, steps, tests)) {
+				hit.Instance = m_Order[i];
+				found = true;
+			}
+		}
+	}, steps);
+	return found;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BVH.h"
+#include "Geometry.h"
+#include "Ray.h"
+
+// A placement of shared geometry in the scene : a mesh or a cluster of spheres, moved,
+// rotated and scaled. Thousands of instances of a model only store the model once.
+struct Instance
+{
+	enum class Kind
+	{
+		Mesh,
+		Cluster
+	};
+
+	Kind Type = Kind::Mesh;
+	// OBJ file of a mesh, relative to the scenes folder, or name of a cluster of the scene
+	std::string Source;
+	// meshes are drawn with it, the spheres of a cluster keep their own
+	int MaterialIndex = 0;
+
+	glm::vec3 Position{ 0.0f };
+	glm::vec3 Rotation{ 0.0f }; // degrees around x, then y, then z
+	float Scale = 1.0f;
+
+	std::shared_ptr<const Geometry> Shape;
+
+	// from the position, rotation and scale, by UpdateTransform
+	glm::mat4 ObjectToWorld{ 1.0f };
+	glm::mat4 WorldToObject{ 1.0f };
+
+	void UpdateTransform();
+	Ray ToObject(const Ray& ray) const;
+	// world bounds of the transformed geometry
+	BVH::Bounds GetWorldBounds() const;
+};
+
+// Top level of the scene : a BVH over the world bounds of the instances, each one
+// holding the bottom level BVH of its geometry. Rays are moved into the object space
+// of an instance before going down its geometry. Built by Scene::Prepare
+class InstanceBVH
+{
+public:
+	struct Hit
+	{
+		uint32_t Instance = 0;
+		Geometry::Hit Primitive;
+	};
+
+	InstanceBVH() = default;
+	// the transforms have to be up to date
+	explicit InstanceBVH(const std::vector<Instance>& instances, const BVHBuildOptions& options = BVHBuildOptions());
+
+	bool Empty() const { return m_BVH.Empty(); }
+
+	// closest hit in [tMin, tMax] among instances, the vector the tree was built from
+	bool Intersect(const std::vector<Instance>& instances, const Ray& ray, float tMin, float& tMax, Hit& hit, uint32_t& steps, uint32_t& tests) const;
+
+private:
+	BVH m_BVH;
+	// instance of each leaf entry
+	std::vector<uint32_t> m_Order;
+};
@@ -0,0 +1,291 @@
+#include "LightBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define M_PI 3.14159265358979323846  /* pi */
+
+namespace {
+
+	float luminance(const glm::vec3& color)
+	{
+		return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	float surfaceArea(const glm::vec3& min, const glm::vec3& max)
+	{
+		glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// cos(max(a - b, 0)) from the cosines of a and b, both in [0, pi]
+	float cosSubClamped(float cosA, float cosB)
+	{
+		if (cosA >= cosB)
+			return 1.0f;
+		float sinA = sqrtf(std::max(0.0f, 1.0f - cosA * cosA));
+		float sinB = sqrtf(std::max(0.0f, 1.0f - cosB * cosB));
+		return cosA * cosB + sinA * sinB;
+	}
+
+}
+
+bool LightBVH::MakeLight(const std::vector<Sphere>& spheres, const std::vector<Material>& materials, uint32_t sphereIndex, LightInfo& light)
+{
+	const Sphere& sphere = spheres[sphereIndex];
+	if (sphere.MaterialIndex < 0 || sphere.MaterialIndex >= (int)materials.size())
+		return false;
+
+	// a diffuse emitter sends pi * L per unit area
+	float radiance = luminance(materials[sphere.MaterialIndex].GetEmission());
+	float area = 4.0f * (float)M_PI * sphere.Radius * sphere.Radius;
+	if (radiance <= 0.0f || area <= 0.0f)
+		return false;
+
+	light.SphereIndex = sphereIndex;
+	light.BoundsMin = sphere.Position - glm::vec3(sphere.Radius);
+	light.BoundsMax = sphere.Position + glm::vec3(sphere.Radius);
+	light.Centroid = sphere.Position;
+	light.Power = (float)M_PI * area * radiance;
+	return true;
+}
+
+LightBVH::LightBVH(const std::vector<Sphere>& spheres, const std::vector<Material>& materials)
+{
+	m_LeafOfSphere.assign(spheres.size(), -1);
+
+	std::vector<LightInfo> lights;
+	for (size_t i = 0; i < spheres.size(); ++i) {
+		LightInfo light;
+		if (MakeLight(spheres, materials, (uint32_t)i, light))
+			lights.push_back(light);
+	}
+
+	m_LightCount = (uint32_t)lights.size();
+	if (lights.empty())
+		return;
+
+	m_Nodes.reserve(2 * lights.size() - 1);
+	Build(lights, 0, lights.size(), -1);
+}
+
+int32_t LightBVH::Build(std::vector<LightInfo>& lights, size_t begin, size_t end, int32_t parent)
+{
+	const int32_t index = (int32_t)m_Nodes.size();
+	m_Nodes.emplace_back();
+
+	glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+	glm::vec3 centroidMin = boundsMin, centroidMax = boundsMax;
+	float power = 0.0f;
+	for (size_t i = begin; i < end; ++i) {
+		boundsMin = glm::min(boundsMin, lights[i].BoundsMin);
+		boundsMax = glm::max(boundsMax, lights[i].BoundsMax);
+		centroidMin = glm::min(centroidMin, lights[i].Centroid);
+		centroidMax = glm::max(centroidMax, lights[i].Centroid);
+		power += lights[i].Power;
+	}
+
+	{
+		Node& node = m_Nodes[index];
+		node.BoundsMin = boundsMin;
+		node.BoundsMax = boundsMax;
+		node.Power = power;
+		node.Parent = parent;
+		// spheres emit toward every direction, so do their groups
+		node.Axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		node.CosThetaO = -1.0f;
+		node.CosThetaE = 0.0f;
+	}
+
+	if (end - begin == 1) {
+		m_Nodes[index].SphereIndex = (int32_t)lights[begin].SphereIndex;
+		m_LeafOfSphere[lights[begin].SphereIndex] = index;
+		return index;
+	}
+
+	// binned split along the widest centroid axis, minimizing power times surface area
+	// (the orientation term of the heuristic is the same for every sphere cone)
+	glm::vec3 extent = centroidMax - centroidMin;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	size_t mid = (begin + end) / 2;
+	if (extent[axis] > 0.0f) {
+		const int BinCount = 12;
+		struct Bin
+		{
+			glm::vec3 Min{ std::numeric_limits<float>::max() };
+			glm::vec3 Max{ -std::numeric_limits<float>::max() };
+			float Power = 0.0f;
+		} bins[BinCount];
+
+		const auto binOf = [&](const LightInfo& light) {
+			int b = (int)(BinCount * (light.Centroid[axis] - centroidMin[axis]) / extent[axis]);
+			return std::min(b, BinCount - 1);
+		};
+		for (size_t i = begin; i < end; ++i) {
+			Bin& bin = bins[binOf(lights[i])];
+			bin.Min = glm::min(bin.Min, lights[i].BoundsMin);
+			bin.Max = glm::max(bin.Max, lights[i].BoundsMax);
+			bin.Power += lights[i].Power;
+		}
+
+		float bestCost = std::numeric_limits<float>::max();
+		int bestSplit = -1;
+		for (int split = 1; split < BinCount; ++split) {
+			Bin left, right;
+			for (int b = 0; b < split; ++b) {
+				left.Min = glm::min(left.Min, bins[b].Min);
+				left.Max = glm::max(left.Max, bins[b].Max);
+				left.Power += bins[b].Power;
+			}
+			for (int b = split; b < BinCount; ++b) {
+				right.Min = glm::min(right.Min, bins[b].Min);
+				right.Max = glm::max(right.Max, bins[b].Max);
+				right.Power += bins[b].Power;
+			}
+			if (left.Power <= 0.0f || right.Power <= 0.0f)
+				continue;
+
+			float cost = left.Power * surfaceArea(left.Min, left.Max) + right.Power * surfaceArea(right.Min, right.Max);
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestSplit = split;
+			}
+		}
+
+		if (bestSplit > 0) {
+			auto it = std::partition(lights.begin() + begin, lights.begin() + end,
+				[&](const LightInfo& light) { return binOf(light) < bestSplit; });
+			mid = it - lights.begin();
+		}
+	}
+
+	// degenerated split, fall back to the median
+	if (mid == begin || mid == end) {
+		mid = (begin + end) / 2;
+		std::nth_element(lights.begin() + begin, lights.begin() + mid, lights.begin() + end,
+			[axis](const LightInfo& a, const LightInfo& b) { return a.Centroid[axis] < b.Centroid[axis]; });
+	}
+
+	int32_t left = Build(lights, begin, mid, index);
+	int32_t right = Build(lights, mid, end, index);
+	m_Nodes[index].Left = left;
+	m_Nodes[index].Right = right;
+	return index;
+}
+
+float LightBVH::Importance(const Node& node, const glm::vec3& p, const glm::vec3& n) const
+{
+	// distance to the cluster, clamped so points inside do not blow up
+	glm::vec3 center = 0.5f * (node.BoundsMin + node.BoundsMax);
+	glm::vec3 toCenter = center - p;
+	float d2 = glm::dot(toCenter, toCenter);
+	float radius2 = glm::dot(node.BoundsMax - center, node.BoundsMax - center);
+	float clampedD2 = std::max(d2, radius2);
+
+	// half angle of the bounding sphere seen from p
+	float cosThetaU = -1.0f;
+	if (d2 > radius2)
+		cosThetaU = sqrtf(std::max(0.0f, 1.0f - radius2 / d2));
+
+	glm::vec3 wi = d2 > 0.0f ? toCenter / sqrtf(d2) : glm::vec3(0.0f);
+
+	// can the emitters face p ?
+	float cosOrientation = 1.0f;
+	if (node.CosThetaO > -1.0f) {
+		float cosTheta = glm::dot(node.Axis, -wi);
+		float cosThetaX = cosSubClamped(cosTheta, node.CosThetaO);
+		cosOrientation = cosSubClamped(cosThetaX, cosThetaU);
+		if (cosOrientation <= node.CosThetaE)
+			return 0.0f;
+	}
+
+	// is the cluster above the surface ?
+	float cosSurface = 1.0f;
+	if (n != glm::vec3(0.0f) && cosThetaU > -1.0f) {
+		float cosThetaI = glm::clamp(glm::dot(n, wi), -1.0f, 1.0f);
+		cosSurface = cosSubClamped(cosThetaI, cosThetaU);
+		if (cosSurface <= 0.0f)
+			return 0.0f;
+	}
+
+	return node.Power * cosOrientation * cosSurface / clampedD2;
+}
+
+bool LightBVH::Sample(const glm::vec3& p, const glm::vec3& n, float u, uint32_t& sphereIndex, float& pmf) const
+{
+	if (m_Nodes.empty())
+		return false;
+
+	int32_t index = 0;
+	pmf = 1.0f;
+	while (m_Nodes[index].SphereIndex < 0) {
+		const Node& node = m_Nodes[index];
+		float left = Importance(m_Nodes[node.Left], p, n);
+		float right = Importance(m_Nodes[node.Right], p, n);
+		if (left + right <= 0.0f)
+			return false;
+
+		// pick a child and remap u to keep using it below
+		float pLeft = left / (left + right);
+		if (u < pLeft) {
+			u = std::min(u / pLeft, 0.99999994f);
+			pmf *= pLeft;
+			index = node.Left;
+		}
+		else {
+			u = std::min((u - pLeft) / (1.0f - pLeft), 0.99999994f);
+			pmf *= 1.0f - pLeft;
+			index = node.Right;
+		}
+	}
+
+	sphereIndex = (uint32_t)m_Nodes[index].SphereIndex;
+	return true;
+}
+
+float LightBVH::Pmf(const glm::vec3& p, const glm::vec3& n, uint32_t sphereIndex) const
+{
+	if (sphereIndex >= m_LeafOfSphere.size() || m_LeafOfSphere[sphereIndex] < 0)
+		return 0.0f;
+
+	// walk back to the root, multiplying the choices made at each parent
+	float pmf = 1.0f;
+	int32_t index = m_LeafOfSphere[sphereIndex];
+	while (m_Nodes[index].Parent >= 0) {
+		const Node& parent = m_Nodes[m_Nodes[index].Parent];
+		float left = Importance(m_Nodes[parent.Left], p, n);
+		float right = Importance(m_Nodes[parent.Right], p, n);
+		if (left + right <= 0.0f)
+			return 0.0f;
+
+		pmf *= (parent.Left == index ? left : right) / (left + right);
+		index = m_Nodes[index].Parent;
+	}
+	return pmf;
+}
+
+bool LightBVH::Refit(const std::vector<Sphere>& spheres, const std::vector<Material>& materials, uint32_t sphereIndex)
+{
+	LightInfo light;
+	if (sphereIndex >= m_LeafOfSphere.size() || m_LeafOfSphere[sphereIndex] < 0 || !MakeLight(spheres, materials, sphereIndex, light))
+		return false;
+
+	int32_t index = m_LeafOfSphere[sphereIndex];
+	m_Nodes[index].BoundsMin = light.BoundsMin;
+	m_Nodes[index].BoundsMax = light.BoundsMax;
+	m_Nodes[index].Power = light.Power;
+
+	// the split stays where it was, only the bounds and the power of the groups follow
+	while (m_Nodes[index].Parent >= 0) {
+		index = m_Nodes[index].Parent;
+		Node& node = m_Nodes[index];
+		const Node& left = m_Nodes[node.Left];
+		const Node& right = m_Nodes[node.Right];
+		node.BoundsMin = glm::min(left.BoundsMin, right.BoundsMin);
+		node.BoundsMax = glm::max(left.BoundsMax, right.BoundsMax);
+		node.Power = left.Power + right.Power;
+	}
+	return true;
+}
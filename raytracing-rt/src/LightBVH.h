@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Material.hpp"
+#include "Sphere.hpp"
+
+// Hierarchy over the emissive spheres used to pick a light for next event estimation.
+// Every node keeps the bounds, the total power and a bounding cone of the emission
+// directions of its lights. Going down, a child is chosen in proportion to the
+// contribution it could bring to the shading point, so distant, dim or hidden groups
+// of lights are rarely picked whatever their number.
+class LightBVH
+{
+public:
+	LightBVH() = default;
+	LightBVH(const std::vector<Sphere>& spheres, const std::vector<Material>& materials);
+
+	bool Empty() const { return m_Nodes.empty(); }
+	uint32_t GetLightCount() const { return m_LightCount; }
+
+	// pick a light for the point p of normal n (n = 0 for no orientation),
+	// u in [0, 1), return false if no light can contribute
+	bool Sample(const glm::vec3& p, const glm::vec3& n, float u, uint32_t& sphereIndex, float& pmf) const;
+	// probability of Sample picking sphereIndex from p, n
+	float Pmf(const glm::vec3& p, const glm::vec3& n, uint32_t sphereIndex) const;
+
+	// the light spheres[sphereIndex] moved or changed radius : updates its leaf and the nodes
+	// above it. Return false when it is not a light of the tree or stopped emitting, the tree
+	// has to be built again then
+	bool Refit(const std::vector<Sphere>& spheres, const std::vector<Material>& materials, uint32_t sphereIndex);
+
+private:
+	// angles are stored as cosines, a cone with CosThetaO = -1 covers every direction
+	struct Node
+	{
+		glm::vec3 BoundsMin;
+		glm::vec3 BoundsMax;
+		glm::vec3 Axis;
+		float CosThetaO; // spread of the emitter normals around Axis
+		float CosThetaE; // spread of the emission around a normal
+		float Power;
+
+		int32_t Left = -1;
+		int32_t Right = -1;
+		int32_t Parent = -1;
+		int32_t SphereIndex = -1; // leaf when >= 0
+	};
+
+	struct LightInfo
+	{
+		uint32_t SphereIndex;
+		glm::vec3 BoundsMin;
+		glm::vec3 BoundsMax;
+		glm::vec3 Centroid;
+		float Power;
+	};
+
+	// false if the sphere does not emit
+	static bool MakeLight(const std::vector<Sphere>& spheres, const std::vector<Material>& materials, uint32_t sphereIndex, LightInfo& light);
+	int32_t Build(std::vector<LightInfo>& lights, size_t begin, size_t end, int32_t parent);
+	float Importance(const Node& node, const glm::vec3& p, const glm::vec3& n) const;
+
+private:
+	std::vector<Node> m_Nodes;
+	// node of each sphere, -1 if the sphere does not emit
+	std::vector<int32_t> m_LeafOfSphere;
+	uint32_t m_LightCount = 0;
+};
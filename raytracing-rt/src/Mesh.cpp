@@ -0,0 +1,290 @@
+#include "Mesh.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "Hash.h"
+
+namespace {
+
+	// ray in the frame where it runs along +z from the origin, after Woop, Benthin and Wald,
+	// "Watertight Ray/Triangle Intersection" : the edge tests only depend on the two
+	// vertices of the edge, so neighbour triangles agree on which side a ray passes
+	struct ShearedRay
+	{
+		glm::vec3 Origin;
+		int Kx, Ky, Kz;
+		float Sx, Sy, Sz;
+
+		explicit ShearedRay(const Ray& ray)
+			: Origin(ray.Origin)
+		{
+			glm::vec3 d = glm::abs(ray.Direction);
+			Kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+			Kx = (Kz + 1) % 3;
+			Ky = (Kx + 1) % 3;
+			// keep the winding
+			if (ray.Direction[Kz] < 0.0f)
+				std::swap(Kx, Ky);
+			Sx = ray.Direction[Kx] / ray.Direction[Kz];
+			Sy = ray.Direction[Ky] / ray.Direction[Kz];
+			Sz = 1.0f / ray.Direction[Kz];
+		}
+	};
+
+	// t and the barycentrics u, v of the second and third vertex
+	bool IntersectTriangle(const ShearedRay& ray, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float tMin, float tMax, float& t, float& u, float& v)
+	{
+		const glm::vec3 A = a - ray.Origin;
+		const glm::vec3 B = b - ray.Origin;
+		const glm::vec3 C = c - ray.Origin;
+
+		const float Ax = A[ray.Kx] - ray.Sx * A[ray.Kz];
+		const float Ay = A[ray.Ky] - ray.Sy * A[ray.Kz];
+		const float Bx = B[ray.Kx] - ray.Sx * B[ray.Kz];
+		const float By = B[ray.Ky] - ray.Sy * B[ray.Kz];
+		const float Cx = C[ray.Kx] - ray.Sx * C[ray.Kz];
+		const float Cy = C[ray.Ky] - ray.Sy * C[ray.Kz];
+
+		float U = Cx * By - Cy * Bx;
+		float V = Ax * Cy - Ay * Cx;
+		float W = Bx * Ay - By * Ax;
+		// exactly on an edge in float, settle it in double
+		if (U == 0.0f || V == 0.0f || W == 0.0f) {
+			U = (float)((double)Cx * By - (double)Cy * Bx);
+			V = (float)((double)Ax * Cy - (double)Ay * Cx);
+			W = (float)((double)Bx * Ay - (double)By * Ax);
+		}
+
+		// both faces are hit
+		if ((U < 0.0f || V < 0.0f || W < 0.0f) && (U > 0.0f || V > 0.0f || W > 0.0f))
+			return false;
+		const float det = U + V + W;
+		if (det == 0.0f)
+			return false;
+
+		const float T = U * ray.Sz * A[ray.Kz] + V * ray.Sz * B[ray.Kz] + W * ray.Sz * C[ray.Kz];
+		// t = T / det in range, without the division
+		if (det > 0.0f ? (T < tMin * det || T > tMax * det) : (T > tMin * det || T < tMax * det))
+			return false;
+
+		const float invDet = 1.0f / det;
+		t = T * invDet;
+		u = V * invDet;
+		v = W * invDet;
+		return true;
+	}
+
+	// 1 based, negative ones count back from the last vertex read. 0 if there is none
+	int64_t ParseIndex(const char*& p, size_t count)
+	{
+		char* end;
+		long long index = strtoll(p, &end, 10);
+		if (end == p)
+			return 0;
+		p = end;
+		if (index < 0)
+			index += (long long)count + 1;
+		return index;
+	}
+
+}
+
+Mesh::Mesh(std::vector<glm::vec3> positions, std::vector<glm::vec3> normals, std::vector<uint32_t> indices)
+	: m_Positions(std::move(positions)), m_Normals(std::move(normals)), m_Indices(std::move(indices))
+{
+	if (m_Indices.size() % 3 != 0)
+		throw std::runtime_error("Mesh indices do not make whole triangles");
+	if (!m_Normals.empty() && m_Normals.size() != m_Positions.size())
+		throw std::runtime_error("Mesh normals do not match its positions");
+	for (uint32_t index : m_Indices)
+		if (index >= m_Positions.size())
+			throw std::runtime_error("Mesh index out of its vertices");
+
+	const size_t triangleCount = GetTriangleCount();
+	std::vector<BVH::Bounds> bounds(triangleCount);
+	for (size_t i = 0; i < triangleCount; ++i)
+		for (int k = 0; k < 3; ++k)
+			bounds[i].Grow(m_Positions[m_Indices[3 * i + k]]);
+
+	std::vector<uint32_t> order;
+	m_BVH.Build(bounds, order);
+
+	std::vector<uint32_t> sorted(m_Indices.size());
+	for (size_t i = 0; i < triangleCount; ++i)
+		for (int k = 0; k < 3; ++k)
+			sorted[3 * i + k] = m_Indices[3 * order[i] + k];
+	m_Indices = std::move(sorted);
+
+	m_Hash = HashBytes(m_Positions.data(), m_Positions.size() * sizeof(glm::vec3));
+	m_Hash = HashBytes(m_Normals.data(), m_Normals.size() * sizeof(glm::vec3), m_Hash);
+	m_Hash = HashBytes(m_Indices.data(), m_Indices.size() * sizeof(uint32_t), m_Hash);
+}
+
+std::shared_ptr<const Mesh> Mesh::LoadOBJ(const std::string& filename, const LoadProgressCallback& onProgress)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Could not open file for reading: " + filename);
+
+	// read by chunks so the progress can be reported, parsing and the BVH take the rest
+	const size_t size = std::filesystem::file_size(filename);
+	std::string content(size, '\0');
+	const size_t chunkSize = 1 << 20;
+	for (size_t offset = 0; offset < size; offset += chunkSize) {
+		file.read(&content[offset], std::min(chunkSize, size - offset));
+		if (onProgress)
+			onProgress(0.3f * (float)std::min(offset + chunkSize, size) / (float)size);
+	}
+	file.close();
+
+	std::vector<glm::vec3> positions, normals;
+	// position and normal index of every triangle corner, the normal one is -1 when missing
+	std::vector<std::pair<uint32_t, int64_t>> corners;
+	bool everyCornerHasNormal = true;
+	std::vector<std::pair<uint32_t, int64_t>> polygon;
+
+	const char* p = content.c_str();
+	const char* const end = p + content.size();
+	size_t lineNumber = 0;
+	while (p < end) {
+		const char* lineEnd = p;
+		while (lineEnd < end && *lineEnd != '\n')
+			++lineEnd;
+		++lineNumber;
+
+		while (p < lineEnd && (*p == ' ' || *p == '\t'))
+			++p;
+		if (p + 1 < lineEnd && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+			char* next;
+			glm::vec3 v;
+			v.x = strtof(p + 2, &next);
+			v.y = strtof(next, &next);
+			v.z = strtof(next, &next);
+			positions.push_back(v);
+		}
+		else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+			char* next;
+			glm::vec3 n;
+			n.x = strtof(p + 3, &next);
+			n.y = strtof(next, &next);
+			n.z = strtof(next, &next);
+			normals.push_back(n);
+		}
+		else if (p + 1 < lineEnd && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+			// v, v/vt, v//vn or v/vt/vn
+			polygon.clear();
+			const char* q = p + 2;
+			for (;;) {
+				while (q < lineEnd && (*q == ' ' || *q == '\t' || *q == '\r'))
+					++q;
+				if (q >= lineEnd)
+					break;
+
+				int64_t position = ParseIndex(q, positions.size());
+				int64_t normal = 0;
+				if (q < lineEnd && *q == '/') {
+					++q;
+					if (q < lineEnd && *q != '/')
+						ParseIndex(q, 0);
+					if (q < lineEnd && *q == '/') {
+						++q;
+						normal = ParseIndex(q, normals.size());
+						if (normal < 1 || normal > (int64_t)normals.size())
+							throw std::runtime_error("Missing normal in face at line " + std::to_string(lineNumber) + ": " + filename);
+					}
+				}
+				if (position < 1 || position > (int64_t)positions.size())
+					throw std::runtime_error("Missing vertex in face at line " + std::to_string(lineNumber) + ": " + filename);
+				everyCornerHasNormal &= normal > 0;
+				polygon.emplace_back((uint32_t)(position - 1), normal - 1);
+				while (q < lineEnd && *q != ' ' && *q != '\t' && *q != '\r')
+					++q;
+			}
+			for (size_t i = 2; i < polygon.size(); ++i) {
+				corners.push_back(polygon[0]);
+				corners.push_back(polygon[i - 1]);
+				corners.push_back(polygon[i]);
+			}
+		}
+		p = lineEnd + 1;
+	}
+	content.clear();
+	content.shrink_to_fit();
+	if (onProgress)
+		onProgress(0.6f);
+
+	std::vector<uint32_t> indices(corners.size());
+	if (!everyCornerHasNormal || normals.empty()) {
+		// flat shaded, the positions are the vertices
+		for (size_t i = 0; i < corners.size(); ++i)
+			indices[i] = corners[i].first;
+		normals.clear();
+	}
+	else {
+		// one vertex per position and normal pair in use
+		std::vector<glm::vec3> vertexPositions, vertexNormals;
+		std::unordered_map<uint64_t, uint32_t> vertexOf;
+		vertexOf.reserve(positions.size());
+		for (size_t i = 0; i < corners.size(); ++i) {
+			uint64_t key = ((uint64_t)corners[i].first << 32) | (uint64_t)corners[i].second;
+			auto inserted = vertexOf.emplace(key, (uint32_t)vertexPositions.size());
+			if (inserted.second) {
+				vertexPositions.push_back(positions[corners[i].first]);
+				vertexNormals.push_back(normals[(size_t)corners[i].second]);
+			}
+			indices[i] = inserted.first->second;
+		}
+		positions = std::move(vertexPositions);
+		normals = std::move(vertexNormals);
+	}
+	corners.clear();
+	corners.shrink_to_fit();
+
+	std::shared_ptr<const Mesh> mesh = std::make_shared<Mesh>(std::move(positions), std::move(normals), std::move(indices));
+	if (onProgress)
+		onProgress(1.0f);
+	return mesh;
+}
+
+bool Mesh::Intersect(const Ray& ray, float tMin, float& tMax, Hit& hit, uint32_t& steps, uint32_t& tests) const
+{
+	const ShearedRay sheared(ray);
+	bool found = false;
+	m_BVH.Traverse(ray, tMin, tMax, [&](uint32_t first, uint32_t count) {
+		tests += count;
+		for (uint32_t i = first; i < first + count; ++i) {
+			const uint32_t* triangle = &m_Indices[3 * i];
+			float t, u, v;
+			if (IntersectTriangle(sheared, m_Positions[triangle[0]], m_Positions[triangle[1]], m_Positions[triangle[2]], tMin, tMax, t, u, v)) {
+				tMax = t;
+				hit.Primitive = i;
+				hit.U = u;
+				hit.V = v;
+				found = true;
+			}
+		}
+	}, steps);
+	return found;
+}
+
+glm::vec3 Mesh::GetNormal(const Hit& hit, const glm::vec3& /*position*/) const
+{
+	const uint32_t* triangle = &m_Indices[3 * hit.Primitive];
+	const glm::vec3& a = m_Positions[triangle[0]];
+	glm::vec3 geometric = glm::cross(m_Positions[triangle[1]] - a, m_Positions[triangle[2]] - a);
+	geometric = glm::normalize(geometric);
+	if (m_Normals.empty())
+		return geometric;
+
+	glm::vec3 shading = (1.0f - hit.U - hit.V) * m_Normals[triangle[0]] + hit.U * m_Normals[triangle[1]] + hit.V * m_Normals[triangle[2]];
+	float length = glm::length(shading);
+	if (!(length > 0.0f))
+		return geometric;
+	shading /= length;
+	return glm::dot(shading, geometric) < 0.0f ? -shading : shading;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BVH.h"
+#include "Cubemap.hpp"
+#include "Geometry.h"
+#include "Ray.h"
+
+// Triangle mesh in indexed vertex buffers, with its own BVH.
+// The triangles are kept in the order of the BVH leaves : the constructor may reorder
+// the indices it is given, and building from the reordered ones changes nothing.
+// A hit gives the triangle and the barycentric weights U, V of its second and third vertex.
+class Mesh : public Geometry
+{
+public:
+	// 3 indices per triangle. normals is empty or holds one normal per position
+	Mesh(std::vector<glm::vec3> positions, std::vector<glm::vec3> normals, std::vector<uint32_t> indices);
+
+	// v, vn and f lines of a Wavefront OBJ file, polygons are split into fans.
+	// Throws std::runtime_error if the file can not be read or refers to a missing vertex
+	static std::shared_ptr<const Mesh> LoadOBJ(const std::string& filename, const LoadProgressCallback& onProgress = nullptr);
+
+	// closest triangle hit in [tMin, tMax], lowers tMax when one is found.
+	// Watertight : a ray through an edge or a vertex shared by triangles hits one of them
+	bool Intersect(const Ray& ray, float tMin, float& tMax, Hit& hit, uint32_t& steps, uint32_t& tests) const override;
+
+	// interpolated when the mesh has vertex normals. On the side of the triangle
+	// winding, so it points outward on a closed mesh wound counterclockwise
+	glm::vec3 GetNormal(const Hit& hit, const glm::vec3& position) const override;
+
+	size_t GetPrimitiveCount() const override { return GetTriangleCount(); }
+	size_t GetTriangleCount() const { return m_Indices.size() / 3; }
+	const std::vector<glm::vec3>& GetPositions() const { return m_Positions; }
+	const std::vector<glm::vec3>& GetNormals() const { return m_Normals; }
+	const std::vector<uint32_t>& GetIndices() const { return m_Indices; }
+	BVH::Bounds GetBounds() const override { return m_BVH.GetBounds(); }
+	uint64_t GetHash() const override { return m_Hash; }
+
+private:
+	std::vector<glm::vec3> m_Positions;
+	std::vector<glm::vec3> m_Normals;
+	std::vector<uint32_t> m_Indices;
+	BVH m_BVH;
+	uint64_t m_Hash = 0;
+};
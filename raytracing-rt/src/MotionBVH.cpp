@@ -0,0 +1,137 @@
+#include "MotionBVH.h"
+
+#include <cmath>
+#include <limits>
+
+MotionBVH::MotionBVH(const std::vector<MovingSphere>& spheres, const BVHBuildOptions& options)
+{
+	std::vector<BVH::Bounds> swept(spheres.size());
+	for (size_t i = 0; i < spheres.size(); ++i) {
+		const MovingSphere& sphere = spheres[i];
+		swept[i].Grow(glm::min(sphere.Position, sphere.EndPosition) - glm::vec3(sphere.Radius));
+		swept[i].Grow(glm::max(sphere.Position, sphere.EndPosition) + glm::vec3(sphere.Radius));
+	}
+	BVH tree;
+	tree.Build(swept, m_Order, options);
+
+	// the children come after their parent, so backwards every node finds its children done
+	const std::vector<BVH::Node>& nodes = tree.GetNodes();
+	m_Nodes.resize(nodes.size());
+	for (size_t n = nodes.size(); n-- > 0;) {
+		Node& node = m_Nodes[n];
+		node.Offset = nodes[n].Offset;
+		node.Count = nodes[n].Count;
+		BVH::Bounds open, close;
+		if (node.Count > 0) {
+			for (uint32_t i = node.Offset; i < node.Offset + node.Count; ++i) {
+				const MovingSphere& sphere = spheres[m_Order[i]];
+				open.Grow(sphere.Position - glm::vec3(sphere.Radius));
+				open.Grow(sphere.Position + glm::vec3(sphere.Radius));
+				close.Grow(sphere.EndPosition - glm::vec3(sphere.Radius));
+				close.Grow(sphere.EndPosition + glm::vec3(sphere.Radius));
+			}
+		}
+		else {
+			for (uint32_t child : { (uint32_t)n + 1, node.Offset }) {
+				const Node& childNode = m_Nodes[child];
+				open.Grow(BVH::Bounds{ childNode.BoundsMin, childNode.BoundsMax });
+				close.Grow(BVH::Bounds{ childNode.BoundsMin + childNode.MotionMin, childNode.BoundsMax + childNode.MotionMax });
+			}
+		}
+		node.BoundsMin = open.Min;
+		node.BoundsMax = open.Max;
+		node.MotionMin = close.Min - open.Min;
+		node.MotionMax = close.Max - open.Max;
+	}
+}
+
+float MotionBVH::IntersectNode(const Node& node, float time, const glm::vec3& origin, const glm::vec3& invDirection, float tMin, float tMax)
+{
+	// per axis as BVH::IntersectBox, the box lerped on the way
+	float enter = tMin, exit = tMax;
+	for (int axis = 0; axis < 3; ++axis) {
+		const float boundsMin = node.BoundsMin[axis] + time * node.MotionMin[axis];
+		const float boundsMax = node.BoundsMax[axis] + time * node.MotionMax[axis];
+		const float t0 = (boundsMin - origin[axis]) * invDirection[axis], t1 = (boundsMax - origin[axis]) * invDirection[axis];
+		enter = std::max(enter, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+	}
+	return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+bool MotionBVH::Intersect(const std::vector<MovingSphere>& spheres, const Ray& ray, float tMin, float& tMax, int& sphereIndex, uint32_t& steps, uint32_t& tests) const
+{
+	if (m_Nodes.empty())
+		return false;
+
+	const float infinity = std::numeric_limits<float>::infinity();
+	const glm::vec3 invDirection = 1.0f / ray.Direction;
+	++steps;
+	if (IntersectNode(m_Nodes[0], ray.Time, ray.Origin, invDirection, tMin, tMax) == infinity)
+		return false;
+
+	const float a = glm::dot(ray.Direction, ray.Direction);
+	bool found = false;
+
+	// as BVH::Traverse, nearest child first
+	struct Pending
+	{
+		uint32_t Node;
+		float Distance;
+	} stack[BVH::MaxDepth];
+	uint32_t stackSize = 0;
+	uint32_t current = 0;
+	for (;;) {
+		const Node& node = m_Nodes[current];
+		if (node.Count > 0) {
+			tests += node.Count;
+			for (uint32_t i = node.Offset; i < node.Offset + node.Count; ++i) {
+				const MovingSphere& sphere = spheres[m_Order[i]];
+				glm::vec3 origin = ray.Origin - sphere.GetPosition(ray.Time);
+
+				float b = 2.0f * glm::dot(origin, ray.Direction);
+				float c = glm::dot(origin, origin) - sphere.Radius * sphere.Radius;
+				float discriminant = b * b - 4.0f * a * c;
+				if (discriminant < 0.0f)
+					continue;
+
+				float t = (-b - sqrtf(discriminant)) / (2.0f * a);
+				if (t < tMin)
+					t = (-b + sqrtf(discriminant)) / (2.0f * a);
+				if (t < tMin || t >= tMax)
+					continue;
+
+				tMax = t;
+				sphereIndex = (int)m_Order[i];
+				found = true;
+			}
+		}
+		else {
+			uint32_t nearChild = current + 1, farChild = node.Offset;
+			steps += 2;
+			float tNear = IntersectNode(m_Nodes[nearChild], ray.Time, ray.Origin, invDirection, tMin, tMax);
+			float tFar = IntersectNode(m_Nodes[farChild], ray.Time, ray.Origin, invDirection, tMin, tMax);
+			if (tFar < tNear) {
+				std::swap(nearChild, farChild);
+				std::swap(tNear, tFar);
+			}
+			if (tNear != infinity) {
+				if (tFar != infinity)
+					stack[stackSize++] = { farChild, tFar };
+				current = nearChild;
+				continue;
+			}
+		}
+
+		// skip the subtrees a closer hit made out of reach
+		for (;;) {
+			if (stackSize == 0)
+				return found;
+			const Pending& pending = stack[--stackSize];
+			if (pending.Distance <= tMax) {
+				current = pending.Node;
+				break;
+			}
+		}
+	}
+}
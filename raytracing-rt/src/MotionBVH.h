@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+#include "Ray.h"
+#include "Sphere.hpp"
+
+// BVH over the moving spheres, for motion blur. Each node keeps its box at the opening and at
+// the closing of the shutter. A sphere moving in a straight line stays inside the interpolation
+// of its two boxes, and so does every node, so a ray only tests the boxes at its own time :
+// they are about as tight as a static tree's, where a tree over the swept boxes would get
+// looser the faster the spheres move. The shape of the tree is a BVH built over the swept boxes.
+class MotionBVH
+{
+public:
+	MotionBVH() = default;
+	explicit MotionBVH(const std::vector<MovingSphere>& spheres, const BVHBuildOptions& options = BVHBuildOptions());
+
+	bool Empty() const { return m_Nodes.empty(); }
+
+	// closest hit in [tMin, tMax] at the time of the ray among spheres, the vector the tree was
+	// built from. Hits closer than tMin are skipped for the far side of the sphere
+	bool Intersect(const std::vector<MovingSphere>& spheres, const Ray& ray, float tMin, float& tMax, int& sphereIndex, uint32_t& steps, uint32_t& tests) const;
+
+private:
+	// as BVH::Node, the box when the shutter opens and how much it moves until it closes
+	struct Node
+	{
+		glm::vec3 BoundsMin;
+		uint32_t Offset;
+		glm::vec3 BoundsMax;
+		uint32_t Count;
+		glm::vec3 MotionMin;
+		glm::vec3 MotionMax;
+	};
+
+	// entry distance in the box of node at time, infinity when the ray misses it in [tMin, tMax]
+	static float IntersectNode(const Node& node, float time, const glm::vec3& origin, const glm::vec3& invDirection, float tMin, float tMax);
+
+private:
+	std::vector<Node> m_Nodes;
+	// sphere of each leaf entry
+	std::vector<uint32_t> m_Order;
+};
@@ -2,7 +2,11 @@
 
 
 namespace CustomRand {
-    // Declare thread_local variables
-    thread_local std::mt19937 CustomRand::mersenneTwister{ std::random_device{}() };
-    thread_local std::uniform_real_distribution<double> CustomRand::uniform(0.0, 1.0);
-}
\ No newline at end of file
+    // threads that are never reseeded still get their own sequence
+    thread_local Pcg32 generator = [] {
+        std::random_device device;
+        Pcg32 pcg;
+        pcg.seed(((uint64_t)device() << 32) | device(), device());
+        return pcg;
+    }();
+}
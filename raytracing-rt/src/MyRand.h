@@ -1,13 +1,43 @@
 #pragma once
+#include <cstdint>
 #include <random>
 
 namespace CustomRand {
+    // PCG32 (O'Neill), small state so it can be reseeded for every pixel
+    struct Pcg32
+    {
+        uint64_t state = 0x853c49e6748fea9bULL;
+        uint64_t inc = 0xda3e39cb94b95bdbULL;
+
+        void seed(uint64_t initState, uint64_t sequence)
+        {
+            state = 0;
+            inc = (sequence << 1u) | 1u;
+            next();
+            state += initState;
+            next();
+        }
+
+        uint32_t next()
+        {
+            uint64_t old = state;
+            state = old * 6364136223846793005ULL + inc;
+            uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+            uint32_t rot = (uint32_t)(old >> 59u);
+            return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31u));
+        }
+    };
+
     // Declare thread_local variables
-    extern thread_local std::mt19937 mersenneTwister;
-    extern thread_local std::uniform_real_distribution<double> uniform;
+    extern thread_local Pcg32 generator;
+
+    // the same (seed, stream) pair gives the same values whatever thread runs it
+    inline void seed(uint64_t seed, uint64_t stream) {
+        generator.seed(seed, stream);
+    }
 
     // Function to get a random value in [0, 1)
     inline float uniform_random_value() {
-        return uniform(mersenneTwister);
+        return (float)(generator.next() >> 8) * (1.0f / 16777216.0f);
     }
 }
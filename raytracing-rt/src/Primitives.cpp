@@ -0,0 +1,226 @@
+#include "Primitives.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+namespace {
+
+	glm::vec3 UnitNormal(const glm::vec3& normal)
+	{
+		// a normal dragged to 0 in the editor still makes a plane
+		float length = glm::length(normal);
+		return length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	// kept finite, a slab at 0 would otherwise be 0 * infinity away on axis aligned rays
+	glm::vec3 SafeInverse(const glm::vec3& direction)
+	{
+		glm::vec3 inverse;
+		for (int axis = 0; axis < 3; ++axis) {
+			float d = direction[axis];
+			inverse[axis] = 1.0f / (std::abs(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f));
+		}
+		return inverse;
+	}
+
+	// entry distance in the box, or the exit one from inside it, to go through glass
+	bool IntersectSlabs(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec3& origin, const glm::vec3& invDirection, float tMin, float& tMax)
+	{
+		glm::vec3 t0 = (boxMin - origin) * invDirection;
+		glm::vec3 t1 = (boxMax - origin) * invDirection;
+		glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+		float tEnter = std::max(std::max(tNear.x, tNear.y), tNear.z);
+		float tExit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		if (tEnter > tExit)
+			return false;
+		float t = tEnter > tMin ? tEnter : tExit;
+		if (t <= tMin || t >= tMax)
+			return false;
+		tMax = t;
+		return true;
+	}
+
+	// face of the box position is on, in the space of the box
+	glm::vec3 BoxNormal(const glm::vec3& local, const glm::vec3& halfSize)
+	{
+		glm::vec3 d = glm::abs(local) / glm::max(halfSize, glm::vec3(1e-20f));
+		int axis = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+		glm::vec3 normal(0.0f);
+		normal[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+		return normal;
+	}
+
+}
+
+PrimitiveSet::PrimitiveSet(const std::vector<Plane>& planes, const std::vector<Box>& boxes, const std::vector<Disk>& disks, const std::vector<Sdf>& sdfs, const BVHBuildOptions& options)
+{
+	m_Planes.reserve(planes.size());
+	for (const Plane& plane : planes) {
+		glm::vec3 normal = UnitNormal(plane.Normal);
+		m_Planes.push_back({ normal, glm::dot(normal, plane.Point), plane.MaterialIndex });
+	}
+
+	std::vector<BVH::Bounds> bounds;
+	std::vector<Tag> tags;
+	for (const Box& box : boxes) {
+		BVH::Bounds boxBounds;
+		if (box.Rotation == glm::vec3(0.0f)) {
+			glm::vec3 halfSize = glm::abs(box.HalfSize);
+			tags.push_back(MakeTag(PrimitiveType::AlignedBox, (uint32_t)m_AlignedBoxes.size()));
+			m_AlignedBoxes.push_back({ box.Center - halfSize, box.Center + halfSize, box.MaterialIndex });
+			boxBounds.Grow(box.Center - halfSize);
+			boxBounds.Grow(box.Center + halfSize);
+		}
+		else {
+			// as Instance::UpdateTransform
+			glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(box.Rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+			rotation = glm::rotate(rotation, glm::radians(box.Rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+			rotation = glm::rotate(rotation, glm::radians(box.Rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+			const glm::mat3 boxToWorld(rotation);
+			const glm::vec3 halfSize = glm::abs(box.HalfSize);
+			tags.push_back(MakeTag(PrimitiveType::OrientedBox, (uint32_t)m_OrientedBoxes.size()));
+			m_OrientedBoxes.push_back({ box.Center, halfSize, glm::transpose(boxToWorld), box.MaterialIndex });
+			// the extent along a world axis sums the half sizes projected on it
+			glm::vec3 extent(0.0f);
+			for (int axis = 0; axis < 3; ++axis)
+				extent += glm::abs(boxToWorld[axis]) * halfSize[axis];
+			boxBounds.Grow(box.Center - extent);
+			boxBounds.Grow(box.Center + extent);
+		}
+		bounds.push_back(boxBounds);
+	}
+	for (const Disk& disk : disks) {
+		glm::vec3 normal = UnitNormal(disk.Normal);
+		tags.push_back(MakeTag(PrimitiveType::Disk, (uint32_t)m_Disks.size()));
+		m_Disks.push_back({ disk.Center, normal, disk.Radius * disk.Radius, disk.MaterialIndex });
+		glm::vec3 extent = std::abs(disk.Radius) * glm::sqrt(glm::max(glm::vec3(1.0f) - normal * normal, glm::vec3(0.0f)));
+		BVH::Bounds diskBounds;
+		diskBounds.Grow(disk.Center - extent);
+		diskBounds.Grow(disk.Center + extent);
+		bounds.push_back(diskBounds);
+	}
+	m_Sdfs.reserve(sdfs.size());
+	for (const Sdf& sdf : sdfs) {
+		tags.push_back(MakeTag(PrimitiveType::Sdf, (uint32_t)m_Sdfs.size()));
+		m_Sdfs.push_back({ SdfProgram(sdf.Root), sdf.MaterialIndex });
+		bounds.push_back(m_Sdfs.back().Program.GetBounds());
+	}
+
+	if (bounds.empty())
+		return;
+	std::vector<uint32_t> order;
+	m_BVH.Build(bounds, order, options);
+	m_Tags.resize(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		m_Tags[i] = tags[order[i]];
+}
+
+bool PrimitiveSet::Intersect(const Ray& ray, float tMin, float& tMax, Tag& hit, uint32_t& steps, uint32_t& tests) const
+{
+	bool found = false;
+
+	// one loop over the planes, no branch but the closest hit
+	for (uint32_t i = 0; i < (uint32_t)m_Planes.size(); ++i) {
+		const PlaneData& plane = m_Planes[i];
+		float t = (plane.Offset - glm::dot(plane.Normal, ray.Origin)) / glm::dot(plane.Normal, ray.Direction);
+		if (t > tMin && t < tMax) {
+			tMax = t;
+			hit = MakeTag(PrimitiveType::Plane, i);
+			found = true;
+		}
+	}
+	tests += (uint32_t)m_Planes.size();
+
+	if (m_Tags.empty())
+		return found;
+	const glm::vec3 invDirection = SafeInverse(ray.Direction);
+	m_BVH.Traverse(ray, tMin, tMax, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			if (IntersectBounded(m_Tags[i], ray, invDirection, tMin, tMax, tests)) {
+				hit = m_Tags[i];
+				found = true;
+			}
+		}
+		tests += count;
+	}, steps);
+	return found;
+}
+
+bool PrimitiveSet::IntersectBounded(Tag tag, const Ray& ray, const glm::vec3& invDirection, float tMin, float& tMax, uint32_t& tests) const
+{
+	const uint32_t index = GetIndex(tag);
+	switch (GetType(tag)) {
+	case PrimitiveType::AlignedBox:
+		return IntersectAlignedBox(m_AlignedBoxes[index], ray, invDirection, tMin, tMax);
+	case PrimitiveType::OrientedBox:
+		return IntersectOrientedBox(m_OrientedBoxes[index], ray, tMin, tMax);
+	case PrimitiveType::Disk:
+		return IntersectDisk(m_Disks[index], ray, tMin, tMax);
+	case PrimitiveType::Sdf:
+		return m_Sdfs[index].Program.Intersect(ray, tMin, tMax, tests);
+	default:
+		return false;
+	}
+}
+
+bool PrimitiveSet::IntersectAlignedBox(const AlignedBoxData& box, const Ray& ray, const glm::vec3& invDirection, float tMin, float& tMax) const
+{
+	return IntersectSlabs(box.Min, box.Max, ray.Origin, invDirection, tMin, tMax);
+}
+
+bool PrimitiveSet::IntersectOrientedBox(const OrientedBoxData& box, const Ray& ray, float tMin, float& tMax) const
+{
+	// the rotation keeps the distances along the ray
+	glm::vec3 origin = box.WorldToBox * (ray.Origin - box.Center);
+	glm::vec3 direction = box.WorldToBox * ray.Direction;
+	return IntersectSlabs(-box.HalfSize, box.HalfSize, origin, SafeInverse(direction), tMin, tMax);
+}
+
+bool PrimitiveSet::IntersectDisk(const DiskData& disk, const Ray& ray, float tMin, float& tMax) const
+{
+	float t = glm::dot(disk.Center - ray.Origin, disk.Normal) / glm::dot(ray.Direction, disk.Normal);
+	if (!(t > tMin && t < tMax))
+		return false;
+	glm::vec3 offset = ray.Origin + t * ray.Direction - disk.Center;
+	if (glm::dot(offset, offset) > disk.RadiusSquared)
+		return false;
+	tMax = t;
+	return true;
+}
+
+glm::vec3 PrimitiveSet::GetNormal(Tag hit, const glm::vec3& position) const
+{
+	const uint32_t index = GetIndex(hit);
+	switch (GetType(hit)) {
+	case PrimitiveType::Plane:
+		return m_Planes[index].Normal;
+	case PrimitiveType::AlignedBox: {
+		const AlignedBoxData& box = m_AlignedBoxes[index];
+		return BoxNormal(position - 0.5f * (box.Min + box.Max), 0.5f * (box.Max - box.Min));
+	}
+	case PrimitiveType::OrientedBox: {
+		const OrientedBoxData& box = m_OrientedBoxes[index];
+		// the inverse of the rotation is its transpose
+		return glm::transpose(box.WorldToBox) * BoxNormal(box.WorldToBox * (position - box.Center), box.HalfSize);
+	}
+	case PrimitiveType::Disk:
+		return m_Disks[index].Normal;
+	case PrimitiveType::Sdf:
+		return m_Sdfs[index].Program.GetNormal(position);
+	default:
+		return glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+}
+
+int PrimitiveSet::GetMaterialIndex(Tag hit) const
+{
+	const uint32_t index = GetIndex(hit);
+	switch (GetType(hit)) {
+	case PrimitiveType::Plane: return m_Planes[index].MaterialIndex;
+	case PrimitiveType::AlignedBox: return m_AlignedBoxes[index].MaterialIndex;
+	case PrimitiveType::OrientedBox: return m_OrientedBoxes[index].MaterialIndex;
+	case PrimitiveType::Disk: return m_Disks[index].MaterialIndex;
+	case PrimitiveType::Sdf: return m_Sdfs[index].MaterialIndex;
+	default: return 0;
+	}
+}
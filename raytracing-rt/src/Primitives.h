@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+#include "Ray.h"
+#include "Sdf.h"
+
+// Flat shapes spheres only approximate : an unbounded plane for a floor or a wall, boxes and disks.
+// Edited and saved as they are, the renderer intersects the PrimitiveSet made of them.
+struct Plane
+{
+	glm::vec3 Point{ 0.0f };
+	glm::vec3 Normal{ 0.0f, 1.0f, 0.0f };
+	int MaterialIndex = 0;
+};
+
+struct Box
+{
+	glm::vec3 Center{ 0.0f };
+	glm::vec3 HalfSize{ 0.5f };
+	glm::vec3 Rotation{ 0.0f }; // degrees around x, then y, then z, as the instances. Axis aligned when 0
+	int MaterialIndex = 0;
+};
+
+struct Disk
+{
+	glm::vec3 Center{ 0.0f };
+	glm::vec3 Normal{ 0.0f, 1.0f, 0.0f };
+	float Radius = 0.5f;
+	int MaterialIndex = 0;
+};
+
+enum class PrimitiveType : uint8_t
+{
+	Plane,
+	AlignedBox,
+	OrientedBox,
+	Disk,
+	Sdf,
+	Count
+};
+
+// The planes, boxes, disks and SDFs of a scene as the renderer intersects them, built by Scene::Prepare.
+// Each type has its own array of what its test needs and its own test. A hit is a tag holding
+// the type and the index in that array, the tests, normals and materials are picked by a switch
+// on the type : no virtual call, unlike the instanced geometry.
+// The planes are unbounded and all tested, the others are under a BVH of tags.
+class PrimitiveSet
+{
+public:
+	using Tag = uint32_t;
+
+	static Tag MakeTag(PrimitiveType type, uint32_t index) { return (uint32_t)type << TypeShift | index; }
+	static PrimitiveType GetType(Tag tag) { return (PrimitiveType)(tag >> TypeShift); }
+	static uint32_t GetIndex(Tag tag) { return tag & ((1u << TypeShift) - 1); }
+
+	PrimitiveSet() = default;
+	// throws std::runtime_error for an SDF SdfProgram can not compile
+	PrimitiveSet(const std::vector<Plane>& planes, const std::vector<Box>& boxes, const std::vector<Disk>& disks, const std::vector<Sdf>& sdfs, const BVHBuildOptions& options = BVHBuildOptions());
+
+	bool Empty() const { return m_Planes.empty() && m_Tags.empty(); }
+
+	// closest hit in [tMin, tMax], lowers tMax
+	bool Intersect(const Ray& ray, float tMin, float& tMax, Tag& hit, uint32_t& steps, uint32_t& tests) const;
+	// outward unit normal at position, on the front side of a plane or a disk
+	glm::vec3 GetNormal(Tag hit, const glm::vec3& position) const;
+	int GetMaterialIndex(Tag hit) const;
+
+private:
+	static const uint32_t TypeShift = 29;
+
+	struct PlaneData
+	{
+		glm::vec3 Normal;
+		float Offset; // along the normal, from the world origin
+		int MaterialIndex;
+	};
+
+	struct AlignedBoxData
+	{
+		glm::vec3 Min;
+		glm::vec3 Max;
+		int MaterialIndex;
+	};
+
+	struct OrientedBoxData
+	{
+		glm::vec3 Center;
+		glm::vec3 HalfSize;
+		// rows are the axes of the box
+		glm::mat3 WorldToBox;
+		int MaterialIndex;
+	};
+
+	struct DiskData
+	{
+		glm::vec3 Center;
+		glm::vec3 Normal;
+		float RadiusSquared;
+		int MaterialIndex;
+	};
+
+	struct SdfData
+	{
+		SdfProgram Program;
+		int MaterialIndex;
+	};
+
+	// invDirection is kept finite for the slabs of the aligned boxes, the SDFs add their steps to tests
+	bool IntersectBounded(Tag tag, const Ray& ray, const glm::vec3& invDirection, float tMin, float& tMax, uint32_t& tests) const;
+	bool IntersectAlignedBox(const AlignedBoxData& box, const Ray& ray, const glm::vec3& invDirection, float tMin, float& tMax) const;
+	bool IntersectOrientedBox(const OrientedBoxData& box, const Ray& ray, float tMin, float& tMax) const;
+	bool IntersectDisk(const DiskData& disk, const Ray& ray, float tMin, float& tMax) const;
+
+private:
+	std::vector<PlaneData> m_Planes;
+	std::vector<AlignedBoxData> m_AlignedBoxes;
+	std::vector<OrientedBoxData> m_OrientedBoxes;
+	std::vector<DiskData> m_Disks;
+	std::vector<SdfData> m_Sdfs;
+
+	// the boxes, disks and SDFs in leaf order
+	BVH m_BVH;
+	std::vector<Tag> m_Tags;
+};
@@ -6,4 +6,6 @@ struct Ray
 {
 	glm::vec3 Origin;
 	glm::vec3 Direction;
+	// in the shutter interval, 0 when it opens and 1 when it closes
+	float Time = 0.0f;
 };
\ No newline at end of file
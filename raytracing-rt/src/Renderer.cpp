@@ -1,13 +1,18 @@
 #include "Camera.h"
 #include "Renderer.h"
 #include "Scene.hpp"
-#include "Walnut/Random.h"
 #include <execution>
 #include <glm/gtx/component_wise.hpp>
 #include "Sampler.h"
 #include "MyRand.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "ImageIO.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <stdexcept>
 
 #define eps 0.0001f
 #define M_PI 3.14159265358979323846  /* pi */
@@ -17,128 +22,105 @@
 namespace Utils {
 
 
-	glm::vec3 backgroundColor(const Ray& ray, const Cubemap& Cubemap)
+	glm::vec3 backgroundColor(const Ray& ray, const Cubemap& Cubemap, float lod = 0.0f)
 	{
 		if (!Cubemap.exist) {
 			return glm::vec3(0.5f, 0.6f, 0.8f);
 		}
 		// with sky box :
+		return Cubemap.Sample(ray.Direction, lod);
+	}
 
-		// get the face
-
-		float X = ray.Direction.x;
-		float Y = ray.Direction.y;
-		float Z = ray.Direction.z;
-		float abs_x = abs(X);
-		float abs_y = abs(Y);
-		float abs_z = abs(Z);
-		float coo = std::max(std::max(abs_x, abs_y), abs_z);
-
-		glm::vec3 red = glm::vec3(1.0f, 0.0f, 0.0f);
-		glm::vec3 green = glm::vec3(0.0f, 1.0f, 0.0f);
-		glm::vec3 blue = glm::vec3(0.0f, 0.0f, 1.0f);
-		glm::vec3 yellow = glm::vec3(1.0f, 1.0f, 0.0f);
-		glm::vec3 magenta = glm::vec3(1.0f, 0.0f, 1.0f);
-		glm::vec3 cyan = glm::vec3(0.0f, 1.0f, 1.0f);
-		glm::vec3 res;
-
-		// coo in the square
-		float u;
-		float v;
-
-		// get the square of the cross image
-		int offset_x;
-		int offset_y;
-
-		int square_size_x = Cubemap.width / 4;
-		int square_size_y = Cubemap.height / 3;
-
-		// to range between -1 and 1
-		float x = X / coo;
-		float y = Y / coo;
-		float z = Z / coo;
-
-		if (coo == Y)
-		{
-			// top
-			u = fmod((x + 1.0f), 2.0f) / 2.0f;
-			v = fmod((1.0f - z), 2.0f) / 2.0f;
-			offset_x = 1;
-			offset_y = 0;
-			res = blue;
-		}
-		else if (coo == -Y)
-		{
-			// bottom
-			u = fmod((x + 1.0f), 2.0f) / 2.0f;
-			v = fmod((z + 1.0f), 2.0f) / 2.0f;
-			offset_x = 1;
-			offset_y = 2;
-			res = magenta;
-		}
-		else if (coo == Z)
-		{
-			// front
-			u = fmod((x + 1.0f), 2.0f) / 2.0f;
-			v = fmod((y + 1.0f), 2.0f) / 2.0f;
-			offset_x = 1;
-			offset_y = 1;
-			res = green;
-		}
-		else if (coo == -Z)
-		{
-			// back
-			u = fmod((1.0f - x), 2.0f) / 2.0f;
-			v = fmod((y + 1.0f), 2.0f) / 2.0f;
-			offset_x = 3;
-			offset_y = 1;
-			res = cyan;
-		}
-		else if (coo == X)
-		{
-			// right
-			u = fmod((1.0f - z), 2.0f) / 2.0f;
-			v = fmod((y + 1.0f), 2.0f) / 2.0f;
-			offset_x = 2;
-			offset_y = 1;
-			res = red;
-		}
-		else
-		{
-			// left
-			u = fmod((z + 1.0f), 2.0f) / 2.0f;
-			v = fmod((y + 1.0f), 2.0f) / 2.0f;
-			offset_x = 0;
-			offset_y = 1;
-			res = yellow;
-		}
 
-		v = 1.0f - v;
 
-		offset_x *= square_size_x;
-		offset_y *= square_size_y;
+	// MIS weight of a sample from the strategy with pdf, against the other one
+	static float powerHeuristic(float pdf, float otherPdf)
+	{
+		// from the ratio, the squares overflow for the tiny cones of lights seen from far away,
+		// as from a grazing hit on a plane
+		float ratio = otherPdf / pdf;
+		return 1.0f / (1.0f + ratio * ratio);
+	}
+
+	// solid angle pdf of a direction sampled uniformly in the cone of the sphere seen from p
+	// 0 when p is inside the sphere
+	static float sphereConePdf(const glm::vec3& p, const Sphere& sphere)
+	{
+		glm::vec3 toCenter = sphere.Position - p;
+		float sin2ThetaMax = sphere.Radius * sphere.Radius / glm::dot(toCenter, toCenter);
+		if (sin2ThetaMax >= 1.0f)
+			return 0.0f;
+
+		// 1 - cos written to stay accurate for small or distant spheres
+		float oneMinusCos = sin2ThetaMax / (1.0f + sqrtf(1.0f - sin2ThetaMax));
+		return 1.0f / (2.0f * (float)M_PI * oneMinusCos);
+	}
 
-		// offset_x = 2 * square_size_x;
-		// offset_y = 1 * square_size_y;
+	// point of the unit disk for a point of the unit square, by Shirley's concentric mapping :
+	// squares around the center go to rings, so strata of the square stay compact on the disk
+	static glm::vec2 concentricDisk(float u, float v)
+	{
+		const float a = 2.0f * u - 1.0f, b = 2.0f * v - 1.0f;
+		if (a == 0.0f && b == 0.0f)
+			return glm::vec2(0.0f);
+		if (std::abs(a) > std::abs(b))
+			return a * glm::vec2(cosf(0.25f * (float)M_PI * b / a), sinf(0.25f * (float)M_PI * b / a));
+		const float phi = 0.5f * (float)M_PI - 0.25f * (float)M_PI * a / b;
+		return b * glm::vec2(cosf(phi), sinf(phi));
+	}
 
-		int pixel_x = square_size_x * u + offset_x;
-		int pixel_y = square_size_y * v + offset_y;
-		int index = (pixel_y * Cubemap.width + pixel_x) * Cubemap.nchannel;
+	// splitmix64 finalizer, spreads close keys (frame 1, 2, 3 ...) over the whole range
+	static uint64_t mixSeed(uint64_t key)
+	{
+		key += 0x9e3779b97f4a7c15ULL;
+		key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+		return key ^ (key >> 31);
+	}
 
-		// Ensure index is within bounds
-		int maxIndex = Cubemap.width * Cubemap.height * Cubemap.nchannel;
-		if (index < 0 || index + 2 >= maxIndex) {
-			return glm::vec3(1.0f); // Return magenta color for error
-		}
+	// seed of the streams of one sample index, the pixel picks the stream
+	static uint64_t sampleSeed(uint32_t seed, uint64_t sample)
+	{
+		return mixSeed(mixSeed(seed) + sample);
+	}
 
-		float r = Cubemap.data[index] / 255.0f;
-		float g = Cubemap.data[index + 1] / 255.0f;
-		float b = Cubemap.data[index + 2] / 255.0f;
-		return glm::vec3(r, g, b);
+	// cost of the pixel this thread is shading, null when costs are not recorded
+	static thread_local glm::vec4* s_PixelCost = nullptr;
 
+	static void addPathLength(int bounce)
+	{
+		Stats::AddPathLength(bounce);
+		if (s_PixelCost)
+			s_PixelCost->z += (float)bounce;
 	}
 
+	// counts the stage and, at the finest trace level, puts it on the timeline
+	struct StageScope
+	{
+		explicit StageScope(Stats::Stage stage)
+			: Counter(stage)
+		{
+			if (Trace::IsEnabled(Trace::Stages))
+				Timeline.Begin(Stats::GetStageName(stage));
+		}
 
+		Stats::ScopedStage Counter;
+		Trace::Scope Timeline;
+	};
+
+	// turbo colormap, polynomial fit from 0 (blue) to 1 (red)
+	static glm::vec3 falseColor(float t)
+	{
+		static const float red[6] = { 0.13572138f, 4.61539260f, -42.66032258f, 132.13108234f, -152.94239396f, 59.28637943f };
+		static const float green[6] = { 0.09140261f, 2.19418839f, 4.84296658f, -14.18503333f, 4.27729857f, 2.82956604f };
+		static const float blue[6] = { 0.10667330f, 12.64194608f, -60.58204836f, 110.36276771f, -89.90310912f, 27.34824973f };
+
+		t = glm::clamp(t, 0.0f, 1.0f);
+		glm::vec3 color{ 0.0f };
+		for (int i = 5; i >= 0; --i)
+			color = color * t + glm::vec3(red[i], green[i], blue[i]);
+		return glm::clamp(color, glm::vec3(0.0f), glm::vec3(1.0f));
+	}
 
 	static uint32_t ConvertToRGBA(const glm::vec4 color)
 	{
@@ -158,23 +140,37 @@ namespace Utils {
 
 void Renderer::OnResize(uint32_t width, uint32_t height) {
 
+	if (m_ImageData && m_Width == width && m_Height == height)
+		return;
+
+	m_Width = width;
+	m_Height = height;
+
+#ifndef RT_HEADLESS
 	if (m_FinalImage)
 	{
-		if (m_FinalImage->GetWidth() == width && m_FinalImage->GetHeight() == height)
-			return;
-
 		m_FinalImage->Resize(width, height);
 	}
 	else 
 	{
 		m_FinalImage = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
 	}
+#endif
+
+	const size_t pixelCount = (size_t)width * height;
+	const bool hugePages = m_Settings.HugePages;
+
+	m_ImageBuffer.Reserve(pixelCount * sizeof(uint32_t), hugePages);
+	m_ImageData = m_ImageBuffer.As<uint32_t>();
+
+	m_Accumulation.Resize((uint32_t)pixelCount, m_Settings.Accumulation, hugePages);
 
-	delete[] m_ImageData;
-	m_ImageData = new uint32_t[width * height];
+	m_PixelCostBuffer.Reserve(pixelCount * sizeof(glm::vec4), hugePages);
+	m_PixelCostData = m_PixelCostBuffer.As<glm::vec4>();
 
-	delete[] m_AccumulationData;
-	m_AccumulationData = new glm::vec4[width * height];
+	// the content did not survive the resize
+	m_FrameIndex = 1;
+	m_FirstFrame = 1;
 
 	m_ImageHorizontalIter.resize(width);
 	m_ImageVerticalIter.resize(height);
@@ -188,70 +184,86 @@ void Renderer::OnResize(uint32_t width, uint32_t height) {
 
 void Renderer::Render(const Scene& scene, const Camera& camera)
 {
+	auto frameStart = std::chrono::steady_clock::now();
+	Stats::Totals statsBefore = Stats::Collect();
+	Trace::Scope frameScope(Trace::Passes, "Frame", m_FrameIndex);
+
 	m_ActiveScene = &scene;
 	m_ActiveCamera = &camera;
 
 	const int N_MC = GetSettings().MonteCarloNbSample;
+	const bool recordCost = GetSettings().RecordPixelCost || GetSettings().ShowPixelCost;
 
-	if (m_FrameIndex == 1)
-		memset(m_AccumulationData, 0, m_FinalImage->GetWidth() * m_FinalImage->GetHeight() * sizeof(glm::vec4));
+	if (m_Accumulation.GetFormat() != m_Settings.Accumulation) {
+		m_Accumulation.Resize(m_Width * m_Height, m_Settings.Accumulation, m_Settings.HugePages);
+		m_FrameIndex = m_FirstFrame;
+	}
 
-	// prepare some random offset for antialiasing
-	if (GetSettings().Antialiasing) 
-	{
-		m_AntialiasingOffset.resize(GetSettings().MonteCarloNbSample);
-		for (int i = 0; i < N_MC; ++i) {
-			m_AntialiasingOffset[i].x = CustomRand::uniform_random_value() - 0.5f;
-			m_AntialiasingOffset[i].y = CustomRand::uniform_random_value() - 0.5f;
-		}
+	// frames in the accumulation once this one is added
+	const uint32_t frameCount = m_FrameIndex - m_FirstFrame + 1;
+	m_Accumulation.BeginFrame(frameCount);
+	if (m_FrameIndex == m_FirstFrame) {
+		m_Accumulation.Clear();
+		std::fill(m_PixelCostData, m_PixelCostData + (size_t)m_Width * m_Height, glm::vec4(0.0f));
 	}
-	
 
+	// an accumulated frame is keyed by its index, so the same samples come out after a reset
+	const uint32_t frameKey = m_Settings.Accumulate ? m_FrameIndex : ++m_FrameCount;
+	// frame n draws the samples [(n - 1) * N_MC, n * N_MC) of every pixel
+	const uint64_t firstSample = (uint64_t)(frameKey - 1) * N_MC;
+	PrepareAntialiasing(firstSample, N_MC);
+
+	Trace::Scope passScope(Trace::Passes, "Render pass");
 	std::for_each(std::execution::par, m_ImageVerticalIter.begin(), m_ImageVerticalIter.end(),
-		[this, N_MC](uint32_t y)
+		[this, N_MC, recordCost, firstSample, frameCount](uint32_t y)
 		{
+			Trace::Scope tileScope(Trace::Tiles, "Row", y);
 			std::for_each(std::execution::par, m_ImageHorizontalIter.begin(), m_ImageHorizontalIter.end(),
-			[this, y, N_MC](uint32_t x)
+			[this, y, N_MC, recordCost, firstSample](uint32_t x)
 				{
-					int index = x + y * m_FinalImage->GetWidth();
+					int index = x + y * m_Width;
+
+					glm::vec4 cost{ 0.0f };
+					uint64_t costStart = 0;
+					if (recordCost) {
+						Utils::s_PixelCost = &cost;
+						costStart = Stats::ReadCycles();
+					}
 
 					//glm::vec4 color = PerPixel(x, y);
 
 					// monte carlo
-					glm::vec3 radiance{0};
-					for (int i = 0; i < N_MC; ++i)
-					{
-						Ray ray;
-						ray.Origin = m_ActiveCamera->GetPosition();
-						ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_FinalImage->GetWidth()];
-
-						if (GetSettings().Antialiasing)
-						{
-							// Generate small random offsets for anti-aliasing
-							// avoid for randering new offset point for each pixel, it's new at each frame
-							float offsetX = m_AntialiasingOffset[i].x / m_ActiveCamera->GetViewportWidth();
-							float offsetY = m_AntialiasingOffset[i].y / m_ActiveCamera->GetViewportHeight();
-							ray.Direction += offsetX * glm::cross(m_ActiveCamera->GetDirection(), glm::vec3(0.0f, 1.0f, 0.0f)) + offsetY * glm::vec3(0.0f, 1.0f, 0.0f);
-						}
-						
-						radiance += Li(ray, 0, glm::vec3{1.0f});
-					}
+					glm::vec3 radiance = SamplePixel(x, y, firstSample, N_MC);
 					radiance /= N_MC;
-					
-					glm::vec4 color(radiance, 1);
-					m_AccumulationData[index] += color;
 
-					glm::vec4 accumulatedColor = m_AccumulationData[index];
-					accumulatedColor /= (float)m_FrameIndex;
-					accumulatedColor = glm::clamp(accumulatedColor, glm::vec4(0.0f), glm::vec4(1.0f));
-					
-					m_ImageData[index] = Utils::ConvertToRGBA(accumulatedColor);
+					if (recordCost) {
+						cost.w = (float)(Stats::ReadCycles() - costStart);
+						Utils::s_PixelCost = nullptr;
+						m_PixelCostData[index] += cost / (float)N_MC;
+					}
+
+					Utils::StageScope stage(Stats::Accumulation);
+					m_Accumulation.Add(index, radiance);
 
 				});
+
+			if (!GetSettings().ShowPixelCost) {
+				Utils::StageScope stage(Stats::Conversion);
+				ResolveRow(y, frameCount);
+			}
 		});
-	
-	
-	m_FinalImage->SetData(m_ImageData);
+	passScope.End();
+
+	if (GetSettings().ShowPixelCost)
+		ShowPixelCost(frameCount);
+
+#ifndef RT_HEADLESS
+	{
+		Trace::Scope uploadScope(Trace::Passes, "Upload");
+		Utils::StageScope stage(Stats::Upload);
+		m_FinalImage->SetData(m_ImageData);
+	}
+#endif
 
 	if (m_Settings.Accumulate)
 	{
@@ -259,27 +271,332 @@ void Renderer::Render(const Scene& scene, const Camera& camera)
 	}
 	else
 	{
-		m_FrameIndex = 1;
+		m_FrameIndex = m_FirstFrame;
+	}
+
+	// only the copy is taken here, the worker compresses and writes it
+	const uint32_t checkpointInterval = m_Settings.CheckpointInterval;
+	if (m_Settings.Accumulate && checkpointInterval > 0 && (m_FrameIndex - m_FirstFrame) % checkpointInterval == 0 && !m_CheckpointWriter.IsBusy()) {
+		Trace::Scope checkpointScope(Trace::Passes, "Checkpoint");
+		m_CheckpointWriter.WriteAsync(CaptureCheckpoint(scene, camera), m_Settings.CheckpointFile);
+	}
+
+	m_LastFrameStats.FrameTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+	m_LastFrameStats.Counters = Stats::Collect() - statsBefore;
+}
+
+void Renderer::RenderSampleRange(const Scene& scene, const Camera& camera, uint64_t firstSample, uint32_t sampleCount, SampleBuffer& buffer)
+{
+	Trace::Scope passScope(Trace::Passes, "Sample range", (int64_t)sampleCount);
+
+	m_ActiveScene = &scene;
+	m_ActiveCamera = &camera;
+
+	SampleBuffer::Origin origin;
+	origin.Width = m_Width;
+	origin.Height = m_Height;
+	origin.Seed = m_Settings.Seed;
+	origin.MonteCarloNbSample = m_Settings.MonteCarloNbSample;
+	origin.Antialiasing = m_Settings.Antialiasing;
+	origin.PrefilteredEnvironment = m_Settings.PrefilteredEnvironment;
+	origin.CameraPosition = camera.GetPosition();
+	origin.CameraDirection = camera.GetDirection();
+	origin.ApertureRadius = camera.GetApertureRadius();
+	origin.FocusDistance = camera.GetFocusDistance();
+	origin.SceneHash = scene.Hash;
+	buffer.BeginRange(origin, firstSample, sampleCount);
+
+	PrepareAntialiasing(firstSample, sampleCount);
+
+	std::for_each(std::execution::par, m_ImageVerticalIter.begin(), m_ImageVerticalIter.end(),
+		[this, firstSample, sampleCount, &buffer](uint32_t y)
+		{
+			Trace::Scope tileScope(Trace::Tiles, "Row", y);
+			std::for_each(std::execution::par, m_ImageHorizontalIter.begin(), m_ImageHorizontalIter.end(),
+				[this, y, firstSample, sampleCount, &buffer](uint32_t x)
+				{
+					glm::vec3 sum = SamplePixel(x, y, firstSample, sampleCount);
+
+					Utils::StageScope stage(Stats::Accumulation);
+					buffer.Add(x + y * m_Width, sum, sampleCount);
+				});
+		});
+}
+
+void Renderer::PrepareAntialiasing(uint64_t firstSample, uint32_t sampleCount)
+{
+	if (!GetSettings().Antialiasing)
+		return;
+
+	// one offset per sample, shared by every pixel
+	m_AntialiasingOffset.resize(sampleCount);
+	for (uint32_t i = 0; i < sampleCount; ++i) {
+		CustomRand::seed(Utils::sampleSeed(GetSettings().Seed, firstSample + i), ~0ULL);
+		m_AntialiasingOffset[i].x = CustomRand::uniform_random_value() - 0.5f;
+		m_AntialiasingOffset[i].y = CustomRand::uniform_random_value() - 0.5f;
+	}
+}
+
+glm::vec3 Renderer::SamplePixel(uint32_t x, uint32_t y, uint64_t firstSample, uint32_t sampleCount)
+{
+	const uint32_t index = x + y * m_Width;
+
+	glm::vec3 radiance{ 0.0f };
+	for (uint32_t i = 0; i < sampleCount; ++i)
+	{
+		// every sample of every pixel has a stream of its own, so a sample comes out the same
+		// whatever frame or range it is rendered in
+		CustomRand::seed(Utils::sampleSeed(GetSettings().Seed, firstSample + i), index);
+
+		Ray ray;
+		{
+			Utils::StageScope stage(Stats::RayGeneration);
+			ray.Origin = m_ActiveCamera->GetPosition();
+			ray.Direction = m_ActiveCamera->GetRayDirections()[index];
+
+			if (GetSettings().Antialiasing)
+			{
+				// Generate small random offsets for anti-aliasing
+				// avoid for randering new offset point for each pixel, it's new at each sample
+				float offsetX = m_AntialiasingOffset[i].x / m_ActiveCamera->GetViewportWidth();
+				float offsetY = m_AntialiasingOffset[i].y / m_ActiveCamera->GetViewportHeight();
+				ray.Direction += offsetX * glm::cross(m_ActiveCamera->GetDirection(), glm::vec3(0.0f, 1.0f, 0.0f)) + offsetY * glm::vec3(0.0f, 1.0f, 0.0f);
+			}
+
+			// the pinhole ray crosses the plane in focus where every ray through the lens
+			// for this sample has to, only the origin moves on the aperture
+			const float apertureRadius = m_ActiveCamera->GetApertureRadius();
+			if (apertureRadius > 0.0f)
+			{
+				const glm::vec3 forward = m_ActiveCamera->GetDirection();
+				const glm::vec3 focus = ray.Origin + ray.Direction * (m_ActiveCamera->GetFocusDistance() / glm::dot(ray.Direction, forward));
+				const float u = CustomRand::uniform_random_value(), v = CustomRand::uniform_random_value();
+				const glm::vec2 lens = apertureRadius * Utils::concentricDisk(u, v);
+				ray.Origin += lens.x * m_ActiveCamera->GetRightDirection() + lens.y * m_ActiveCamera->GetUpDirection();
+				ray.Direction = glm::normalize(focus - ray.Origin);
+			}
+
+			// the whole path sees the scene at one time of the shutter interval. Drawn only
+			// when something moves, still scenes keep their random streams
+			if (!m_ActiveScene->MovingSpheres.empty())
+				ray.Time = CustomRand::uniform_random_value();
+		}
+
+		Utils::StageScope stage(Stats::Shading);
+		radiance += Li(ray, 0, glm::vec3{1.0f}, BsdfSample{}, firstSample + i);
 	}
+	return radiance;
+}
+
+void Renderer::SetRowRange(uint32_t firstRow, uint32_t rowCount)
+{
+	m_ImageVerticalIter.resize(rowCount);
+	for (uint32_t i = 0; i < rowCount; ++i)
+		m_ImageVerticalIter[i] = firstRow + i;
 }
 
+void Renderer::BeginFrameRange(uint32_t firstFrame)
+{
+	m_FirstFrame = firstFrame;
+	m_FrameIndex = firstFrame;
+}
 
-glm::vec3 Renderer::Li(Ray ray, int bounce, glm::vec3 throughput) {
+void Renderer::ResolveRow(uint32_t y, uint32_t frameCount)
+{
+	const size_t rowStart = (size_t)y * m_Width;
+	thread_local std::vector<float> scratch;
+	scratch.resize((size_t)m_Width * AccumulationBuffer::ChannelCount);
+
+	const float* channels[AccumulationBuffer::ChannelCount];
+	m_Accumulation.GetRow(rowStart, m_Width, scratch.data(), channels);
+	const float* red = channels[0];
+	const float* green = channels[1];
+	const float* blue = channels[2];
+	uint32_t* row = m_ImageData + rowStart;
+
+	// same rounding as ConvertToRGBA, written over plain arrays so it vectorizes
+	const float scale = 1.0f / (float)frameCount;
+	for (uint32_t x = 0; x < m_Width; ++x) {
+		uint32_t r = (uint32_t)(std::min(std::max(red[x] * scale, 0.0f), 1.0f) * 255.0f);
+		uint32_t g = (uint32_t)(std::min(std::max(green[x] * scale, 0.0f), 1.0f) * 255.0f);
+		uint32_t b = (uint32_t)(std::min(std::max(blue[x] * scale, 0.0f), 1.0f) * 255.0f);
+		row[x] = 0xff000000u | (b << 16) | (g << 8) | r;
+	}
+}
+
+const char* Renderer::GetPixelCostName(PixelCost cost)
+{
+	switch (cost) {
+	case PixelCost::TraversalSteps: return "Traversal steps";
+	case PixelCost::IntersectionTests: return "Intersection tests";
+	case PixelCost::PathLength: return "Path length";
+	case PixelCost::Cycles: return "Cycles";
+	default: return "";
+	}
+}
+
+void Renderer::ShowPixelCost(uint32_t frameCount)
+{
+	Trace::Scope passScope(Trace::Passes, "Pixel cost heatmap");
+	Utils::StageScope stage(Stats::Conversion);
+
+	const size_t pixelCount = (size_t)m_Width * m_Height;
+	const int channel = (int)GetSettings().PixelCostView;
+
+	std::vector<float> values(pixelCount);
+	for (size_t i = 0; i < pixelCount; ++i)
+		values[i] = m_PixelCostData[i][channel] / (float)frameCount;
+
+	// the 99th percentile tops the scale, a few preempted pixels would flatten the cycles view
+	std::vector<float> sorted = values;
+	size_t top = pixelCount * 99 / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + top, sorted.end());
+	m_PixelCostScale = pixelCount > 0 ? sorted[top] : 0.0f;
+
+	float invScale = m_PixelCostScale > 0.0f ? 1.0f / m_PixelCostScale : 0.0f;
+	for (size_t i = 0; i < pixelCount; ++i)
+		m_ImageData[i] = Utils::ConvertToRGBA(glm::vec4(Utils::falseColor(values[i] * invScale), 1.0f));
+}
+
+void Renderer::ExportPixelCost(const std::string& filename, PixelCost cost) const
+{
+	const size_t pixelCount = (size_t)m_Width * m_Height;
+	const int channel = (int)cost;
+	const float frameCount = (float)std::max<uint32_t>(GetAccumulatedFrameCount(), 1);
+
+	std::vector<float> values(pixelCount);
+	for (size_t i = 0; i < pixelCount; ++i)
+		values[i] = m_PixelCostData[i][channel] / frameCount;
+
+	ImageIO::WritePFM(filename, m_Width, m_Height, 1, values.data());
+}
+
+std::vector<float> Renderer::GetRadiance() const
+{
+	const size_t pixelCount = (size_t)m_Width * m_Height;
+	const float frameCount = (float)std::max<uint32_t>(GetAccumulatedFrameCount(), 1);
+
+	std::vector<float> values(pixelCount * 3);
+	for (size_t i = 0; i < pixelCount; ++i) {
+		glm::vec3 sum = m_Accumulation.Get(i);
+		values[i * 3 + 0] = sum.r / frameCount;
+		values[i * 3 + 1] = sum.g / frameCount;
+		values[i * 3 + 2] = sum.b / frameCount;
+	}
+	return values;
+}
+
+void Renderer::ExportRadiance(const std::string& filename) const
+{
+	std::vector<float> values = GetRadiance();
+	ImageIO::WritePFM(filename, m_Width, m_Height, 3, values.data());
+}
+
+Checkpoint Renderer::CaptureCheckpoint(const Scene& scene, const Camera& camera) const
+{
+	Checkpoint checkpoint;
+	checkpoint.Width = m_Width;
+	checkpoint.Height = m_Height;
+	checkpoint.FirstFrame = m_FirstFrame;
+	checkpoint.FrameIndex = m_FrameIndex;
+	checkpoint.FrameCount = m_FrameCount;
+	checkpoint.Seed = m_Settings.Seed;
+	checkpoint.MonteCarloNbSample = m_Settings.MonteCarloNbSample;
+	checkpoint.Antialiasing = m_Settings.Antialiasing;
+	checkpoint.PrefilteredEnvironment = m_Settings.PrefilteredEnvironment;
+	checkpoint.CameraPosition = camera.GetPosition();
+	checkpoint.CameraDirection = camera.GetDirection();
+	checkpoint.ApertureRadius = camera.GetApertureRadius();
+	checkpoint.FocusDistance = camera.GetFocusDistance();
+	checkpoint.SceneHash = scene.Hash;
+
+	checkpoint.Format = m_Accumulation.GetFormat();
+	const uint8_t* bytes = m_Accumulation.GetBytes();
+	checkpoint.Accumulation.assign(bytes, bytes + m_Accumulation.GetByteSize());
+	return checkpoint;
+}
+
+void Renderer::RestoreCheckpoint(const Checkpoint& checkpoint, const Scene& scene, Camera& camera)
+{
+	if (checkpoint.SceneHash != scene.Hash)
+		throw std::runtime_error("The checkpoint was made from an other scene");
+	if (checkpoint.Width == 0 || checkpoint.Height == 0 || checkpoint.FirstFrame == 0 || checkpoint.FrameIndex < checkpoint.FirstFrame || checkpoint.MonteCarloNbSample <= 0)
+		throw std::runtime_error("Damaged checkpoint");
+
+	// everything the samples of the next frames depend on
+	m_Settings.Accumulate = true;
+	m_Settings.Seed = checkpoint.Seed;
+	m_Settings.MonteCarloNbSample = checkpoint.MonteCarloNbSample;
+	m_Settings.Antialiasing = checkpoint.Antialiasing;
+	m_Settings.PrefilteredEnvironment = checkpoint.PrefilteredEnvironment;
+	m_Settings.Accumulation = checkpoint.Format;
+
+	OnResize(checkpoint.Width, checkpoint.Height);
+	const uint32_t pixelCount = m_Width * m_Height;
+	m_Accumulation.Resize(pixelCount, checkpoint.Format, m_Settings.HugePages);
+	if (m_Accumulation.GetByteSize() != checkpoint.Accumulation.size()) {
+		ResetFrameIndex();
+		throw std::runtime_error("The checkpoint accumulation does not match its image size");
+	}
+	memcpy(m_Accumulation.GetBytes(), checkpoint.Accumulation.data(), checkpoint.Accumulation.size());
+	std::fill(m_PixelCostData, m_PixelCostData + pixelCount, glm::vec4(0.0f));
+
+	m_FirstFrame = checkpoint.FirstFrame;
+	m_FrameIndex = checkpoint.FrameIndex;
+	m_FrameCount = checkpoint.FrameCount;
+
+	// show the restored image before the next frame lands
+	const uint32_t frameCount = std::max<uint32_t>(GetAccumulatedFrameCount(), 1);
+	m_Accumulation.BeginFrame(frameCount);
+	for (uint32_t y = 0; y < m_Height; ++y)
+		ResolveRow(y, frameCount);
+#ifndef RT_HEADLESS
+	m_FinalImage->SetData(m_ImageData);
+#endif
+
+	camera.OnResize(checkpoint.Width, checkpoint.Height);
+	camera.SetView(checkpoint.CameraPosition, checkpoint.CameraDirection);
+	camera.SetLens(checkpoint.ApertureRadius, checkpoint.FocusDistance);
+}
+
+
+glm::vec3 Renderer::Li(Ray ray, int bounce, glm::vec3 throughput, const BsdfSample& previous, uint64_t sample) {
 	// no russian roulette
 	//if (bounce > 10) return glm::vec3(0);
 
 	HitPayload payload = TraceRay(ray);
 	
 	if (payload.HitDistance < eps) {
-		return Utils::backgroundColor(ray, m_ActiveScene->Cubemap);
+		Stats::Add(Stats::EscapeRays);
+		Utils::addPathLength(bounce);
+
+		const Cubemap& cubemap = m_ActiveScene->Cubemap;
+		if (previous.Pdf <= 0.0f || !cubemap.exist)
+			return Utils::backgroundColor(ray, cubemap);
+
+		// this direction could also have been found by the cubemap sampling
+		return Utils::backgroundColor(ray, cubemap, EnvironmentLod(previous.Pdf, sample)) * Utils::powerHeuristic(previous.Pdf, cubemap.Pdf(ray.Direction));
 		//return glm::vec3{ 1.0f };
 	}
 
-	const Sphere& sphere = m_ActiveScene->Spheres[payload.ObjectIndex];
-	const Material& material = m_ActiveScene->Materials[sphere.MaterialIndex];
+	const Material& material = m_ActiveScene->Materials[payload.MaterialIndex];
 
 	glm::vec3 radiance = material.GetEmission();
 
+	// this light could also have been picked by the light sampling at the previous hit,
+	// emissive instances and primitives are only found by the bsdf sampling
+	if (previous.Pdf > 0.0f && m_ActiveScene->Lights && radiance != glm::vec3(0.0f) && payload.ObjectIndex >= 0) {
+		const Sphere& sphere = m_ActiveScene->Spheres[payload.ObjectIndex];
+		float lightPdf = m_ActiveScene->Lights->Pmf(ray.Origin, previous.Normal, payload.ObjectIndex) * Utils::sphereConePdf(ray.Origin, sphere);
+		radiance *= Utils::powerHeuristic(previous.Pdf, lightPdf);
+	}
+
+	if (material.Type == DIFFUSE) {
+		if (m_ActiveScene->Cubemap.exist)
+			radiance += SampleEnvironment(ray, payload, material, sample);
+		radiance += SampleLights(ray, payload, material);
+	}
+
 	const int MIN_BOUNCES = 3;
 	float rr_prob;
 	if (bounce < MIN_BOUNCES) {
@@ -290,25 +607,118 @@ glm::vec3 Renderer::Li(Ray ray, int bounce, glm::vec3 throughput) {
 		rr_prob = glm::clamp(rr_prob, 0.0f, 0.99f);
 	}
 
-	if (CustomRand::uniform_random_value() >= rr_prob) return radiance;
+	if (CustomRand::uniform_random_value() >= rr_prob) {
+		Stats::Add(Stats::RussianRouletteTerminations);
+		Utils::addPathLength(bounce);
+		return radiance;
+	}
 
+	Stats::Add(Stats::Bounces);
 	
 	Ray newRay;
 	newRay.Origin = payload.WorldPosition; // +0.0001f * payload.WorldNormal;
+	newRay.Time = ray.Time;
 	glm::vec3 brdfmultiplier = sampler.sample(ray.Direction, material, payload.WorldNormal, newRay.Direction);
+	BsdfSample bsdfSample;
+	bsdfSample.Pdf = sampler.pdf(ray.Direction, material, payload.WorldNormal, newRay.Direction);
+	bsdfSample.Normal = payload.WorldNormal;
 	throughput *= brdfmultiplier / rr_prob;
-	radiance += brdfmultiplier * Li(newRay, bounce + 1, throughput) / rr_prob;
+	radiance += brdfmultiplier * Li(newRay, bounce + 1, throughput, bsdfSample, sample) / rr_prob;
 
 	return radiance;
 }
 
+glm::vec3 Renderer::SampleEnvironment(const Ray& ray, const HitPayload& payload, const Material& material, uint64_t sample)
+{
+	const Cubemap& cubemap = m_ActiveScene->Cubemap;
+
+	Ray shadowRay;
+	shadowRay.Origin = payload.WorldPosition;
+	shadowRay.Time = ray.Time;
+	float lightPdf;
+	shadowRay.Direction = cubemap.SampleDirection(CustomRand::uniform_random_value(), CustomRand::uniform_random_value(), CustomRand::uniform_random_value(), lightPdf);
+
+	float cosTheta = glm::dot(payload.WorldNormal, shadowRay.Direction);
+	if (cosTheta <= 0.0f || lightPdf <= 0.0f)
+		return glm::vec3(0.0f);
+
+	// occluded
+	if (TraceRay(shadowRay).HitDistance >= eps)
+		return glm::vec3(0.0f);
+
+	float bsdfPdf = sampler.pdf(ray.Direction, material, payload.WorldNormal, shadowRay.Direction);
+	glm::vec3 brdf = sampler.eval(ray.Direction, material, payload.WorldNormal, shadowRay.Direction);
+
+	return brdf * cubemap.Sample(shadowRay.Direction, EnvironmentLod(bsdfPdf, sample)) * cosTheta / lightPdf * Utils::powerHeuristic(lightPdf, bsdfPdf);
+}
+
+float Renderer::EnvironmentLod(float bsdfPdf, uint64_t sample) const
+{
+	// a bsdf sample stands for about 1 / (pdf * N) steradians out of the N drawn up to this one,
+	// no need for finer texels. N is the index of the sample, not of the frame or range it is
+	// rendered in, so every way of splitting a render sees the same blur, and it fades out as
+	// the samples add up
+	if (!m_Settings.PrefilteredEnvironment || bsdfPdf <= 0.0f)
+		return 0.0f;
+	return m_ActiveScene->Cubemap.LodForSolidAngle(1.0f / (bsdfPdf * (float)(sample + 1)));
+}
+
+
+glm::vec3 Renderer::SampleLights(const Ray& ray, const HitPayload& payload, const Material& material)
+{
+	const LightBVH* lights = m_ActiveScene->Lights.get();
+	if (!lights || lights->Empty())
+		return glm::vec3(0.0f);
+
+	uint32_t lightIndex;
+	float lightPmf;
+	if (!lights->Sample(payload.WorldPosition, payload.WorldNormal, CustomRand::uniform_random_value(), lightIndex, lightPmf))
+		return glm::vec3(0.0f);
+	if ((int)lightIndex == payload.ObjectIndex)
+		return glm::vec3(0.0f);
+
+	const Sphere& light = m_ActiveScene->Spheres[lightIndex];
+	float conePdf = Utils::sphereConePdf(payload.WorldPosition, light);
+	if (conePdf <= 0.0f)
+		return glm::vec3(0.0f);
+
+	// uniform direction in the cone subtended by the sphere
+	glm::vec3 toLight = light.Position - payload.WorldPosition;
+	float distance = glm::length(toLight);
+	float sin2ThetaMax = light.Radius * light.Radius / (distance * distance);
+	float oneMinusCosMax = sin2ThetaMax / (1.0f + sqrtf(1.0f - sin2ThetaMax));
+	float cosTheta = 1.0f - CustomRand::uniform_random_value() * oneMinusCosMax;
+	float sinTheta = sqrtf(glm::max(0.0f, 1.0f - cosTheta * cosTheta));
+	float phi = 2.0f * (float)M_PI * CustomRand::uniform_random_value();
+
+	Ray shadowRay;
+	shadowRay.Origin = payload.WorldPosition;
+	shadowRay.Time = ray.Time;
+	shadowRay.Direction = sampler.local_to_world(glm::vec3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta), toLight / distance);
+
+	float cosSurface = glm::dot(payload.WorldNormal, shadowRay.Direction);
+	if (cosSurface <= 0.0f)
+		return glm::vec3(0.0f);
+
+	// the first thing hit has to be the light itself
+	HitPayload shadow = TraceRay(shadowRay);
+	if (shadow.HitDistance < eps || shadow.ObjectIndex != (int)lightIndex)
+		return glm::vec3(0.0f);
+
+	float lightPdf = lightPmf * conePdf;
+	float bsdfPdf = sampler.pdf(ray.Direction, material, payload.WorldNormal, shadowRay.Direction);
+	glm::vec3 brdf = sampler.eval(ray.Direction, material, payload.WorldNormal, shadowRay.Direction);
+	glm::vec3 emission = m_ActiveScene->Materials[light.MaterialIndex].GetEmission();
+
+	return brdf * emission * cosSurface / lightPdf * Utils::powerHeuristic(lightPdf, bsdfPdf);
+}
 
 
 glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 {
 	Ray ray;
 	ray.Origin = m_ActiveCamera->GetPosition();
-	ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_FinalImage->GetWidth()];
+	ray.Direction = m_ActiveCamera->GetRayDirections()[x + y * m_Width];
 
 	glm::vec3 light(0.0f);
 	// placeholder to not get something too bright
@@ -332,15 +742,14 @@ glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 		//glm::vec3 lightDirection = glm::normalize(glm::vec3(-1, -1, -1));
 		//float d = glm::max(glm::dot(payload.WorldNormal, -lightDirection), 0.0f);
 
-		const Sphere& sphere = m_ActiveScene->Spheres[payload.ObjectIndex];
-		const Material& material = m_ActiveScene->Materials[sphere.MaterialIndex];
+		const Material& material = m_ActiveScene->Materials[payload.MaterialIndex];
 
 		contribution *= material.Albedo;
 		light += material.GetEmission() * material.Albedo;
 
 		ray.Origin = payload.WorldPosition; //+ 0.0001f * payload.WorldNormal;
 
-		ray.Direction = glm::normalize(payload.WorldNormal + Walnut::Random::InUnitSphere());
+		ray.Direction = sampler.local_to_world(sampler.cosine_weighted_hemisphere(), payload.WorldNormal);
 	
 	}
 
@@ -350,38 +759,45 @@ glm::vec4 Renderer::PerPixel(uint32_t x, uint32_t y)
 
 Renderer::HitPayload Renderer::TraceRay(const Ray& ray)
 {
+	Utils::StageScope stage(Stats::Traversal);
+	Stats::Add(Stats::RaysTraced);
+
 	int closestSphere = -1;
 	float hitDistance = std::numeric_limits<float>::max();
-
-	for (size_t i = 0; i < m_ActiveScene->Spheres.size(); ++i)
-	{
-		const Sphere& sphere = m_ActiveScene->Spheres[i];
-		glm::vec3 Origin = ray.Origin - sphere.Position;
-
-		float a = glm::dot(ray.Direction, ray.Direction);
-		float b = 2.0f * glm::dot(Origin, ray.Direction);
-		float c = glm::dot(Origin, Origin) - sphere.Radius * sphere.Radius;
-
-		float discriminant = b * b - 4.0f * a * c;
-		if (discriminant < 0.0f)
-			continue;
-
-		float t1 = (-b - glm::sqrt(discriminant)) / (2.0f * a);
-
-		if (t1 < eps)
-		{
-			t1 = (-b + glm::sqrt(discriminant)) / (2.0f * a);
-			if (t1 < eps) {
-				continue;
-			}
-		}
-
-		if (t1 < hitDistance)
-		{
-			hitDistance = t1;
-			closestSphere = (int)i;
-		}
+	uint32_t steps = 0, primitiveTests = 0;
+	if (m_ActiveScene->SphereTree)
+		m_ActiveScene->SphereTree->Intersect(m_ActiveScene->Spheres, ray, eps, hitDistance, closestSphere, steps, primitiveTests);
+
+	// the moving spheres where they are at the time of the ray
+	int movingSphere = -1;
+	if (m_ActiveScene->MotionTree)
+		m_ActiveScene->MotionTree->Intersect(m_ActiveScene->MovingSpheres, ray, eps, hitDistance, movingSphere, steps, primitiveTests);
+
+	// the instances only have to be searched up to the closest sphere
+	bool hitInstance = false;
+	InstanceBVH::Hit instanceHit;
+	if (m_ActiveScene->InstanceTree)
+		hitInstance = m_ActiveScene->InstanceTree->Intersect(m_ActiveScene->Instances, ray, eps, hitDistance, instanceHit, steps, primitiveTests);
+
+	// then the primitives up to the closest of both
+	bool hitPrimitive = false;
+	PrimitiveSet::Tag primitiveHit = 0;
+	if (m_ActiveScene->Primitives)
+		hitPrimitive = m_ActiveScene->Primitives->Intersect(ray, eps, hitDistance, primitiveHit, steps, primitiveTests);
+
+	Stats::Add(Stats::IntersectionTests, primitiveTests);
+	// each BVH node visited is one step
+	if (Utils::s_PixelCost) {
+		Utils::s_PixelCost->x += (float)steps;
+		Utils::s_PixelCost->y += (float)primitiveTests;
 	}
+
+	if (hitPrimitive)
+		return ClosestPrimitiveHit(ray, hitDistance, primitiveHit);
+	if (hitInstance)
+		return ClosestInstanceHit(ray, hitDistance, instanceHit);
+	if (movingSphere >= 0)
+		return ClosestMovingSphereHit(ray, hitDistance, movingSphere);
 	// Miss
 	if (closestSphere < 0 )
 		return Miss(ray);
@@ -396,6 +812,7 @@ Renderer::HitPayload Renderer::ClosestHit(const Ray& ray, float hitDistance, int
 	payload.ObjectIndex = objectIndex;
 
 	const Sphere& closestSphere = m_ActiveScene->Spheres[objectIndex];
+	payload.MaterialIndex = closestSphere.MaterialIndex;
 
 	glm::vec3 Origin = ray.Origin - closestSphere.Position; // offset to origin for calcul
 	payload.WorldPosition = Origin + hitDistance * ray.Direction;
@@ -405,6 +822,60 @@ Renderer::HitPayload Renderer::ClosestHit(const Ray& ray, float hitDistance, int
 	return payload;
 }
 
+Renderer::HitPayload Renderer::ClosestMovingSphereHit(const Ray& ray, float hitDistance, int movingIndex)
+{
+	const MovingSphere& sphere = m_ActiveScene->MovingSpheres[movingIndex];
+
+	Renderer::HitPayload payload;
+	payload.HitDistance = hitDistance;
+	// not one of Spheres, the light sampling never aims at it
+	payload.ObjectIndex = -1;
+	payload.MaterialIndex = sphere.MaterialIndex;
+	payload.WorldPosition = ray.Origin + hitDistance * ray.Direction;
+	payload.WorldNormal = glm::normalize(payload.WorldPosition - sphere.GetPosition(ray.Time));
+
+	return payload;
+}
+
+Renderer::HitPayload Renderer::ClosestInstanceHit(const Ray& ray, float hitDistance, const InstanceBVH::Hit& hit)
+{
+	const Instance& instance = m_ActiveScene->Instances[hit.Instance];
+
+	Renderer::HitPayload payload;
+	payload.HitDistance = hitDistance;
+	payload.ObjectIndex = -1;
+	int materialIndex = instance.Shape->GetMaterialIndex(hit.Primitive);
+	payload.MaterialIndex = materialIndex >= 0 ? materialIndex : instance.MaterialIndex;
+	payload.WorldPosition = ray.Origin + hitDistance * ray.Direction;
+
+	// the same distance along the object space ray, normals go back by the inverse transpose
+	Ray local = instance.ToObject(ray);
+	glm::vec3 normal = instance.Shape->GetNormal(hit.Primitive, local.Origin + hitDistance * local.Direction);
+	payload.WorldNormal = glm::normalize(glm::vec3(glm::transpose(instance.WorldToObject) * glm::vec4(normal, 0.0f)));
+
+	// a dielectric tells the inside from the outward normal, any other surface has two sides
+	if (m_ActiveScene->Materials[payload.MaterialIndex].Type != DIELECTRIC && glm::dot(payload.WorldNormal, ray.Direction) > 0.0f)
+		payload.WorldNormal = -payload.WorldNormal;
+
+	return payload;
+}
+
+Renderer::HitPayload Renderer::ClosestPrimitiveHit(const Ray& ray, float hitDistance, PrimitiveSet::Tag hit)
+{
+	Renderer::HitPayload payload;
+	payload.HitDistance = hitDistance;
+	payload.ObjectIndex = -1;
+	payload.MaterialIndex = m_ActiveScene->Primitives->GetMaterialIndex(hit);
+	payload.WorldPosition = ray.Origin + hitDistance * ray.Direction;
+	payload.WorldNormal = m_ActiveScene->Primitives->GetNormal(hit, payload.WorldPosition);
+
+	// as on the instances, only a dielectric keeps the outward normal
+	if (m_ActiveScene->Materials[payload.MaterialIndex].Type != DIELECTRIC && glm::dot(payload.WorldNormal, ray.Direction) > 0.0f)
+		payload.WorldNormal = -payload.WorldNormal;
+
+	return payload;
+}
+
 Renderer::HitPayload Renderer::Miss(const Ray& ray)
 {
 	Renderer::HitPayload payload;
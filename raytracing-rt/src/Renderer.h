@@ -2,25 +2,68 @@
 
 #pragma once
 
+// the headless build renders to memory only and does not link Walnut
+#ifndef RT_HEADLESS
 #include "Walnut/Image.h"  // Ensure this include is correct and the path is correct
+#endif
 
 #include "Camera.h"
 #include "Ray.h"
 #include "Scene.hpp"
 #include "Sampler.h"
+#include "Stats.h"
+#include "Framebuffer.h"
+#include "Checkpoint.h"
+#include "SampleBuffer.h"
 
 #include <memory>  // Include for std::shared_ptr
+#include <string>
+#include <vector>
 #include <glm/glm.hpp> // Include for glm::vec2
 
 
 class Renderer
 {
 public:
+    // per pixel counters, averaged per sample, for the cost heatmap
+    enum class PixelCost
+    {
+        TraversalSteps,
+        IntersectionTests,
+        PathLength,
+        Cycles,
+        Count
+    };
+
     struct Settings
     {
         bool Accumulate = true;
         bool Antialiasing = true;
         int MonteCarloNbSample = 8;
+        // every sample of every pixel draws from its own stream derived from the seed and the
+        // sample index, so a render does not depend on how the work was spread over the threads
+        uint32_t Seed = 0;
+        // diffuse bounces and environment samples read the cubemap mip matching the footprint of
+        // the bsdf sample in that direction. Biased, but consistent: the footprint shrinks with
+        // the index of the sample, so the accumulation still converges
+        bool PrefilteredEnvironment = false;
+        // record what each pixel cost, shown instead of the radiance when ShowPixelCost is set
+        bool RecordPixelCost = false;
+        bool ShowPixelCost = false;
+        PixelCost PixelCostView = PixelCost::Cycles;
+        // back the frame buffers with huge pages when the system allows it, taken at the next resize
+        bool HugePages = false;
+        // changing it restarts the accumulation
+        AccumulationFormat Accumulation = AccumulationFormat::Float;
+        // save the accumulation to CheckpointFile every CheckpointInterval frames, 0 to never
+        uint32_t CheckpointInterval = 0;
+        std::string CheckpointFile = "render.rtcheckpoint";
+    };
+
+    struct FrameStats
+    {
+        float FrameTime = 0.0f; // ms, wall clock
+        Stats::Totals Counters; // what the frame added to the counters
     };
 
     Renderer() = default;
@@ -28,14 +71,54 @@ public:
     void OnResize(uint32_t width, uint32_t height);
     void Render(const Scene& scene, const Camera& camera);
 
+#ifndef RT_HEADLESS
     std::shared_ptr<Walnut::Image> GetFinalImage() const {
         return m_FinalImage;
     }
+#endif
+    // RGBA8, rows bottom to top
+    const uint32_t* GetImageData() const { return m_ImageData; }
+    uint32_t GetWidth() const { return m_Width; }
+    uint32_t GetHeight() const { return m_Height; }
 
-    void ResetFrameIndex() { m_FrameIndex = 1; }
+    void ResetFrameIndex() { m_FrameIndex = m_FirstFrame = 1; }
     uint32_t GetFrameIndex() { return m_FrameIndex; };
+    uint32_t GetAccumulatedFrameCount() const { return m_FrameIndex - m_FirstFrame; }
+
+    // only render rows [firstRow, firstRow + rowCount) from now on, the others keep what
+    // they hold. A resize goes back to the whole image
+    void SetRowRange(uint32_t firstRow, uint32_t rowCount);
+    // start a new accumulation at frame firstFrame : the next frames draw the samples a
+    // render from frame 1 would have drawn at that index, summed from zero. Pieces of a
+    // long render can so be made apart and added together
+    void BeginFrameRange(uint32_t firstFrame);
+    const AccumulationBuffer& GetAccumulation() const { return m_Accumulation; }
+
+    // add the samples [firstSample, firstSample + sampleCount) of every pixel to buffer,
+    // without dividing them. Frame n of Render draws the samples from (n - 1) * MonteCarloNbSample
+    void RenderSampleRange(const Scene& scene, const Camera& camera, uint64_t firstSample, uint32_t sampleCount, SampleBuffer& buffer);
 
     Settings& GetSettings() { return m_Settings; }
+    const FrameStats& GetLastFrameStats() const { return m_LastFrameStats; }
+
+    static const char* GetPixelCostName(PixelCost cost);
+    // value mapped to the top of the heatmap on the last frame
+    float GetPixelCostScale() const { return m_PixelCostScale; }
+    // writes one cost channel, averaged over the accumulated frames, as a float image
+    void ExportPixelCost(const std::string& filename, PixelCost cost) const;
+    // writes the accumulated radiance, before clamping, as a float image
+    void ExportRadiance(const std::string& filename) const;
+    // accumulated radiance averaged over the frames, rgb interleaved, rows bottom to top
+    std::vector<float> GetRadiance() const;
+
+    // the accumulation so far with what is needed to continue it, to call between two frames
+    Checkpoint CaptureCheckpoint(const Scene& scene, const Camera& camera) const;
+    // carry on the render saved in checkpoint : takes its size, settings and camera, the
+    // pixel costs start over. Throws std::runtime_error if it was made from an other scene
+    void RestoreCheckpoint(const Checkpoint& checkpoint, const Scene& scene, Camera& camera);
+    const CheckpointWriter& GetCheckpointWriter() const { return m_CheckpointWriter; }
+    // block until the checkpoint being written, if any, is on disk
+    void WaitForCheckpoint() { m_CheckpointWriter.Wait(); }
 
 private:
     struct HitPayload
@@ -44,19 +127,51 @@ private:
         glm::vec3 WorldPosition;
         glm::vec3 WorldNormal;
 
-        int ObjectIndex;
+        int ObjectIndex; // sphere hit, -1 on a moving sphere, an instance or a primitive
+        int MaterialIndex;
+    };
+
+    // the scattering event that spawned a ray, for multiple importance sampling
+    struct BsdfSample
+    {
+        float Pdf = 0.0f; // solid angle pdf, 0 if the direction can not be light sampled
+        glm::vec3 Normal{ 0.0f };
     };
 
 
     glm::vec4 PerPixel(uint32_t x, uint32_t y); // RayGen Shader
-    glm::vec3 Li(Ray ray, int bounce, glm::vec3 throughput);
+    // camera offsets of the samples, the same for every pixel
+    void PrepareAntialiasing(uint64_t firstSample, uint32_t sampleCount);
+    // radiance summed over the samples [firstSample, firstSample + sampleCount) of the pixel
+    glm::vec3 SamplePixel(uint32_t x, uint32_t y, uint64_t firstSample, uint32_t sampleCount);
+    // radiance along the path of the sample of index sample
+    glm::vec3 Li(Ray ray, int bounce, glm::vec3 throughput, const BsdfSample& previous, uint64_t sample);
+    // next event estimation toward the cubemap, MIS weighted against bsdf sampling
+    glm::vec3 SampleEnvironment(const Ray& ray, const HitPayload& payload, const Material& material, uint64_t sample);
+    // next event estimation toward an emissive sphere picked by the light BVH
+    glm::vec3 SampleLights(const Ray& ray, const HitPayload& payload, const Material& material);
+    // mip level of the cubemap seen in a direction of bsdf pdf bsdfPdf by the sample of index
+    // sample, the same for both strategies so that they weight estimates of one integrand
+    float EnvironmentLod(float bsdfPdf, uint64_t sample) const;
     HitPayload TraceRay(const Ray& ray);
     HitPayload ClosestHit(const Ray& ray, float hitDistance, int objectIndex);
+    // outward normal at the time of the ray, as on the spheres
+    HitPayload ClosestMovingSphereHit(const Ray& ray, float hitDistance, int movingIndex);
+    HitPayload ClosestInstanceHit(const Ray& ray, float hitDistance, const InstanceBVH::Hit& hit);
+    HitPayload ClosestPrimitiveHit(const Ray& ray, float hitDistance, PrimitiveSet::Tag hit);
     HitPayload Miss(const Ray& ray);
+    // average of the accumulated frames to RGBA8, one row at a time
+    void ResolveRow(uint32_t y, uint32_t frameCount);
+    // false color of the selected cost in place of the radiance
+    void ShowPixelCost(uint32_t frameCount);
 
 private:
+#ifndef RT_HEADLESS
     std::shared_ptr<Walnut::Image> m_FinalImage;
+#endif
+    uint32_t m_Width = 0, m_Height = 0;
     Settings m_Settings;
+    FrameStats m_LastFrameStats;
 
     // iterator for multy threading
     std::vector<uint32_t> m_ImageHorizontalIter, m_ImageVerticalIter;
@@ -69,10 +184,22 @@ private:
 
     glm::vec3 radiance;
 
+    // the buffers keep their memory when the viewport shrinks, the pointers follow them
+    AlignedBuffer m_ImageBuffer;
     uint32_t* m_ImageData = nullptr;
-    glm::vec4* m_AccumulationData = nullptr;
+    AccumulationBuffer m_Accumulation;
+    // summed over the accumulated frames, one component per PixelCost
+    AlignedBuffer m_PixelCostBuffer;
+    glm::vec4* m_PixelCostData = nullptr;
+    float m_PixelCostScale = 0.0f;
 
     uint32_t m_FrameIndex = 1;
+    // index of the first frame in the accumulation, past 1 when rendering a piece of a longer run
+    uint32_t m_FirstFrame = 1;
+    // frames rendered since the start, keeps the noise moving when not accumulating
+    uint32_t m_FrameCount = 0;
+
+    CheckpointWriter m_CheckpointWriter;
 
     const Sampler sampler;
 };
@@ -0,0 +1,228 @@
+#include "SampleBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+	const char Magic[4] = { 'R', 'T', 'S', 'B' };
+	// 2 added the lens of the camera
+	const uint32_t Version = 2;
+
+	size_t RoundUp(size_t value, size_t multiple)
+	{
+		return (value + multiple - 1) / multiple * multiple;
+	}
+
+	template<typename T>
+	void WriteValue(std::ofstream& file, const T& value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	T ReadValue(std::ifstream& file)
+	{
+		T value{};
+		file.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+
+	bool Overlap(const std::vector<SampleBuffer::Range>& a, const std::vector<SampleBuffer::Range>& b)
+	{
+		for (const SampleBuffer::Range& first : a)
+			for (const SampleBuffer::Range& second : b)
+				if (first.First < second.First + second.Count && second.First < first.First + first.Count)
+					return true;
+		return false;
+	}
+
+}
+
+bool SampleBuffer::Origin::operator==(const Origin& other) const
+{
+	return Width == other.Width && Height == other.Height && Seed == other.Seed
+		&& MonteCarloNbSample == other.MonteCarloNbSample && Antialiasing == other.Antialiasing
+		&& PrefilteredEnvironment == other.PrefilteredEnvironment && CameraPosition == other.CameraPosition
+		&& CameraDirection == other.CameraDirection && ApertureRadius == other.ApertureRadius
+		&& FocusDistance == other.FocusDistance && SceneHash == other.SceneHash;
+}
+
+void SampleBuffer::BeginRange(const Origin& origin, uint64_t first, uint64_t count)
+{
+	if (origin != m_Origin || m_PlaneStride == 0)
+		Resize(origin);
+	AddRange({ first, count });
+}
+
+void SampleBuffer::Resize(const Origin& origin)
+{
+	m_Origin = origin;
+	m_Ranges.clear();
+
+	m_PlaneStride = RoundUp(GetPixelCount(), AlignedBuffer::Alignment / sizeof(float));
+	m_Sums.Reserve(m_PlaneStride * ChannelCount * sizeof(float));
+	m_Counts.Reserve(m_PlaneStride * sizeof(uint32_t));
+	memset(m_Sums.As<char>(), 0, m_PlaneStride * ChannelCount * sizeof(float));
+	memset(m_Counts.As<char>(), 0, m_PlaneStride * sizeof(uint32_t));
+}
+
+void SampleBuffer::AddRange(const Range& range)
+{
+	if (range.Count == 0)
+		return;
+
+	m_Ranges.push_back(range);
+	std::sort(m_Ranges.begin(), m_Ranges.end(), [](const Range& a, const Range& b) { return a.First < b.First; });
+
+	std::vector<Range> joined;
+	for (const Range& next : m_Ranges) {
+		if (!joined.empty() && next.First <= joined.back().First + joined.back().Count)
+			joined.back().Count = std::max(joined.back().Count, next.First + next.Count - joined.back().First);
+		else
+			joined.push_back(next);
+	}
+	m_Ranges = std::move(joined);
+}
+
+uint64_t SampleBuffer::GetSampleCount() const
+{
+	uint64_t count = 0;
+	for (const Range& range : m_Ranges)
+		count += range.Count;
+	return count;
+}
+
+void SampleBuffer::Merge(const SampleBuffer& other)
+{
+	if (other.m_PlaneStride == 0)
+		return;
+	if (m_PlaneStride == 0)
+		Resize(other.m_Origin);
+	if (other.m_Origin != m_Origin)
+		throw std::runtime_error("The sample buffers come from different scenes, cameras or settings");
+
+	const size_t stride = m_PlaneStride;
+	uint32_t* counts = m_Counts.As<uint32_t>();
+	const uint32_t* otherCounts = other.m_Counts.As<uint32_t>();
+
+	// the same samples are only a problem if they landed in the same pixels, tiles of
+	// one range are fine
+	if (Overlap(m_Ranges, other.m_Ranges)) {
+		for (size_t i = 0; i < stride; ++i)
+			if (counts[i] > 0 && otherCounts[i] > 0)
+				throw std::runtime_error("The sample buffers hold the same samples of a pixel");
+	}
+
+	// plain loops over aligned planes, the compiler turns them into packed adds
+	float* sums = m_Sums.As<float>();
+	const float* otherSums = other.m_Sums.As<float>();
+	for (size_t i = 0; i < stride * ChannelCount; ++i)
+		sums[i] += otherSums[i];
+	for (size_t i = 0; i < stride; ++i)
+		counts[i] += otherCounts[i];
+
+	for (const Range& range : other.m_Ranges)
+		AddRange(range);
+}
+
+std::vector<float> SampleBuffer::Resolve() const
+{
+	const size_t pixelCount = GetPixelCount();
+	const float* red = m_Sums.As<float>();
+	const float* green = red + m_PlaneStride;
+	const float* blue = green + m_PlaneStride;
+	const uint32_t* counts = m_Counts.As<uint32_t>();
+
+	std::vector<float> values(pixelCount * ChannelCount);
+	for (size_t i = 0; i < pixelCount; ++i) {
+		const float scale = counts[i] > 0 ? 1.0f / (float)counts[i] : 0.0f;
+		values[i * 3 + 0] = red[i] * scale;
+		values[i * 3 + 1] = green[i] * scale;
+		values[i * 3 + 2] = blue[i] * scale;
+	}
+	return values;
+}
+
+// little endian : magic, version, origin, ranges, then the planes without their padding
+void SampleBuffer::Write(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open file for writing: " + filename);
+
+	file.write(Magic, sizeof(Magic));
+	WriteValue(file, Version);
+	WriteValue(file, m_Origin.Width);
+	WriteValue(file, m_Origin.Height);
+	WriteValue(file, m_Origin.Seed);
+	WriteValue(file, (int32_t)m_Origin.MonteCarloNbSample);
+	WriteValue(file, (uint8_t)m_Origin.Antialiasing);
+	WriteValue(file, (uint8_t)m_Origin.PrefilteredEnvironment);
+	WriteValue(file, (uint16_t)0);
+	WriteValue(file, m_Origin.CameraPosition);
+	WriteValue(file, m_Origin.CameraDirection);
+	WriteValue(file, m_Origin.ApertureRadius);
+	WriteValue(file, m_Origin.FocusDistance);
+	WriteValue(file, m_Origin.SceneHash);
+
+	WriteValue(file, (uint32_t)m_Ranges.size());
+	for (const Range& range : m_Ranges) {
+		WriteValue(file, range.First);
+		WriteValue(file, range.Count);
+	}
+
+	const size_t pixelCount = GetPixelCount();
+	for (int channel = 0; channel < ChannelCount; ++channel)
+		file.write(reinterpret_cast<const char*>(m_Sums.As<float>() + channel * m_PlaneStride), pixelCount * sizeof(float));
+	file.write(reinterpret_cast<const char*>(m_Counts.As<uint32_t>()), pixelCount * sizeof(uint32_t));
+
+	if (!file)
+		throw std::runtime_error("Could not write sample buffer: " + filename);
+}
+
+void SampleBuffer::Read(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open file for reading: " + filename);
+
+	char magic[sizeof(Magic)] = {};
+	file.read(magic, sizeof(magic));
+	if (memcmp(magic, Magic, sizeof(Magic)) != 0 || ReadValue<uint32_t>(file) != Version)
+		throw std::runtime_error("Not a sample buffer of a supported version: " + filename);
+
+	Origin origin;
+	origin.Width = ReadValue<uint32_t>(file);
+	origin.Height = ReadValue<uint32_t>(file);
+	origin.Seed = ReadValue<uint32_t>(file);
+	origin.MonteCarloNbSample = ReadValue<int32_t>(file);
+	origin.Antialiasing = ReadValue<uint8_t>(file) != 0;
+	origin.PrefilteredEnvironment = ReadValue<uint8_t>(file) != 0;
+	ReadValue<uint16_t>(file);
+	origin.CameraPosition = ReadValue<glm::vec3>(file);
+	origin.CameraDirection = ReadValue<glm::vec3>(file);
+	origin.ApertureRadius = ReadValue<float>(file);
+	origin.FocusDistance = ReadValue<float>(file);
+	origin.SceneHash = ReadValue<uint64_t>(file);
+
+	std::vector<Range> ranges(ReadValue<uint32_t>(file));
+	for (Range& range : ranges) {
+		range.First = ReadValue<uint64_t>(file);
+		range.Count = ReadValue<uint64_t>(file);
+	}
+	if (!file)
+		throw std::runtime_error("Truncated sample buffer: " + filename);
+
+	Resize(origin);
+	m_Ranges = std::move(ranges);
+
+	const size_t pixelCount = GetPixelCount();
+	for (int channel = 0; channel < ChannelCount; ++channel)
+		file.read(reinterpret_cast<char*>(m_Sums.As<float>() + channel * m_PlaneStride), pixelCount * sizeof(float));
+	file.read(reinterpret_cast<char*>(m_Counts.As<uint32_t>()), pixelCount * sizeof(uint32_t));
+	if (!file)
+		throw std::runtime_error("Truncated sample buffer: " + filename);
+}
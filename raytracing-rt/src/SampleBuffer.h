@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Framebuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Radiance summed over ranges of samples, not divided, with the number of samples each
+// pixel got. Buffers of disjoint ranges of the same render, made on any machine, add up
+// to the buffer of their union, and pixels that got unequal counts still weigh right.
+// Sums and counts are in separate aligned planes so a merge is a plain add of arrays.
+class SampleBuffer
+{
+public:
+	static const int ChannelCount = 3;
+
+	// what the samples depend on, buffers only merge with the same origin
+	struct Origin
+	{
+		uint32_t Width = 0, Height = 0;
+		uint32_t Seed = 0;
+		int MonteCarloNbSample = 0; // picks the environment footprint
+		bool Antialiasing = true;
+		bool PrefilteredEnvironment = false;
+		glm::vec3 CameraPosition{ 0.0f };
+		glm::vec3 CameraDirection{ 0.0f };
+		float ApertureRadius = 0.0f;
+		float FocusDistance = 0.0f;
+		uint64_t SceneHash = 0;
+
+		bool operator==(const Origin& other) const;
+		bool operator!=(const Origin& other) const { return !(*this == other); }
+	};
+
+	struct Range
+	{
+		uint64_t First = 0;
+		uint64_t Count = 0;
+	};
+
+	// start taking the samples [first, first + count) of origin, clears the buffer when it
+	// held samples of an other origin. Taking a range again is allowed for other pixels,
+	// rendering the same pixels twice counts their samples twice
+	void BeginRange(const Origin& origin, uint64_t first, uint64_t count);
+
+	// not synchronized, a pixel has to be added by one thread at a time
+	void Add(size_t index, const glm::vec3& sum, uint32_t count)
+	{
+		float* sums = m_Sums.As<float>();
+		sums[index] += sum.r;
+		sums[m_PlaneStride + index] += sum.g;
+		sums[2 * m_PlaneStride + index] += sum.b;
+		m_Counts.As<uint32_t>()[index] += count;
+	}
+
+	// add the samples of other, throws std::runtime_error when it comes from an other
+	// origin or when both hold the same samples of a pixel
+	void Merge(const SampleBuffer& other);
+
+	// sum divided by count, rgb interleaved, rows bottom to top, black where no sample landed
+	std::vector<float> Resolve() const;
+
+	const Origin& GetOrigin() const { return m_Origin; }
+	// sorted, adjacent ranges joined
+	const std::vector<Range>& GetRanges() const { return m_Ranges; }
+	uint64_t GetSampleCount() const;
+	size_t GetPixelCount() const { return (size_t)m_Origin.Width * m_Origin.Height; }
+	// bytes of sums and counts, what a merge reads
+	size_t GetByteSize() const { return m_PlaneStride * (ChannelCount * sizeof(float) + sizeof(uint32_t)); }
+
+	// .rtsamples files, throw std::runtime_error when the file can not be written or read.
+	// Read replaces what the buffer held
+	void Write(const std::string& filename) const;
+	void Read(const std::string& filename);
+
+private:
+	void Resize(const Origin& origin);
+	void AddRange(const Range& range);
+
+private:
+	Origin m_Origin;
+	std::vector<Range> m_Ranges;
+
+	AlignedBuffer m_Sums;
+	AlignedBuffer m_Counts;
+	// elements between two planes, rounded up to keep every plane aligned
+	size_t m_PlaneStride = 0;
+};
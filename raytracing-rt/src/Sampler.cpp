@@ -145,7 +145,8 @@ glm::vec3 Sampler::eval(glm::vec3 incomingOmega, Material material, glm::vec3 no
 float Sampler::pdf(glm::vec3 incomingOmega, Material material, glm::vec3 normal, glm::vec3 omega) const
 {
 	if (material.Type == DIFFUSE) {
-		return 1.0f / (float)M_PI;
+		// cosine weighted hemisphere
+		return glm::max(glm::dot(normal, omega), 0.0f) / (float)M_PI;
 	}
 	else if (material.Type == METALLIC) {
 		return 0.0f;
@@ -1,9 +1,367 @@
 #include "Scene.hpp"
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include "Hash.h"
 #include "Serialization.hpp"
-#include "include/stb_image.h"
+
+namespace {
+
+    // Binary scenes (.rtscene) hold the same data as the JSON ones but load in a
+    // single read of the sphere array, for the generated scenes of millions of spheres.
+    // little endian: magic, version, material count, materials, sphere count, spheres,
+    // then since version 3 the geometries (clusters and meshes) and the instances of them,
+    // since version 4 the planes, boxes and disks, since version 5 the SDF trees, since version 6
+    // the moving spheres.
+    // Version 2 had an untransformed mesh per instance instead
+    const char BinaryMagic[4] = { 'R', 'T', 'S', 'C' };
+    const uint32_t BinaryVersion = 6;
+    const char* BinaryExtension = ".rtscene";
+
+    struct BinarySphere
+    {
+        float Position[3];
+        float Radius;
+        int32_t MaterialIndex;
+    };
+    static_assert(sizeof(BinarySphere) == 20, "BinarySphere is read and written as is");
+    static_assert(sizeof(Plane) == 28 && sizeof(Box) == 40 && sizeof(Disk) == 32 && sizeof(MovingSphere) == 32, "primitives are read and written as they are in memory");
+
+    bool IsBinary(const std::filesystem::path& path)
+    {
+        return path.extension() == BinaryExtension;
+    }
+
+    template<typename T>
+    void Write(std::ostream& file, const T& value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    T Read(std::istream& file)
+    {
+        T value{};
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    void WriteArray(std::ostream& file, const std::vector<T>& values)
+    {
+        Write(file, (uint64_t)values.size());
+        file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    // a count of elements taking at least elementSize bytes each, checked against what is left
+    // of the stream before anything is allocated : a damaged or hostile count would ask for more
+    // memory than the file holds
+    uint64_t CheckCount(std::istream& file, const std::string& filename, uint64_t count, size_t elementSize)
+    {
+        const std::streampos position = file.tellg();
+        file.seekg(0, std::ios::end);
+        const std::streampos end = file.tellg();
+        file.seekg(position);
+        if (!file || position < 0 || end < position || count > (uint64_t)(end - position) / elementSize)
+            throw std::runtime_error("Truncated binary scene: " + filename);
+        return count;
+    }
+
+    // the smallest size on disk of what the counts of ReadBinary count
+    const size_t MinMaterialSize = sizeof(uint32_t) + 2 * sizeof(glm::vec3) + 6 * sizeof(float);
+    const size_t MinGeometrySize = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t);
+    const size_t MinInstanceSize = sizeof(uint32_t) + sizeof(int32_t) + 2 * sizeof(glm::vec3) + sizeof(float);
+    // version 2, a mesh per instance
+    const size_t MinMeshInstanceSize = sizeof(uint32_t) + sizeof(int32_t) + 3 * sizeof(uint64_t);
+    const size_t MinSdfNodeSize = sizeof(uint8_t) + sizeof(glm::vec3) + sizeof(glm::vec4) + sizeof(uint32_t);
+    const size_t MaxMaterialNameLength = 4096;
+
+    template<typename T>
+    std::vector<T> ReadArray(std::istream& file, const std::string& filename)
+    {
+        const uint64_t count = CheckCount(file, filename, Read<uint64_t>(file), sizeof(T));
+        std::vector<T> values((size_t)count);
+        file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T));
+        if (!file)
+            throw std::runtime_error("Truncated binary scene: " + filename);
+        return values;
+    }
+
+    std::vector<BinarySphere> PackSpheres(const std::vector<Sphere>& spheres)
+    {
+        std::vector<BinarySphere> packed(spheres.size());
+        for (size_t i = 0; i < spheres.size(); ++i)
+            packed[i] = { { spheres[i].Position.x, spheres[i].Position.y, spheres[i].Position.z }, spheres[i].Radius, spheres[i].MaterialIndex };
+        return packed;
+    }
+
+    std::vector<Sphere> UnpackSpheres(const std::vector<BinarySphere>& packed)
+    {
+        std::vector<Sphere> spheres(packed.size());
+        for (size_t i = 0; i < packed.size(); ++i)
+            spheres[i] = Sphere{ glm::vec3(packed[i].Position[0], packed[i].Position[1], packed[i].Position[2]), packed[i].Radius, packed[i].MaterialIndex };
+        return spheres;
+    }
+
+    void WriteString(std::ostream& file, const std::string& value)
+    {
+        Write(file, (uint32_t)value.size());
+        file.write(value.data(), value.size());
+    }
+
+    std::string ReadString(std::istream& file, const std::string& filename)
+    {
+        uint32_t length = Read<uint32_t>(file);
+        if (!file || length > (1u << 16))
+            throw std::runtime_error("Truncated binary scene: " + filename);
+        CheckCount(file, filename, length, 1);
+        std::string value(length, '\0');
+        file.read(&value[0], length);
+        return value;
+    }
+
+    // depth first, each node followed by its children
+    void WriteSdfNode(std::ostream& file, const SdfNode& node)
+    {
+        Write(file, (uint8_t)node.Op);
+        Write(file, node.Position);
+        Write(file, node.Params);
+        Write(file, (uint32_t)node.Children.size());
+        for (const SdfNode& child : node.Children)
+            WriteSdfNode(file, child);
+    }
+
+    SdfNode ReadSdfNode(std::istream& file, const std::string& filename, uint32_t depth)
+    {
+        SdfNode node;
+        node.Op = (SdfOp)Read<uint8_t>(file);
+        node.Position = Read<glm::vec3>(file);
+        node.Params = Read<glm::vec4>(file);
+        uint32_t childCount = Read<uint32_t>(file);
+        if (!file || node.Op >= SdfOp::Count || depth > SdfProgram::MaxStack || childCount > (1u << 16))
+            throw std::runtime_error("Truncated binary scene: " + filename);
+        CheckCount(file, filename, childCount, MinSdfNodeSize);
+        node.Children.reserve(childCount);
+        for (uint32_t i = 0; i < childCount; ++i)
+            node.Children.push_back(ReadSdfNode(file, filename, depth + 1));
+        return node;
+    }
+
+    std::shared_ptr<const Mesh> ReadMesh(std::istream& file, const std::string& filename)
+    {
+        std::vector<glm::vec3> positions = ReadArray<glm::vec3>(file, filename);
+        std::vector<glm::vec3> normals = ReadArray<glm::vec3>(file, filename);
+        std::vector<uint32_t> indices = ReadArray<uint32_t>(file, filename);
+        // the triangles were saved in BVH order, building again gives the same tree and hash
+        return std::make_shared<Mesh>(std::move(positions), std::move(normals), std::move(indices));
+    }
+
+    uint64_t HashSdfNode(const SdfNode& node, uint64_t hash)
+    {
+        const float values[] = {
+            (float)node.Op, node.Position.x, node.Position.y, node.Position.z,
+            node.Params.x, node.Params.y, node.Params.z, node.Params.w, (float)node.Children.size() };
+        hash = HashBytes(values, sizeof(values), hash);
+        for (const SdfNode& child : node.Children)
+            hash = HashSdfNode(child, hash);
+        return hash;
+    }
+
+    void WriteBinary(std::ostream& file, const Scene& scene)
+    {
+        file.write(BinaryMagic, sizeof(BinaryMagic));
+        Write(file, BinaryVersion);
+
+        Write(file, (uint32_t)scene.Materials.size());
+        for (const Material& material : scene.Materials) {
+            uint32_t nameLength = (uint32_t)strlen(material.Name);
+            Write(file, nameLength);
+            file.write(material.Name, nameLength);
+            Write(file, material.Albedo);
+            Write(file, material.Roughness);
+            Write(file, material.Metallic);
+            Write(file, material.EmissionColor);
+            Write(file, material.EmissionPower);
+            Write(file, (int32_t)material.Type);
+            Write(file, material.IndiceOut);
+            Write(file, material.IndiceIn);
+        }
+
+        WriteArray(file, PackSpheres(scene.Spheres));
+
+        // every geometry once with its data, a scene sent to a worker has no OBJ file.
+        // The clusters come first, then the geometry of the instances in order of use
+        std::map<const Geometry*, uint32_t> geometryIndex;
+        for (const auto& cluster : scene.Clusters)
+            geometryIndex.emplace(cluster.second.get(), (uint32_t)geometryIndex.size());
+        std::vector<const Instance*> others;
+        for (const Instance& instance : scene.Instances)
+            if (geometryIndex.emplace(instance.Shape.get(), (uint32_t)geometryIndex.size()).second)
+                others.push_back(&instance);
+
+        const auto writeCluster = [&](const std::string& name, const SphereCluster& cluster) {
+            Write(file, (uint8_t)Instance::Kind::Cluster);
+            WriteString(file, name);
+            WriteArray(file, PackSpheres(cluster.GetSpheres()));
+        };
+        Write(file, (uint32_t)geometryIndex.size());
+        for (const auto& cluster : scene.Clusters)
+            writeCluster(cluster.first, *cluster.second);
+        for (const Instance* instance : others) {
+            if (instance->Type == Instance::Kind::Cluster) {
+                writeCluster(instance->Source, static_cast<const SphereCluster&>(*instance->Shape));
+                continue;
+            }
+            const Mesh& mesh = static_cast<const Mesh&>(*instance->Shape);
+            Write(file, (uint8_t)Instance::Kind::Mesh);
+            WriteString(file, instance->Source);
+            WriteArray(file, mesh.GetPositions());
+            WriteArray(file, mesh.GetNormals());
+            WriteArray(file, mesh.GetIndices());
+        }
+
+        Write(file, (uint32_t)scene.Instances.size());
+        for (const Instance& instance : scene.Instances) {
+            Write(file, geometryIndex.at(instance.Shape.get()));
+            Write(file, (int32_t)instance.MaterialIndex);
+            Write(file, instance.Position);
+            Write(file, instance.Rotation);
+            Write(file, instance.Scale);
+        }
+
+        WriteArray(file, scene.Planes);
+        WriteArray(file, scene.Boxes);
+        WriteArray(file, scene.Disks);
+
+        Write(file, (uint32_t)scene.Sdfs.size());
+        for (const Sdf& sdf : scene.Sdfs) {
+            Write(file, (int32_t)sdf.MaterialIndex);
+            WriteSdfNode(file, sdf.Root);
+        }
+
+        WriteArray(file, scene.MovingSpheres);
+    }
+
+    void ReadBinary(std::istream& file, const std::string& filename, Scene& scene, const LoadProgressCallback& onProgress)
+    {
+        char magic[4];
+        file.read(magic, sizeof(magic));
+        const uint32_t version = Read<uint32_t>(file);
+        if (!file || memcmp(magic, BinaryMagic, sizeof(magic)) != 0 || version < 1 || version > BinaryVersion)
+            throw std::runtime_error("Not a binary scene of a supported version: " + filename);
+
+        std::vector<Material> loadedMaterials(CheckCount(file, filename, Read<uint32_t>(file), MinMaterialSize));
+        for (Material& material : loadedMaterials) {
+            uint32_t nameLength = Read<uint32_t>(file);
+            if (!file || nameLength > MaxMaterialNameLength)
+                throw std::runtime_error("Truncated binary scene: " + filename);
+            CheckCount(file, filename, nameLength, 1);
+            material.Name = new char[nameLength + 1];
+            file.read(material.Name, nameLength);
+            material.Name[nameLength] = '\0';
+            material.Albedo = Read<glm::vec3>(file);
+            material.Roughness = Read<float>(file);
+            material.Metallic = Read<float>(file);
+            material.EmissionColor = Read<glm::vec3>(file);
+            material.EmissionPower = Read<float>(file);
+            material.Type = (MaterialType)Read<int32_t>(file);
+            material.IndiceOut = Read<float>(file);
+            material.IndiceIn = Read<float>(file);
+        }
+
+        const uint64_t sphereCount = CheckCount(file, filename, Read<uint64_t>(file), sizeof(BinarySphere));
+
+        // by chunks so the progress can be reported
+        std::vector<Sphere> loadedSpheres(sphereCount);
+        std::vector<BinarySphere> chunk(1 << 16);
+        for (uint64_t offset = 0; offset < sphereCount; offset += chunk.size()) {
+            size_t count = (size_t)std::min<uint64_t>(chunk.size(), sphereCount - offset);
+            file.read(reinterpret_cast<char*>(chunk.data()), count * sizeof(BinarySphere));
+            if (!file)
+                throw std::runtime_error("Truncated binary scene: " + filename);
+
+            for (size_t i = 0; i < count; ++i) {
+                const BinarySphere& packed = chunk[i];
+                loadedSpheres[offset + i] = Sphere{ glm::vec3(packed.Position[0], packed.Position[1], packed.Position[2]), packed.Radius, packed.MaterialIndex };
+            }
+            if (onProgress)
+                onProgress((float)(offset + count) / (float)sphereCount);
+        }
+
+        std::map<std::string, std::shared_ptr<const SphereCluster>> loadedClusters;
+        std::vector<Instance> loadedInstances;
+        if (version == 2) {
+            // a mesh per instance, untransformed
+            loadedInstances.resize(CheckCount(file, filename, Read<uint32_t>(file), MinMeshInstanceSize));
+            for (Instance& instance : loadedInstances) {
+                instance.Source = ReadString(file, filename);
+                instance.MaterialIndex = Read<int32_t>(file);
+                instance.Shape = ReadMesh(file, filename);
+            }
+        }
+        else if (version >= 3) {
+            std::vector<Instance> geometries(CheckCount(file, filename, Read<uint32_t>(file), MinGeometrySize));
+            for (Instance& geometry : geometries) {
+                geometry.Type = (Instance::Kind)Read<uint8_t>(file);
+                geometry.Source = ReadString(file, filename);
+                if (geometry.Type == Instance::Kind::Cluster) {
+                    auto cluster = std::make_shared<SphereCluster>(UnpackSpheres(ReadArray<BinarySphere>(file, filename)));
+                    loadedClusters[geometry.Source] = cluster;
+                    geometry.Shape = cluster;
+                }
+                else {
+                    geometry.Shape = ReadMesh(file, filename);
+                }
+            }
+
+            loadedInstances.resize(CheckCount(file, filename, Read<uint32_t>(file), MinInstanceSize));
+            for (Instance& instance : loadedInstances) {
+                uint32_t geometry = Read<uint32_t>(file);
+                if (!file || geometry >= geometries.size())
+                    throw std::runtime_error("Truncated binary scene: " + filename);
+                instance = geometries[geometry];
+                instance.MaterialIndex = Read<int32_t>(file);
+                instance.Position = Read<glm::vec3>(file);
+                instance.Rotation = Read<glm::vec3>(file);
+                instance.Scale = Read<float>(file);
+            }
+        }
+        std::vector<Plane> loadedPlanes;
+        std::vector<Box> loadedBoxes;
+        std::vector<Disk> loadedDisks;
+        if (version >= 4) {
+            loadedPlanes = ReadArray<Plane>(file, filename);
+            loadedBoxes = ReadArray<Box>(file, filename);
+            loadedDisks = ReadArray<Disk>(file, filename);
+        }
+        std::vector<Sdf> loadedSdfs;
+        if (version >= 5) {
+            loadedSdfs.resize(CheckCount(file, filename, Read<uint32_t>(file), sizeof(int32_t) + MinSdfNodeSize));
+            for (Sdf& sdf : loadedSdfs) {
+                sdf.MaterialIndex = Read<int32_t>(file);
+                sdf.Root = ReadSdfNode(file, filename, 0);
+            }
+        }
+        std::vector<MovingSphere> loadedMovingSpheres;
+        if (version >= 6)
+            loadedMovingSpheres = ReadArray<MovingSphere>(file, filename);
+        if (!file)
+            throw std::runtime_error("Truncated binary scene: " + filename);
+
+        scene.Spheres = std::move(loadedSpheres);
+        scene.Materials = std::move(loadedMaterials);
+        scene.Clusters = std::move(loadedClusters);
+        scene.Instances = std::move(loadedInstances);
+        scene.Planes = std::move(loadedPlanes);
+        scene.Boxes = std::move(loadedBoxes);
+        scene.Disks = std::move(loadedDisks);
+        scene.Sdfs = std::move(loadedSdfs);
+        scene.MovingSpheres = std::move(loadedMovingSpheres);
+    }
+}
 
 void Scene::AddMaterial(char* Name,
 glm::vec3 Albedo,
@@ -27,11 +385,83 @@ void Scene::AddSphere(const Sphere& sphere) {
     Spheres.push_back(sphere);
 }
 
-void Scene::saveScene(const std::string& filename) const {
-    nlohmann::json j;
-    j["Spheres"] = Spheres;
-    j["Materials"] = Materials;
+void Scene::loadMesh(const std::string& filename, int materialIndex)
+{
+    std::filesystem::path fullPath = std::filesystem::current_path() / "scenes" / filename;
+    Instance instance;
+    instance.Type = Instance::Kind::Mesh;
+    instance.Source = filename;
+    instance.MaterialIndex = materialIndex;
+    instance.Shape = Mesh::LoadOBJ(fullPath.string());
+    Instances.push_back(std::move(instance));
+}
+
+void Scene::Prepare()
+{
+    SphereTree = std::make_shared<SphereBVH>(Spheres, TreeOptions);
+    MotionTree = std::make_shared<MotionBVH>(MovingSpheres, TreeOptions);
+    Lights = std::make_shared<LightBVH>(Spheres, Materials);
+    for (Instance& instance : Instances)
+        instance.UpdateTransform();
+    InstanceTree = std::make_shared<InstanceBVH>(Instances, TreeOptions);
+    Primitives = std::make_shared<PrimitiveSet>(Planes, Boxes, Disks, Sdfs, TreeOptions);
+    Hash = ComputeHash();
+}
+
+void Scene::UpdateSphere(size_t index)
+{
+    if (SphereTree && SphereTree->GetSphereCount() == Spheres.size())
+        SphereTree->Refit(Spheres, (uint32_t)index);
+    else
+        SphereTree = std::make_shared<SphereBVH>(Spheres, TreeOptions);
+
+    const bool emits = Materials[Spheres[index].MaterialIndex].GetEmission() != glm::vec3(0.0f);
+    if (emits && (!Lights || !Lights->Refit(Spheres, Materials, (uint32_t)index)))
+        Lights = std::make_shared<LightBVH>(Spheres, Materials);
+}
+
+uint64_t Scene::ComputeHash() const
+{
+    static_assert(sizeof(Sphere) == 5 * sizeof(float), "spheres are hashed as they are in memory");
+    uint64_t hash = HashBytes(Spheres.data(), Spheres.size() * sizeof(Sphere));
+
+    // field by field, the name is a pointer
+    for (const Material& material : Materials) {
+        hash = HashBytes(material.Name, strlen(material.Name), hash);
+        const float values[] = {
+            material.Albedo.r, material.Albedo.g, material.Albedo.b, material.Roughness, material.Metallic,
+            material.EmissionColor.r, material.EmissionColor.g, material.EmissionColor.b, material.EmissionPower,
+            (float)material.Type, material.IndiceOut, material.IndiceIn };
+        hash = HashBytes(values, sizeof(values), hash);
+    }
 
+    // each geometry hashed its primitives when it was built
+    for (const Instance& instance : Instances) {
+        const uint64_t geometry = instance.Shape->GetHash();
+        hash = HashBytes(&geometry, sizeof(geometry), hash);
+        const float values[] = {
+            (float)instance.MaterialIndex, instance.Position.x, instance.Position.y, instance.Position.z,
+            instance.Rotation.x, instance.Rotation.y, instance.Rotation.z, instance.Scale };
+        hash = HashBytes(values, sizeof(values), hash);
+    }
+
+    // left out when there are none, scenes without them keep the hash they had before
+    if (!Planes.empty())
+        hash = HashBytes(Planes.data(), Planes.size() * sizeof(Plane), hash);
+    if (!Boxes.empty())
+        hash = HashBytes(Boxes.data(), Boxes.size() * sizeof(Box), hash);
+    if (!Disks.empty())
+        hash = HashBytes(Disks.data(), Disks.size() * sizeof(Disk), hash);
+    for (const Sdf& sdf : Sdfs)
+        hash = HashSdfNode(sdf.Root, HashBytes(&sdf.MaterialIndex, sizeof(sdf.MaterialIndex), hash));
+    if (!MovingSpheres.empty())
+        hash = HashBytes(MovingSpheres.data(), MovingSpheres.size() * sizeof(MovingSphere), hash);
+
+    const int cubemap[] = { Cubemap.exist ? 1 : 0, Cubemap.faceSize, Cubemap.levelCount };
+    return HashBytes(cubemap, sizeof(cubemap), hash);
+}
+
+void Scene::saveScene(const std::string& filename) const {
     // Construct the full path to the scenes folder
     std::filesystem::path scenesFolder = std::filesystem::current_path() / "scenes";
     std::filesystem::path fullPath = scenesFolder / filename;
@@ -41,6 +471,35 @@ void Scene::saveScene(const std::string& filename) const {
         std::filesystem::create_directories(scenesFolder);
     }
 
+    if (IsBinary(fullPath)) {
+        std::ofstream file(fullPath, std::ios::binary);
+        if (!file.is_open())
+            throw std::runtime_error("Could not open file for writing: " + fullPath.string());
+        WriteBinary(file, *this);
+        return;
+    }
+
+    nlohmann::json j;
+    j["Spheres"] = Spheres;
+    j["Materials"] = Materials;
+    if (!Clusters.empty()) {
+        nlohmann::json& clusters = j["Clusters"];
+        for (const auto& cluster : Clusters)
+            clusters.push_back({ { "Name", cluster.first }, { "Spheres", cluster.second->GetSpheres() } });
+    }
+    if (!Instances.empty())
+        j["Instances"] = Instances;
+    if (!Planes.empty())
+        j["Planes"] = Planes;
+    if (!Boxes.empty())
+        j["Boxes"] = Boxes;
+    if (!Disks.empty())
+        j["Disks"] = Disks;
+    if (!Sdfs.empty())
+        j["Sdfs"] = Sdfs;
+    if (!MovingSpheres.empty())
+        j["MovingSpheres"] = MovingSpheres;
+
     std::ofstream file(fullPath);
     if (file.is_open()) {
         file << j.dump(4); // Pretty print with 4 spaces of indentation
@@ -51,51 +510,91 @@ void Scene::saveScene(const std::string& filename) const {
     }
 }
 
-void Scene::loadCubemap(const char * filename)
+void Scene::Serialize(std::ostream& stream) const
 {
+    WriteBinary(stream, *this);
+}
 
-    std::filesystem::path cubemapsFolder = std::filesystem::current_path() / "cubemaps";
-    std::filesystem::path fullPath = cubemapsFolder / filename;
-
-    // Ensure the scenes directory exists
-    if (!std::filesystem::exists(cubemapsFolder)) {
-        std::filesystem::create_directories(cubemapsFolder);
-        Cubemap.exist = false;
-        return ;
-    }
-
-    std::string fullPathStr = fullPath.string();
-    const char* fullPathCStr = fullPathStr.c_str();
-
-
-    int n, ok;
-    ok = stbi_info(fullPathCStr, &Cubemap.width, &Cubemap.height, &Cubemap.nchannel);
-    if (ok) {
-        Cubemap.data = stbi_load(fullPathCStr, &Cubemap.width, &Cubemap.height, &Cubemap.nchannel, 0);
-        Cubemap.exist = true;
-    }
-    else {
-        Cubemap.exist = false;
+void Scene::Deserialize(std::istream& stream, const std::string& source)
+{
+    ReadBinary(stream, source, *this, nullptr);
+}
 
-        return;
-    }
+void Scene::loadCubemap(const char * filename)
+{
+    Cubemap = ::Cubemap::Load(filename);
 }
 
-void Scene::loadScene(const std::string& filename) {
+void Scene::loadScene(const std::string& filename, const LoadProgressCallback& onProgress) {
 
     // Construct the full path to the scenes folder
     std::filesystem::path scenesFolder = std::filesystem::current_path() / "scenes";
     std::filesystem::path fullPath = scenesFolder / filename;
 
-    std::ifstream file(fullPath);
-    if (file.is_open()) {
-        nlohmann::json j;
-        file >> j;
+    std::ifstream file(fullPath, std::ios::binary);
+    if (file.is_open() && IsBinary(fullPath)) {
+        ReadBinary(file, fullPath.string(), *this, onProgress);
+    }
+    else if (file.is_open()) {
+        // read by chunks so the progress can be reported, parsing takes the last half
+        const size_t size = std::filesystem::file_size(fullPath);
+        std::string content(size, '\0');
+        const size_t chunkSize = 1 << 20;
+        for (size_t offset = 0; offset < size; offset += chunkSize) {
+            file.read(&content[offset], std::min(chunkSize, size - offset));
+            if (onProgress)
+                onProgress(0.5f * (float)std::min(offset + chunkSize, size) / (float)size);
+        }
+        file.close();
+
+        nlohmann::json j = nlohmann::json::parse(content);
 
         Spheres = j.at("Spheres").get<std::vector<Sphere>>();
         Materials = j.at("Materials").get<std::vector<Material>>();
 
-        file.close();
+        Clusters.clear();
+        if (j.contains("Clusters")) {
+            for (const nlohmann::json& cluster : j.at("Clusters"))
+                Clusters[cluster.at("Name").get<std::string>()] = std::make_shared<SphereCluster>(cluster.at("Spheres").get<std::vector<Sphere>>());
+        }
+
+        // "Meshes" holds untransformed mesh instances, from before the instances
+        Instances = j.value("Instances", std::vector<Instance>());
+        for (const nlohmann::json& mesh : j.value("Meshes", nlohmann::json::array())) {
+            Instance& instance = Instances.emplace_back();
+            instance.Source = mesh.at("File").get<std::string>();
+            instance.MaterialIndex = mesh.at("MaterialIndex").get<int>();
+        }
+
+        Planes = j.value("Planes", std::vector<Plane>());
+        Boxes = j.value("Boxes", std::vector<Box>());
+        Disks = j.value("Disks", std::vector<Disk>());
+        Sdfs = j.value("Sdfs", std::vector<Sdf>());
+        MovingSpheres = j.value("MovingSpheres", std::vector<MovingSphere>());
+
+        // OBJ files next to the scene, the instances of a file share its geometry
+        std::map<std::string, std::shared_ptr<const Mesh>> meshes;
+        for (size_t i = 0; i < Instances.size(); ++i) {
+            Instance& instance = Instances[i];
+            if (instance.Type == Instance::Kind::Cluster) {
+                auto cluster = Clusters.find(instance.Source);
+                if (cluster == Clusters.end())
+                    throw std::runtime_error("Instance of an unknown cluster " + instance.Source + ": " + fullPath.string());
+                instance.Shape = cluster->second;
+                continue;
+            }
+
+            std::shared_ptr<const Mesh>& mesh = meshes[instance.Source];
+            if (!mesh) {
+                mesh = Mesh::LoadOBJ((fullPath.parent_path() / instance.Source).string());
+                if (onProgress)
+                    onProgress(0.5f + 0.5f * (float)(i + 1) / (float)Instances.size());
+            }
+            instance.Shape = mesh;
+        }
+
+        if (onProgress)
+            onProgress(1.0f);
     }
     else {
         throw std::runtime_error("Could not open file for reading: " + fullPath.string());
@@ -1,27 +1,52 @@
 #pragma once
 
+#include <iosfwd>
+#include <map>
 #include <vector>
 #include <string>
+#include "Cubemap.hpp"
+#include "Instance.h"
+#include "LightBVH.h"
 #include "Material.hpp"
+#include "Mesh.h"
+#include "MotionBVH.h"
+#include "Primitives.h"
 #include "Sphere.hpp"
-
-struct Cubemap
-{
-    bool exist;
-    unsigned char* data;
-    int width;
-    int height;
-    int nchannel;
-};
-
+#include "SphereBVH.h"
+#include "SphereCluster.h"
 
 struct Scene
 {
     std::vector<Sphere> Spheres;
+    // blurred along their path over the shutter interval, apart from the spheres so still scenes pay nothing for them
+    std::vector<MovingSphere> MovingSpheres;
     std::vector<Material> Materials;
+    // groups of spheres the instances refer to by name
+    std::map<std::string, std::shared_ptr<const SphereCluster>> Clusters;
+    std::vector<Instance> Instances;
+    // floors, walls and other flat shapes, cheaper than huge spheres
+    std::vector<Plane> Planes;
+    std::vector<Box> Boxes;
+    std::vector<Disk> Disks;
+    // procedural shapes, sphere traced
+    std::vector<Sdf> Sdfs;
     Cubemap Cubemap;
+    // how Prepare builds the sphere and instance trees, the hash leaves it out
+    BVHBuildOptions TreeOptions;
+    // built by Prepare from the spheres, refit by UpdateSphere
+    std::shared_ptr<SphereBVH> SphereTree;
+    // built by Prepare from the moving spheres
+    std::shared_ptr<const MotionBVH> MotionTree;
+    // built by Prepare from the emissive spheres, refit by UpdateSphere
+    std::shared_ptr<LightBVH> Lights;
+    // built by Prepare from the instances
+    std::shared_ptr<const InstanceBVH> InstanceTree;
+    // built by Prepare from the planes, boxes, disks and SDFs
+    std::shared_ptr<const PrimitiveSet> Primitives;
 
     bool pass;
+    // identifies the spheres, moving spheres, instances, primitives, materials and cubemap size a render was made of, set by Prepare
+    uint64_t Hash = 0;
 
     void Scene::AddMaterial(char* Name,
         glm::vec3 Albedo,
@@ -34,8 +59,23 @@ struct Scene
         float IndiceIn);
     void AddSphere(const glm::vec3& position, float radius, int materialIndex);
     void AddSphere(const Sphere& sphere);
+    // instance of an OBJ file in the scenes folder, where it was modelled
+    void loadMesh(const std::string& filename, int materialIndex);
+    // in the scenes folder, as JSON or as a binary scene when the name ends with .rtscene
     void saveScene(const std::string& filename) const;
+    // spheres, instances with their geometry, primitives and materials in the binary scene format, to send a scene without a file,
+    // source names the stream in errors
+    void Serialize(std::ostream& stream) const;
+    void Deserialize(std::istream& stream, const std::string& source);
+
+    // rebuild what the renderer derives from the spheres, instances, primitives and materials, to call after editing them
+    void Prepare();
+    // after moving or resizing Spheres[index] : refits the sphere tree above it, and the light
+    // tree when it emits, instead of building them again. Leaves Hash as it was, computing it
+    // walks every sphere
+    void UpdateSphere(size_t index);
+    uint64_t ComputeHash() const;
 
     void loadCubemap(const char* name);
-    void loadScene(const std::string& filename);
+    void loadScene(const std::string& filename, const LoadProgressCallback& onProgress = nullptr);
 };
@@ -0,0 +1,258 @@
+#include "SceneGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MyRand.h"
+
+#define M_PI 3.14159265358979323846  /* pi */
+
+namespace {
+
+	// own generator, so the scene does not depend on the renderer's streams
+	class Random
+	{
+	public:
+		explicit Random(uint32_t seed) { m_Pcg.seed(seed, 0x5ce4e); }
+
+		float Uniform() { return (float)(m_Pcg.next() >> 8) * (1.0f / 16777216.0f); }
+		float Uniform(float min, float max) { return min + (max - min) * Uniform(); }
+		glm::vec3 InCube(float extent) { return glm::vec3(Uniform(-extent, extent), Uniform(-extent, extent), Uniform(-extent, extent)); }
+
+		// Box-Muller
+		float Normal()
+		{
+			float u1 = std::max(Uniform(), 1e-7f);
+			float u2 = Uniform();
+			return sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float)M_PI * u2);
+		}
+
+		glm::vec3 InBall(float radius)
+		{
+			glm::vec3 p;
+			do {
+				p = InCube(1.0f);
+			} while (glm::dot(p, p) > 1.0f);
+			return p * radius;
+		}
+
+	private:
+		CustomRand::Pcg32 m_Pcg;
+	};
+
+	// a small palette per type, spheres share their materials
+	const int PaletteSize = 8;
+
+	struct Palette
+	{
+		int Diffuse, Metallic, Dielectric, Emissive;
+	};
+
+	// material names own their storage, as the ones of loaded scenes
+	char* CopyName(const char* name)
+	{
+		char* copy = new char[strlen(name) + 1];
+		strcpy(copy, name);
+		return copy;
+	}
+
+	Palette AddMaterials(Scene& scene, Random& random)
+	{
+		Palette palette;
+
+		palette.Diffuse = (int)scene.Materials.size();
+		for (int i = 0; i < PaletteSize; ++i) {
+			Material& material = scene.Materials.emplace_back();
+			material.Name = CopyName("Generated diffuse");
+			material.Albedo = glm::vec3(random.Uniform(0.1f, 0.9f), random.Uniform(0.1f, 0.9f), random.Uniform(0.1f, 0.9f));
+			material.Roughness = random.Uniform(0.5f, 1.0f);
+		}
+
+		palette.Metallic = (int)scene.Materials.size();
+		for (int i = 0; i < PaletteSize; ++i) {
+			Material& material = scene.Materials.emplace_back();
+			material.Name = CopyName("Generated metallic");
+			material.Type = METALLIC;
+			material.Albedo = glm::vec3(random.Uniform(0.5f, 1.0f), random.Uniform(0.5f, 1.0f), random.Uniform(0.5f, 1.0f));
+			material.Roughness = random.Uniform(0.0f, 0.3f);
+			material.Metallic = 1.0f;
+		}
+
+		palette.Dielectric = (int)scene.Materials.size();
+		for (int i = 0; i < PaletteSize; ++i) {
+			Material& material = scene.Materials.emplace_back();
+			material.Name = CopyName("Generated glass");
+			material.Type = DIELECTRIC;
+			material.IndiceOut = 1.0f;
+			material.IndiceIn = random.Uniform(1.3f, 1.8f);
+		}
+
+		palette.Emissive = (int)scene.Materials.size();
+		for (int i = 0; i < PaletteSize; ++i) {
+			Material& material = scene.Materials.emplace_back();
+			material.Name = CopyName("Generated light");
+			material.Albedo = glm::vec3(random.Uniform(0.5f, 1.0f), random.Uniform(0.5f, 1.0f), random.Uniform(0.5f, 1.0f));
+			material.EmissionColor = material.Albedo;
+			material.EmissionPower = random.Uniform(2.0f, 10.0f);
+		}
+
+		return palette;
+	}
+
+	int PickMaterial(const SceneGeneratorSettings& settings, const Palette& palette, Random& random)
+	{
+		int variant = std::min((int)(random.Uniform() * PaletteSize), PaletteSize - 1);
+		if (random.Uniform() < settings.EmissiveFraction)
+			return palette.Emissive + variant;
+
+		float total = settings.DiffuseWeight + settings.MetallicWeight + settings.DielectricWeight;
+		float u = random.Uniform() * total;
+		if (u < settings.DiffuseWeight || total <= 0.0f)
+			return palette.Diffuse + variant;
+		if (u < settings.DiffuseWeight + settings.MetallicWeight)
+			return palette.Metallic + variant;
+		return palette.Dielectric + variant;
+	}
+
+}
+
+Scene GenerateScene(const SceneGeneratorSettings& settings)
+{
+	Random random(settings.Seed);
+
+	Scene scene;
+	scene.Cubemap.exist = false;
+	scene.pass = false;
+
+	const Palette palette = AddMaterials(scene, random);
+	const glm::vec3 center(0.0f, 0.0f, -settings.Extent);
+	const float extent = settings.Extent;
+
+	// the grid of copies, centered on the first one
+	const uint32_t gridSide = (uint32_t)std::ceil(std::sqrt((double)settings.InstanceCount));
+	const float spacing = 2.2f * extent;
+
+	// under the whole grid
+	if (settings.Ground)
+		scene.Planes.push_back(Plane{ center - glm::vec3(0.0f, extent, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), palette.Diffuse });
+
+	scene.Spheres.reserve(settings.SphereCount);
+
+	std::vector<glm::vec3> clusters;
+	if (settings.Distribution == SphereDistribution::Clustered) {
+		for (int i = 0; i < std::max(settings.ClusterCount, 1); ++i)
+			clusters.push_back(center + random.InCube(extent * 0.8f));
+	}
+
+	const int chainLength = 8;
+	Sphere parent;
+
+	for (uint32_t i = 0; i < settings.SphereCount; ++i) {
+		Sphere sphere;
+		sphere.MaterialIndex = PickMaterial(settings, palette, random);
+
+		switch (settings.Distribution) {
+		case SphereDistribution::Uniform:
+			sphere.Position = center + random.InCube(extent);
+			sphere.Radius = random.Uniform(settings.MinRadius, settings.MaxRadius);
+			break;
+
+		case SphereDistribution::Clustered: {
+			const glm::vec3& cluster = clusters[std::min((size_t)(random.Uniform() * clusters.size()), clusters.size() - 1)];
+			float sigma = extent * 0.05f;
+			sphere.Position = cluster + sigma * glm::vec3(random.Normal(), random.Normal(), random.Normal());
+			sphere.Radius = random.Uniform(settings.MinRadius, settings.MaxRadius);
+			break;
+		}
+
+		case SphereDistribution::Nested:
+			// the first of a chain is large, each next one fits inside the previous
+			if (i % chainLength == 0) {
+				sphere.Radius = random.Uniform(settings.MaxRadius, settings.MaxRadius * 4.0f);
+				sphere.Position = center + random.InCube(extent);
+			}
+			else {
+				sphere.Radius = parent.Radius * random.Uniform(0.5f, 0.8f);
+				sphere.Position = parent.Position + random.InBall(parent.Radius - sphere.Radius);
+			}
+			parent = sphere;
+			break;
+
+		case SphereDistribution::MixedScale:
+			// 1 in 50 is a giant, the others are a tenth of the usual size
+			if (random.Uniform() < 0.02f)
+				sphere.Radius = random.Uniform(extent * 0.1f, extent * 0.4f);
+			else
+				sphere.Radius = random.Uniform(settings.MinRadius, settings.MaxRadius) * 0.1f;
+			sphere.Position = center + random.InCube(extent);
+			break;
+
+		default:
+			break;
+		}
+
+		scene.Spheres.push_back(sphere);
+	}
+
+	if (settings.MovingFraction > 0.0f && settings.InstanceCount == 0) {
+		std::vector<Sphere> spheres = std::move(scene.Spheres);
+		scene.Spheres.clear();
+		for (const Sphere& sphere : spheres) {
+			const bool emits = sphere.MaterialIndex >= palette.Emissive && sphere.MaterialIndex < palette.Emissive + PaletteSize;
+			if (emits || random.Uniform() >= settings.MovingFraction) {
+				scene.Spheres.push_back(sphere);
+				continue;
+			}
+			const glm::vec3 direction = glm::normalize(glm::vec3(random.Normal(), random.Normal(), random.Normal()));
+			scene.MovingSpheres.push_back(MovingSphere{ sphere.Position, sphere.Radius, sphere.MaterialIndex, sphere.Position + settings.MotionLength * direction });
+		}
+	}
+
+	if (settings.InstanceCount > 0) {
+		// the cluster is modelled around its origin
+		std::vector<Sphere> spheres = std::move(scene.Spheres);
+		for (Sphere& sphere : spheres)
+			sphere.Position -= center;
+		scene.Spheres.clear();
+		std::shared_ptr<const SphereCluster> cluster = std::make_shared<SphereCluster>(std::move(spheres));
+		scene.Clusters["generated"] = cluster;
+
+		scene.Instances.reserve(settings.InstanceCount);
+		for (uint32_t i = 0; i < settings.InstanceCount; ++i) {
+			Instance& instance = scene.Instances.emplace_back();
+			instance.Type = Instance::Kind::Cluster;
+			instance.Source = "generated";
+			instance.Shape = cluster;
+			const float column = (float)(i % gridSide) - 0.5f * (float)(gridSide - 1);
+			const float row = (float)(i / gridSide);
+			instance.Position = center + glm::vec3(column * spacing, 0.0f, -row * spacing);
+			instance.Rotation.y = random.Uniform(0.0f, 360.0f);
+			instance.Scale = random.Uniform(0.8f, 1.2f);
+		}
+	}
+
+	return scene;
+}
+
+const char* GetDistributionName(SphereDistribution distribution)
+{
+	switch (distribution) {
+	case SphereDistribution::Uniform: return "uniform";
+	case SphereDistribution::Clustered: return "clustered";
+	case SphereDistribution::Nested: return "nested";
+	case SphereDistribution::MixedScale: return "mixed-scale";
+	default: return "";
+	}
+}
+
+bool ParseDistribution(const char* name, SphereDistribution& distribution)
+{
+	for (int i = 0; i < (int)SphereDistribution::Count; ++i) {
+		if (strcmp(name, GetDistributionName((SphereDistribution)i)) == 0) {
+			distribution = (SphereDistribution)i;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Scene.hpp"
+
+// Procedural scenes of many spheres, to stress the traversal and the scene loading.
+// The same settings always give the same scene.
+enum class SphereDistribution
+{
+	Uniform,    // spread over the whole volume
+	Clustered,  // gaussian blobs around a few centers
+	Nested,     // chains of spheres each inside the previous one
+	MixedScale, // a few huge spheres among many tiny ones
+	Count
+};
+
+struct SceneGeneratorSettings
+{
+	uint32_t SphereCount = 1000;
+	SphereDistribution Distribution = SphereDistribution::Uniform;
+	uint32_t Seed = 1;
+
+	// spheres fill a cube of this half size, centered in front of the default camera
+	float Extent = 10.0f;
+	float MinRadius = 0.05f;
+	float MaxRadius = 0.3f;
+	int ClusterCount = 16;
+
+	// relative weights of the material types
+	float DiffuseWeight = 0.6f;
+	float MetallicWeight = 0.25f;
+	float DielectricWeight = 0.15f;
+	// fraction of the spheres that are lights, taken before the weights
+	float EmissiveFraction = 0.02f;
+
+	// plane under the volume
+	bool Ground = true;
+
+	// when not 0, the spheres make a cluster placed that many times on a square grid,
+	// one volume apart, each copy turned around the vertical and scaled. A forest of
+	// thousands of copies stores the spheres once
+	uint32_t InstanceCount = 0;
+
+	// fraction of the spheres that move while the shutter is open, in a random direction
+	// over MotionLength. The lights stay still, and so does the cluster of the instances
+	float MovingFraction = 0.0f;
+	float MotionLength = 0.5f;
+};
+
+Scene GenerateScene(const SceneGeneratorSettings& settings);
+
+const char* GetDistributionName(SphereDistribution distribution);
+// false when the name is not one of GetDistributionName
+bool ParseDistribution(const char* name, SphereDistribution& distribution);
@@ -0,0 +1,124 @@
+#include "SceneLoader.h"
+
+#include <filesystem>
+#include <iostream>
+
+SceneLoader::~SceneLoader()
+{
+    // the worker reports progress into this object, wait for it before tearing down
+    if (m_PendingScene.valid())
+        m_PendingScene.wait();
+    if (m_PendingCubemap.valid())
+        m_PendingCubemap.wait();
+    if (m_PendingMesh.valid())
+        m_PendingMesh.wait();
+}
+
+bool SceneLoader::LoadSceneAsync(const std::string& filename, const BVHBuildOptions& treeOptions)
+{
+    if (!Start(Job::Scene, filename))
+        return false;
+
+    m_PendingScene = std::async(std::launch::async, [this, filename, treeOptions]()
+        {
+            std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+            scene->loadScene(filename, [this](float progress) { m_Progress = progress; });
+            scene->TreeOptions = treeOptions;
+            scene->Prepare();
+            return scene;
+        });
+    return true;
+}
+
+bool SceneLoader::LoadCubemapAsync(const std::string& filename)
+{
+    if (!Start(Job::Cubemap, filename))
+        return false;
+
+    m_PendingCubemap = std::async(std::launch::async, [this, filename]()
+        {
+            Cubemap cubemap = Cubemap::Load(filename, [this](float progress) { m_Progress = progress; });
+            return cubemap;
+        });
+    return true;
+}
+
+bool SceneLoader::LoadMeshAsync(const std::string& filename, int materialIndex)
+{
+    if (!Start(Job::Mesh, filename))
+        return false;
+
+    m_MeshMaterial = materialIndex;
+    m_PendingMesh = std::async(std::launch::async, [this, filename]()
+        {
+            std::filesystem::path fullPath = std::filesystem::current_path() / "scenes" / filename;
+            return Mesh::LoadOBJ(fullPath.string(), [this](float progress) { m_Progress = progress; });
+        });
+    return true;
+}
+
+bool SceneLoader::Start(Job job, const std::string& filename)
+{
+    // the previous result has to be applied before starting a new job
+    if (m_Job != Job::None)
+        return false;
+
+    m_Job = job;
+    m_CurrentFile = filename;
+    m_Progress = 0.0f;
+    return true;
+}
+
+bool SceneLoader::IsBusy() const
+{
+    const auto ready = [](const auto& future) { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; };
+
+    if (m_Job == Job::Scene)
+        return !ready(m_PendingScene);
+    if (m_Job == Job::Cubemap)
+        return !ready(m_PendingCubemap);
+    if (m_Job == Job::Mesh)
+        return !ready(m_PendingMesh);
+    return false;
+}
+
+bool SceneLoader::ApplyPending(Scene& scene)
+{
+    if (m_Job == Job::None || IsBusy())
+        return false;
+
+    Job job = m_Job;
+    m_Job = Job::None;
+
+    try {
+        if (job == Job::Scene) {
+            std::shared_ptr<Scene> loaded = m_PendingScene.get();
+            // the cubemap is not part of the scene file, keep the current one
+            loaded->Cubemap = std::move(scene.Cubemap);
+            loaded->pass = scene.pass;
+            scene = std::move(*loaded);
+        }
+        else if (job == Job::Cubemap) {
+            // the previous cubemap buffer is released here, unless an other scene still holds it
+            scene.Cubemap = m_PendingCubemap.get();
+        }
+        else {
+            Instance instance;
+            instance.Type = Instance::Kind::Mesh;
+            instance.Source = m_CurrentFile;
+            instance.MaterialIndex = m_MeshMaterial;
+            instance.Shape = m_PendingMesh.get();
+            scene.Instances.push_back(std::move(instance));
+            // the instance tree has to take it
+            scene.Prepare();
+        }
+        // the hash covers the cubemap and the meshes, one of them just changed
+        scene.Hash = scene.ComputeHash();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading " << m_CurrentFile << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
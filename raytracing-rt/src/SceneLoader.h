@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Scene.hpp"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+
+// Loads scenes and cubemaps on a background worker.
+// The result is only handed over to the rendered scene by ApplyPending, which the UI
+// calls between two render passes so a pass never sees a half loaded scene.
+class SceneLoader
+{
+public:
+    SceneLoader() = default;
+    ~SceneLoader();
+
+    // return false if a load is already running. The scene is prepared with the given trees
+    bool LoadSceneAsync(const std::string& filename, const BVHBuildOptions& treeOptions = BVHBuildOptions());
+    bool LoadCubemapAsync(const std::string& filename);
+    // OBJ file in the scenes folder, added to the scene with the given material
+    bool LoadMeshAsync(const std::string& filename, int materialIndex);
+
+    bool IsBusy() const;
+    float GetProgress() const { return m_Progress; }
+    const std::string& GetCurrentFile() const { return m_CurrentFile; }
+
+    // swap the finished scene or cubemap into scene or add the mesh, return true if scene changed
+    // a loaded scene comes already prepared
+    bool ApplyPending(Scene& scene);
+
+private:
+    enum class Job
+    {
+        None,
+        Scene,
+        Cubemap,
+        Mesh
+    };
+
+    bool Start(Job job, const std::string& filename);
+
+private:
+    Job m_Job = Job::None;
+    std::string m_CurrentFile;
+
+    std::future<std::shared_ptr<Scene>> m_PendingScene;
+    std::future<Cubemap> m_PendingCubemap;
+    std::future<std::shared_ptr<const Mesh>> m_PendingMesh;
+    int m_MeshMaterial = 0;
+
+    std::atomic<float> m_Progress{ 0.0f };
+};
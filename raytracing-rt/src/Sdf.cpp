@@ -0,0 +1,250 @@
+#include "Sdf.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+	float BoxDistance(const glm::vec3& p, const glm::vec3& halfSize)
+	{
+		glm::vec3 q = glm::abs(p) - halfSize;
+		return glm::length(glm::max(q, glm::vec3(0.0f))) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+	}
+
+	// unit sponge in [-1, 1], each iteration carves the crosses of the next third
+	float MengerDistance(const glm::vec3& p, int iterations)
+	{
+		float d = BoxDistance(p, glm::vec3(1.0f));
+		float scale = 1.0f;
+		for (int i = 0; i < iterations; ++i) {
+			glm::vec3 a;
+			for (int axis = 0; axis < 3; ++axis) {
+				float x = p[axis] * scale;
+				a[axis] = x - 2.0f * std::floor(x * 0.5f) - 1.0f;
+			}
+			scale *= 3.0f;
+			glm::vec3 r = glm::abs(glm::vec3(1.0f) - 3.0f * glm::abs(a));
+			float da = std::max(r.x, r.y), db = std::max(r.y, r.z), dc = std::max(r.z, r.x);
+			d = std::max(d, (std::min(da, std::min(db, dc)) - 1.0f) / scale);
+		}
+		return d;
+	}
+
+	BVH::Bounds Intersection(const BVH::Bounds& a, const BVH::Bounds& b)
+	{
+		BVH::Bounds bounds;
+		bounds.Min = glm::max(a.Min, b.Min);
+		bounds.Max = glm::min(a.Max, b.Max);
+		return bounds;
+	}
+
+	// entry and exit of the ray in box, false when it misses
+	bool Clip(const BVH::Bounds& box, const Ray& ray, float& tEnter, float& tExit)
+	{
+		tEnter = 0.0f;
+		tExit = std::numeric_limits<float>::max();
+		for (int axis = 0; axis < 3; ++axis) {
+			float d = ray.Direction[axis];
+			if (std::abs(d) < 1e-20f) {
+				if (ray.Origin[axis] < box.Min[axis] || ray.Origin[axis] > box.Max[axis])
+					return false;
+				continue;
+			}
+			float t0 = (box.Min[axis] - ray.Origin[axis]) / d, t1 = (box.Max[axis] - ray.Origin[axis]) / d;
+			tEnter = std::max(tEnter, std::min(t0, t1));
+			tExit = std::min(tExit, std::max(t0, t1));
+		}
+		return tEnter <= tExit;
+	}
+
+}
+
+const char* GetSdfOpName(SdfOp op)
+{
+	switch (op) {
+	case SdfOp::Sphere: return "Sphere";
+	case SdfOp::Box: return "Box";
+	case SdfOp::RoundBox: return "RoundBox";
+	case SdfOp::Torus: return "Torus";
+	case SdfOp::Menger: return "Menger";
+	case SdfOp::Union: return "Union";
+	case SdfOp::Intersection: return "Intersection";
+	case SdfOp::Subtraction: return "Subtraction";
+	case SdfOp::SmoothUnion: return "SmoothUnion";
+	default: return "";
+	}
+}
+
+bool ParseSdfOp(const char* name, SdfOp& op)
+{
+	for (int i = 0; i < (int)SdfOp::Count; ++i) {
+		if (strcmp(name, GetSdfOpName((SdfOp)i)) == 0) {
+			op = (SdfOp)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+SdfProgram::SdfProgram(const SdfNode& root)
+{
+	if (Compile(root, glm::vec3(0.0f)) > MaxStack)
+		throw std::runtime_error("SDF nested too deeply");
+	m_Bounds = ComputeBounds(root, glm::vec3(0.0f));
+}
+
+uint32_t SdfProgram::Compile(const SdfNode& node, const glm::vec3& offset)
+{
+	const glm::vec3 position = offset + node.Position;
+	if (IsSdfShape(node.Op)) {
+		m_Code.push_back({ node.Op, position, node.Params });
+		return 1;
+	}
+	// an operator without children is empty space
+	if (node.Children.empty()) {
+		m_Code.push_back({ SdfOp::Sphere, position, glm::vec4(-std::numeric_limits<float>::max()) });
+		return 1;
+	}
+
+	// each next child is combined with what the ones before it made
+	uint32_t depth = Compile(node.Children[0], position);
+	for (size_t i = 1; i < node.Children.size(); ++i) {
+		depth = std::max(depth, 1 + Compile(node.Children[i], position));
+		m_Code.push_back({ node.Op, position, node.Params });
+	}
+	return depth;
+}
+
+BVH::Bounds SdfProgram::ComputeBounds(const SdfNode& node, const glm::vec3& offset)
+{
+	const glm::vec3 position = offset + node.Position;
+	BVH::Bounds bounds;
+	glm::vec3 extent(0.0f);
+	switch (node.Op) {
+	case SdfOp::Sphere: extent = glm::vec3(node.Params.x); break;
+	case SdfOp::Box:
+	case SdfOp::RoundBox: extent = glm::abs(glm::vec3(node.Params)); break;
+	case SdfOp::Torus: extent = glm::vec3(node.Params.x + node.Params.y, node.Params.y, node.Params.x + node.Params.y); break;
+	case SdfOp::Menger: extent = glm::vec3(node.Params.x); break;
+	default:
+		if (node.Children.empty())
+			return bounds;
+		bounds = ComputeBounds(node.Children[0], position);
+		for (size_t i = 1; i < node.Children.size(); ++i) {
+			const BVH::Bounds child = ComputeBounds(node.Children[i], position);
+			if (node.Op == SdfOp::Intersection)
+				bounds = Intersection(bounds, child);
+			// the others can only take away from the first child
+			else if (node.Op != SdfOp::Subtraction)
+				bounds.Grow(child);
+		}
+		// the blend pulls the surface out by up to a quarter of its distance
+		if (node.Op == SdfOp::SmoothUnion) {
+			bounds.Min -= glm::vec3(0.25f * node.Params.x);
+			bounds.Max += glm::vec3(0.25f * node.Params.x);
+		}
+		return bounds;
+	}
+	bounds.Grow(position - extent);
+	bounds.Grow(position + extent);
+	return bounds;
+}
+
+float SdfProgram::Evaluate(const glm::vec3& p) const
+{
+	float stack[MaxStack];
+	uint32_t top = 0;
+	for (const Instruction& instruction : m_Code) {
+		const glm::vec3 local = p - instruction.Offset;
+		const glm::vec4& params = instruction.Params;
+		switch (instruction.Op) {
+		case SdfOp::Sphere:
+			stack[top++] = glm::length(local) - params.x;
+			break;
+		case SdfOp::Box:
+			stack[top++] = BoxDistance(local, glm::vec3(params));
+			break;
+		case SdfOp::RoundBox:
+			stack[top++] = BoxDistance(local, glm::vec3(params) - glm::vec3(params.w)) - params.w;
+			break;
+		case SdfOp::Torus: {
+			float ring = std::sqrt(local.x * local.x + local.z * local.z) - params.x;
+			stack[top++] = std::sqrt(ring * ring + local.y * local.y) - params.y;
+			break;
+		}
+		case SdfOp::Menger:
+			stack[top++] = MengerDistance(local / params.x, (int)params.y) * params.x;
+			break;
+		default: {
+			const float b = stack[--top];
+			float& a = stack[top - 1];
+			switch (instruction.Op) {
+			case SdfOp::Union: a = std::min(a, b); break;
+			case SdfOp::Intersection: a = std::max(a, b); break;
+			case SdfOp::Subtraction: a = std::max(a, -b); break;
+			case SdfOp::SmoothUnion: {
+				// polynomial smooth minimum
+				float k = std::max(params.x, 1e-6f);
+				float h = std::max(k - std::abs(a - b), 0.0f) / k;
+				a = std::min(a, b) - h * h * k * 0.25f;
+				break;
+			}
+			default: break;
+			}
+		}
+		}
+	}
+	return stack[0];
+}
+
+glm::vec3 SdfProgram::GetNormal(const glm::vec3& p) const
+{
+	// four evaluations at the corners of a tetrahedron instead of six along the axes
+	const float h = 1e-3f;
+	const glm::vec3 k0(1.0f, -1.0f, -1.0f), k1(-1.0f, -1.0f, 1.0f), k2(-1.0f, 1.0f, -1.0f), k3(1.0f, 1.0f, 1.0f);
+	glm::vec3 gradient = k0 * Evaluate(p + h * k0) + k1 * Evaluate(p + h * k1) + k2 * Evaluate(p + h * k2) + k3 * Evaluate(p + h * k3);
+	float length = glm::length(gradient);
+	return length > 0.0f ? gradient / length : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+bool SdfProgram::Intersect(const Ray& ray, float tMin, float& tMax, uint32_t& steps) const
+{
+	float tEnter, tExit;
+	BVH::Bounds bounds = m_Bounds;
+	bounds.Min -= glm::vec3(SurfaceDistance);
+	bounds.Max += glm::vec3(SurfaceDistance);
+	if (!Clip(bounds, ray, tEnter, tExit))
+		return false;
+	float t = std::max(tEnter, tMin);
+	const float end = std::min(tExit, tMax);
+	// distances are along the direction, which may not be a unit vector
+	const float toT = 1.0f / glm::length(ray.Direction);
+
+	uint32_t step = 0;
+	float d = Evaluate(ray.Origin + t * ray.Direction);
+	float side = d < 0.0f ? -1.0f : 1.0f;
+	if (tEnter <= tMin && std::abs(d) < SurfaceDistance) {
+		// starting on the surface, the ray leaves it on the side it goes to
+		side = glm::dot(GetNormal(ray.Origin + t * ray.Direction), ray.Direction) > 0.0f ? 1.0f : -1.0f;
+		while (side * d < SurfaceDistance && t <= end && step < MaxSteps) {
+			t += 2.0f * SurfaceDistance * toT;
+			d = Evaluate(ray.Origin + t * ray.Direction);
+			++step;
+		}
+	}
+
+	bool hit = false;
+	for (; step < MaxSteps && t <= end; ++step) {
+		const float distance = side * d;
+		if (distance < SurfaceDistance) {
+			tMax = t;
+			hit = true;
+			break;
+		}
+		t += distance * toT;
+		d = Evaluate(ray.Origin + t * ray.Direction);
+	}
+	steps += step;
+	return hit;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+#include "Ray.h"
+
+// Shapes and operators of a signed distance field
+enum class SdfOp : uint8_t
+{
+	// shapes, centered on the position of their node
+	Sphere,       // Params.x radius
+	Box,          // Params.xyz half size
+	RoundBox,     // Params.xyz half size, Params.w radius of the edges, inside the half size
+	Torus,        // Params.x radius of the ring, Params.y of the tube, around the y axis
+	Menger,       // Params.x half size, Params.y iterations of the sponge
+	// operators on the children, moved by the position of their node
+	Union,
+	Intersection,
+	Subtraction,  // the first child minus the others
+	SmoothUnion,  // Params.x distance over which the children blend
+	Count
+};
+
+const char* GetSdfOpName(SdfOp op);
+// false when the name is not one of GetSdfOpName
+bool ParseSdfOp(const char* name, SdfOp& op);
+inline bool IsSdfShape(SdfOp op) { return op < SdfOp::Union; }
+
+// Node of the expression tree of an SDF, as it is edited and saved
+struct SdfNode
+{
+	SdfOp Op = SdfOp::Sphere;
+	glm::vec3 Position{ 0.0f };
+	glm::vec4 Params{ 0.5f, 0.0f, 0.0f, 0.0f };
+	std::vector<SdfNode> Children;
+};
+
+// Procedural shape of a scene : rounded boxes, blends, fractals, without triangles
+struct Sdf
+{
+	SdfNode Root;
+	int MaterialIndex = 0;
+};
+
+// An SDF tree compiled to a flat program for a stack machine : each shape pushes its
+// distance, each operator combines the last two. The positions are summed down the tree
+// into the shapes, the bounds are worked out from the shapes and the operators.
+// Rays are sphere traced only inside the bounds.
+class SdfProgram
+{
+public:
+	// deepest tree the stack of the evaluation holds
+	static const uint32_t MaxStack = 16;
+	// a ray stops this close to the surface
+	static constexpr float SurfaceDistance = 1e-4f;
+	static const uint32_t MaxSteps = 256;
+
+	// throws std::runtime_error if the tree needs more than MaxStack
+	explicit SdfProgram(const SdfNode& root);
+
+	float Evaluate(const glm::vec3& p) const;
+	// outward unit normal, the gradient by tetrahedral differences
+	glm::vec3 GetNormal(const glm::vec3& p) const;
+	const BVH::Bounds& GetBounds() const { return m_Bounds; }
+
+	// closest surface in [tMin, tMax], lowers tMax. A ray leaving the surface, as a bounce
+	// does, is not stopped by it and a ray inside finds the way out. steps counts the evaluations
+	bool Intersect(const Ray& ray, float tMin, float& tMax, uint32_t& steps) const;
+
+private:
+	struct Instruction
+	{
+		SdfOp Op;
+		glm::vec3 Offset;
+		glm::vec4 Params;
+	};
+
+	// appends the code of node, returns the stack it uses
+	uint32_t Compile(const SdfNode& node, const glm::vec3& offset);
+	static BVH::Bounds ComputeBounds(const SdfNode& node, const glm::vec3& offset);
+
+private:
+	std::vector<Instruction> m_Code;
+	BVH::Bounds m_Bounds;
+};
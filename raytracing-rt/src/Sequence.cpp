@@ -0,0 +1,158 @@
+#include "Sequence.h"
+
+#include "Camera.h"
+#include "Scene.hpp"
+#include "SphereTreeRebuilder.h"
+#include "include/json.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+	glm::vec3 ReadVec3(const nlohmann::json& j, const char* key)
+	{
+		auto values = j.at(key).get<std::vector<float>>();
+		if (values.size() != 3)
+			throw std::runtime_error(std::string("Expected 3 values for ") + key);
+		return glm::vec3(values[0], values[1], values[2]);
+	}
+
+	// keys sorted by frame, two keys on one frame would make a jump
+	template<typename Key>
+	void SortKeys(std::vector<Key>& keys, const std::string& filename)
+	{
+		std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) { return a.Frame < b.Frame; });
+		for (size_t i = 1; i < keys.size(); ++i) {
+			if (keys[i].Frame == keys[i - 1].Frame)
+				throw std::runtime_error("Two keys on frame " + std::to_string(keys[i].Frame) + ": " + filename);
+		}
+	}
+
+	// the keys around frame : first and last clamped to the ends, t in [0, 1] between them
+	template<typename Key>
+	void FindSegment(const std::vector<Key>& keys, uint32_t frame, size_t& first, size_t& last, float& t)
+	{
+		auto next = std::upper_bound(keys.begin(), keys.end(), frame, [](uint32_t f, const Key& key) { return f < key.Frame; });
+		last = std::min((size_t)(next - keys.begin()), keys.size() - 1);
+		first = next == keys.begin() ? 0 : last - (next == keys.end() ? 0 : 1);
+		t = first == last ? 0.0f : (float)(frame - keys[first].Frame) / (float)(keys[last].Frame - keys[first].Frame);
+	}
+
+	// uniform Catmull-Rom between p1 and p2, through all four points
+	glm::vec3 CatmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+	{
+		const float t2 = t * t, t3 = t2 * t;
+		return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+	}
+
+	template<typename Key, typename Member>
+	glm::vec3 SplineAt(const std::vector<Key>& keys, size_t first, size_t last, float t, Member member)
+	{
+		if (first == last)
+			return keys[first].*member;
+		const glm::vec3& p0 = keys[first > 0 ? first - 1 : first].*member;
+		const glm::vec3& p3 = keys[last + 1 < keys.size() ? last + 1 : last].*member;
+		return CatmullRom(p0, keys[first].*member, keys[last].*member, p3, t);
+	}
+
+}
+
+Sequence Sequence::Load(const std::string& filename)
+{
+	std::filesystem::path fullPath = std::filesystem::current_path() / "scenes" / filename;
+	std::ifstream file(fullPath);
+	if (!file.is_open())
+		throw std::runtime_error("Could not open file for reading: " + fullPath.string());
+
+	// what is wrong with an entry gets the name of the file
+	Sequence sequence;
+	try {
+		nlohmann::json j;
+		file >> j;
+		sequence.m_Scene = j.at("Scene").get<std::string>();
+		sequence.m_FrameCount = j.at("Frames").get<uint32_t>();
+		if (sequence.m_FrameCount == 0)
+			throw std::runtime_error("No frames");
+
+		// "Direction" is the same as a target one unit ahead
+		for (const nlohmann::json& entry : j.value("Camera", nlohmann::json::array())) {
+			CameraKey& key = sequence.m_Camera.emplace_back();
+			key.Frame = entry.at("Frame").get<uint32_t>();
+			key.Position = ReadVec3(entry, "Position");
+			key.Target = entry.contains("Target") ? ReadVec3(entry, "Target") : key.Position + ReadVec3(entry, "Direction");
+			key.ApertureRadius = entry.value("Aperture", 0.0f);
+			key.FocusDistance = entry.value("Focus", 5.0f);
+			if (key.Target == key.Position)
+				throw std::runtime_error("Camera key looking nowhere on frame " + std::to_string(key.Frame));
+		}
+
+		for (const nlohmann::json& entry : j.value("Spheres", nlohmann::json::array())) {
+			SphereTrack& track = sequence.m_Spheres.emplace_back();
+			track.Index = entry.at("Index").get<uint32_t>();
+			for (const nlohmann::json& keyEntry : entry.at("Keys")) {
+				SphereKey& key = track.Keys.emplace_back();
+				key.Frame = keyEntry.at("Frame").get<uint32_t>();
+				key.Position = ReadVec3(keyEntry, "Position");
+				key.Radius = keyEntry.at("Radius").get<float>();
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		throw std::runtime_error("Invalid sequence " + filename + ": " + e.what());
+	}
+
+	SortKeys(sequence.m_Camera, filename);
+	for (SphereTrack& track : sequence.m_Spheres) {
+		if (track.Keys.empty())
+			throw std::runtime_error("Sphere track without keys: " + filename);
+		SortKeys(track.Keys, filename);
+	}
+	return sequence;
+}
+
+CameraKey Sequence::GetCamera(uint32_t frame) const
+{
+	size_t first, last;
+	float t;
+	FindSegment(m_Camera, frame, first, last, t);
+
+	CameraKey camera;
+	camera.Frame = frame;
+	camera.Position = SplineAt(m_Camera, first, last, t, &CameraKey::Position);
+	camera.Target = SplineAt(m_Camera, first, last, t, &CameraKey::Target);
+	camera.ApertureRadius = glm::mix(m_Camera[first].ApertureRadius, m_Camera[last].ApertureRadius, t);
+	camera.FocusDistance = glm::mix(m_Camera[first].FocusDistance, m_Camera[last].FocusDistance, t);
+	return camera;
+}
+
+void Sequence::Apply(uint32_t frame, Scene& scene, SphereTreeRebuilder& rebuilder, Camera& camera) const
+{
+	for (const SphereTrack& track : m_Spheres) {
+		if (track.Index >= scene.Spheres.size())
+			throw std::runtime_error("Sequence track of sphere " + std::to_string(track.Index) + " not in the scene: " + m_Scene);
+
+		size_t first, last;
+		float t;
+		FindSegment(track.Keys, frame, first, last, t);
+		const glm::vec3 position = SplineAt(track.Keys, first, last, t, &SphereKey::Position);
+		const float radius = glm::mix(track.Keys[first].Radius, track.Keys[last].Radius, t);
+
+		// the held stretches of a track cost nothing
+		Sphere& sphere = scene.Spheres[track.Index];
+		if (sphere.Position == position && sphere.Radius == radius)
+			continue;
+		sphere.Position = position;
+		sphere.Radius = radius;
+		rebuilder.SphereChanged(scene, track.Index);
+	}
+
+	if (!HasCamera())
+		return;
+	const CameraKey key = GetCamera(frame);
+	if (key.Position != camera.GetPosition() || glm::normalize(key.Target - key.Position) != camera.GetDirection())
+		camera.SetView(key.Position, key.Target - key.Position);
+	camera.SetLens(key.ApertureRadius, key.FocusDistance);
+}
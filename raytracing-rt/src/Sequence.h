@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Camera;
+class SphereTreeRebuilder;
+struct Scene;
+
+// Where the camera is at a frame of a sequence, it looks at Target
+struct CameraKey
+{
+	uint32_t Frame = 0;
+	glm::vec3 Position{ 0.0f, 0.0f, 3.0f };
+	glm::vec3 Target{ 0.0f, 0.0f, 0.0f };
+	float ApertureRadius = 0.0f;
+	float FocusDistance = 5.0f;
+};
+
+struct SphereKey
+{
+	uint32_t Frame = 0;
+	glm::vec3 Position{ 0.0f };
+	float Radius = 0.5f;
+};
+
+// keys of Scene::Spheres[Index]
+struct SphereTrack
+{
+	uint32_t Index = 0;
+	std::vector<SphereKey> Keys;
+};
+
+// Animation of a scene over numbered frames, for turntables and fly-throughs : keys of the
+// camera and of some spheres, the frames between two keys interpolated. Positions and targets
+// follow a Catmull-Rom spline through their keys, so a few keys around an object make a smooth
+// orbit, the other values go in a straight line. Before the first key and after the last one
+// the values hold. Nothing else of the scene changes, so a frame only refits the sphere tree
+// above the keyed spheres.
+class Sequence
+{
+public:
+	// from the scenes folder, throws std::runtime_error when the file can not be read or
+	// its keys are out of order
+	static Sequence Load(const std::string& filename);
+
+	// the scene the sequence animates, in the scenes folder
+	const std::string& GetScene() const { return m_Scene; }
+	uint32_t GetFrameCount() const { return m_FrameCount; }
+	bool HasCamera() const { return !m_Camera.empty(); }
+	CameraKey GetCamera(uint32_t frame) const;
+
+	// moves the keyed spheres of scene to frame through the rebuilder, which refits the trees
+	// above the ones that moved, and the camera when the sequence has camera keys. Throws
+	// std::runtime_error when a track refers to a sphere the scene does not have
+	void Apply(uint32_t frame, Scene& scene, SphereTreeRebuilder& rebuilder, Camera& camera) const;
+
+private:
+	std::string m_Scene;
+	uint32_t m_FrameCount = 1;
+	std::vector<CameraKey> m_Camera;
+	std::vector<SphereTrack> m_Spheres;
+};
@@ -46,3 +46,169 @@ void from_json(const nlohmann::json& j, Sphere& s) {
     s.Radius = j.at("Radius").get<float>();
     s.MaterialIndex = j.at("MaterialIndex").get<int>();
 }
+
+void to_json(nlohmann::json& j, const MovingSphere& s) {
+    j = nlohmann::json{
+        {"Position", {s.Position.x, s.Position.y, s.Position.z}},
+        {"EndPosition", {s.EndPosition.x, s.EndPosition.y, s.EndPosition.z}},
+        {"Radius", s.Radius},
+        {"MaterialIndex", s.MaterialIndex}
+    };
+}
+
+void from_json(const nlohmann::json& j, MovingSphere& s) {
+    auto position = j.at("Position").get<std::vector<float>>();
+    s.Position = glm::vec3(position[0], position[1], position[2]);
+    if (j.contains("EndPosition")) {
+        auto end = j.at("EndPosition").get<std::vector<float>>();
+        s.EndPosition = glm::vec3(end[0], end[1], end[2]);
+    }
+    else {
+        auto velocity = j.value("Velocity", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+        s.EndPosition = s.Position + glm::vec3(velocity[0], velocity[1], velocity[2]);
+    }
+    s.Radius = j.at("Radius").get<float>();
+    s.MaterialIndex = j.at("MaterialIndex").get<int>();
+}
+
+void to_json(nlohmann::json& j, const Instance& i) {
+    j = nlohmann::json{
+        {i.Type == Instance::Kind::Cluster ? "Cluster" : "Mesh", i.Source},
+        {"MaterialIndex", i.MaterialIndex},
+        {"Position", {i.Position.x, i.Position.y, i.Position.z}},
+        {"Rotation", {i.Rotation.x, i.Rotation.y, i.Rotation.z}},
+        {"Scale", i.Scale}
+    };
+}
+
+void from_json(const nlohmann::json& j, Instance& i) {
+    i.Type = j.contains("Cluster") ? Instance::Kind::Cluster : Instance::Kind::Mesh;
+    i.Source = j.at(i.Type == Instance::Kind::Cluster ? "Cluster" : "Mesh").get<std::string>();
+    i.MaterialIndex = j.value("MaterialIndex", 0);
+    auto position = j.value("Position", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+    i.Position = glm::vec3(position[0], position[1], position[2]);
+    auto rotation = j.value("Rotation", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+    i.Rotation = glm::vec3(rotation[0], rotation[1], rotation[2]);
+    i.Scale = j.value("Scale", 1.0f);
+}
+
+void to_json(nlohmann::json& j, const Plane& p) {
+    j = nlohmann::json{
+        {"Point", {p.Point.x, p.Point.y, p.Point.z}},
+        {"Normal", {p.Normal.x, p.Normal.y, p.Normal.z}},
+        {"MaterialIndex", p.MaterialIndex}
+    };
+}
+
+void from_json(const nlohmann::json& j, Plane& p) {
+    auto point = j.value("Point", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+    p.Point = glm::vec3(point[0], point[1], point[2]);
+    auto normal = j.value("Normal", std::vector<float>{ 0.0f, 1.0f, 0.0f });
+    p.Normal = glm::vec3(normal[0], normal[1], normal[2]);
+    p.MaterialIndex = j.value("MaterialIndex", 0);
+}
+
+void to_json(nlohmann::json& j, const Box& b) {
+    j = nlohmann::json{
+        {"Center", {b.Center.x, b.Center.y, b.Center.z}},
+        {"HalfSize", {b.HalfSize.x, b.HalfSize.y, b.HalfSize.z}},
+        {"Rotation", {b.Rotation.x, b.Rotation.y, b.Rotation.z}},
+        {"MaterialIndex", b.MaterialIndex}
+    };
+}
+
+void from_json(const nlohmann::json& j, Box& b) {
+    auto center = j.value("Center", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+    b.Center = glm::vec3(center[0], center[1], center[2]);
+    auto halfSize = j.value("HalfSize", std::vector<float>{ 0.5f, 0.5f, 0.5f });
+    b.HalfSize = glm::vec3(halfSize[0], halfSize[1], halfSize[2]);
+    auto rotation = j.value("Rotation", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+    b.Rotation = glm::vec3(rotation[0], rotation[1], rotation[2]);
+    b.MaterialIndex = j.value("MaterialIndex", 0);
+}
+
+void to_json(nlohmann::json& j, const Disk& d) {
+    j = nlohmann::json{
+        {"Center", {d.Center.x, d.Center.y, d.Center.z}},
+        {"Normal", {d.Normal.x, d.Normal.y, d.Normal.z}},
+        {"Radius", d.Radius},
+        {"MaterialIndex", d.MaterialIndex}
+    };
+}
+
+void from_json(const nlohmann::json& j, Disk& d) {
+    auto center = j.value("Center", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+    d.Center = glm::vec3(center[0], center[1], center[2]);
+    auto normal = j.value("Normal", std::vector<float>{ 0.0f, 1.0f, 0.0f });
+    d.Normal = glm::vec3(normal[0], normal[1], normal[2]);
+    d.Radius = j.value("Radius", 0.5f);
+    d.MaterialIndex = j.value("MaterialIndex", 0);
+}
+
+void to_json(nlohmann::json& j, const SdfNode& n) {
+    j = nlohmann::json{
+        {"Type", GetSdfOpName(n.Op)},
+        {"Position", {n.Position.x, n.Position.y, n.Position.z}}
+    };
+    switch (n.Op) {
+    case SdfOp::Sphere: j["Radius"] = n.Params.x; break;
+    case SdfOp::Box: j["HalfSize"] = { n.Params.x, n.Params.y, n.Params.z }; break;
+    case SdfOp::RoundBox:
+        j["HalfSize"] = { n.Params.x, n.Params.y, n.Params.z };
+        j["Radius"] = n.Params.w;
+        break;
+    case SdfOp::Torus:
+        j["Radius"] = n.Params.x;
+        j["TubeRadius"] = n.Params.y;
+        break;
+    case SdfOp::Menger:
+        j["HalfSize"] = n.Params.x;
+        j["Iterations"] = (int)n.Params.y;
+        break;
+    case SdfOp::SmoothUnion: j["Blend"] = n.Params.x; break;
+    default: break;
+    }
+    if (!IsSdfShape(n.Op))
+        j["Children"] = n.Children;
+}
+
+void from_json(const nlohmann::json& j, SdfNode& n) {
+    std::string type = j.at("Type").get<std::string>();
+    if (!ParseSdfOp(type.c_str(), n.Op))
+        throw std::runtime_error("Unknown SDF type: " + type);
+    auto position = j.value("Position", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+    n.Position = glm::vec3(position[0], position[1], position[2]);
+    n.Params = glm::vec4(0.0f);
+    switch (n.Op) {
+    case SdfOp::Sphere: n.Params.x = j.value("Radius", 0.5f); break;
+    case SdfOp::Box:
+    case SdfOp::RoundBox: {
+        auto halfSize = j.value("HalfSize", std::vector<float>{ 0.5f, 0.5f, 0.5f });
+        n.Params = glm::vec4(halfSize[0], halfSize[1], halfSize[2], n.Op == SdfOp::RoundBox ? j.value("Radius", 0.1f) : 0.0f);
+        break;
+    }
+    case SdfOp::Torus:
+        n.Params.x = j.value("Radius", 0.5f);
+        n.Params.y = j.value("TubeRadius", 0.1f);
+        break;
+    case SdfOp::Menger:
+        n.Params.x = j.value("HalfSize", 0.5f);
+        n.Params.y = (float)j.value("Iterations", 3);
+        break;
+    case SdfOp::SmoothUnion: n.Params.x = j.value("Blend", 0.2f); break;
+    default: break;
+    }
+    n.Children = j.value("Children", std::vector<SdfNode>());
+}
+
+void to_json(nlohmann::json& j, const Sdf& s) {
+    j = nlohmann::json{
+        {"Root", s.Root},
+        {"MaterialIndex", s.MaterialIndex}
+    };
+}
+
+void from_json(const nlohmann::json& j, Sdf& s) {
+    s.Root = j.at("Root").get<SdfNode>();
+    s.MaterialIndex = j.value("MaterialIndex", 0);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Material.hpp"
+#include "Instance.h"
+#include "Primitives.h"
+#include "Sdf.h"
 #include "Sphere.hpp"
 #include "include/json.hpp"
 
@@ -8,3 +11,20 @@ void to_json(nlohmann::json& j, const Material& m);
 void from_json(const nlohmann::json& j, Material& m);
 void to_json(nlohmann::json& j, const Sphere& s);
 void from_json(const nlohmann::json& j, Sphere& s);
+// reads an EndPosition, or a Velocity over the shutter interval
+void to_json(nlohmann::json& j, const MovingSphere& s);
+void from_json(const nlohmann::json& j, MovingSphere& s);
+// the source and placement only, the scene finds the geometry
+void to_json(nlohmann::json& j, const Instance& i);
+void from_json(const nlohmann::json& j, Instance& i);
+void to_json(nlohmann::json& j, const Plane& p);
+void from_json(const nlohmann::json& j, Plane& p);
+void to_json(nlohmann::json& j, const Box& b);
+void from_json(const nlohmann::json& j, Box& b);
+void to_json(nlohmann::json& j, const Disk& d);
+void from_json(const nlohmann::json& j, Disk& d);
+// the parameters are named after the type of the node, an unknown type throws std::runtime_error
+void to_json(nlohmann::json& j, const SdfNode& n);
+void from_json(const nlohmann::json& j, SdfNode& n);
+void to_json(nlohmann::json& j, const Sdf& s);
+void from_json(const nlohmann::json& j, Sdf& s);
@@ -10,5 +10,17 @@ struct Sphere
     int MaterialIndex = 0;
 };
 
+// Sphere moving in a straight line while the shutter is open, from Position to EndPosition
+struct MovingSphere
+{
+    glm::vec3 Position{ 0.0f };
+    float Radius = 0.5f;
+    int MaterialIndex = 0;
+    glm::vec3 EndPosition{ 0.0f };
+
+    // time in [0, 1] over the shutter interval
+    glm::vec3 GetPosition(float time) const { return Position + time * (EndPosition - Position); }
+};
+
 void to_json(nlohmann::json& j, const Sphere& s);
 void from_json(const nlohmann::json& j, Sphere& s);
@@ -0,0 +1,116 @@
+#include "SphereBVH.h"
+
+#include <cmath>
+
+namespace {
+
+	BVH::Bounds SphereBounds(const Sphere& sphere)
+	{
+		BVH::Bounds bounds;
+		bounds.Min = sphere.Position - glm::vec3(sphere.Radius);
+		bounds.Max = sphere.Position + glm::vec3(sphere.Radius);
+		return bounds;
+	}
+
+}
+
+SphereBVH::SphereBVH(const std::vector<Sphere>& spheres, const BVHBuildOptions& options)
+	: m_Width(options.Width)
+{
+	std::vector<BVH::Bounds> bounds(spheres.size());
+	for (size_t i = 0; i < spheres.size(); ++i)
+		bounds[i] = SphereBounds(spheres[i]);
+	m_BVH.Build(bounds, m_Order, options);
+	// spheres are dragged around in the app
+	switch (m_Width) {
+	case 4:
+		m_BVH4.Build(m_BVH);
+		m_BVH4.PrepareRefit();
+		m_BVH = BVH();
+		break;
+	case 8:
+		m_BVH8.Build(m_BVH);
+		m_BVH8.PrepareRefit();
+		m_BVH = BVH();
+		break;
+	default:
+		m_Width = 2;
+		m_BVH.PrepareRefit();
+		break;
+	}
+
+	m_SlotOfSphere.resize(m_Order.size());
+	for (uint32_t slot = 0; slot < (uint32_t)m_Order.size(); ++slot)
+		m_SlotOfSphere[m_Order[slot]] = slot;
+}
+
+template<typename IntersectLeaf>
+void SphereBVH::Traverse(const Ray& ray, float tMin, float& tMax, IntersectLeaf&& intersectLeaf, uint32_t& steps) const
+{
+	switch (m_Width) {
+	case 4: m_BVH4.Traverse(ray, tMin, tMax, intersectLeaf, steps); break;
+	case 8: m_BVH8.Traverse(ray, tMin, tMax, intersectLeaf, steps); break;
+	default: m_BVH.Traverse(ray, tMin, tMax, intersectLeaf, steps); break;
+	}
+}
+
+bool SphereBVH::Intersect(const std::vector<Sphere>& spheres, const Ray& ray, float tMin, float& tMax, int& sphereIndex, uint32_t& steps, uint32_t& tests) const
+{
+	const float a = glm::dot(ray.Direction, ray.Direction);
+	bool found = false;
+	Traverse(ray, tMin, tMax, [&](uint32_t first, uint32_t count) {
+		tests += count;
+		for (uint32_t i = first; i < first + count; ++i) {
+			const Sphere& sphere = spheres[m_Order[i]];
+			glm::vec3 origin = ray.Origin - sphere.Position;
+
+			float b = 2.0f * glm::dot(origin, ray.Direction);
+			float c = glm::dot(origin, origin) - sphere.Radius * sphere.Radius;
+			float discriminant = b * b - 4.0f * a * c;
+			if (discriminant < 0.0f)
+				continue;
+
+			float t = (-b - sqrtf(discriminant)) / (2.0f * a);
+			if (t < tMin)
+				t = (-b + sqrtf(discriminant)) / (2.0f * a);
+			if (t < tMin || t >= tMax)
+				continue;
+
+			tMax = t;
+			sphereIndex = (int)m_Order[i];
+			found = true;
+		}
+	}, steps);
+	return found;
+}
+
+void SphereBVH::Refit(const std::vector<Sphere>& spheres, uint32_t index)
+{
+	const auto boundsOf = [&](uint32_t slot) { return SphereBounds(spheres[m_Order[slot]]); };
+	switch (m_Width) {
+	case 4: m_BVH4.Refit(m_SlotOfSphere[index], boundsOf); break;
+	case 8: m_BVH8.Refit(m_SlotOfSphere[index], boundsOf); break;
+	default: m_BVH.Refit(m_SlotOfSphere[index], boundsOf); break;
+	}
+}
+
+float SphereBVH::GetCost() const
+{
+	switch (m_Width) {
+	case 4: return m_BVH4.GetCost();
+	case 8: return m_BVH8.GetCost();
+	default: return m_BVH.GetCost();
+	}
+}
+
+float SphereBVH::GetDegradation() const
+{
+	float buildCost = m_Width == 4 ? m_BVH4.GetBuildCost() : m_Width == 8 ? m_BVH8.GetBuildCost() : m_BVH.GetBuildCost();
+	return buildCost > 0.0f ? GetCost() / buildCost : 1.0f;
+}
+
+size_t SphereBVH::GetMemoryUsage() const
+{
+	size_t tree = m_Width == 4 ? m_BVH4.GetMemoryUsage() : m_Width == 8 ? m_BVH8.GetMemoryUsage() : m_BVH.GetMemoryUsage();
+	return tree + (m_Order.capacity() + m_SlotOfSphere.capacity()) * sizeof(uint32_t);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Ray.h"
+#include "Sphere.hpp"
+
+// BVH over the spheres of the scene. The spheres keep their order, the tree stores the
+// sphere of each leaf entry instead. Moving a sphere refits the nodes above it only, the
+// tree gets rebuilt once the refits made it too slow (see SphereTreeRebuilder).
+// With BVHBuildOptions::Width at 4 or 8 the binary tree is turned into a WideBVH and dropped
+class SphereBVH
+{
+public:
+	SphereBVH() = default;
+	explicit SphereBVH(const std::vector<Sphere>& spheres, const BVHBuildOptions& options = BVHBuildOptions());
+
+	bool Empty() const { return m_Order.empty(); }
+	size_t GetSphereCount() const { return m_Order.size(); }
+
+	// closest hit in [tMin, tMax] among spheres, the vector the tree was built from.
+	// Hits closer than tMin are skipped for the far side of the sphere
+	bool Intersect(const std::vector<Sphere>& spheres, const Ray& ray, float tMin, float& tMax, int& sphereIndex, uint32_t& steps, uint32_t& tests) const;
+
+	// spheres[index] moved or changed radius
+	void Refit(const std::vector<Sphere>& spheres, uint32_t index);
+	// surface area heuristic cost of the tree, see BVH::GetCost
+	float GetCost() const;
+	// expected cost of a ray over its cost right after the build, it grows with the refits
+	float GetDegradation() const;
+	// bytes of the nodes and of what the refits use, the spheres left out
+	size_t GetMemoryUsage() const;
+
+private:
+	template<typename IntersectLeaf>
+	void Traverse(const Ray& ray, float tMin, float& tMax, IntersectLeaf&& intersectLeaf, uint32_t& steps) const;
+
+private:
+	// the one of m_Width children per node is built
+	uint32_t m_Width = 2;
+	BVH m_BVH;
+	WideBVH<4> m_BVH4;
+	WideBVH<8> m_BVH8;
+	// sphere of each leaf entry, and the other way round
+	std::vector<uint32_t> m_Order;
+	std::vector<uint32_t> m_SlotOfSphere;
+};
@@ -0,0 +1,61 @@
+#include "SphereCluster.h"
+
+#include <cmath>
+
+#include "Hash.h"
+
+SphereCluster::SphereCluster(std::vector<Sphere> spheres)
+{
+	std::vector<BVH::Bounds> bounds(spheres.size());
+	for (size_t i = 0; i < spheres.size(); ++i) {
+		bounds[i].Min = spheres[i].Position - glm::vec3(spheres[i].Radius);
+		bounds[i].Max = spheres[i].Position + glm::vec3(spheres[i].Radius);
+	}
+
+	std::vector<uint32_t> order;
+	m_BVH.Build(bounds, order);
+
+	m_Spheres.resize(spheres.size());
+	for (size_t i = 0; i < spheres.size(); ++i)
+		m_Spheres[i] = spheres[order[i]];
+
+	static_assert(sizeof(Sphere) == 5 * sizeof(float), "spheres are hashed as they are in memory");
+	m_Hash = HashBytes(m_Spheres.data(), m_Spheres.size() * sizeof(Sphere));
+}
+
+bool SphereCluster::Intersect(const Ray& ray, float tMin, float& tMax, Hit& hit, uint32_t& steps, uint32_t& tests) const
+{
+	// the direction is not unit length in object space
+	const float a = glm::dot(ray.Direction, ray.Direction);
+	bool found = false;
+	m_BVH.Traverse(ray, tMin, tMax, [&](uint32_t first, uint32_t count) {
+		tests += count;
+		for (uint32_t i = first; i < first + count; ++i) {
+			const Sphere& sphere = m_Spheres[i];
+			glm::vec3 origin = ray.Origin - sphere.Position;
+
+			float b = 2.0f * glm::dot(origin, ray.Direction);
+			float c = glm::dot(origin, origin) - sphere.Radius * sphere.Radius;
+			float discriminant = b * b - 4.0f * a * c;
+			if (discriminant < 0.0f)
+				continue;
+
+			float t = (-b - sqrtf(discriminant)) / (2.0f * a);
+			if (t < tMin)
+				t = (-b + sqrtf(discriminant)) / (2.0f * a);
+			if (t < tMin || t > tMax)
+				continue;
+
+			tMax = t;
+			hit.Primitive = i;
+			found = true;
+		}
+	}, steps);
+	return found;
+}
+
+glm::vec3 SphereCluster::GetNormal(const Hit& hit, const glm::vec3& position) const
+{
+	const Sphere& sphere = m_Spheres[hit.Primitive];
+	return glm::normalize(position - sphere.Position);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+#include "Geometry.h"
+#include "Sphere.hpp"
+
+// Group of spheres under their own BVH, to be instanced as a whole (a tree, a rock pile).
+// Each sphere keeps its material. The spheres are kept in the order of the BVH leaves,
+// like the triangles of a Mesh.
+class SphereCluster : public Geometry
+{
+public:
+	explicit SphereCluster(std::vector<Sphere> spheres);
+
+	bool Intersect(const Ray& ray, float tMin, float& tMax, Hit& hit, uint32_t& steps, uint32_t& tests) const override;
+	glm::vec3 GetNormal(const Hit& hit, const glm::vec3& position) const override;
+	int GetMaterialIndex(const Hit& hit) const override { return m_Spheres[hit.Primitive].MaterialIndex; }
+
+	size_t GetPrimitiveCount() const override { return m_Spheres.size(); }
+	const std::vector<Sphere>& GetSpheres() const { return m_Spheres; }
+	BVH::Bounds GetBounds() const override { return m_BVH.GetBounds(); }
+	uint64_t GetHash() const override { return m_Hash; }
+
+private:
+	std::vector<Sphere> m_Spheres;
+	BVH m_BVH;
+	uint64_t m_Hash = 0;
+};
@@ -0,0 +1,64 @@
+#include "SphereTreeRebuilder.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+	// expected ray cost over the one of a new tree that starts a rebuild
+	const float RebuildDegradation = 1.3f;
+
+}
+
+SphereTreeRebuilder::~SphereTreeRebuilder()
+{
+	if (m_Pending.valid())
+		m_Pending.wait();
+}
+
+void SphereTreeRebuilder::SphereChanged(Scene& scene, size_t index)
+{
+	scene.UpdateSphere(index);
+
+	if (m_Pending.valid()) {
+		m_Edited.push_back((uint32_t)index);
+		return;
+	}
+	if (!scene.SphereTree || scene.SphereTree->GetDegradation() < RebuildDegradation)
+		return;
+
+	m_Replaced = scene.SphereTree;
+	m_Pending = std::async(std::launch::async, [spheres = scene.Spheres, options = scene.TreeOptions]()
+		{
+			return std::make_shared<SphereBVH>(spheres, options);
+		});
+}
+
+bool SphereTreeRebuilder::IsBusy() const
+{
+	return m_Pending.valid() && m_Pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+bool SphereTreeRebuilder::ApplyPending(Scene& scene)
+{
+	if (!m_Pending.valid() || IsBusy())
+		return false;
+
+	std::shared_ptr<SphereBVH> tree = m_Pending.get();
+	std::vector<uint32_t> edited = std::move(m_Edited);
+	std::shared_ptr<SphereBVH> replaced = std::move(m_Replaced);
+	m_Edited.clear();
+
+	// a load or a Prepare since then made a tree of its own
+	if (scene.SphereTree != replaced || tree->GetSphereCount() != scene.Spheres.size())
+		return false;
+
+	std::sort(edited.begin(), edited.end());
+	edited.erase(std::unique(edited.begin(), edited.end()), edited.end());
+	for (uint32_t index : edited)
+		tree->Refit(scene.Spheres, index);
+
+	// a single pointer swap, the render passes only run between two UI updates
+	scene.SphereTree = std::move(tree);
+	return true;
+}
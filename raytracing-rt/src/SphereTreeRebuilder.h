@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Scene.hpp"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+// Keeps the sphere tree of an edited scene fast. An edit refits the tree right away, and
+// once the refits made it too slow a new tree is built on a background worker from a copy
+// of the spheres. ApplyPending swaps it in between two render passes, like SceneLoader,
+// after refitting it for the spheres edited while it was built.
+class SphereTreeRebuilder
+{
+public:
+	SphereTreeRebuilder() = default;
+	~SphereTreeRebuilder();
+
+	// after moving or resizing scene.Spheres[index]
+	void SphereChanged(Scene& scene, size_t index);
+
+	bool IsBusy() const;
+	// return true if the scene got the new tree
+	bool ApplyPending(Scene& scene);
+
+private:
+	std::future<std::shared_ptr<SphereBVH>> m_Pending;
+	// the tree being replaced, the new one is dropped if the scene got another one meanwhile
+	std::shared_ptr<SphereBVH> m_Replaced;
+	std::vector<uint32_t> m_Edited;
+};
@@ -0,0 +1,98 @@
+#include "Stats.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Stats {
+
+	std::atomic<bool> Enabled{ true };
+
+	namespace {
+
+		// blocks outlive their thread, so the counts of finished threads are kept
+		std::mutex s_RegistryMutex;
+		std::vector<std::unique_ptr<ThreadBlock>> s_Registry;
+
+		ThreadBlock* Register()
+		{
+			std::lock_guard<std::mutex> lock(s_RegistryMutex);
+			s_Registry.push_back(std::make_unique<ThreadBlock>());
+			return s_Registry.back().get();
+		}
+
+		const uint64_t s_StartCycles = ReadCycles();
+		const std::chrono::steady_clock::time_point s_StartTime = std::chrono::steady_clock::now();
+
+	}
+
+	const char* GetCounterName(Counter counter)
+	{
+		switch (counter) {
+		case RaysTraced: return "Rays traced";
+		case IntersectionTests: return "Intersection tests";
+		case Bounces: return "Bounces";
+		case RussianRouletteTerminations: return "Russian roulette terminations";
+		case EscapeRays: return "Escape rays";
+		default: return "";
+		}
+	}
+
+	const char* GetStageName(Stage stage)
+	{
+		switch (stage) {
+		case RayGeneration: return "Ray generation";
+		case Traversal: return "Traversal";
+		case Shading: return "Shading";
+		case Accumulation: return "Accumulation";
+		case Conversion: return "RGBA conversion";
+		case Upload: return "Upload";
+		default: return "";
+		}
+	}
+
+	ThreadBlock& Local()
+	{
+		thread_local ThreadBlock* block = Register();
+		return *block;
+	}
+
+	Totals Totals::operator-(const Totals& other) const
+	{
+		Totals result;
+		for (int i = 0; i < CounterCount; ++i)
+			result.Counters[i] = Counters[i] - other.Counters[i];
+		for (int i = 0; i < MaxDepth; ++i)
+			result.Depth[i] = Depth[i] - other.Depth[i];
+		for (int i = 0; i < StageCount; ++i)
+			result.StageCycles[i] = StageCycles[i] - other.StageCycles[i];
+		return result;
+	}
+
+	Totals Collect()
+	{
+		Totals totals;
+
+		// only registration takes the lock, the counters are read as they are
+		std::lock_guard<std::mutex> lock(s_RegistryMutex);
+		for (const std::unique_ptr<ThreadBlock>& block : s_Registry) {
+			for (int i = 0; i < CounterCount; ++i)
+				totals.Counters[i] += block->Counters[i].load(std::memory_order_relaxed);
+			for (int i = 0; i < MaxDepth; ++i)
+				totals.Depth[i] += block->Depth[i].load(std::memory_order_relaxed);
+			for (int i = 0; i < StageCount; ++i)
+				totals.StageCycles[i] += block->StageCycles[i].load(std::memory_order_relaxed);
+		}
+		return totals;
+	}
+
+	double CyclesPerSecond()
+	{
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - s_StartTime).count();
+		if (seconds <= 0.0)
+			return 1.0;
+		return (double)(ReadCycles() - s_StartCycles) / seconds;
+	}
+
+}
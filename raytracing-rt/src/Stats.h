@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#include <chrono>
+#endif
+
+// Lightweight render performance counters.
+// Each thread owns a block it is the only one to write to (relaxed load + store, no
+// locked instruction), Collect sums every block without stopping the writers.
+// Stage timers are exclusive : entering a stage pauses the enclosing one, so the
+// traversal done inside shading is only charged to traversal.
+namespace Stats {
+
+	enum Counter
+	{
+		RaysTraced,
+		IntersectionTests,
+		Bounces,
+		RussianRouletteTerminations,
+		EscapeRays,
+		CounterCount
+	};
+
+	enum Stage
+	{
+		None = -1,
+		RayGeneration,
+		Traversal,
+		Shading,
+		Accumulation,
+		Conversion,
+		Upload,
+		StageCount
+	};
+
+	const char* GetCounterName(Counter counter);
+	const char* GetStageName(Stage stage);
+
+	// path lengths above are counted in the last bin
+	const int MaxDepth = 32;
+
+	extern std::atomic<bool> Enabled;
+
+	inline uint64_t ReadCycles()
+	{
+#if defined(_M_X64) || defined(__x86_64__)
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	struct ThreadBlock
+	{
+		std::atomic<uint64_t> Counters[CounterCount] = {};
+		std::atomic<uint64_t> Depth[MaxDepth] = {};
+		std::atomic<uint64_t> StageCycles[StageCount] = {};
+
+		// owner thread only
+		Stage CurrentStage = None;
+		uint64_t StageStart = 0;
+	};
+
+	// block of the calling thread, registered on first use
+	ThreadBlock& Local();
+
+	inline void Bump(std::atomic<uint64_t>& value, uint64_t n)
+	{
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	inline void Add(Counter counter, uint64_t n = 1)
+	{
+		if (Enabled.load(std::memory_order_relaxed))
+			Bump(Local().Counters[counter], n);
+	}
+
+	inline void AddPathLength(int depth)
+	{
+		if (Enabled.load(std::memory_order_relaxed))
+			Bump(Local().Depth[depth < MaxDepth ? depth : MaxDepth - 1], 1);
+	}
+
+	class ScopedStage
+	{
+	public:
+		explicit ScopedStage(Stage stage)
+		{
+			if (!Enabled.load(std::memory_order_relaxed))
+				return;
+
+			m_Block = &Local();
+			m_Previous = m_Block->CurrentStage;
+			Switch(stage);
+		}
+
+		~ScopedStage()
+		{
+			if (m_Block)
+				Switch(m_Previous);
+		}
+
+		ScopedStage(const ScopedStage&) = delete;
+		ScopedStage& operator=(const ScopedStage&) = delete;
+
+	private:
+		void Switch(Stage stage)
+		{
+			uint64_t now = ReadCycles();
+			if (m_Block->CurrentStage != None)
+				Bump(m_Block->StageCycles[m_Block->CurrentStage], now - m_Block->StageStart);
+			m_Block->CurrentStage = stage;
+			m_Block->StageStart = now;
+		}
+
+	private:
+		ThreadBlock* m_Block = nullptr;
+		Stage m_Previous = None;
+	};
+
+	struct Totals
+	{
+		uint64_t Counters[CounterCount] = {};
+		uint64_t Depth[MaxDepth] = {};
+		uint64_t StageCycles[StageCount] = {};
+
+		Totals operator-(const Totals& other) const;
+	};
+
+	// sum of every thread block since the start
+	Totals Collect();
+
+	// rate of ReadCycles, measured against the steady clock
+	double CyclesPerSecond();
+}
@@ -0,0 +1,119 @@
+#include "Trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace Trace {
+
+	std::atomic<int> CurrentLevel{ Off };
+
+	namespace {
+
+		struct Event
+		{
+			const char* Name;
+			uint64_t Begin;
+			uint64_t End;
+			int64_t Arg;
+		};
+
+		struct ThreadBuffer
+		{
+			std::unique_ptr<Event[]> Events{ new Event[RingCapacity] };
+			// written by the owner thread only
+			std::atomic<uint64_t> Head{ 0 };
+			uint32_t ThreadId = 0;
+		};
+
+		// buffers outlive their thread, a dump still shows the workers that exited
+		std::mutex s_RegistryMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> s_Registry;
+
+		ThreadBuffer* Register()
+		{
+			std::lock_guard<std::mutex> lock(s_RegistryMutex);
+			s_Registry.push_back(std::make_unique<ThreadBuffer>());
+			s_Registry.back()->ThreadId = (uint32_t)s_Registry.size();
+			return s_Registry.back().get();
+		}
+
+		ThreadBuffer& Local()
+		{
+			thread_local ThreadBuffer* buffer = Register();
+			return *buffer;
+		}
+
+		const uint64_t s_StartCycles = Stats::ReadCycles();
+
+	}
+
+	static_assert((RingCapacity & (RingCapacity - 1)) == 0, "RingCapacity has to be a power of two");
+
+	void Record(const char* name, uint64_t begin, uint64_t end, int64_t arg)
+	{
+		ThreadBuffer& buffer = Local();
+		uint64_t head = buffer.Head.load(std::memory_order_relaxed);
+		buffer.Events[head & (RingCapacity - 1)] = { name, begin, end, arg };
+		buffer.Head.store(head + 1, std::memory_order_release);
+	}
+
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(s_RegistryMutex);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : s_Registry)
+			buffer->Head.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t GetEventCount()
+	{
+		uint64_t count = 0;
+		std::lock_guard<std::mutex> lock(s_RegistryMutex);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : s_Registry)
+			count += buffer->Head.load(std::memory_order_acquire);
+		return count;
+	}
+
+	void Dump(const std::string& filename)
+	{
+		std::ofstream file(filename);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open file for writing: " + filename);
+
+		// timestamps are in microseconds from the program start
+		const double microsecondsPerCycle = 1e6 / Stats::CyclesPerSecond();
+		uint64_t dropped = 0;
+
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+
+		std::lock_guard<std::mutex> lock(s_RegistryMutex);
+		for (const std::unique_ptr<ThreadBuffer>& buffer : s_Registry) {
+			uint64_t head = buffer->Head.load(std::memory_order_acquire);
+			uint64_t count = head < RingCapacity ? head : RingCapacity;
+			dropped += head - count;
+
+			if (!first)
+				file << ",\n";
+			first = false;
+			file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->ThreadId
+				<< ",\"args\":{\"name\":\"Thread " << buffer->ThreadId << "\"}}";
+
+			for (uint64_t i = head - count; i < head; ++i) {
+				const Event& event = buffer->Events[i & (RingCapacity - 1)];
+				file << ",\n{\"name\":\"" << event.Name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->ThreadId
+					<< ",\"ts\":" << (event.Begin - s_StartCycles) * microsecondsPerCycle
+					<< ",\"dur\":" << (event.End - event.Begin) * microsecondsPerCycle;
+				if (event.Arg != NoArg)
+					file << ",\"args\":{\"index\":" << event.Arg << "}";
+				file << "}";
+			}
+		}
+
+		file << "\n],\"otherData\":{\"droppedEvents\":" << dropped << "}}\n";
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline of the render, dumped in the Chrome trace format (chrome://tracing, ui.perfetto.dev).
+// Each thread appends complete events to its own ring buffer, the oldest ones are
+// overwritten once it is full. When the level is below a scope's, the scope costs a
+// relaxed load and a branch.
+namespace Trace {
+
+	enum Level
+	{
+		Off,
+		Passes, // frame and its passes
+		Tiles,  // + one event per row of pixels handed to a worker
+		Stages  // + ray generation, traversal, shading ... inside every pixel
+	};
+
+	extern std::atomic<int> CurrentLevel;
+
+	inline bool IsEnabled(Level level)
+	{
+		return CurrentLevel.load(std::memory_order_relaxed) >= level;
+	}
+
+	const int64_t NoArg = -1;
+
+	// events per thread kept before wrapping around
+	const uint32_t RingCapacity = 1 << 16;
+
+	void Record(const char* name, uint64_t begin, uint64_t end, int64_t arg = NoArg);
+
+	// name has to outlive the dump, string literals are expected
+	class Scope
+	{
+	public:
+		Scope() = default;
+		Scope(Level level, const char* name, int64_t arg = NoArg)
+		{
+			if (IsEnabled(level))
+				Begin(name, arg);
+		}
+
+		~Scope()
+		{
+			End();
+		}
+
+		void Begin(const char* name, int64_t arg = NoArg)
+		{
+			m_Name = name;
+			m_Arg = arg;
+			m_Begin = Stats::ReadCycles();
+		}
+
+		// records the event now instead of at the end of the block
+		void End()
+		{
+			if (m_Name)
+				Record(m_Name, m_Begin, Stats::ReadCycles(), m_Arg);
+			m_Name = nullptr;
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char* m_Name = nullptr;
+		int64_t m_Arg = NoArg;
+		uint64_t m_Begin = 0;
+	};
+
+	// drop every recorded event, call it between frames
+	void Clear();
+
+	// events recorded so far, over all threads and including the overwritten ones
+	uint64_t GetEventCount();
+
+	// write the buffers as Chrome trace JSON, call it between frames
+	// throws std::runtime_error when the file can not be written
+	void Dump(const std::string& filename);
+}
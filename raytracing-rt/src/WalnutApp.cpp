@@ -7,6 +7,9 @@
 #include "Scene.hpp"
 #include "Camera.h"
 #include "Renderer.h"
+#include "SceneLoader.h"
+#include "SphereTreeRebuilder.h"
+#include "Trace.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -26,6 +29,22 @@ std::vector<std::string> GetCubemapFilenames(const std::string& folderPath) {
 	return filenames;
 }
 
+// the position and parameters of node and of its children, true when one changed
+bool EditSdfNode(SdfNode& node, int id) {
+	bool changed = false;
+	ImGui::PushID(id);
+	if (ImGui::TreeNode(GetSdfOpName(node.Op))) {
+		changed |= ImGui::DragFloat3("Position", glm::value_ptr(node.Position), 0.05f);
+		if (node.Op != SdfOp::Union && node.Op != SdfOp::Intersection && node.Op != SdfOp::Subtraction)
+			changed |= ImGui::DragFloat4("Parameters", glm::value_ptr(node.Params), 0.01f);
+		for (size_t i = 0; i < node.Children.size(); ++i)
+			changed |= EditSdfNode(node.Children[i], (int)i);
+		ImGui::TreePop();
+	}
+	ImGui::PopID();
+	return changed;
+}
+
 
 class ExampleLayer : public Walnut::Layer
 {
@@ -75,6 +94,8 @@ public:
 		glass.Name = "Glass";
 		glass.IndiceOut = 1.0f;
 		glass.IndiceIn = 1.5f;
+
+		m_Scene.Prepare();
 		/*
 		// Spheres
 		
@@ -104,6 +125,12 @@ public:
 	{
 		bool ShouldResetFrame = false;
 
+		// swap in what the background loader finished, before this frame's render pass
+		if (m_Loader.ApplyPending(m_Scene))
+			m_Renderer.ResetFrameIndex();
+		// a rebuilt tree finds the same hits, the accumulation goes on
+		m_TreeRebuilder.ApplyPending(m_Scene);
+
 		// Settings
 		ImGui::Begin("Settings");
 		ImGui::Text("Last render: %.3fms", m_LastRenderTime);
@@ -114,13 +141,72 @@ public:
 		ImGui::Checkbox("Real Time", &m_RealTime);
 		ImGui::Checkbox("Accumulate", &m_Renderer.GetSettings().Accumulate);
 		ImGui::Checkbox("Antialiasing", &m_Renderer.GetSettings().Antialiasing);
+		ShouldResetFrame |= ImGui::Checkbox("Prefiltered environment", &m_Renderer.GetSettings().PrefilteredEnvironment);
+		if (ImGui::BeginCombo("Accumulation", GetAccumulationFormatName(m_Renderer.GetSettings().Accumulation))) {
+			for (int i = 0; i < (int)AccumulationFormat::Count; ++i) {
+				AccumulationFormat format = (AccumulationFormat)i;
+				if (ImGui::Selectable(GetAccumulationFormatName(format), m_Renderer.GetSettings().Accumulation == format))
+					m_Renderer.GetSettings().Accumulation = format;
+			}
+			ImGui::EndCombo();
+		}
 		ImGui::DragInt("Monter Carlo nb sample", &m_Renderer.GetSettings().MonteCarloNbSample, 1.0f, 1, 2048);
+		ShouldResetFrame |= ImGui::InputScalar("Seed", ImGuiDataType_U32, &m_Renderer.GetSettings().Seed);
+		// depth of field, the scene stays as it is so only the accumulation restarts
+		float aperture = m_Camera.GetApertureRadius(), focus = m_Camera.GetFocusDistance();
+		bool lensChanged = ImGui::DragFloat("Aperture", &aperture, 0.005f, 0.0f, 2.0f);
+		lensChanged |= ImGui::DragFloat("Focus distance", &focus, 0.05f, 0.1f, 100.0f);
+		if (lensChanged) {
+			m_Camera.SetLens(aperture, focus);
+			m_Renderer.ResetFrameIndex();
+		}
 		ImGui::Text("Nb frame: %i", m_Renderer.GetFrameIndex());
 
 		ShouldResetFrame |= ImGui::Button("Reset");
+
+		// Pixel cost heatmap
+		ImGui::Separator();
+		Renderer::Settings& settings = m_Renderer.GetSettings();
+		ShouldResetFrame |= ImGui::Checkbox("Record pixel cost", &settings.RecordPixelCost);
+		ShouldResetFrame |= ImGui::Checkbox("Show pixel cost", &settings.ShowPixelCost);
+		if (ImGui::BeginCombo("Pixel cost", Renderer::GetPixelCostName(settings.PixelCostView))) {
+			for (int i = 0; i < (int)Renderer::PixelCost::Count; ++i) {
+				Renderer::PixelCost cost = (Renderer::PixelCost)i;
+				if (ImGui::Selectable(Renderer::GetPixelCostName(cost), settings.PixelCostView == cost))
+					settings.PixelCostView = cost;
+			}
+			ImGui::EndCombo();
+		}
+		if (settings.ShowPixelCost)
+			ImGui::Text("Scale: 0 (blue) to %.1f (red) per sample", m_Renderer.GetPixelCostScale());
+
+		ImGui::InputText("Cost file name", m_PixelCostFileName, sizeof(m_PixelCostFileName));
+		if (ImGui::Button("Export pixel cost") && (settings.RecordPixelCost || settings.ShowPixelCost)) {
+			try {
+				m_Renderer.ExportPixelCost(m_PixelCostFileName, settings.PixelCostView);
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Error exporting pixel cost: " << e.what() << std::endl;
+			}
+		}
+
+		ImGui::Separator();
+		// the periodic saves and the resume share the file
+		if (ImGui::InputText("Checkpoint file", m_CheckpointFileName, sizeof(m_CheckpointFileName)))
+			settings.CheckpointFile = m_CheckpointFileName;
+		int checkpointInterval = (int)settings.CheckpointInterval;
+		if (ImGui::InputInt("Checkpoint every (frames)", &checkpointInterval))
+			settings.CheckpointInterval = (uint32_t)std::max(checkpointInterval, 0);
+		const CheckpointWriter& checkpointWriter = m_Renderer.GetCheckpointWriter();
+		ImGui::Text("Checkpoints written: %u%s", checkpointWriter.GetWrittenCount(), checkpointWriter.IsBusy() ? " (writing)" : "");
+		if (ImGui::Button("Resume checkpoint"))
+			ResumeCheckpoint();
 		
 		ImGui::End();
 
+		// Stats
+		RenderStatsPanel();
+
 		// camera
 		
 
@@ -128,6 +214,30 @@ public:
 		// Scene
 		ImGui::Begin("Scene");
 
+		// the trees are built again by the Prepare of the frame reset
+		BVHBuildOptions& treeOptions = m_Scene.TreeOptions;
+		if (ImGui::BeginCombo("BVH builder", GetBVHBuilderName(treeOptions.Builder))) {
+			for (int i = 0; i < (int)BVHBuilder::Count; ++i) {
+				BVHBuilder builder = (BVHBuilder)i;
+				if (ImGui::Selectable(GetBVHBuilderName(builder), treeOptions.Builder == builder)) {
+					treeOptions.Builder = builder;
+					ShouldResetFrame = true;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		ShouldResetFrame |= ImGui::Checkbox("Treelet restructuring", &treeOptions.Treelets);
+		// 4 and 8 store the sphere tree with quantized boxes
+		if (ImGui::BeginCombo("Sphere tree width", std::to_string(treeOptions.Width).c_str())) {
+			for (uint32_t width : { 2u, 4u, 8u }) {
+				if (ImGui::Selectable(std::to_string(width).c_str(), treeOptions.Width == width)) {
+					treeOptions.Width = width;
+					ShouldResetFrame = true;
+				}
+			}
+			ImGui::EndCombo();
+		}
+
 		// Create a collapsible header for the spheres category
 		if (ImGui::CollapsingHeader("Spheres")) {
 			for (size_t i = 0; i < m_Scene.Spheres.size(); ++i) {
@@ -137,13 +247,23 @@ public:
 				// Begin a new tree node for each sphere
 				if (ImGui::TreeNode(("Sphere " + std::to_string(i)).c_str())) {
 					Sphere& sphere = m_Scene.Spheres[i];
-					ShouldResetFrame |= ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
-					ShouldResetFrame |= ImGui::DragFloat("Radius", &sphere.Radius, 0.1f, 0.0f, 100.0f);
+					// dragging refits the trees above the sphere instead of preparing the whole scene again
+					bool moved = ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
+					bool doneMoving = ImGui::IsItemDeactivatedAfterEdit();
+					moved |= ImGui::DragFloat("Radius", &sphere.Radius, 0.1f, 0.0f, 100.0f);
+					doneMoving |= ImGui::IsItemDeactivatedAfterEdit();
+					if (moved) {
+						m_TreeRebuilder.SphereChanged(m_Scene, i);
+						m_Renderer.ResetFrameIndex();
+					}
+					if (doneMoving)
+						m_Scene.Hash = m_Scene.ComputeHash();
 					ShouldResetFrame |= ImGui::SliderInt("Material", &sphere.MaterialIndex, 0, (int)m_Scene.Materials.size() - 1);
 
 					// Remove button
 					if (ImGui::Button("Remove")) {
 						m_Scene.Spheres.erase(m_Scene.Spheres.begin() + i);
+						ShouldResetFrame = true;
 						ImGui::PopID(); // Pop the unique identifier
 						break; // Exit loop since we modified the vector
 					}
@@ -157,6 +277,177 @@ public:
 			}
 		}
 
+		// the motion tree is small next to the sphere tree, edits prepare the scene again
+		if (ImGui::CollapsingHeader("Moving spheres")) {
+			for (size_t i = 0; i < m_Scene.MovingSpheres.size(); ++i) {
+				ImGui::PushID(("moving" + std::to_string(i)).c_str());
+				if (ImGui::TreeNode(("Moving sphere " + std::to_string(i)).c_str())) {
+					MovingSphere& sphere = m_Scene.MovingSpheres[i];
+					ShouldResetFrame |= ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
+					ShouldResetFrame |= ImGui::DragFloat3("End position", glm::value_ptr(sphere.EndPosition), 0.1f);
+					ShouldResetFrame |= ImGui::DragFloat("Radius", &sphere.Radius, 0.1f, 0.0f, 100.0f);
+					ShouldResetFrame |= ImGui::SliderInt("Material", &sphere.MaterialIndex, 0, (int)m_Scene.Materials.size() - 1);
+					if (ImGui::Button("Remove")) {
+						m_Scene.MovingSpheres.erase(m_Scene.MovingSpheres.begin() + i);
+						ShouldResetFrame = true;
+						ImGui::TreePop();
+						ImGui::PopID();
+						break;
+					}
+					ImGui::TreePop();
+				}
+				ImGui::PopID();
+			}
+
+			if (ImGui::Button("Add moving sphere")) {
+				m_Scene.MovingSpheres.push_back(MovingSphere{ glm::vec3(0.0f), 0.5f, 0, glm::vec3(1.0f, 0.0f, 0.0f) });
+				ShouldResetFrame = true;
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Instances")) {
+			for (size_t i = 0; i < m_Scene.Instances.size(); ++i) {
+				ImGui::PushID(static_cast<int>(i));
+
+				Instance& instance = m_Scene.Instances[i];
+				if (ImGui::TreeNode((instance.Source + "##instance").c_str())) {
+					ImGui::Text("%zu %s", instance.Shape->GetPrimitiveCount(), instance.Type == Instance::Kind::Mesh ? "triangles" : "spheres");
+					ShouldResetFrame |= ImGui::DragFloat3("Position", glm::value_ptr(instance.Position), 0.1f);
+					ShouldResetFrame |= ImGui::DragFloat3("Rotation", glm::value_ptr(instance.Rotation), 1.0f);
+					ShouldResetFrame |= ImGui::DragFloat("Scale", &instance.Scale, 0.01f, 0.001f, 1000.0f);
+					if (instance.Type == Instance::Kind::Mesh)
+						ShouldResetFrame |= ImGui::SliderInt("Material", &instance.MaterialIndex, 0, (int)m_Scene.Materials.size() - 1);
+
+					// the copy shares the geometry
+					if (ImGui::Button("Duplicate")) {
+						Instance copy = instance;
+						m_Scene.Instances.push_back(std::move(copy));
+						ShouldResetFrame = true;
+						ImGui::TreePop();
+						ImGui::PopID();
+						break;
+					}
+					ImGui::SameLine();
+					if (ImGui::Button("Remove")) {
+						m_Scene.Instances.erase(m_Scene.Instances.begin() + i);
+						ShouldResetFrame = true;
+						ImGui::TreePop();
+						ImGui::PopID();
+						break;
+					}
+
+					ImGui::TreePop();
+				}
+
+				ImGui::PopID();
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Planes, boxes and disks")) {
+			const int lastMaterial = (int)m_Scene.Materials.size() - 1;
+			for (size_t i = 0; i < m_Scene.Planes.size(); ++i) {
+				ImGui::PushID(("plane" + std::to_string(i)).c_str());
+				if (ImGui::TreeNode(("Plane " + std::to_string(i)).c_str())) {
+					Plane& plane = m_Scene.Planes[i];
+					ShouldResetFrame |= ImGui::DragFloat3("Point", glm::value_ptr(plane.Point), 0.1f);
+					ShouldResetFrame |= ImGui::DragFloat3("Normal", glm::value_ptr(plane.Normal), 0.01f);
+					ShouldResetFrame |= ImGui::SliderInt("Material", &plane.MaterialIndex, 0, lastMaterial);
+					if (ImGui::Button("Remove")) {
+						m_Scene.Planes.erase(m_Scene.Planes.begin() + i);
+						ShouldResetFrame = true;
+						ImGui::TreePop();
+						ImGui::PopID();
+						break;
+					}
+					ImGui::TreePop();
+				}
+				ImGui::PopID();
+			}
+			for (size_t i = 0; i < m_Scene.Boxes.size(); ++i) {
+				ImGui::PushID(("box" + std::to_string(i)).c_str());
+				if (ImGui::TreeNode(("Box " + std::to_string(i)).c_str())) {
+					Box& box = m_Scene.Boxes[i];
+					ShouldResetFrame |= ImGui::DragFloat3("Center", glm::value_ptr(box.Center), 0.1f);
+					ShouldResetFrame |= ImGui::DragFloat3("Half size", glm::value_ptr(box.HalfSize), 0.05f, 0.0f, 1000.0f);
+					ShouldResetFrame |= ImGui::DragFloat3("Rotation", glm::value_ptr(box.Rotation), 1.0f);
+					ShouldResetFrame |= ImGui::SliderInt("Material", &box.MaterialIndex, 0, lastMaterial);
+					if (ImGui::Button("Remove")) {
+						m_Scene.Boxes.erase(m_Scene.Boxes.begin() + i);
+						ShouldResetFrame = true;
+						ImGui::TreePop();
+						ImGui::PopID();
+						break;
+					}
+					ImGui::TreePop();
+				}
+				ImGui::PopID();
+			}
+			for (size_t i = 0; i < m_Scene.Disks.size(); ++i) {
+				ImGui::PushID(("disk" + std::to_string(i)).c_str());
+				if (ImGui::TreeNode(("Disk " + std::to_string(i)).c_str())) {
+					Disk& disk = m_Scene.Disks[i];
+					ShouldResetFrame |= ImGui::DragFloat3("Center", glm::value_ptr(disk.Center), 0.1f);
+					ShouldResetFrame |= ImGui::DragFloat3("Normal", glm::value_ptr(disk.Normal), 0.01f);
+					ShouldResetFrame |= ImGui::DragFloat("Radius", &disk.Radius, 0.05f, 0.0f, 1000.0f);
+					ShouldResetFrame |= ImGui::SliderInt("Material", &disk.MaterialIndex, 0, lastMaterial);
+					if (ImGui::Button("Remove")) {
+						m_Scene.Disks.erase(m_Scene.Disks.begin() + i);
+						ShouldResetFrame = true;
+						ImGui::TreePop();
+						ImGui::PopID();
+						break;
+					}
+					ImGui::TreePop();
+				}
+				ImGui::PopID();
+			}
+
+			// added at the origin, to move from there
+			if (ImGui::Button("Add plane")) {
+				m_Scene.Planes.emplace_back();
+				ShouldResetFrame = true;
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Add box")) {
+				m_Scene.Boxes.emplace_back();
+				ShouldResetFrame = true;
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Add disk")) {
+				m_Scene.Disks.emplace_back();
+				ShouldResetFrame = true;
+			}
+		}
+
+		if (ImGui::CollapsingHeader("SDFs")) {
+			for (size_t i = 0; i < m_Scene.Sdfs.size(); ++i) {
+				ImGui::PushID(("sdf" + std::to_string(i)).c_str());
+				if (ImGui::TreeNode(("SDF " + std::to_string(i)).c_str())) {
+					Sdf& sdf = m_Scene.Sdfs[i];
+					ShouldResetFrame |= ImGui::SliderInt("Material", &sdf.MaterialIndex, 0, (int)m_Scene.Materials.size() - 1);
+					ShouldResetFrame |= EditSdfNode(sdf.Root, 0);
+					if (ImGui::Button("Remove")) {
+						m_Scene.Sdfs.erase(m_Scene.Sdfs.begin() + i);
+						ShouldResetFrame = true;
+						ImGui::TreePop();
+						ImGui::PopID();
+						break;
+					}
+					ImGui::TreePop();
+				}
+				ImGui::PopID();
+			}
+
+			// a rounded box to start from, the scene file holds the trees
+			if (ImGui::Button("Add SDF")) {
+				Sdf sdf;
+				sdf.Root.Op = SdfOp::RoundBox;
+				sdf.Root.Params = glm::vec4(0.5f, 0.5f, 0.5f, 0.1f);
+				m_Scene.Sdfs.push_back(sdf);
+				ShouldResetFrame = true;
+			}
+		}
+
 		ImGui::End();
 
 
@@ -180,13 +471,21 @@ public:
 		// Load Scene
 		ImGui::InputText("Load File Name", m_LoadFileName, sizeof(m_LoadFileName));
 		if (ImGui::Button("Load Scene")) {
-			try {
-				m_Scene.loadScene(m_LoadFileName);
-				ShouldResetFrame = true;
-			}
-			catch (const std::exception& e) {
-				std::cerr << "Error loading scene: " << e.what() << std::endl;
-			}
+			m_Loader.LoadSceneAsync(m_LoadFileName, m_Scene.TreeOptions);
+		}
+
+		ImGui::Separator();
+
+		// Import a mesh into the current scene
+		ImGui::InputText("OBJ File Name", m_MeshFileName, sizeof(m_MeshFileName));
+		ImGui::SliderInt("Mesh material", &m_MeshMaterial, 0, (int)m_Scene.Materials.size() - 1);
+		if (ImGui::Button("Import Mesh")) {
+			m_Loader.LoadMeshAsync(m_MeshFileName, m_MeshMaterial);
+		}
+
+		if (m_Loader.IsBusy()) {
+			ImGui::Text("Loading %s", m_Loader.GetCurrentFile().c_str());
+			ImGui::ProgressBar(m_Loader.GetProgress());
 		}
 
 		ImGui::End();
@@ -227,10 +526,12 @@ public:
 
 			// Add a button to load the selected cubemap
 			if (ImGui::Button("Load cube map")  && selectedFileIndex >= 0) {
-				std::string selectedFilename = m_CubeMapNames[selectedFileIndex];
-				const char* filename = selectedFilename.c_str();
-				m_Scene.loadCubemap(filename);
-				ShouldResetFrame = true;
+				m_Loader.LoadCubemapAsync(m_CubeMapNames[selectedFileIndex]);
+			}
+
+			if (m_Loader.IsBusy()) {
+				ImGui::Text("Loading %s", m_Loader.GetCurrentFile().c_str());
+				ImGui::ProgressBar(m_Loader.GetProgress());
 			}
 		}
 		else {
@@ -263,6 +564,7 @@ public:
 				// Remove button
 				if (ImGui::Button("Remove")) {
 					m_Scene.Materials.erase(m_Scene.Materials.begin() + i);
+					ShouldResetFrame = true;
 					break; // Exit loop since we modified the vector
 				}
 			}
@@ -336,8 +638,10 @@ public:
 		ImGui::PopStyleVar();
 		
 
-		if (ShouldResetFrame)
+		if (ShouldResetFrame) {
+			m_Scene.Prepare();
 			m_Renderer.ResetFrameIndex();
+		}
 
 
 		if (m_RealTime)
@@ -354,6 +658,109 @@ public:
 		m_Renderer.Render(m_Scene, m_Camera);
 
 		m_LastRenderTime = timer.ElapsedMillis();
+
+		UpdateStatsHistory();
+	}
+
+	void UpdateStatsHistory()
+	{
+		const Renderer::FrameStats& frame = m_Renderer.GetLastFrameStats();
+		const double cyclesPerMs = Stats::CyclesPerSecond() / 1000.0;
+
+		const auto push = [](std::vector<float>& history, float value) {
+			if (history.size() >= StatsHistorySize)
+				history.erase(history.begin());
+			history.push_back(value);
+		};
+
+		float rays = (float)frame.Counters.Counters[Stats::RaysTraced];
+		push(m_MraysHistory, frame.FrameTime > 0.0f ? rays / (frame.FrameTime * 1000.0f) : 0.0f);
+		for (int i = 0; i < Stats::StageCount; ++i)
+			push(m_StageHistory[i], (float)(frame.Counters.StageCycles[i] / cyclesPerMs));
+	}
+
+	void ResumeCheckpoint()
+	{
+		try {
+			Checkpoint checkpoint = CheckpointIO::Read(m_CheckpointFileName);
+			// the render takes the viewport size every frame, an other size would restart it
+			if (checkpoint.Width != m_ViewportWidth || checkpoint.Height != m_ViewportHeight)
+				throw std::runtime_error("the checkpoint is " + std::to_string(checkpoint.Width) + "x" + std::to_string(checkpoint.Height)
+					+ ", resize the viewport to match");
+			m_Renderer.RestoreCheckpoint(checkpoint, m_Scene, m_Camera);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Error resuming checkpoint: " << e.what() << std::endl;
+		}
+	}
+
+	void RenderStatsPanel()
+	{
+		ImGui::Begin("Stats");
+
+		bool enabled = Stats::Enabled;
+		if (ImGui::Checkbox("Enabled", &enabled))
+			Stats::Enabled = enabled;
+
+		const Renderer::FrameStats& frame = m_Renderer.GetLastFrameStats();
+		const Stats::Totals& counters = frame.Counters;
+
+		ImGui::Text("Frame: %.3fms", frame.FrameTime);
+		ImGui::Text("Mrays/s: %.2f", m_MraysHistory.empty() ? 0.0f : m_MraysHistory.back());
+		if (!m_MraysHistory.empty())
+			ImGui::PlotLines("##Mrays", m_MraysHistory.data(), (int)m_MraysHistory.size(), 0, "Mrays/s", 0.0f, FLT_MAX, ImVec2(0, 60));
+
+		if (ImGui::CollapsingHeader("Counters (last frame)", ImGuiTreeNodeFlags_DefaultOpen)) {
+			for (int i = 0; i < Stats::CounterCount; ++i)
+				ImGui::Text("%s: %llu", Stats::GetCounterName((Stats::Counter)i), (unsigned long long)counters.Counters[i]);
+
+			uint64_t rays = counters.Counters[Stats::RaysTraced];
+			if (rays > 0)
+				ImGui::Text("Intersection tests per ray: %.1f", (double)counters.Counters[Stats::IntersectionTests] / rays);
+		}
+
+		if (ImGui::CollapsingHeader("Stages (thread time)", ImGuiTreeNodeFlags_DefaultOpen)) {
+			for (int i = 0; i < Stats::StageCount; ++i) {
+				const std::vector<float>& history = m_StageHistory[i];
+				if (history.empty())
+					continue;
+
+				ImGui::Text("%s: %.3fms", Stats::GetStageName((Stats::Stage)i), history.back());
+				ImGui::PushID(i);
+				ImGui::PlotLines("##Stage", history.data(), (int)history.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+				ImGui::PopID();
+			}
+		}
+
+		if (ImGui::CollapsingHeader("Path length", ImGuiTreeNodeFlags_DefaultOpen)) {
+			float depth[Stats::MaxDepth];
+			for (int i = 0; i < Stats::MaxDepth; ++i)
+				depth[i] = (float)counters.Depth[i];
+			ImGui::PlotHistogram("##Depth", depth, Stats::MaxDepth, 0, "bounces before termination", 0.0f, FLT_MAX, ImVec2(0, 80));
+		}
+
+		if (ImGui::CollapsingHeader("Timeline trace")) {
+			static const char* levelNames[] = { "Off", "Passes", "Tiles", "Stages" };
+			int level = Trace::CurrentLevel;
+			if (ImGui::Combo("Level", &level, levelNames, IM_ARRAYSIZE(levelNames)))
+				Trace::CurrentLevel = level;
+			ImGui::Text("Events recorded: %llu", (unsigned long long)Trace::GetEventCount());
+
+			ImGui::InputText("Trace file name", m_TraceFileName, sizeof(m_TraceFileName));
+			if (ImGui::Button("Dump trace")) {
+				try {
+					Trace::Dump(m_TraceFileName);
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Error writing trace: " << e.what() << std::endl;
+				}
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Clear trace"))
+				Trace::Clear();
+		}
+
+		ImGui::End();
 	}
 
 private:
@@ -362,15 +769,28 @@ private:
 	Material PreviewMaterial;
 	Camera m_Camera;
 	Renderer m_Renderer;
+	SceneLoader m_Loader;
+	SphereTreeRebuilder m_TreeRebuilder;
 	uint32_t m_ViewportWidth = 0, m_ViewportHeight = 0;
 	float m_LastRenderTime = 0.0f;
 	bool m_RealTime = true;
 	char m_BaseInput[101] = "100 char name";
 	char m_SaveFileName[256] = "scene.json"; // Default file name for saving
 	char m_LoadFileName[256] = "scene.json"; // Default file name for loading
+	char m_MeshFileName[256] = "model.obj";
+	int m_MeshMaterial = 0;
 
 	bool m_CubeMapFolderExist;
 	std::vector<std::string> m_CubeMapNames;
+
+	char m_PixelCostFileName[128] = "pixel_cost.pfm";
+	char m_TraceFileName[128] = "trace.json";
+	char m_CheckpointFileName[128] = "render.rtcheckpoint";
+
+	// one entry per rendered frame
+	static const size_t StatsHistorySize = 120;
+	std::vector<float> m_MraysHistory;
+	std::vector<float> m_StageHistory[Stats::StageCount];
 };
 
 Walnut::Application* Walnut::CreateApplication(int argc, char** argv)
@@ -0,0 +1,240 @@
+#include "WideBVH.h"
+
+#include <cmath>
+
+namespace {
+
+	// exponents of the normal floats, GetScale makes 2^e from the exponent bits
+	const int MinExponent = -126;
+	const int MaxExponent = 127;
+	// an inner child smaller than this part of the node is not pulled up into it, its children
+	// would be rounded on too coarse a grid. It stays a node of its own, with a finer grid
+	const float MinPulledExtent = 1.0f / 32.0f;
+
+	float MaxExtent(const BVH::Node& node)
+	{
+		glm::vec3 d = node.BoundsMax - node.BoundsMin;
+		return std::max(d.x, std::max(d.y, d.z));
+	}
+
+	double Area(const BVH::Bounds& box)
+	{
+		glm::dvec3 d = glm::max(glm::dvec3(box.Max) - glm::dvec3(box.Min), glm::dvec3(0.0));
+		return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// smallest q of the grid planes at or below value, largest at or above
+	template<typename Dequantize>
+	uint8_t RoundDown(float value, float origin, float scale, Dequantize&& dequantize)
+	{
+		int q = (int)std::floor((value - origin) / scale);
+		q = std::min(std::max(q, 0), 255);
+		// the division rounds, the planes are checked as the traversal places them
+		while (q > 0 && dequantize(origin, (uint8_t)q, scale) > value)
+			--q;
+		return (uint8_t)q;
+	}
+
+	template<typename Dequantize>
+	uint8_t RoundUp(float value, float origin, float scale, Dequantize&& dequantize)
+	{
+		int q = (int)std::ceil((value - origin) / scale);
+		q = std::min(std::max(q, 0), 255);
+		while (q < 255 && dequantize(origin, (uint8_t)q, scale) < value)
+			++q;
+		return (uint8_t)q;
+	}
+
+}
+
+template<uint32_t Width>
+void WideBVH<Width>::Build(const BVH& binary)
+{
+	m_Nodes.clear();
+	m_Parents.clear();
+	m_LeafOfSlot.clear();
+	m_CostSum = 0.0;
+	m_BuildCost = 0.0f;
+	if (binary.Empty())
+		return;
+
+	// each node takes the place of Width - 1 binary inner nodes at best
+	m_Nodes.reserve(binary.GetNodes().size() / (2 * (Width - 1)) + 1);
+	Emit(binary.GetNodes(), 0);
+	m_Nodes.shrink_to_fit();
+
+	for (const Node& node : m_Nodes)
+		for (uint32_t i = 0; i < node.ChildCount; ++i)
+			m_CostSum += ChildCost(node, i);
+	m_BuildCost = GetCost();
+}
+
+template<uint32_t Width>
+uint32_t WideBVH<Width>::Emit(const std::vector<BVH::Node>& binary, uint32_t binaryIndex)
+{
+	// the children of the binary node, the largest inner one pulled up until there are Width
+	uint32_t children[Width];
+	uint32_t childCount = 0;
+	if (binary[binaryIndex].Count > 0) {
+		// only a root can be a leaf
+		children[childCount++] = binaryIndex;
+	}
+	else {
+		children[childCount++] = binaryIndex + 1;
+		children[childCount++] = binary[binaryIndex].Offset;
+	}
+	const float minExtent = MaxExtent(binary[binaryIndex]) * MinPulledExtent;
+	while (childCount < Width) {
+		int largest = -1;
+		double largestArea = -1.0;
+		for (uint32_t i = 0; i < childCount; ++i) {
+			const BVH::Node& child = binary[children[i]];
+			double area = Area(BVH::Bounds{ child.BoundsMin, child.BoundsMax });
+			if (child.Count == 0 && MaxExtent(child) >= minExtent && area > largestArea) {
+				largest = (int)i;
+				largestArea = area;
+			}
+		}
+		if (largest < 0)
+			break;
+		const uint32_t opened = children[largest];
+		children[largest] = opened + 1;
+		children[childCount++] = binary[opened].Offset;
+	}
+
+	Node node{};
+	node.ChildCount = (uint8_t)childCount;
+	BVH::Bounds all;
+	for (uint32_t i = 0; i < childCount; ++i)
+		all.Grow(BVH::Bounds{ binary[children[i]].BoundsMin, binary[children[i]].BoundsMax });
+	SetGrid(node, all);
+	for (uint32_t i = 0; i < childCount; ++i) {
+		const BVH::Node& child = binary[children[i]];
+		SetChildBounds(node, i, BVH::Bounds{ child.BoundsMin, child.BoundsMax });
+		node.Count[i] = (uint8_t)child.Count;
+		node.Index[i] = child.Offset;
+	}
+
+	const uint32_t index = (uint32_t)m_Nodes.size();
+	m_Nodes.push_back(node);
+	for (uint32_t i = 0; i < childCount; ++i) {
+		if (binary[children[i]].Count == 0) {
+			uint32_t child = Emit(binary, children[i]);
+			m_Nodes[index].Index[i] = child;
+		}
+	}
+	return index;
+}
+
+template<uint32_t Width>
+BVH::Bounds WideBVH<Width>::GetBounds() const
+{
+	BVH::Bounds bounds;
+	if (!m_Nodes.empty())
+		for (uint32_t i = 0; i < m_Nodes[0].ChildCount; ++i)
+			bounds.Grow(GetChildBounds(m_Nodes[0], i));
+	return bounds;
+}
+
+template<uint32_t Width>
+size_t WideBVH<Width>::GetMemoryUsage() const
+{
+	return m_Nodes.capacity() * sizeof(Node) + (m_Parents.capacity() + m_LeafOfSlot.capacity()) * sizeof(uint32_t);
+}
+
+template<uint32_t Width>
+float WideBVH<Width>::GetCost() const
+{
+	// the root box is never tested, its children always are
+	double rootArea = m_Nodes.empty() ? 0.0 : Area(GetBounds());
+	return rootArea > 0.0 ? (float)((m_CostSum + rootArea * m_Nodes[0].ChildCount) / rootArea) : 0.0f;
+}
+
+template<uint32_t Width>
+double WideBVH<Width>::ChildCost(const Node& node, uint32_t lane) const
+{
+	// a leaf costs a test per primitive, an inner node one per child box
+	double tests = node.Count[lane] > 0 ? (double)node.Count[lane] : (double)m_Nodes[node.Index[lane]].ChildCount;
+	return Area(GetChildBounds(node, lane)) * tests;
+}
+
+template<uint32_t Width>
+void WideBVH<Width>::PrepareRefit()
+{
+	uint32_t primitiveCount = 0;
+	for (const Node& node : m_Nodes)
+		for (uint32_t i = 0; i < node.ChildCount; ++i)
+			if (node.Count[i] > 0)
+				primitiveCount = std::max(primitiveCount, node.Index[i] + node.Count[i]);
+
+	m_Parents.assign(m_Nodes.size(), 0);
+	m_LeafOfSlot.assign(primitiveCount, 0);
+	for (uint32_t n = 0; n < (uint32_t)m_Nodes.size(); ++n) {
+		const Node& node = m_Nodes[n];
+		for (uint32_t i = 0; i < node.ChildCount; ++i) {
+			if (node.Count[i] > 0) {
+				for (uint32_t slot = node.Index[i]; slot < node.Index[i] + node.Count[i]; ++slot)
+					m_LeafOfSlot[slot] = n * Width + i;
+			}
+			else {
+				m_Parents[node.Index[i]] = n * Width + i;
+			}
+		}
+	}
+}
+
+template<uint32_t Width>
+bool WideBVH<Width>::InsideGrid(const Node& node, const BVH::Bounds& box)
+{
+	const glm::vec3 scale = GetScale(node);
+	for (int axis = 0; axis < 3; ++axis)
+		if (box.Min[axis] < node.Origin[axis] || box.Max[axis] > Dequantize(node.Origin[axis], 255, scale[axis]))
+			return false;
+	return true;
+}
+
+template<uint32_t Width>
+void WideBVH<Width>::SetGrid(Node& node, const BVH::Bounds& box)
+{
+	node.Origin = box.Min;
+	for (int axis = 0; axis < 3; ++axis) {
+		// 255 steps of 2^e cover the extent
+		float extent = box.Max[axis] - box.Min[axis];
+		int exponent = MinExponent;
+		if (extent > 0.0f) {
+			std::frexp(extent / 255.0f, &exponent);
+			exponent = std::min(std::max(exponent, MinExponent), MaxExponent);
+		}
+		node.Exponent[axis] = (int8_t)exponent;
+		while (node.Exponent[axis] < MaxExponent && Dequantize(node.Origin[axis], 255, GetScale(node)[axis]) < box.Max[axis])
+			++node.Exponent[axis];
+	}
+}
+
+template<uint32_t Width>
+void WideBVH<Width>::SetChildBounds(Node& node, uint32_t lane, const BVH::Bounds& box)
+{
+	const glm::vec3 scale = GetScale(node);
+	node.LoX[lane] = RoundDown(box.Min.x, node.Origin.x, scale.x, Dequantize);
+	node.LoY[lane] = RoundDown(box.Min.y, node.Origin.y, scale.y, Dequantize);
+	node.LoZ[lane] = RoundDown(box.Min.z, node.Origin.z, scale.z, Dequantize);
+	node.HiX[lane] = RoundUp(box.Max.x, node.Origin.x, scale.x, Dequantize);
+	node.HiY[lane] = RoundUp(box.Max.y, node.Origin.y, scale.y, Dequantize);
+	node.HiZ[lane] = RoundUp(box.Max.z, node.Origin.z, scale.z, Dequantize);
+}
+
+template<uint32_t Width>
+bool WideBVH<Width>::SameBounds(const Node& a, const Node& b)
+{
+	if (a.Origin != b.Origin || memcmp(a.Exponent, b.Exponent, sizeof(a.Exponent)) != 0)
+		return false;
+	for (uint32_t i = 0; i < a.ChildCount; ++i) {
+		if (a.LoX[i] != b.LoX[i] || a.LoY[i] != b.LoY[i] || a.LoZ[i] != b.LoZ[i] ||
+			a.HiX[i] != b.HiX[i] || a.HiY[i] != b.HiY[i] || a.HiZ[i] != b.HiZ[i])
+			return false;
+	}
+	return true;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
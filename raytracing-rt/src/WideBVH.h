@@ -0,0 +1,255 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "BVH.h"
+#include "Ray.h"
+
+// x64 always has SSE2, the other targets test the children one at a time
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RT_WIDE_BVH_SSE
+#endif
+
+// BVH of Width children per node, made from a binary BVH by pulling the largest inner nodes
+// up into their parents. A node keeps a grid around its box and its children's boxes on 8 bits
+// per plane of that grid, rounded outward : 4 children fit a cache line, 8 fit two.
+// The traversal tests the children of a node four at a time with SSE and goes down the ones
+// hit nearest first. Leaves and primitive order are the binary tree's.
+// A refit that moves a box out of the grid of its parent makes a new grid, the siblings are
+// rounded again onto it and can only grow.
+template<uint32_t Width>
+class WideBVH
+{
+public:
+	struct alignas(64) Node
+	{
+		// the grid planes are Origin + q * 2^Exponent, q from 0 to 255
+		glm::vec3 Origin;
+		int8_t Exponent[3];
+		uint8_t ChildCount;
+		// node of an inner child, first primitive of a leaf child
+		uint32_t Index[Width];
+		// primitives of a leaf child, 0 for an inner one
+		uint8_t Count[Width];
+		uint8_t LoX[Width], LoY[Width], LoZ[Width];
+		uint8_t HiX[Width], HiY[Width], HiZ[Width];
+	};
+
+	WideBVH() = default;
+
+	// same leaves, so the same primitive order, as binary
+	void Build(const BVH& binary);
+
+	bool Empty() const { return m_Nodes.empty(); }
+	const std::vector<Node>& GetNodes() const { return m_Nodes; }
+	BVH::Bounds GetBounds() const;
+	size_t GetMemoryUsage() const;
+
+	// box and primitive tests a ray through the root box can expect, as BVH::GetCost
+	float GetCost() const;
+	float GetBuildCost() const { return m_BuildCost; }
+
+	// as BVH::Refit
+	template<typename BoundsOf>
+	void Refit(uint32_t slot, BoundsOf&& boundsOf);
+	void PrepareRefit();
+
+	// as BVH::Traverse, steps counts the child boxes tested
+	template<typename IntersectLeaf>
+	void Traverse(const Ray& ray, float tMin, float& tMax, IntersectLeaf&& intersectLeaf, uint32_t& steps) const;
+
+	// box of a child as the traversal sees it
+	static BVH::Bounds GetChildBounds(const Node& node, uint32_t lane);
+
+private:
+	// entry distance of the ray in every child box, infinity for the ones it misses in
+	// [tMin, tMax] and the empty lanes. The planes are at base + q * step along the ray
+	static void IntersectChildren(const Node& node, const glm::vec3& base, const glm::vec3& step, float tMin, float tMax, float* enter);
+	static glm::vec3 GetScale(const Node& node);
+	// where the rounding and the refits place the planes
+	static float Dequantize(float origin, uint8_t q, float scale) { return origin + (float)q * scale; }
+	static bool InsideGrid(const Node& node, const BVH::Bounds& box);
+	// grid of node around box
+	static void SetGrid(Node& node, const BVH::Bounds& box);
+	// smallest box of the grid around box, which has to be inside the grid
+	static void SetChildBounds(Node& node, uint32_t lane, const BVH::Bounds& box);
+	static bool SameBounds(const Node& a, const Node& b);
+	// the area of the child times the tests it leads to
+	double ChildCost(const Node& node, uint32_t lane) const;
+	uint32_t Emit(const std::vector<BVH::Node>& binary, uint32_t binaryIndex);
+
+private:
+	std::vector<Node> m_Nodes;
+
+	double m_CostSum = 0.0;
+	float m_BuildCost = 0.0f;
+	// child entry (node * Width + lane) of each node in its parent and of the leaf of each slot
+	std::vector<uint32_t> m_Parents;
+	std::vector<uint32_t> m_LeafOfSlot;
+};
+
+template<uint32_t Width>
+inline glm::vec3 WideBVH<Width>::GetScale(const Node& node)
+{
+	// the exponents stay in the range of the normal floats, 2^e is only the exponent bits
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; ++axis) {
+		uint32_t bits = (uint32_t)(node.Exponent[axis] + 127) << 23;
+		memcpy(&scale[axis], &bits, sizeof(float));
+	}
+	return scale;
+}
+
+template<uint32_t Width>
+inline BVH::Bounds WideBVH<Width>::GetChildBounds(const Node& node, uint32_t lane)
+{
+	const glm::vec3 scale = GetScale(node);
+	BVH::Bounds box;
+	box.Min = glm::vec3(Dequantize(node.Origin.x, node.LoX[lane], scale.x), Dequantize(node.Origin.y, node.LoY[lane], scale.y), Dequantize(node.Origin.z, node.LoZ[lane], scale.z));
+	box.Max = glm::vec3(Dequantize(node.Origin.x, node.HiX[lane], scale.x), Dequantize(node.Origin.y, node.HiY[lane], scale.y), Dequantize(node.Origin.z, node.HiZ[lane], scale.z));
+	return box;
+}
+
+template<uint32_t Width>
+inline void WideBVH<Width>::IntersectChildren(const Node& node, const glm::vec3& base, const glm::vec3& step, float tMin, float tMax, float* enter)
+{
+#ifdef RT_WIDE_BVH_SSE
+	const __m128i zero = _mm_setzero_si128();
+	const auto planes = [&](const uint8_t* q, float first, float spacing) {
+		int32_t packed;
+		memcpy(&packed, q, sizeof(packed));
+		__m128i lanes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+		return _mm_add_ps(_mm_set1_ps(first), _mm_mul_ps(_mm_cvtepi32_ps(lanes), _mm_set1_ps(spacing)));
+	};
+	for (uint32_t i = 0; i < Width; i += 4) {
+		__m128 tx0 = planes(node.LoX + i, base.x, step.x), tx1 = planes(node.HiX + i, base.x, step.x);
+		__m128 ty0 = planes(node.LoY + i, base.y, step.y), ty1 = planes(node.HiY + i, base.y, step.y);
+		__m128 tz0 = planes(node.LoZ + i, base.z, step.z), tz1 = planes(node.HiZ + i, base.z, step.z);
+		__m128 tEnter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_set1_ps(tMin)));
+		__m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(tMax)));
+		__m128 hit = _mm_cmple_ps(tEnter, tExit);
+		_mm_storeu_ps(enter + i, _mm_or_ps(_mm_and_ps(hit, tEnter), _mm_andnot_ps(hit, _mm_set1_ps(std::numeric_limits<float>::infinity()))));
+	}
+#else
+	for (uint32_t i = 0; i < Width; ++i) {
+		float tx0 = base.x + (float)node.LoX[i] * step.x, tx1 = base.x + (float)node.HiX[i] * step.x;
+		float ty0 = base.y + (float)node.LoY[i] * step.y, ty1 = base.y + (float)node.HiY[i] * step.y;
+		float tz0 = base.z + (float)node.LoZ[i] * step.z, tz1 = base.z + (float)node.HiZ[i] * step.z;
+		float tEnter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), tMin));
+		float tExit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), tMax));
+		enter[i] = tEnter <= tExit ? tEnter : std::numeric_limits<float>::infinity();
+	}
+#endif
+	for (uint32_t i = node.ChildCount; i < Width; ++i)
+		enter[i] = std::numeric_limits<float>::infinity();
+}
+
+template<uint32_t Width>
+template<typename BoundsOf>
+void WideBVH<Width>::Refit(uint32_t slot, BoundsOf&& boundsOf)
+{
+	if (m_LeafOfSlot.empty())
+		PrepareRefit();
+
+	uint32_t entry = m_LeafOfSlot[slot];
+	BVH::Bounds box;
+	{
+		const Node& node = m_Nodes[entry / Width];
+		const uint32_t lane = entry % Width;
+		for (uint32_t i = node.Index[lane]; i < node.Index[lane] + node.Count[lane]; ++i)
+			box.Grow(boundsOf(i));
+	}
+
+	// a box that stays on the same grid planes ends the refit, small moves mostly stop at the leaf
+	for (;;) {
+		const uint32_t nodeIndex = entry / Width, lane = entry % Width;
+		Node& node = m_Nodes[nodeIndex];
+		const Node before = node;
+		if (InsideGrid(node, box)) {
+			SetChildBounds(node, lane, box);
+		}
+		else {
+			BVH::Bounds children[Width], all;
+			for (uint32_t i = 0; i < node.ChildCount; ++i) {
+				children[i] = i == lane ? box : GetChildBounds(node, i);
+				all.Grow(children[i]);
+			}
+			SetGrid(node, all);
+			for (uint32_t i = 0; i < node.ChildCount; ++i)
+				SetChildBounds(node, i, children[i]);
+		}
+		if (SameBounds(before, node))
+			return;
+
+		for (uint32_t i = 0; i < node.ChildCount; ++i)
+			m_CostSum += ChildCost(node, i) - ChildCost(before, i);
+		if (nodeIndex == 0)
+			return;
+
+		box = BVH::Bounds();
+		for (uint32_t i = 0; i < node.ChildCount; ++i)
+			box.Grow(GetChildBounds(node, i));
+		entry = m_Parents[nodeIndex];
+	}
+}
+
+template<uint32_t Width>
+template<typename IntersectLeaf>
+void WideBVH<Width>::Traverse(const Ray& ray, float tMin, float& tMax, IntersectLeaf&& intersectLeaf, uint32_t& steps) const
+{
+	if (m_Nodes.empty())
+		return;
+
+	// kept finite, a plane at q = 0 would otherwise be 0 * infinity away on axis aligned rays
+	glm::vec3 invDirection;
+	for (int axis = 0; axis < 3; ++axis) {
+		float d = ray.Direction[axis];
+		invDirection[axis] = 1.0f / (std::abs(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f));
+	}
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	// children of the nodes on the way down, leaves included. The binary tree keeps under
+	// MaxDepth levels, this one has fewer
+	struct Pending
+	{
+		uint32_t Index;
+		uint32_t Count;
+		float Distance;
+	} stack[BVH::MaxDepth * Width];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, 0, tMin };
+	while (stackSize > 0) {
+		const Pending pending = stack[--stackSize];
+		// skip what a closer hit made out of reach
+		if (pending.Distance > tMax)
+			continue;
+		if (pending.Count > 0) {
+			intersectLeaf(pending.Index, pending.Count);
+			continue;
+		}
+
+		const Node& node = m_Nodes[pending.Index];
+		float enter[Width];
+		IntersectChildren(node, (node.Origin - ray.Origin) * invDirection, GetScale(node) * invDirection, tMin, tMax, enter);
+		steps += node.ChildCount;
+
+		// pushed farthest first, the nearest child is taken next
+		const uint32_t first = stackSize;
+		for (uint32_t i = 0; i < node.ChildCount; ++i) {
+			if (enter[i] == infinity)
+				continue;
+			const Pending hit = { node.Index[i], node.Count[i], enter[i] };
+			uint32_t j = stackSize++;
+			for (; j > first && stack[j - 1].Distance < hit.Distance; --j)
+				stack[j] = stack[j - 1];
+			stack[j] = hit;
+		}
+	}
+}